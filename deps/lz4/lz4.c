@@ -0,0 +1,448 @@
+/* Compressor and decompressor for the LZ4 block format.
+ *
+ * A block is a sequence of sequences. Every sequence is composed of:
+ *
+ * token | [literal length bytes] | literals | offset | [match length bytes]
+ *
+ * The high 4 bits of the token are the number of literals, the low 4 bits
+ * the length of the match minus 4 (the minimum match length). A value of
+ * 15 means that more length bytes follow, each adding up to 255, the
+ * first byte smaller than 255 terminating the length. The offset is a 16 bit
+ * little endian distance back into the already decompressed data. The last
+ * sequence is only composed of the token and the literals.
+ *
+ * The format also requires the last 5 bytes of a block to be literals, and
+ * the last match to start at least 12 bytes before the end of the block.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2026, agent <agent at local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5      /* Bytes at the end that are always literals */
+#define LZ4_MFLIMIT 12          /* No match can start in the last 12 bytes */
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_LOG_MIN 8      /* Hash table size for small inputs... */
+#define LZ4_HASH_LOG_MAX 14     /* ...growing up to 16k entries. */
+#define LZ4_SKIP_TRIGGER 6      /* Go faster on incompressible data */
+
+static inline uint32_t lz4Read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4Hash(uint32_t seq, unsigned int hashlog) {
+    return (seq * 2654435761U) >> (32-hashlog);
+}
+
+/* Emit a length of 15 or more as additional length bytes. */
+static inline unsigned char *lz4WriteLength(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+/* Emit a sequence: the literals from 'anchor' to 'anchor+litlen', followed,
+ * if 'mlen' is not zero, by a match of 'mlen' bytes at 'offset'. Returns
+ * the new output pointer, or NULL if the sequence does not fit. */
+static unsigned char *lz4WriteSequence(unsigned char *op, unsigned char *oend,
+    const unsigned char *anchor, size_t litlen, size_t offset, size_t mlen)
+{
+    unsigned char *token;
+    size_t need;
+
+    /* Worst case: token, literals, their length bytes, and unless this is
+     * the last sequence, offset and match length bytes. */
+    need = 1 + litlen + litlen/255 + 1;
+    if (mlen) need += 2 + mlen/255 + 1;
+    if (op >= oend || (size_t)(oend-op) < need) return NULL;
+    token = op++;
+
+    if (litlen >= 15) {
+        *token = 15<<4;
+        op = lz4WriteLength(op,litlen-15);
+    } else {
+        *token = litlen<<4;
+    }
+    memcpy(op,anchor,litlen);
+    op += litlen;
+    if (mlen == 0) return op; /* Last sequence. */
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    mlen -= LZ4_MINMATCH;
+    if (mlen >= 15) {
+        *token |= 15;
+        op = lz4WriteLength(op,mlen-15);
+    } else {
+        *token |= mlen;
+    }
+    return op;
+}
+
+unsigned int lz4_compress(const void *in_data, unsigned int in_len,
+                          void *out_data, unsigned int out_len)
+{
+    uint32_t table[1<<LZ4_HASH_LOG_MAX];
+    unsigned int hashlog = LZ4_HASH_LOG_MIN;
+    const unsigned char *in = in_data;
+    const unsigned char *ip = in, *anchor = in;
+    const unsigned char *iend = in + in_len;
+    const unsigned char *mflimit = iend - LZ4_MFLIMIT;
+    const unsigned char *matchlimit = iend - LZ4_LASTLITERALS;
+    unsigned char *op = out_data, *oend = op + out_len;
+    unsigned int searches = 1 << LZ4_SKIP_TRIGGER;
+
+    if (out_len == 0) return 0;
+    if (in_len < LZ4_MFLIMIT+1) goto last_literals;
+
+    /* Size the hash table after the input, so that compressing small
+     * strings does not require clearing a big table. */
+    while (hashlog < LZ4_HASH_LOG_MAX && (1U<<hashlog) < in_len) hashlog++;
+    memset(table,0,sizeof(uint32_t)<<hashlog);
+    ip++;
+    while (ip < mflimit) {
+        uint32_t seq = lz4Read32(ip);
+        uint32_t h = lz4Hash(seq,hashlog);
+        const unsigned char *ref = in + table[h];
+        const unsigned char *p, *r;
+
+        table[h] = ip - in;
+        if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4Read32(ref) != seq) {
+            /* No match: advance faster and faster while we fail. */
+            ip += searches++ >> LZ4_SKIP_TRIGGER;
+            continue;
+        }
+        searches = 1 << LZ4_SKIP_TRIGGER;
+
+        /* Extend the match backward over the pending literals... */
+        while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+        /* ...and forward, without entering the last literals. */
+        p = ip + LZ4_MINMATCH;
+        r = ref + LZ4_MINMATCH;
+        while (p < matchlimit && *p == *r) {
+            p++;
+            r++;
+        }
+
+        op = lz4WriteSequence(op,oend,anchor,ip-anchor,ip-ref,p-ip);
+        if (op == NULL) return 0;
+        ip = anchor = p;
+
+        /* Index a position inside the match for a better ratio. */
+        if (ip < mflimit) table[lz4Hash(lz4Read32(ip-2),hashlog)] = ip-2-in;
+    }
+
+last_literals:
+    op = lz4WriteSequence(op,oend,anchor,iend-anchor,0,0);
+    if (op == NULL) return 0;
+    return op - (unsigned char*)out_data;
+}
+
+/* Read a length of 15 or more from its additional length bytes. Returns 0
+ * on truncated input. */
+static inline int lz4ReadLength(const unsigned char **ip,
+                                const unsigned char *iend, size_t *len)
+{
+    unsigned char s;
+
+    do {
+        if (*ip >= iend) return 0;
+        s = *(*ip)++;
+        *len += s;
+    } while (s == 255);
+    return 1;
+}
+
+unsigned int lz4_decompress(const void *in_data, unsigned int in_len,
+                            void *out_data, unsigned int out_len)
+{
+    const unsigned char *ip = in_data, *iend = ip + in_len;
+    unsigned char *out = out_data, *op = out, *oend = out + out_len;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+        size_t litlen = token >> 4, mlen = token & 15, offset;
+        const unsigned char *ref;
+
+        if (litlen == 15 && !lz4ReadLength(&ip,iend,&litlen)) return 0;
+        if (litlen > (size_t)(iend-ip) || litlen > (size_t)(oend-op))
+            return 0;
+        memcpy(op,ip,litlen);
+        op += litlen;
+        ip += litlen;
+        if (ip == iend) break; /* The last sequence has no match. */
+
+        if (iend-ip < 2) return 0;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op-out)) return 0;
+        if (mlen == 15 && !lz4ReadLength(&ip,iend,&mlen)) return 0;
+        mlen += LZ4_MINMATCH;
+        if (mlen > (size_t)(oend-op)) return 0;
+
+        /* The match may overlap the bytes it is producing, in which case
+         * it must be copied one byte at a time. */
+        ref = op - offset;
+        if (offset >= mlen) {
+            memcpy(op,ref,mlen);
+            op += mlen;
+        } else {
+            while (mlen--) *op++ = *ref++;
+        }
+    }
+    return op - out;
+}
+
+#ifdef LZ4_TEST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LZ4_TEST_GUARD 64
+
+static int lz4_tests, lz4_failed;
+
+static void lz4TestCond(const char *descr, int cond) {
+    lz4_tests++;
+    if (!cond) {
+        lz4_failed++;
+        printf("%d - %s: FAILED\n", lz4_tests, descr);
+    }
+}
+
+/* Allocate 'len' bytes followed by a guard area, to detect writes past the
+ * end of the output buffers. */
+static unsigned char *lz4TestAlloc(size_t len) {
+    unsigned char *p = malloc(len+LZ4_TEST_GUARD);
+    memset(p+len,0xAA,LZ4_TEST_GUARD);
+    return p;
+}
+
+static int lz4TestGuardOk(const unsigned char *p, size_t len) {
+    size_t j;
+
+    for (j = 0; j < LZ4_TEST_GUARD; j++)
+        if (p[len+j] != 0xAA) return 0;
+    return 1;
+}
+
+/* Fill 'p' with data of the kind selected by 'kind'. */
+static void lz4TestFill(unsigned char *p, size_t len, int kind) {
+    size_t j;
+
+    for (j = 0; j < len; j++) {
+        switch(kind) {
+        case 0: p[j] = rand(); break;                   /* Incompressible */
+        case 1: p[j] = 'A'; break;                      /* One long run */
+        case 2: p[j] = "abcdefgh"[rand()%8]; break;     /* Small alphabet */
+        case 3: p[j] = (j/300)%2 ? rand() : 'x'; break; /* Runs >= 270 */
+        default: p[j] = (j%4096 < 2048) ? (int)(j%251) : rand(); break;
+        }
+    }
+}
+
+/* Compress and decompress 'len' bytes of data of kind 'kind', checking the
+ * bounds of the output buffers along the way. Returns 1 on success. */
+static int lz4TestRoundtrip(size_t len, int kind) {
+    unsigned char *in = malloc(len+1), *comp, *dec;
+    size_t bound = len + len/255 + 16, j;
+    unsigned int clen, dlen, tiny;
+    int ok = 1;
+
+    lz4TestFill(in,len,kind);
+    comp = lz4TestAlloc(bound);
+    dec = lz4TestAlloc(len);
+    clen = lz4_compress(in,len,comp,bound);
+    if (clen == 0 || !lz4TestGuardOk(comp,bound)) ok = 0;
+    if (ok) {
+        dlen = lz4_decompress(comp,clen,dec,len);
+        if (dlen != len || memcmp(in,dec,len) || !lz4TestGuardOk(dec,len))
+            ok = 0;
+    }
+    /* Output buffers that are too small must be detected, and never
+     * written past their end: try every size for small inputs. */
+    for (j = 0; ok && j < clen && (len <= 4096 || j < 32); j++) {
+        tiny = len <= 4096 ? j : rand() % clen;
+        memset(comp+tiny,0xAA,LZ4_TEST_GUARD);
+        if (lz4_compress(in,len,comp,tiny) != 0 ||
+            !lz4TestGuardOk(comp,tiny)) ok = 0;
+    }
+    if (ok && len) {
+        clen = lz4_compress(in,len,comp,bound);
+        for (j = 0; ok && j < len && (len <= 4096 || j < 32); j++) {
+            tiny = len <= 4096 ? j : rand() % len;
+            memset(dec+tiny,0xAA,LZ4_TEST_GUARD);
+            if (lz4_decompress(comp,clen,dec,tiny) != 0 ||
+                !lz4TestGuardOk(dec,tiny)) ok = 0;
+        }
+    }
+    free(in);
+    free(comp);
+    free(dec);
+    return ok;
+}
+
+/* Decompress the 'len' bytes at 'block' into a buffer of 'out_len' bytes.
+ * Returns the decompressed length, or -1 if the buffer was overrun. */
+static long lz4TestDecompress(const void *block, size_t len, size_t out_len) {
+    unsigned char *in = malloc(len ? len : 1), *out = lz4TestAlloc(out_len);
+    unsigned int ret;
+
+    /* Copy the block to a buffer of its exact size, so that memory checkers
+     * can catch reads past the end of the input. */
+    memcpy(in,block,len);
+    ret = lz4_decompress(in,len,out,out_len);
+    if (!lz4TestGuardOk(out,out_len)) ret = -1;
+    free(in);
+    free(out);
+    return ret == (unsigned int)-1 ? -1 : (long)ret;
+}
+
+int main(void) {
+    size_t sizes[] = {0,1,12,13,14,100,255,270,4096,65536,65537,300000};
+    size_t j;
+    int kind;
+
+    srand(1234);
+
+    for (j = 0; j < sizeof(sizes)/sizeof(sizes[0]); j++) {
+        for (kind = 0; kind < 5; kind++) {
+            char descr[128];
+
+            snprintf(descr,sizeof(descr),
+                "Roundtrip of %zu bytes of data kind %d",sizes[j],kind);
+            lz4TestCond(descr,lz4TestRoundtrip(sizes[j],kind));
+        }
+    }
+
+    {
+        unsigned char in[4096], comp[4096+64];
+        unsigned int clen, k;
+        int ok = 1;
+
+        lz4TestFill(in,sizeof(in),2);
+        clen = lz4_compress(in,sizeof(in),comp,sizeof(comp));
+        for (k = 0; k < clen; k++) {
+            long ret = lz4TestDecompress(comp,k,sizeof(in));
+            if (ret == -1 || ret == (long)sizeof(in)) ok = 0;
+        }
+        lz4TestCond("Truncated blocks are never decompressed in full",ok);
+    }
+
+    {
+        /* "abcd" then a match at offset 0, 5 and 65535. */
+        unsigned char zero[] = {0x40,'a','b','c','d',0x00,0x00,0x10,'x'};
+        unsigned char past[] = {0x40,'a','b','c','d',0x05,0x00,0x10,'x'};
+        unsigned char far[] = {0x40,'a','b','c','d',0xff,0xff,0x10,'x'};
+        unsigned char good[] = {0x40,'a','b','c','d',0x04,0x00,0x10,'x'};
+
+        lz4TestCond("Match offset 0 is rejected",
+            lz4TestDecompress(zero,sizeof(zero),64) == 0);
+        lz4TestCond("Match offset before the output start is rejected",
+            lz4TestDecompress(past,sizeof(past),64) == 0);
+        lz4TestCond("Match offset 65535 with 4 bytes of output is rejected",
+            lz4TestDecompress(far,sizeof(far),64) == 0);
+        lz4TestCond("A valid offset is accepted",
+            lz4TestDecompress(good,sizeof(good),64) == 9);
+    }
+
+    {
+        /* Literal lengths pointing past the end of the input or output. */
+        unsigned char past_in[] = {0x50,'a','b','c','d'};
+        unsigned char ext_past_in[] = {0xf0,0x10,'a','b'};
+        unsigned char unterminated[] = {0xf0,0xff,0xff,0xff,0xff};
+        unsigned char *huge = malloc(70000);
+
+        lz4TestCond("Literals past the end of the input are rejected",
+            lz4TestDecompress(past_in,sizeof(past_in),64) == 0);
+        lz4TestCond("Extended literals past the end of the input are rejected",
+            lz4TestDecompress(ext_past_in,sizeof(ext_past_in),64) == 0);
+        lz4TestCond("Unterminated literal length is rejected",
+            lz4TestDecompress(unterminated,sizeof(unterminated),64) == 0);
+        lz4TestCond("Literals not fitting the output are rejected",
+            lz4TestDecompress(past_in,sizeof(past_in),3) == 0);
+
+        /* A literal length of about 16M, made of 65535 bytes of 255. */
+        huge[0] = 0xf0;
+        memset(huge+1,0xff,69999);
+        lz4TestCond("Huge literal length is rejected",
+            lz4TestDecompress(huge,70000,1024) == 0);
+        free(huge);
+    }
+
+    {
+        /* Match lengths producing more than the output can hold. */
+        unsigned char mlen[] = {0x4f,'a','b','c','d',0x01,0x00,0xff,0xff,
+                                0x00,0x10,'x'};
+        unsigned char unterminated[] = {0x4f,'a','b','c','d',0x01,0x00,
+                                        0xff,0xff};
+
+        lz4TestCond("Match not fitting the output is rejected",
+            lz4TestDecompress(mlen,sizeof(mlen),256) == 0);
+        lz4TestCond("Match fitting the output is accepted",
+            lz4TestDecompress(mlen,sizeof(mlen),4+15+255+255+4+1) ==
+            4+15+255+255+4+1);
+        lz4TestCond("Unterminated match length is rejected",
+            lz4TestDecompress(unterminated,sizeof(unterminated),1024) == 0);
+    }
+
+    {
+        unsigned char in[8192], comp[8192+64], bad[8192+64];
+        unsigned int clen, k;
+        int ok = 1;
+
+        lz4TestFill(in,sizeof(in),4);
+        clen = lz4_compress(in,sizeof(in),comp,sizeof(comp));
+        for (k = 0; k < 20000; k++) {
+            int flips = 1 + rand()%4;
+
+            memcpy(bad,comp,clen);
+            while (flips--) bad[rand()%clen] = rand();
+            if (lz4TestDecompress(bad,clen,sizeof(in)) == -1) ok = 0;
+        }
+        lz4TestCond("Randomly corrupted blocks never overrun the output",ok);
+    }
+
+    printf("%d tests, %d passed, %d failed\n",
+        lz4_tests, lz4_tests-lz4_failed, lz4_failed);
+    return lz4_failed != 0;
+}
+#endif
@@ -63,25 +63,35 @@ list *listCreate(void)
     return list;
 }
 
-/* Free the whole list.
- *
- * This function can't fail. */
-/* 释放整个列表
- * 这个函数不会失败？XXX
-*/
-void listRelease(list *list)
+/* Remove all the elements from the list without destroying the list
+ * itself. */
+/* 清空列表中的所有节点，但不释放列表本身 */
+void listEmpty(list *list)
 {
     unsigned long len;
     listNode *current, *next;
-    
+
     current = list->head;   // 从list的头开始释放
     len = list->len;        // 需要释放的node的数量就是list的长度
     while(len--) {  // 依次释放
         next = current->next;
         if (list->free) list->free(current->value); // 如果list有定义free方法，则调用自己的free方法来释放node
         zfree(current); // 调用redis定义的zfree函数释放当前节点
-        current = next; 
+        current = next;
     }
+    list->head = list->tail = NULL;
+    list->len = 0;
+}
+
+/* Free the whole list.
+ *
+ * This function can't fail. */
+/* 释放整个列表
+ * 这个函数不会失败？XXX
+*/
+void listRelease(list *list)
+{
+    listEmpty(list);
     zfree(list);    // 最后使用zfree释放list
 }
 
@@ -176,12 +186,31 @@ list *listInsertNode(list *list, listNode *old_node, void *value, int after) {
     return list;    // 返回list
 }
 
-/* Remove the specified node from the specified list.
- * It's up to the caller to free the private value of the node.
+/* Add a node allocated by the caller (for instance embedded in the structure
+ * it references) to the head of the list. The node value must already be
+ * set. Such nodes must be removed with listUnlinkNode(), never freed by
+ * listDelNode() or listEmpty().
  *
  * This function can't fail. */
-/* 从list删除指定的节点 */
-void listDelNode(list *list, listNode *node)
+/* 将调用者分配的节点链接为头节点 */
+void listLinkNodeHead(list *list, listNode *node)
+{
+    node->prev = NULL;
+    node->next = list->head;
+    if (list->len == 0)
+        list->tail = node;
+    else
+        list->head->prev = node;
+    list->head = node;
+    list->len++;
+}
+
+/* Remove the specified node from the list without freeing it nor its
+ * value.
+ *
+ * This function can't fail. */
+/* 从list摘除指定的节点，但不释放 */
+void listUnlinkNode(list *list, listNode *node)
 {
     if (node->prev) // 如果被删除的节点不是头节点，则将前一个节点的next设置的被删除节点的next节点
         node->prev->next = node->next;
@@ -191,9 +220,20 @@ void listDelNode(list *list, listNode *node)
         node->next->prev = node->prev;
     else    // 如果被删除的是尾节点，则将前一个的节点设置为尾节点
         list->tail = node->prev;
+    node->prev = node->next = NULL;
+    list->len--;    // list长度减1
+}
+
+/* Remove the specified node from the specified list.
+ * It's up to the caller to free the private value of the node.
+ *
+ * This function can't fail. */
+/* 从list删除指定的节点 */
+void listDelNode(list *list, listNode *node)
+{
+    listUnlinkNode(list,node);
     if (list->free) list->free(node->value);    // 如果list定义了free函数，则使用该free函数释放node
     zfree(node);
-    list->len--;    // list长度减1
 }
 
 /* Returns a list iterator 'iter'. After the initialization every
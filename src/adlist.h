@@ -75,10 +75,13 @@ typedef struct list {
 /* 函数原型 */
 list *listCreate(void); // 创建list
 void listRelease(list *list);   // 释放list
+void listEmpty(list *list); // 清空list中的所有节点
 list *listAddNodeHead(list *list, void *value); // 增加头节点
 list *listAddNodeTail(list *list, void *value); // 增加尾节点
 list *listInsertNode(list *list, listNode *old_node, void *value, int after);   // 指定位置插入节点
 void listDelNode(list *list, listNode *node);   // 删除节点
+void listLinkNodeHead(list *list, listNode *node); // 链接调用者分配的头节点
+void listUnlinkNode(list *list, listNode *node);   // 摘除节点但不释放
 listIter *listGetIterator(list *list, int direction);   // 获取list指定方向的迭代器
 listNode *listNext(listIter *iter); // 获取迭代器的下一节点
 void listReleaseIterator(listIter *iter);   // 释放列表迭代器
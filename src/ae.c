@@ -70,7 +70,13 @@ aeEventLoop *aeCreateEventLoop(int setsize) {
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
     eventLoop->setsize = setsize;
     eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
+    eventLoop->timeEventHeap = NULL;
+    eventLoop->timeEventCount = 0;
+    eventLoop->timeEventHeapSize = 0;
+    eventLoop->timeEventFired = NULL;
+    eventLoop->timeEventTable = NULL;
+    eventLoop->timeEventTableSize = 0;
+    eventLoop->timeEventTableUsed = 0;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
     eventLoop->maxfd = -1;
@@ -122,9 +128,15 @@ int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+
     aeApiFree(eventLoop);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
+    for (j = 0; j < eventLoop->timeEventCount; j++)
+        zfree(eventLoop->timeEventHeap[j]);
+    zfree(eventLoop->timeEventHeap);
+    zfree(eventLoop->timeEventTable);
     zfree(eventLoop);
 }
 
@@ -204,6 +216,128 @@ static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms)
     *ms = when_ms;
 }
 
+/* Time events are stored in a binary min-heap ordered by deadline, so that
+ * the nearest timer is always at the top of the heap and adding a timer or
+ * removing the nearest one is O(log(N)). */
+#define AE_TIME_HEAP_INITIAL_SIZE 16
+
+/* Return non-zero if the event 'a' should fire before the event 'b'. */
+static int aeTimeEventBefore(aeTimeEvent *a, aeTimeEvent *b) {
+    return a->when_sec < b->when_sec ||
+           (a->when_sec == b->when_sec && a->when_ms < b->when_ms);
+}
+
+static void aeTimeHeapSiftUp(aeEventLoop *eventLoop, int j) {
+    aeTimeEvent **heap = eventLoop->timeEventHeap;
+    aeTimeEvent *te = heap[j];
+
+    while (j > 0) {
+        int parent = (j-1)/2;
+        if (!aeTimeEventBefore(te,heap[parent])) break;
+        heap[j] = heap[parent];
+        heap[j]->heap_index = j;
+        j = parent;
+    }
+    heap[j] = te;
+    te->heap_index = j;
+}
+
+static void aeTimeHeapSiftDown(aeEventLoop *eventLoop, int j) {
+    aeTimeEvent **heap = eventLoop->timeEventHeap;
+    aeTimeEvent *te = heap[j];
+    int count = eventLoop->timeEventCount;
+
+    while (1) {
+        int child = j*2+1;
+        if (child >= count) break;
+        if (child+1 < count && aeTimeEventBefore(heap[child+1],heap[child]))
+            child++;
+        if (!aeTimeEventBefore(heap[child],te)) break;
+        heap[j] = heap[child];
+        heap[j]->heap_index = j;
+        j = child;
+    }
+    heap[j] = te;
+    te->heap_index = j;
+}
+
+static void aeTimeHeapPush(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (eventLoop->timeEventCount == eventLoop->timeEventHeapSize) {
+        int size = eventLoop->timeEventHeapSize ?
+                   eventLoop->timeEventHeapSize*2 : AE_TIME_HEAP_INITIAL_SIZE;
+        eventLoop->timeEventHeap = zrealloc(eventLoop->timeEventHeap,
+                                            sizeof(aeTimeEvent*)*size);
+        eventLoop->timeEventHeapSize = size;
+    }
+    eventLoop->timeEventHeap[eventLoop->timeEventCount++] = te;
+    aeTimeHeapSiftUp(eventLoop,eventLoop->timeEventCount-1);
+}
+
+/* Remove and return the nearest time event. The heap must not be empty. */
+static aeTimeEvent *aeTimeHeapPop(aeEventLoop *eventLoop) {
+    aeTimeEvent *top = eventLoop->timeEventHeap[0];
+
+    if (--eventLoop->timeEventCount > 0) {
+        eventLoop->timeEventHeap[0] =
+            eventLoop->timeEventHeap[eventLoop->timeEventCount];
+        aeTimeHeapSiftDown(eventLoop,0);
+    }
+    top->heap_index = -1;
+    return top;
+}
+
+/* Live time events are also hashed by ID, so that aeDeleteTimeEvent() can
+ * find them, and their position in the heap, in constant time. IDs are
+ * sequential, so the low bits of the ID are used as hash function. */
+#define AE_TIME_TABLE_INITIAL_SIZE 16
+
+static void aeTimeTableAdd(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    int j, mask;
+
+    if (eventLoop->timeEventTableUsed == eventLoop->timeEventTableSize) {
+        int size = eventLoop->timeEventTableSize ?
+                   eventLoop->timeEventTableSize*2 : AE_TIME_TABLE_INITIAL_SIZE;
+        aeTimeEvent **table = zcalloc(sizeof(aeTimeEvent*)*size);
+
+        for (j = 0; j < eventLoop->timeEventTableSize; j++) {
+            aeTimeEvent *e = eventLoop->timeEventTable[j], *next;
+
+            while (e) {
+                next = e->id_next;
+                e->id_next = table[e->id & (size-1)];
+                table[e->id & (size-1)] = e;
+                e = next;
+            }
+        }
+        zfree(eventLoop->timeEventTable);
+        eventLoop->timeEventTable = table;
+        eventLoop->timeEventTableSize = size;
+    }
+    mask = eventLoop->timeEventTableSize-1;
+    te->id_next = eventLoop->timeEventTable[te->id & mask];
+    eventLoop->timeEventTable[te->id & mask] = te;
+    eventLoop->timeEventTableUsed++;
+}
+
+/* Unlink the event with the specified ID from the table and return it,
+ * or return NULL if there is no such event. */
+static aeTimeEvent *aeTimeTableRemove(aeEventLoop *eventLoop, long long id) {
+    aeTimeEvent **link, *te;
+
+    if (eventLoop->timeEventTableSize == 0 || id < 0) return NULL;
+    link = &eventLoop->timeEventTable[id & (eventLoop->timeEventTableSize-1)];
+    while ((te = *link) != NULL) {
+        if (te->id == id) {
+            *link = te->id_next;
+            te->id_next = NULL;
+            eventLoop->timeEventTableUsed--;
+            return te;
+        }
+        link = &te->id_next;
+    }
+    return NULL;
+}
+
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc)
@@ -218,22 +352,26 @@ long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
+    te->next = NULL;
+    te->id_next = NULL;
+    aeTimeHeapPush(eventLoop,te);
+    aeTimeTableAdd(eventLoop,te);
     return id;
 }
 
+/* Mark the event as deleted: it is actually removed, and its finalizer
+ * called, by processTimeEvents(), since we may be called by the time
+ * event itself. Events in the heap are moved to the top, so that they
+ * are reclaimed by the next processTimeEvents() call. This is O(log(N)). */
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-            te->id = AE_DELETED_EVENT_ID;
-            return AE_OK;
-        }
-        te = te->next;
-    }
-    return AE_ERR; /* NO event with the specified ID found */
+    aeTimeEvent *te = aeTimeTableRemove(eventLoop,id);
+
+    if (te == NULL) return AE_ERR; /* NO event with the specified ID found */
+    te->id = AE_DELETED_EVENT_ID;
+    te->when_sec = te->when_ms = 0;
+    if (te->heap_index != -1) aeTimeHeapSiftUp(eventLoop,te->heap_index);
+    return AE_OK;
 }
 
 /* Search the first timer to fire.
@@ -241,32 +379,18 @@ int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
  * put in sleep without to delay any event.
  * If there are no timers NULL is returned.
  *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
+ * This is O(1) since the nearest timer is at the top of the heap. */
 static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
-    }
-    return nearest;
+    return eventLoop->timeEventCount ? eventLoop->timeEventHeap[0] : NULL;
 }
 
 /* Process time events */
 static int processTimeEvents(aeEventLoop *eventLoop) {
     int processed = 0;
-    aeTimeEvent *te, *prev;
+    aeTimeEvent *te;
     long long maxId;
+    long now_sec, now_ms;
     time_t now = time(NULL);
 
     /* If the system clock is moved to the future, and then set back to the
@@ -276,63 +400,63 @@ static int processTimeEvents(aeEventLoop *eventLoop) {
      * Here we try to detect system clock skews, and force all the time
      * events to be processed ASAP when this happens: the idea is that
      * processing events earlier is less dangerous than delaying them
-     * indefinitely, and practice suggests it is. */
+     * indefinitely, and practice suggests it is. Since all the deadlines
+     * become the same, the heap is still valid. */
     if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
+        int j;
+
+        for (j = 0; j < eventLoop->timeEventCount; j++) {
+            te = eventLoop->timeEventHeap[j];
+            te->when_sec = te->when_ms = 0;
         }
     }
     eventLoop->lastTime = now;
 
-    prev = NULL;
-    te = eventLoop->timeEventHead;
     maxId = eventLoop->timeEventNextId-1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
+    aeGetTime(&now_sec, &now_ms);
+    while(eventLoop->timeEventCount) {
+        int retval;
+
+        te = eventLoop->timeEventHeap[0];
 
         /* Remove events scheduled for deletion. */
         if (te->id == AE_DELETED_EVENT_ID) {
-            aeTimeEvent *next = te->next;
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
+            aeTimeHeapPop(eventLoop);
             if (te->finalizerProc)
                 te->finalizerProc(eventLoop, te->clientData);
             zfree(te);
-            te = next;
             continue;
         }
 
-        /* Make sure we don't process time events created by time events in
-         * this iteration. Note that this check is currently useless: we always
-         * add new timers on the head, however if we change the implementation
-         * detail, this check may be useful again: we keep it here for future
-         * defense. */
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
-        }
-        aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            if (retval != AE_NOMORE) {
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                te->id = AE_DELETED_EVENT_ID;
-            }
+        /* Events are ordered by deadline: stop at the first event that
+         * is not due yet. */
+        if (now_sec < te->when_sec ||
+            (now_sec == te->when_sec && now_ms < te->when_ms)) break;
+
+        /* Move the event out of the heap while it is processed, so that
+         * events rescheduled with a zero period, or created by time events
+         * in this iteration, are not processed again before returning. */
+        aeTimeHeapPop(eventLoop);
+        te->next = eventLoop->timeEventFired;
+        eventLoop->timeEventFired = te;
+        if (te->id > maxId) continue;
+
+        retval = te->timeProc(eventLoop, te->id, te->clientData);
+        processed++;
+        if (retval != AE_NOMORE) {
+            aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
+        } else {
+            aeTimeTableRemove(eventLoop,te->id);
+            te->id = AE_DELETED_EVENT_ID;
         }
-        prev = te;
-        te = te->next;
+    }
+
+    /* Put back the events processed in this iteration. The ones marked as
+     * deleted will be reclaimed by the next call. */
+    while((te = eventLoop->timeEventFired) != NULL) {
+        eventLoop->timeEventFired = te->next;
+        te->next = NULL;
+        aeTimeHeapPush(eventLoop,te);
     }
     return processed;
 }
@@ -497,3 +621,124 @@ char *aeGetApiName(void) {
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
     eventLoop->beforesleep = beforesleep;
 }
+
+#ifdef REDIS_TEST
+#define assert(_e) ((_e)?(void)0:(_assert(#_e,__FILE__,__LINE__),exit(1)))
+static void _assert(char *estr, char *file, int line) {
+    printf("\n\n=== ASSERTION FAILED ===\n");
+    printf("==> %s:%d '%s' is not true\n",file,line,estr);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+static long long aeTestLastFired;   /* Deadline of the last fired event. */
+static int aeTestFired, aeTestFinalized, aeTestOrderErrors;
+
+static int aeTestTimeProc(aeEventLoop *eventLoop, long long id, void *data) {
+    /* The event being processed is the last one moved out of the heap. */
+    aeTimeEvent *te = eventLoop->timeEventFired;
+    long long when = (long long)te->when_sec*1000+te->when_ms;
+    AE_NOTUSED(id);
+    AE_NOTUSED(data);
+
+    if (when < aeTestLastFired) aeTestOrderErrors++;
+    aeTestLastFired = when;
+    aeTestFired++;
+    return AE_NOMORE;
+}
+
+static int aeTestIdleProc(aeEventLoop *eventLoop, long long id, void *data) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(id);
+    AE_NOTUSED(data);
+    return 1000;
+}
+
+static void aeTestFinalizer(aeEventLoop *eventLoop, void *data) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(data);
+    aeTestFinalized++;
+}
+
+int aeTest(int argc, char *argv[]) {
+    aeEventLoop *el;
+    long long start, ids[1000];
+    int j, k, sizes[] = {10, 1000, 10000, 100000};
+    AE_NOTUSED(argc);
+    AE_NOTUSED(argv);
+
+    srand(time(NULL));
+
+    printf("Timers fire in deadline order: ");
+    {
+        el = aeCreateEventLoop(64);
+        for (j = 0; j < 1000; j++) {
+            long long ms = rand() % 50;
+            ids[j] = aeCreateTimeEvent(el,ms,aeTestTimeProc,NULL,
+                                       aeTestFinalizer);
+        }
+        /* Delete one timer every ten: they must never fire. */
+        for (j = 0; j < 1000; j += 10)
+            assert(aeDeleteTimeEvent(el,ids[j]) == AE_OK);
+        assert(aeDeleteTimeEvent(el,ids[0]) == AE_ERR);
+        start = usec();
+        while (el->timeEventCount && usec()-start < 1000000)
+            aeProcessEvents(el,AE_TIME_EVENTS);
+        assert(aeTestOrderErrors == 0);
+        assert(aeTestFired == 900);
+        assert(aeTestFinalized == 1000);
+        assert(el->timeEventCount == 0);
+        aeDeleteEventLoop(el);
+        printf("OK\n");
+    }
+
+    for (k = 0; k < (int)(sizeof(sizes)/sizeof(sizes[0])); k++) {
+        int numtimers = sizes[k], loops = 100000, numdel;
+        long long elapsed, *pending = zmalloc(sizeof(long long)*numtimers);
+
+        printf("Benchmark with %d pending timers:\n", numtimers);
+        el = aeCreateEventLoop(64);
+        start = usec();
+        for (j = 0; j < numtimers; j++)
+            pending[j] = aeCreateTimeEvent(el,1000000+rand()%1000000,
+                                           aeTestIdleProc,NULL,NULL);
+        elapsed = usec()-start;
+        printf("  create: %.3f usec per timer\n",(double)elapsed/numtimers);
+
+        start = usec();
+        for (j = 0; j < loops; j++)
+            aeProcessEvents(el,AE_TIME_EVENTS|AE_DONT_WAIT);
+        elapsed = usec()-start;
+        printf("  event loop iteration: %.3f usec\n",(double)elapsed/loops);
+
+        start = usec();
+        for (j = 0; j < 1000; j++) {
+            long long id = aeCreateTimeEvent(el,1,aeTestIdleProc,NULL,NULL);
+            aeDeleteTimeEvent(el,id);
+            aeProcessEvents(el,AE_TIME_EVENTS|AE_DONT_WAIT);
+        }
+        elapsed = usec()-start;
+        printf("  create+delete: %.3f usec per timer\n",(double)elapsed/1000);
+        assert(el->timeEventCount == numtimers);
+
+        /* Delete pending timers spread across the whole heap. */
+        numdel = numtimers < 1000 ? numtimers : 1000;
+        start = usec();
+        for (j = 0; j < numdel; j++)
+            assert(aeDeleteTimeEvent(el,pending[j*(numtimers/numdel)]) ==
+                   AE_OK);
+        elapsed = usec()-start;
+        printf("  delete pending: %.3f usec per timer\n",
+            (double)elapsed/numdel);
+        aeProcessEvents(el,AE_TIME_EVENTS|AE_DONT_WAIT);
+        assert(el->timeEventCount == numtimers-numdel);
+        aeDeleteEventLoop(el);
+        zfree(pending);
+    }
+    return 0;
+}
+#endif
@@ -82,7 +82,9 @@ typedef struct aeTimeEvent {
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    int heap_index; /* Position in the heap, -1 while out of the heap. */
+    struct aeTimeEvent *next; /* Used while the event is out of the heap. */
+    struct aeTimeEvent *id_next; /* Next event in the same ID table bucket. */
 } aeTimeEvent;
 
 /* A fired event */
@@ -99,7 +101,13 @@ typedef struct aeEventLoop {
     time_t lastTime;     /* Used to detect system clock skew */
     aeFileEvent *events; /* Registered events */
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    aeTimeEvent **timeEventHeap; /* Time events, min-heap by deadline. */
+    int timeEventCount;          /* Number of events in the heap. */
+    int timeEventHeapSize;       /* Allocated slots in the heap. */
+    aeTimeEvent *timeEventFired; /* Events fired in the current iteration. */
+    aeTimeEvent **timeEventTable; /* Live time events, hashed by ID. */
+    int timeEventTableSize;       /* Buckets in the table, a power of two. */
+    int timeEventTableUsed;       /* Events in the table. */
     int stop;
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
@@ -125,4 +133,8 @@ void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep
 int aeGetSetSize(aeEventLoop *eventLoop);
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize);
 
+#ifdef REDIS_TEST
+int aeTest(int argc, char *argv[]);
+#endif
+
 #endif
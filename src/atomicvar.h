@@ -0,0 +1,142 @@
+/* This file implements atomic counters using __atomic or __sync macros if
+ * available, otherwise synchronizing different threads using a mutex.
+ *
+ * The exported interface is composed of the following macros:
+ *
+ * atomicIncr(var,count,mutex) -- Increment the atomic counter
+ * atomicDecr(var,count,mutex) -- Decrement the atomic counter
+ * atomicIncrGet(var,newvalue_var,count,mutex) -- Increment and get the
+ *                                                resulting value
+ * atomicDecrGet(var,newvalue_var,count,mutex) -- Decrement and get the
+ *                                                resulting value
+ * atomicGet(var,dstvar,mutex) -- Fetch the atomic counter value
+ * atomicSet(var,value,mutex) -- Set the atomic counter value
+ *
+ * Every variable accessed with these macros should also have a declared
+ * mutex, that is passed as last argument, for instance:
+ *
+ *  long myvar;
+ *  pthread_mutex_t myvar_mutex;
+ *  atomicSet(myvar,12345,myvar_mutex);
+ *
+ * If atomic primitives are available (tested in config.h) the mutex
+ * is not used.
+ *
+ * Never use return value from the macros, instead use the atomicIncrGet()
+ * if you need to get the current value and increment it atomically, like
+ * in the following example:
+ *
+ *  long oldvalue;
+ *  atomicIncrGet(myvar,oldvalue,1,myvar_mutex);
+ *  doSomethingWith(oldvalue);
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2015, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+
+#ifndef __ATOMIC_VAR_H
+#define __ATOMIC_VAR_H
+
+#if defined(__ATOMIC_RELAXED) && !defined(__sun)
+/* Implementation using __atomic macros. */
+
+#define atomicIncr(var,count,mutex) __atomic_add_fetch(&var,(count),__ATOMIC_RELAXED)
+#define atomicIncrGet(var,newvalue_var,count,mutex) do { \
+    newvalue_var = __atomic_add_fetch(&var,(count),__ATOMIC_RELAXED); \
+} while(0)
+#define atomicDecr(var,count,mutex) __atomic_sub_fetch(&var,(count),__ATOMIC_RELAXED)
+#define atomicDecrGet(var,newvalue_var,count,mutex) do { \
+    newvalue_var = __atomic_sub_fetch(&var,(count),__ATOMIC_ACQ_REL); \
+} while(0)
+#define atomicGet(var,dstvar,mutex) do { \
+    dstvar = __atomic_load_n(&var,__ATOMIC_ACQUIRE); \
+} while(0)
+#define atomicSet(var,value,mutex) __atomic_store_n(&var,value,__ATOMIC_RELEASE)
+#define REDIS_ATOMIC_API "atomic-builtin"
+
+#elif defined(HAVE_ATOMIC)
+/* Implementation using __sync macros. */
+
+#define atomicIncr(var,count,mutex) __sync_add_and_fetch(&var,(count))
+#define atomicIncrGet(var,newvalue_var,count,mutex) do { \
+    newvalue_var = __sync_add_and_fetch(&var,(count)); \
+} while(0)
+#define atomicDecr(var,count,mutex) __sync_sub_and_fetch(&var,(count))
+#define atomicDecrGet(var,newvalue_var,count,mutex) do { \
+    newvalue_var = __sync_sub_and_fetch(&var,(count)); \
+} while(0)
+#define atomicGet(var,dstvar,mutex) do { \
+    dstvar = __sync_sub_and_fetch(&var,0); \
+} while(0)
+#define atomicSet(var,value,mutex) do { \
+    while(!__sync_bool_compare_and_swap(&var,var,value)); \
+} while(0)
+#define REDIS_ATOMIC_API "sync-builtin"
+
+#else
+/* Implementation using pthread mutex. */
+
+#define atomicIncr(var,count,mutex) do { \
+    pthread_mutex_lock(&mutex); \
+    var += (count); \
+    pthread_mutex_unlock(&mutex); \
+} while(0)
+#define atomicIncrGet(var,newvalue_var,count,mutex) do { \
+    pthread_mutex_lock(&mutex); \
+    var += (count); \
+    newvalue_var = var; \
+    pthread_mutex_unlock(&mutex); \
+} while(0)
+#define atomicDecr(var,count,mutex) do { \
+    pthread_mutex_lock(&mutex); \
+    var -= (count); \
+    pthread_mutex_unlock(&mutex); \
+} while(0)
+#define atomicDecrGet(var,newvalue_var,count,mutex) do { \
+    pthread_mutex_lock(&mutex); \
+    var -= (count); \
+    newvalue_var = var; \
+    pthread_mutex_unlock(&mutex); \
+} while(0)
+#define atomicGet(var,dstvar,mutex) do { \
+    pthread_mutex_lock(&mutex); \
+    dstvar = var; \
+    pthread_mutex_unlock(&mutex); \
+} while(0)
+#define atomicSet(var,value,mutex) do { \
+    pthread_mutex_lock(&mutex); \
+    var = value; \
+    pthread_mutex_unlock(&mutex); \
+} while(0)
+#define REDIS_ATOMIC_API "pthread-mutex"
+
+#endif
+#endif /* __ATOMIC_VAR_H */
@@ -84,10 +84,6 @@ struct bio_job {
 
 void *bioProcessBackgroundJobs(void *arg);
 
-/* Make sure we have enough stack to perform all the things we do in the
- * main thread. */
-#define REDIS_THREAD_STACK_SIZE (1024*1024*4)
-
 /* Initialize the background system, spawning the thread. */
 void bioInit(void) {
     pthread_attr_t attr;
@@ -183,6 +179,20 @@ void *bioProcessBackgroundJobs(void *arg) {
             close((long)job->arg1);
         } else if (type == BIO_AOF_FSYNC) {
             aof_fsync((long)job->arg1);
+        } else if (type == BIO_LAZY_FREE) {
+            /* What we free changes depending on what arguments are set:
+             * arg2 (& arg3, arg1) -> free the dictionaries of a Redis DB
+             *     (arg3 is NULL when the DB uses embedded expires) and
+             *     its expiry index, if not NULL.
+             * only arg1 -> free the object at pointer.
+             * only arg3 -> free the slots-keys map of Redis Cluster. */
+            if (job->arg2)
+                lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3,
+                                                  job->arg1);
+            else if (job->arg1)
+                lazyfreeFreeObjectFromBioThread(job->arg1);
+            else if (job->arg3)
+                lazyfreeFreeSlotsMapFromBioThread(job->arg3);
         } else {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
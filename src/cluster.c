@@ -468,8 +468,9 @@ void clusterInit(void) {
         }
     }
 
-    /* The slots -> keys map is a sorted set. Init it. */
-    server.cluster->slots_to_keys = zslCreate();
+    /* The slots -> keys map is an array of per slot dictionaries, that
+     * are created lazily when the first key of a slot is added. */
+    server.cluster->slots_to_keys = zcalloc(sizeof(dict*)*CLUSTER_SLOTS);
 
     /* Set myself->port to my listening port, we'll just need to discover
      * the IP address via MEET messages. */
@@ -497,7 +498,7 @@ void clusterReset(int hard) {
     if (nodeIsSlave(myself)) {
         clusterSetNodeAsMaster(myself);
         replicationUnsetMaster();
-        emptyDb(NULL);
+        emptyDb(EMPTYDB_NO_FLAGS,NULL);
     }
 
     /* Close slots, reset manual failover state. */
@@ -4163,7 +4164,7 @@ void clusterCommand(client *c) {
         /* CLUSTER GETKEYSINSLOT <slot> <count> */
         long long maxkeys, slot;
         unsigned int numkeys, j;
-        robj **keys;
+        sds *keys;
 
         if (getLongLongFromObjectOrReply(c,c->argv[2],&slot,NULL) != C_OK)
             return;
@@ -4175,10 +4176,11 @@ void clusterCommand(client *c) {
             return;
         }
 
-        keys = zmalloc(sizeof(robj*)*maxkeys);
+        keys = zmalloc(sizeof(sds)*maxkeys);
         numkeys = getKeysInSlot(slot, keys, maxkeys);
         addReplyMultiBulkLen(c,numkeys);
-        for (j = 0; j < numkeys; j++) addReplyBulk(c,keys[j]);
+        for (j = 0; j < numkeys; j++)
+            addReplyBulkCBuffer(c,keys[j],sdslen(keys[j]));
         zfree(keys);
     } else if (!strcasecmp(c->argv[1]->ptr,"forget") && c->argc == 3) {
         /* CLUSTER FORGET <NODE ID> */
@@ -4397,18 +4399,13 @@ void clusterCommand(client *c) {
  * DUMP, RESTORE and MIGRATE commands
  * -------------------------------------------------------------------------- */
 
-/* Generates a DUMP-format representation of the object 'o', adding it to the
- * io stream pointed by 'rio'. This function can't fail. */
-void createDumpPayload(rio *payload, robj *o) {
+/* Write the DUMP payload footer at the end of the RDB serialized object
+ * accumulated into the buffer based rio 'payload'. 'rdbver' is the RDB
+ * version the payload requires. */
+static void dumpPayloadAddFooter(rio *payload, int rdbver) {
     unsigned char buf[2];
     uint64_t crc;
 
-    /* Serialize the object in a RDB-like format. It consist of an object type
-     * byte followed by the serialized object. This is understood by RESTORE. */
-    rioInitWithBuffer(payload,sdsempty());
-    serverAssert(rdbSaveObjectType(payload,o));
-    serverAssert(rdbSaveObject(payload,o));
-
     /* Write the footer, this is how it looks like:
      * ----------------+---------------------+---------------+
      * ... RDB payload | 2 bytes RDB version | 8 bytes CRC64 |
@@ -4417,8 +4414,8 @@ void createDumpPayload(rio *payload, robj *o) {
      */
 
     /* RDB version */
-    buf[0] = RDB_VERSION & 0xff;
-    buf[1] = (RDB_VERSION >> 8) & 0xff;
+    buf[0] = rdbver & 0xff;
+    buf[1] = (rdbver >> 8) & 0xff;
     payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,buf,2);
 
     /* CRC64 */
@@ -4428,6 +4425,159 @@ void createDumpPayload(rio *payload, robj *o) {
     payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,&crc,8);
 }
 
+/* Generates a DUMP-format representation of the object 'o', adding it to the
+ * io stream pointed by 'rio'. This function can't fail. */
+void createDumpPayload(rio *payload, robj *o) {
+    /* Serialize the object in a RDB-like format. It consist of an object type
+     * byte followed by the serialized object. This is understood by RESTORE.
+     *
+     * Strings are never compressed with LZ4, so that only the values stored
+     * as listpacks (small hashes and sorted sets, and lists) require the
+     * current RDB version: all the other values can be restored by servers
+     * using the older format. */
+    rioInitWithBuffer(payload,sdsempty());
+    payload->flags |= RIO_FLAG_NO_LZ4;
+    serverAssert(rdbSaveObjectType(payload,o));
+    serverAssert(rdbSaveObject(payload,o));
+    dumpPayloadAddFooter(payload,(o->encoding == OBJ_ENCODING_LISTPACK ||
+                                  o->encoding == OBJ_ENCODING_QUICKLIST) ?
+                                 RDB_VERSION : RDB_DUMP_COMPAT_VERSION);
+}
+
+/* Aggregate values with more elements than this are transferred by MIGRATE
+ * as multiple DUMP payloads, see dumpPartsNext(). */
+#define MIGRATE_PART_ITEMS 1024
+
+/* Cursor used to serialize a big aggregate value one part at a time. */
+typedef struct dumpParts {
+    robj *o;                /* Value being split. */
+    unsigned char rdbtype;  /* RDB type of every part. */
+    unsigned long total;    /* Number of elements of the value. */
+    unsigned long done;     /* Elements serialized so far. */
+    listTypeIterator *li;   /* Iterator for lists. */
+    setTypeIterator *si;    /* Iterator for sets. */
+    zskiplistNode *zn;      /* Next node for sorted sets. */
+    hashTypeIterator *hi;   /* Iterator for hashes. */
+} dumpParts;
+
+/* Return the number of elements of 'o' if it is an aggregate value big
+ * enough to be split by dumpPartsCreate(), otherwise zero is returned.
+ * Small encodings (listpacks, intsets) are never split since they are
+ * cheap to serialize and load in a single step. */
+static unsigned long dumpPartsValueLength(robj *o) {
+    unsigned long len = 0;
+
+    if (o->type == OBJ_LIST && o->encoding == OBJ_ENCODING_QUICKLIST)
+        len = listTypeLength(o);
+    else if (o->type == OBJ_SET && o->encoding == OBJ_ENCODING_HT)
+        len = setTypeSize(o);
+    else if (o->type == OBJ_ZSET && o->encoding == OBJ_ENCODING_SKIPLIST)
+        len = zsetLength(o);
+    else if (o->type == OBJ_HASH && o->encoding == OBJ_ENCODING_HT)
+        len = hashTypeLength(o);
+    return (len > MIGRATE_PART_ITEMS) ? len : 0;
+}
+
+/* Create a cursor to split the big aggregate value 'o' into multiple DUMP
+ * payloads of at most MIGRATE_PART_ITEMS elements each, see dumpPartsNext().
+ * If 'o' is not big enough to be split NULL is returned.
+ *
+ * The cursor holds a reference to the value and iterates it in place, so
+ * the value must not be modified until the cursor is released with
+ * dumpPartsRelease(). */
+static dumpParts *dumpPartsCreate(robj *o) {
+    dumpParts *dp;
+    unsigned long total;
+
+    if ((total = dumpPartsValueLength(o)) == 0) return NULL;
+    dp = zcalloc(sizeof(*dp));
+    dp->o = o;
+    dp->total = total;
+    incrRefCount(o);
+    if (o->type == OBJ_LIST) {
+        dp->rdbtype = RDB_TYPE_LIST;
+        dp->li = listTypeInitIterator(o,0,LIST_TAIL);
+    } else if (o->type == OBJ_SET) {
+        dp->rdbtype = RDB_TYPE_SET;
+        dp->si = setTypeInitIterator(o);
+    } else if (o->type == OBJ_ZSET) {
+        dp->rdbtype = RDB_TYPE_ZSET;
+        dp->zn = ((zset*)o->ptr)->zsl->header->level[0].forward;
+    } else if (o->type == OBJ_HASH) {
+        dp->rdbtype = RDB_TYPE_HASH;
+        dp->hi = hashTypeInitIterator(o);
+    } else {
+        serverPanic("Unknown object type");
+    }
+    return dp;
+}
+
+static void dumpPartsRelease(dumpParts *dp) {
+    if (dp == NULL) return;
+    if (dp->li) listTypeReleaseIterator(dp->li);
+    if (dp->si) setTypeReleaseIterator(dp->si);
+    if (dp->hi) hashTypeReleaseIterator(dp->hi);
+    decrRefCount(dp->o);
+    zfree(dp);
+}
+
+/* Serialize the next part of the value of the cursor 'dp', resuming where
+ * the previous call stopped. Every part is the DUMP of a value of the same
+ * type, so the original value can be recreated with RESTORE for the first
+ * part, followed by RESTORE ... APPEND for the others, without either side
+ * having to serialize or load the whole value in a single step.
+ *
+ * The part is returned as an sds string the caller should free, or NULL
+ * if all the elements were already serialized. */
+static sds dumpPartsNext(dumpParts *dp) {
+    unsigned long count;
+    rio part;
+
+    if (dp->done == dp->total) return NULL;
+    count = dp->total - dp->done;
+    if (count > MIGRATE_PART_ITEMS) count = MIGRATE_PART_ITEMS;
+
+    rioInitWithBuffer(&part,sdsempty());
+    part.flags |= RIO_FLAG_NO_LZ4;
+    serverAssert(rdbSaveType(&part,dp->rdbtype));
+    serverAssert(rdbSaveLen(&part,count));
+    while (count--) {
+        if (dp->li) {
+            listTypeEntry entry;
+            robj *ele;
+
+            serverAssert(listTypeNext(dp->li,&entry));
+            ele = listTypeGet(&entry);
+            serverAssert(rdbSaveStringObject(&part,ele) != -1);
+            decrRefCount(ele);
+        } else if (dp->si) {
+            robj *ele = setTypeNextObject(dp->si);
+
+            serverAssert(ele != NULL);
+            serverAssert(rdbSaveStringObject(&part,ele) != -1);
+            decrRefCount(ele);
+        } else if (dp->hi) {
+            robj *field, *value;
+
+            serverAssert(hashTypeNext(dp->hi) != C_ERR);
+            field = hashTypeCurrentObject(dp->hi,OBJ_HASH_KEY);
+            value = hashTypeCurrentObject(dp->hi,OBJ_HASH_VALUE);
+            serverAssert(rdbSaveStringObject(&part,field) != -1);
+            serverAssert(rdbSaveStringObject(&part,value) != -1);
+            decrRefCount(field);
+            decrRefCount(value);
+        } else {
+            serverAssert(dp->zn != NULL);
+            serverAssert(rdbSaveStringObject(&part,dp->zn->obj) != -1);
+            serverAssert(rdbSaveDoubleValue(&part,dp->zn->score) != -1);
+            dp->zn = dp->zn->level[0].forward;
+        }
+        dp->done++;
+    }
+    dumpPayloadAddFooter(&part,RDB_DUMP_COMPAT_VERSION);
+    return part.io.buffer.ptr;
+}
+
 /* Verify that the RDB version of the dump payload matches the one of this Redis
  * instance and that the checksum is ok.
  * If the DUMP payload looks valid C_OK is returned, otherwise C_ERR
@@ -4443,7 +4593,7 @@ int verifyDumpPayload(unsigned char *p, size_t len) {
 
     /* Verify RDB version */
     rdbver = (footer[1] << 8) | footer[0];
-    if (rdbver > RDB_VERSION) return C_ERR;
+    if (!rdbIsKnownVersion(rdbver)) return C_ERR;
 
     /* Verify CRC64 */
     crc = crc64(0,p,len-8);
@@ -4474,28 +4624,104 @@ void dumpCommand(client *c) {
     return;
 }
 
-/* RESTORE key ttl serialized-value [REPLACE] */
+/* Add all the elements of the aggregate value 'src' to 'dst', that must be
+ * of the same type. Used by RESTORE ... APPEND to recreate a value that
+ * MIGRATE transferred in multiple parts. */
+static void restoreAppendElements(robj *dst, robj *src) {
+    if (dst->type == OBJ_LIST) {
+        listTypeIterator *li = listTypeInitIterator(src,0,LIST_TAIL);
+        listTypeEntry entry;
+
+        while (listTypeNext(li,&entry)) {
+            robj *ele = listTypeGet(&entry);
+            listTypePush(dst,ele,LIST_TAIL);
+            decrRefCount(ele);
+        }
+        listTypeReleaseIterator(li);
+    } else if (dst->type == OBJ_SET) {
+        setTypeIterator *si = setTypeInitIterator(src);
+        robj *ele;
+
+        while ((ele = setTypeNextObject(si)) != NULL) {
+            setTypeAdd(dst,ele);
+            decrRefCount(ele);
+        }
+        setTypeReleaseIterator(si);
+    } else if (dst->type == OBJ_ZSET) {
+        zset *zs, *srczs;
+        zskiplistNode *ln;
+
+        if (dst->encoding != OBJ_ENCODING_SKIPLIST)
+            zsetConvert(dst,OBJ_ENCODING_SKIPLIST);
+        if (src->encoding != OBJ_ENCODING_SKIPLIST)
+            zsetConvert(src,OBJ_ENCODING_SKIPLIST);
+        zs = dst->ptr;
+        srczs = src->ptr;
+        for (ln = srczs->zsl->header->level[0].forward; ln;
+             ln = ln->level[0].forward)
+        {
+            zskiplistNode *znode;
+
+            if (dictFind(zs->dict,ln->obj) != NULL) continue;
+            znode = zslInsert(zs->zsl,ln->score,ln->obj);
+            incrRefCount(ln->obj); /* Inserted in skiplist. */
+            serverAssert(dictAdd(zs->dict,ln->obj,&znode->score) == DICT_OK);
+            incrRefCount(ln->obj); /* Added to dictionary. */
+        }
+    } else if (dst->type == OBJ_HASH) {
+        hashTypeIterator *hi = hashTypeInitIterator(src);
+
+        if (src->encoding == OBJ_ENCODING_HT &&
+            dst->encoding != OBJ_ENCODING_HT)
+            hashTypeConvert(dst,OBJ_ENCODING_HT);
+        while (hashTypeNext(hi) != C_ERR) {
+            robj *field = hashTypeCurrentObject(hi,OBJ_HASH_KEY);
+            robj *value = hashTypeCurrentObject(hi,OBJ_HASH_VALUE);
+
+            hashTypeSet(dst,field,value);
+            decrRefCount(field);
+            decrRefCount(value);
+        }
+        hashTypeReleaseIterator(hi);
+    } else {
+        serverPanic("Unknown object type");
+    }
+}
+
+/* RESTORE key ttl serialized-value [REPLACE | APPEND]
+ *
+ * The APPEND option adds the elements of the serialized aggregate value to
+ * the existing key, that must be of the same type. The TTL is ignored in
+ * this case. It is used by MIGRATE to transfer big values in parts. */
 void restoreCommand(client *c) {
     long long ttl;
     rio payload;
-    int j, type, replace = 0;
-    robj *obj;
+    int j, type, replace = 0, append = 0;
+    robj *obj, *existing;
 
     /* Parse additional options */
     for (j = 4; j < c->argc; j++) {
-        if (!strcasecmp(c->argv[j]->ptr,"replace")) {
+        if (!strcasecmp(c->argv[j]->ptr,"replace") && !append) {
             replace = 1;
+        } else if (!strcasecmp(c->argv[j]->ptr,"append") && !replace) {
+            append = 1;
         } else {
             addReply(c,shared.syntaxerr);
             return;
         }
     }
 
-    /* Make sure this key does not already exist here... */
-    if (!replace && lookupKeyWrite(c->db,c->argv[1]) != NULL) {
+    /* Make sure this key does not already exist here, or that it exists
+     * if we have to append to it. */
+    existing = lookupKeyWrite(c->db,c->argv[1]);
+    if (!replace && !append && existing != NULL) {
         addReply(c,shared.busykeyerr);
         return;
     }
+    if (append && existing == NULL) {
+        addReply(c,shared.nokeyerr);
+        return;
+    }
 
     /* Check if the TTL value makes sense */
     if (getLongLongFromObjectOrReply(c,c->argv[2],&ttl,NULL) != C_OK) {
@@ -4520,6 +4746,20 @@ void restoreCommand(client *c) {
         return;
     }
 
+    if (append) {
+        if (obj->type != existing->type || obj->type == OBJ_STRING) {
+            decrRefCount(obj);
+            addReply(c,shared.wrongtypeerr);
+            return;
+        }
+        restoreAppendElements(existing,obj);
+        decrRefCount(obj);
+        signalModifiedKey(c->db,c->argv[1]);
+        addReply(c,shared.ok);
+        server.dirty++;
+        return;
+    }
+
     /* Remove the old key if needed. */
     if (replace) dbDelete(c->db,c->argv[1]);
 
@@ -4648,11 +4888,94 @@ void migrateCloseTimedoutSockets(void) {
     dictReleaseIterator(di);
 }
 
+/* Write 'buf' to the target instance in 64K chunks. Returns C_OK on success,
+ * or C_ERR on write error or timeout. */
+static int migrateWriteBuffer(int fd, sds buf, long timeout) {
+    size_t pos = 0, towrite;
+    int nwritten = 0;
+
+    while ((towrite = sdslen(buf)-pos) > 0) {
+        towrite = (towrite > (64*1024) ? (64*1024) : towrite);
+        nwritten = syncWrite(fd,buf+pos,towrite,timeout);
+        if (nwritten != (signed)towrite) return C_ERR;
+        pos += nwritten;
+    }
+    return C_OK;
+}
+
+/* Delete from the target instance the keys of big values whose transfer
+ * was interrupted after their first part was accepted: otherwise the target
+ * would be left with a truncated value, and retrying the MIGRATE would fail
+ * with BUSYKEY. The connection 'fd' is used if it is still in sync with
+ * the target, otherwise pass -1 and a new connection is created just for
+ * this. No reply is sent to the client. Returns C_OK if every DEL was
+ * acknowledged. */
+static int migrateDeletePartialKeys(client *c, int fd, long dbid,
+                                    robj **keys, int numkeys, long timeout)
+{
+    int j, replies = 1, newfd = (fd == -1), retval = C_OK;
+    char buf[1024];
+    rio cmd;
+
+    if (newfd) {
+        fd = anetTcpNonBlockConnect(server.neterr,c->argv[1]->ptr,
+                                    atoi(c->argv[2]->ptr));
+        if (fd == -1) return C_ERR;
+        anetEnableTcpNoDelay(server.neterr,fd);
+        if ((aeWait(fd,AE_WRITABLE,timeout) & AE_WRITABLE) == 0) {
+            close(fd);
+            return C_ERR;
+        }
+    }
+
+    /* The target slots may still be importing, so in cluster mode every DEL
+     * is preceded by ASKING, like RESTORE-ASKING is used for the transfer. */
+    rioInitWithBuffer(&cmd,sdsempty());
+    serverAssertWithInfo(c,NULL,rioWriteBulkCount(&cmd,'*',2));
+    serverAssertWithInfo(c,NULL,rioWriteBulkString(&cmd,"SELECT",6));
+    serverAssertWithInfo(c,NULL,rioWriteBulkLongLong(&cmd,dbid));
+    for (j = 0; j < numkeys; j++) {
+        if (server.cluster_enabled) {
+            serverAssertWithInfo(c,NULL,rioWriteBulkCount(&cmd,'*',1));
+            serverAssertWithInfo(c,NULL,rioWriteBulkString(&cmd,"ASKING",6));
+            replies++;
+        }
+        serverAssertWithInfo(c,NULL,rioWriteBulkCount(&cmd,'*',2));
+        serverAssertWithInfo(c,NULL,rioWriteBulkString(&cmd,"DEL",3));
+        serverAssertWithInfo(c,NULL,rioWriteBulkString(&cmd,keys[j]->ptr,
+                sdslen(keys[j]->ptr)));
+        replies++;
+    }
+
+    if (migrateWriteBuffer(fd,cmd.io.buffer.ptr,timeout) == C_ERR) {
+        retval = C_ERR;
+    } else {
+        while (replies--) {
+            if (syncReadLine(fd,buf,sizeof(buf),timeout) <= 0) {
+                retval = C_ERR;
+                break;
+            }
+            if (buf[0] == '-') retval = C_ERR;
+        }
+    }
+    sdsfree(cmd.io.buffer.ptr);
+    if (newfd) close(fd);
+    return retval;
+}
+
 /* MIGRATE host port key dbid timeout [COPY | REPLACE]
  *
  * On in the multiple keys form:
  *
- * MIGRATE host port "" dbid timeout [COPY | REPLACE] KEYS key1 key2 ... keyN */
+ * MIGRATE host port "" dbid timeout [COPY | REPLACE] KEYS key1 key2 ... keyN
+ *
+ * All the keys are transferred with a single pipeline of RESTORE commands.
+ * Big aggregate values are split into parts (see dumpPartsNext()): only the
+ * first part is sent in the pipeline. Once it was accepted, the other parts
+ * are serialized and sent as RESTORE ... APPEND commands one at a time, each
+ * one only after the previous one was acknowledged, so that neither side
+ * ever has to hold or load a huge value at once, and an existing key on the
+ * target is never modified without REPLACE. */
 void migrateCommand(client *c) {
     migrateCachedSocket *cs;
     int copy, replace, j;
@@ -4661,6 +4984,8 @@ void migrateCommand(client *c) {
     robj **ov = NULL; /* Objects to migrate. */
     robj **kv = NULL; /* Key names. */
     robj **newargv = NULL; /* Used to rewrite the command as DEL ... keys ... */
+    dumpParts **cursors = NULL; /* Big values with parts still to send. */
+    char *partial = NULL; /* Values only partially transferred so far. */
     rio cmd, payload;
     int may_retry = 1;
     int write_error = 0;
@@ -4725,6 +5050,8 @@ void migrateCommand(client *c) {
         addReplySds(c,sdsnew("+NOKEY\r\n"));
         return;
     }
+    cursors = zcalloc(sizeof(dumpParts*)*num_keys);
+    partial = zmalloc(num_keys);
 
 try_again:
     write_error = 0;
@@ -4732,9 +5059,10 @@ try_again:
     /* Connect */
     cs = migrateGetSocket(c,c->argv[1],c->argv[2],timeout);
     if (cs == NULL) {
-        zfree(ov); zfree(kv);
+        zfree(ov); zfree(kv); zfree(cursors); zfree(partial);
         return; /* error sent to the client by migrateGetSocket() */
     }
+    memset(partial,0,num_keys);
 
     rioInitWithBuffer(&cmd,sdsempty());
 
@@ -4767,8 +5095,14 @@ try_again:
         serverAssertWithInfo(c,NULL,rioWriteBulkLongLong(&cmd,ttl));
 
         /* Emit the payload argument, that is the serialized object using
-         * the DUMP format. */
-        createDumpPayload(&payload,ov[j]);
+         * the DUMP format. Big values are split, and only the first part
+         * is serialized and sent now: the cursor remembers where to resume
+         * once it was accepted. */
+        if ((cursors[j] = dumpPartsCreate(ov[j])) == NULL) {
+            createDumpPayload(&payload,ov[j]);
+        } else {
+            rioInitWithBuffer(&payload,dumpPartsNext(cursors[j]));
+        }
         serverAssertWithInfo(c,NULL,
             rioWriteBulkString(&cmd,payload.io.buffer.ptr,
                                sdslen(payload.io.buffer.ptr)));
@@ -4782,20 +5116,9 @@ try_again:
 
     /* Transfer the query to the other node in 64K chunks. */
     errno = 0;
-    {
-        sds buf = cmd.io.buffer.ptr;
-        size_t pos = 0, towrite;
-        int nwritten = 0;
-
-        while ((towrite = sdslen(buf)-pos) > 0) {
-            towrite = (towrite > (64*1024) ? (64*1024) : towrite);
-            nwritten = syncWrite(cs->fd,buf+pos,towrite,timeout);
-            if (nwritten != (signed)towrite) {
-                write_error = 1;
-                goto socket_err;
-            }
-            pos += nwritten;
-        }
+    if (migrateWriteBuffer(cs->fd,cmd.io.buffer.ptr,timeout) == C_ERR) {
+        write_error = 1;
+        goto socket_err;
     }
 
     char buf1[1024]; /* Select reply. */
@@ -4825,7 +5148,10 @@ try_again:
                     (select && buf1[0] == '-') ? buf1+1 : buf2+1);
                 error_from_target = 1;
             }
-        } else {
+            /* Don't send the other parts of a value that was refused. */
+            dumpPartsRelease(cursors[j]);
+            cursors[j] = NULL;
+        } else if (cursors[j] == NULL) {
             if (!copy) {
                 /* No COPY option: remove the local key, signal the change. */
                 dbDelete(c->db,kv[j]);
@@ -4836,9 +5162,22 @@ try_again:
                 newargv[del_idx++] = kv[j];
                 incrRefCount(kv[j]);
             }
+        } else {
+            /* The target has the first part of the value: it must be
+             * removed there if the other parts can't be transferred. */
+            partial[j] = 1;
         }
     }
 
+    /* Values whose first reply was not read because of a socket error may
+     * be partially on the target as well. With REPLACE they are removed
+     * too, otherwise we can't tell them from keys the target already had. */
+    if (socket_error && replace) {
+        int k;
+
+        for (k = j; k < num_keys; k++) if (cursors[k]) partial[k] = 1;
+    }
+
     /* On socket error, if we want to retry, do it now before rewriting the
      * command vector. We only retry if we are sure nothing was processed
      * and we failed to read the first reply (j == 0 test). */
@@ -4848,11 +5187,91 @@ try_again:
         goto socket_err; /* A retry is guaranteed because of tested conditions.*/
     }
 
+    /* Send the remaining parts of the big values whose first part was
+     * accepted, and remove the keys once all their parts are acknowledged.
+     * Every part is serialized only after the previous one was accepted, so
+     * just one part at a time is held in memory. From now on we can't
+     * retry, since the target was already modified. */
+    for (j = 0; j < num_keys && !socket_error; j++) {
+        int part_error = 0;
+        sds part;
+
+        if (cursors[j] == NULL) continue;
+        while (!part_error && (part = dumpPartsNext(cursors[j])) != NULL) {
+            rio append;
+
+            rioInitWithBuffer(&append,sdsempty());
+            serverAssertWithInfo(c,NULL,rioWriteBulkCount(&append,'*',5));
+            if (server.cluster_enabled)
+                serverAssertWithInfo(c,NULL,
+                    rioWriteBulkString(&append,"RESTORE-ASKING",14));
+            else
+                serverAssertWithInfo(c,NULL,
+                    rioWriteBulkString(&append,"RESTORE",7));
+            serverAssertWithInfo(c,NULL,rioWriteBulkString(&append,
+                kv[j]->ptr,sdslen(kv[j]->ptr)));
+            serverAssertWithInfo(c,NULL,rioWriteBulkLongLong(&append,0));
+            serverAssertWithInfo(c,NULL,
+                rioWriteBulkString(&append,part,sdslen(part)));
+            serverAssertWithInfo(c,NULL,
+                rioWriteBulkString(&append,"APPEND",6));
+            sdsfree(part);
+
+            if (migrateWriteBuffer(cs->fd,append.io.buffer.ptr,timeout)
+                == C_ERR)
+            {
+                write_error = 1;
+                socket_error = 1;
+            } else if (syncReadLine(cs->fd,buf2,sizeof(buf2),timeout) <= 0) {
+                socket_error = 1;
+            } else if (buf2[0] == '-') {
+                part_error = 1;
+                if (!error_from_target) {
+                    cs->last_dbid = -1;
+                    addReplyErrorFormat(c,
+                        "Target instance replied with error: %s",buf2+1);
+                    error_from_target = 1;
+                }
+            }
+            sdsfree(append.io.buffer.ptr);
+            if (socket_error) break;
+        }
+        if (!socket_error && !part_error) {
+            partial[j] = 0;
+            if (!copy) {
+                dbDelete(c->db,kv[j]);
+                signalModifiedKey(c->db,kv[j]);
+                server.dirty++;
+                newargv[del_idx++] = kv[j];
+                incrRefCount(kv[j]);
+            }
+        }
+    }
+
     /* On socket errors, close the migration socket now that we still have
      * the original host/port in the ARGV. Later the original command may be
      * rewritten to DEL and will be too later. */
     if (socket_error) migrateCloseSocket(c->argv[1],c->argv[2]);
 
+    /* Remove the values the target only got in part: the local keys were
+     * not deleted, so the MIGRATE can be retried. The socket is reused if
+     * all the replies were read, otherwise a new connection is needed. */
+    if (memchr(partial,1,num_keys) != NULL) {
+        robj **pkeys = zmalloc(sizeof(robj*)*num_keys);
+        int numpartial = 0;
+
+        for (j = 0; j < num_keys; j++)
+            if (partial[j]) pkeys[numpartial++] = kv[j];
+        if (migrateDeletePartialKeys(c,socket_error ? -1 : cs->fd,dbid,
+                                     pkeys,numpartial,timeout) == C_ERR)
+        {
+            serverLog(LL_WARNING,
+                "MIGRATE: the target may keep a partial copy of %d key(s) "
+                "whose transfer failed", numpartial);
+        }
+        zfree(pkeys);
+    }
+
     if (!copy) {
         /* Translate MIGRATE as DEL for replication/AOF. Note that we do
          * this only for the keys for which we received an acknowledgement
@@ -4892,7 +5311,8 @@ try_again:
     }
 
     sdsfree(cmd.io.buffer.ptr);
-    zfree(ov); zfree(kv); zfree(newargv);
+    for (j = 0; j < num_keys; j++) dumpPartsRelease(cursors[j]);
+    zfree(ov); zfree(kv); zfree(newargv); zfree(cursors); zfree(partial);
     return;
 
 /* On socket errors we try to close the cached socket and try again.
@@ -4902,6 +5322,10 @@ socket_err:
     /* Cleanup we want to perform in both the retry and no retry case.
      * Note: Closing the migrate socket will also force SELECT next time. */
     sdsfree(cmd.io.buffer.ptr);
+    for (j = 0; j < num_keys; j++) {
+        dumpPartsRelease(cursors[j]);
+        cursors[j] = NULL;
+    }
 
     /* If the command was rewritten as DEL and there was a socket error,
      * we already closed the socket earlier. While migrateCloseSocket()
@@ -4919,7 +5343,7 @@ socket_err:
     }
 
     /* Cleanup we want to do if no retry is attempted. */
-    zfree(ov); zfree(kv);
+    zfree(ov); zfree(kv); zfree(cursors); zfree(partial);
     addReplySds(c,
         sdscatprintf(sdsempty(),
             "-IOERR error or timeout %s to target instance\r\n",
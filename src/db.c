@@ -33,35 +33,69 @@
 #include <signal.h>
 #include <ctype.h>
 
-void slotToKeyAdd(robj *key);
-void slotToKeyDel(robj *key);
-void slotToKeyFlush(void);
+static int expireIfNeededGeneric(redisDb *db, robj *key, long long when);
 
 /*-----------------------------------------------------------------------------
  * C-level DB API
  *----------------------------------------------------------------------------*/
 
+/* Create the main and the expires dictionaries of a DB, using the layouts
+ * selected by keyspace-grouped-buckets and keyspace-embedded-expires, the
+ * expiry index if active-expire-index is enabled, and reset its volatile
+ * keys count. The previous ones, if any, must have been detached or
+ * released by the caller. */
+void dbCreateDicts(redisDb *db) {
+    dict *(*create)(dictType*,void*) = server.keyspace_grouped_buckets ?
+                                        dictCreateGrouped : dictCreate;
+
+    db->dict = create(&dbDictType,NULL);
+    if (server.keyspace_embedded_expires) {
+        dictSetMetadataSize(db->dict,sizeof(dbEntryMeta));
+        db->expires = NULL;
+    } else {
+        db->expires = create(&keyptrDictType,NULL);
+    }
+    db->volatile_count = 0;
+    db->expiry_index = server.active_expire_index ? expireIdxCreate() : NULL;
+}
+
+/* Update LFU when an object is accessed.
+ * Firstly, decrement the counter if the decrement time is reached.
+ * Then logarithmically increment the counter, and update the access time. */
+void updateLFU(robj *val) {
+    unsigned long counter = LFUDecrAndReturn(val);
+    counter = LFULogIncr(counter);
+    val->lru = (LFUGetTimeInMinutes()<<8) | counter;
+}
+
+/* Return the value of the key stored at the db->dict entry 'de', updating
+ * its access time according to 'flags'. */
+static robj *lookupKeyByEntry(dictEntry *de, int flags) {
+    robj *val = dictGetVal(de);
+
+    /* Update the access time for the ageing algorithm.
+     * Don't do it if we have a saving child, as this will trigger
+     * a copy on write madness. */
+    if (server.rdb_child_pid == -1 &&
+        server.aof_child_pid == -1 &&
+        !(flags & LOOKUP_NOTOUCH))
+    {
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+            updateLFU(val);
+        } else {
+            val->lru = LRU_CLOCK();
+        }
+    }
+    return val;
+}
+
 /* Low level key lookup API, not actually called directly from commands
  * implementations that should instead rely on lookupKeyRead(),
  * lookupKeyWrite() and lookupKeyReadWithFlags(). */
 robj *lookupKey(redisDb *db, robj *key, int flags) {
     dictEntry *de = dictFind(db->dict,key->ptr);
-    if (de) {
-        robj *val = dictGetVal(de);
-
-        /* Update the access time for the ageing algorithm.
-         * Don't do it if we have a saving child, as this will trigger
-         * a copy on write madness. */
-        if (server.rdb_child_pid == -1 &&
-            server.aof_child_pid == -1 &&
-            !(flags & LOOKUP_NOTOUCH))
-        {
-            val->lru = LRU_CLOCK();
-        }
-        return val;
-    } else {
-        return NULL;
-    }
+
+    return de ? lookupKeyByEntry(de,flags) : NULL;
 }
 
 /* Lookup a key for read operations, or return NULL if the key is not found
@@ -86,9 +120,12 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
  * correctly report a key is expired on slaves even if the master is lagging
  * expiring our key via DELs in the replication link. */
 robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags) {
+    dictEntry *de = dictFind(db->dict,key->ptr);
     robj *val;
 
-    if (expireIfNeeded(db,key) == 1) {
+    /* The expire is checked against the entry just found: with embedded
+     * expires this takes no additional lookup. */
+    if (de && expireIfNeededGeneric(db,key,getEntryExpire(db,de)) == 1) {
         /* Key expired. If we are in the context of a master, expireIfNeeded()
          * returns 0 only when the key does not exist at all, so it's safe
          * to return NULL ASAP. */
@@ -114,7 +151,7 @@ robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags) {
             return NULL;
         }
     }
-    val = lookupKey(db,key,flags);
+    val = de ? lookupKeyByEntry(de,flags) : NULL;
     if (val == NULL)
         server.stat_keyspace_misses++;  // 如果没有找到，misses+1
     else
@@ -134,8 +171,13 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  * Returns the linked value object if the key exists or NULL if the key
  * does not exist in the specified DB. */
 robj *lookupKeyWrite(redisDb *db, robj *key) {
-    expireIfNeeded(db,key);
-    return lookupKey(db,key,LOOKUP_NONE);
+    dictEntry *de = dictFind(db->dict,key->ptr);
+
+    /* Like in lookupKeyReadWithFlags(), when an expired key is found in the
+     * context of a master it was just deleted, while slaves return it. */
+    if (de && expireIfNeededGeneric(db,key,getEntryExpire(db,de)) == 1 &&
+        server.masterhost == NULL) return NULL;
+    return de ? lookupKeyByEntry(de,LOOKUP_NONE) : NULL;
 }
 
 robj *lookupKeyReadOrReply(client *c, robj *key, robj *reply) {
@@ -160,7 +202,7 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
 
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
     if (val->type == OBJ_LIST) signalListAsReady(db, key);
-    if (server.cluster_enabled) slotToKeyAdd(key);
+    if (server.cluster_enabled) slotToKeyAdd(copy);
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
@@ -170,9 +212,18 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  * The program is aborted if the key was not already present. */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict,key->ptr);
+    robj *old;
 
     serverAssertWithInfo(NULL,key,de != NULL);
-    dictReplace(db->dict, key->ptr, val);
+    old = dictGetVal(de);
+    /* The new value inherits the access frequency of the old one, so
+     * that overwriting a hot key does not make it a candidate for eviction. */
+    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) val->lru = old->lru;
+    dictSetVal(db->dict, de, val);
+    if (server.lazyfree_lazy_server_del)
+        freeObjAsync(old);
+    else
+        decrRefCount(old);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -213,7 +264,7 @@ robj *dbRandomKey(redisDb *db) {
 
         key = dictGetKey(de);
         keyobj = createStringObject(key,sdslen(key));
-        if (dictFind(db->expires,key)) {
+        if (getEntryExpire(db,de) != -1) {
             if (expireIfNeeded(db,keyobj)) {    // 如果key已经过期了，再换一个
                 decrRefCount(keyobj);
                 continue; /* search for another key. This expired. */
@@ -224,18 +275,27 @@ robj *dbRandomKey(redisDb *db) {
 }
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
-int dbDelete(redisDb *db, robj *key) {
+int dbSyncDelete(redisDb *db, robj *key) {
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);    // 删除过期信息
+    dbDeleteExpire(db,key->ptr);    // 删除过期信息
+    /* The slots map references the sds of the main dictionary as well, so
+     * it must be updated before the key is freed. */
+    if (server.cluster_enabled) slotToKeyDel(key);
     if (dictDelete(db->dict,key->ptr) == DICT_OK) { // 删除key
-        if (server.cluster_enabled) slotToKeyDel(key);
         return 1;
     } else {
         return 0;
     }
 }
 
+/* This is a wrapper whose behavior depends on the Redis lazy free
+ * configuration. Deletes the key synchronously or asynchronously. */
+int dbDelete(redisDb *db, robj *key) {
+    return server.lazyfree_lazy_server_del ? dbAsyncDelete(db,key) :
+                                             dbSyncDelete(db,key);
+}
+
 /* Prepare the string object stored at 'key' to be modified destructively
  * to implement commands like SETBIT or APPEND.
  *
@@ -274,17 +334,35 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     return o;
 }
 
+/* Remove all keys from all the databases in a Redis server.
+ * If callback is given the function is called from time to time to
+ * signal that work is in progress.
+ *
+ * The flags may be EMPTYDB_NO_FLAGS if no special flags are specified or
+ * EMPTYDB_ASYNC if we want the memory to be freed in a different thread.
+ *
+ * The function returns the number of keys removed from the database(s). */
 // 清空所有db中的数据
-long long emptyDb(void(callback)(void*)) {
-    int j;
+long long emptyDb(int flags, void(callback)(void*)) {
+    int j, async = (flags & EMPTYDB_ASYNC);
     long long removed = 0;
 
     for (j = 0; j < server.dbnum; j++) {    // 轮训所有db
         removed += dictSize(server.db[j].dict);
-        dictEmpty(server.db[j].dict,callback);  // 清空db
-        dictEmpty(server.db[j].expires,callback);   // 清空过期信息
+        if (async) {
+            emptyDbAsync(&server.db[j]);
+        } else {
+            dictEmpty(server.db[j].dict,callback);  // 清空db
+            dbEmptyExpires(&server.db[j],callback);   // 清空过期信息
+        }
+    }
+    if (server.cluster_enabled) {   // 如果是集群模式，还需要清空key和slot的对应关系
+        if (async) {
+            slotToKeyFlushAsync();
+        } else {
+            slotToKeyFlush();
+        }
     }
-    if (server.cluster_enabled) slotToKeyFlush();   // 如果是集群模式，还需要清空key和slot的对应关系
     return removed;
 }
 
@@ -320,18 +398,57 @@ void signalFlushedDb(int dbid) {
  *----------------------------------------------------------------------------*/
 // 下面是对redis的各种操作
 
+/* Return the set of flags to use for the emptyDb() call for FLUSHALL
+ * and FLUSHDB commands.
+ *
+ * Currently the command just attempts to parse the "ASYNC" option. It
+ * also checks if the command arity is wrong.
+ *
+ * On success C_OK is returned and the flags are stored in *flags, otherwise
+ * C_ERR is returned and the function sends an error to the client. */
+int getFlushCommandFlags(client *c, int *flags) {
+    /* Parse the optional ASYNC option. */
+    if (c->argc > 1) {
+        if (c->argc > 2 || strcasecmp(c->argv[1]->ptr,"async")) {
+            addReply(c,shared.syntaxerr);
+            return C_ERR;
+        }
+        *flags = EMPTYDB_ASYNC;
+    } else {
+        *flags = EMPTYDB_NO_FLAGS;
+    }
+    return C_OK;
+}
+
+/* FLUSHDB [ASYNC]
+ *
+ * Flushes the currently SELECTed Redis DB. */
 void flushdbCommand(client *c) {
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     server.dirty += dictSize(c->db->dict);  // 从上次save，db的改变次数
     signalFlushedDb(c->db->id);
-    dictEmpty(c->db->dict,NULL);    // 清空db数据
-    dictEmpty(c->db->expires,NULL);    // 清空db过期相关信息
-    if (server.cluster_enabled) slotToKeyFlush();   // 如果是集群模式，还要清空key和slot的对应关系
+    if (flags & EMPTYDB_ASYNC) {
+        emptyDbAsync(c->db);
+        if (server.cluster_enabled) slotToKeyFlushAsync();
+    } else {
+        dictEmpty(c->db->dict,NULL);    // 清空db数据
+        dbEmptyExpires(c->db,NULL);    // 清空db过期相关信息
+        if (server.cluster_enabled) slotToKeyFlush();   // 如果是集群模式，还要清空key和slot的对应关系
+    }
     addReply(c,shared.ok);
 }
 
+/* FLUSHALL [ASYNC]
+ *
+ * Flushes the whole server data set. */
 void flushallCommand(client *c) {
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     signalFlushedDb(-1);    // -1代码所有的db
-    server.dirty += emptyDb(NULL);  // 从上次save，db的改变次数
+    server.dirty += emptyDb(flags,NULL);  // 从上次save，db的改变次数
     addReply(c,shared.ok);
     if (server.rdb_child_pid != -1) {
         kill(server.rdb_child_pid,SIGUSR1); // 杀掉rdb save操作的子进程
@@ -349,12 +466,15 @@ void flushallCommand(client *c) {
     server.dirty++;
 }
 
-void delCommand(client *c) {
+/* This command implements DEL and UNLINK. */
+void delGenericCommand(client *c, int lazy) {
     int deleted = 0, j;
 
     for (j = 1; j < c->argc; j++) { // 轮训删除客户端给到的key
         expireIfNeeded(c->db,c->argv[j]);   // 如果key过期的话执行过期操作
-        if (dbDelete(c->db,c->argv[j])) {
+        int deleted_key = lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                                 dbSyncDelete(c->db,c->argv[j]);
+        if (deleted_key) {
             signalModifiedKey(c->db,c->argv[j]);
             notifyKeyspaceEvent(NOTIFY_GENERIC,
                 "del",c->argv[j],c->db->id);
@@ -365,6 +485,15 @@ void delCommand(client *c) {
     addReplyLongLong(c,deleted);
 }
 
+void delCommand(client *c) {
+    delGenericCommand(c,0);
+}
+
+// 和DEL一样，但是value的内存在后台线程中释放
+void unlinkCommand(client *c) {
+    delGenericCommand(c,1);
+}
+
 /* EXISTS key1 key2 ... key_N.
  * Return value is the number of keys existing. */
 void existsCommand(client *c) { // 返回客户端给到的key列表中存在的key的数量
@@ -416,14 +545,16 @@ void keysCommand(client *c) {
     int plen = sdslen(pattern), allkeys;
     unsigned long numkeys = 0;
     void *replylen = addDeferredMultiBulkLength(c);
+    stringmatcher *matcher;
 
     di = dictGetSafeIterator(c->db->dict);
     allkeys = (pattern[0] == '*' && pattern[1] == '\0');
+    matcher = stringmatcherCompile(pattern,plen,0);
     while((de = dictNext(di)) != NULL) {
         sds key = dictGetKey(de);
         robj *keyobj;
 
-        if (allkeys || stringmatchlen(pattern,plen,key,sdslen(key),0)) {
+        if (allkeys || stringmatcherMatch(matcher,key,sdslen(key))) {
             keyobj = createStringObject(key,sdslen(key));
             if (expireIfNeeded(c->db,keyobj) == 0) {
                 addReplyBulk(c,keyobj);
@@ -433,6 +564,7 @@ void keysCommand(client *c) {
         }
     }
     dictReleaseIterator(di);
+    stringmatcherFree(matcher);
     setDeferredMultiBulkLength(c,replylen,numkeys);
 }
 
@@ -504,6 +636,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     long count = 10;
     sds pat = NULL;
     int patlen = 0, use_pattern = 0;
+    stringmatcher *matcher = NULL;
     dict *ht;
 
     /* Object must be NULL (to iterate keys names), or the type of the object
@@ -545,9 +678,13 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
         }
     }
 
+    /* The pattern is compiled once, since it is matched against every
+     * element returned by the iteration. */
+    if (use_pattern) matcher = stringmatcherCompile(pat,patlen,0);
+
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
@@ -594,17 +731,17 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
     } else if (o->type == OBJ_HASH || o->type == OBJ_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        unsigned char *p = lpFirst(o->ptr);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            vstr = lpGetValue(p,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
@@ -621,7 +758,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
         /* Filter element if it does not match the pattern. */
         if (!filter && use_pattern) {
             if (sdsEncodedObject(kobj)) {
-                if (!stringmatchlen(pat, patlen, kobj->ptr, sdslen(kobj->ptr), 0))
+                if (!stringmatcherMatch(matcher, kobj->ptr, sdslen(kobj->ptr)))
                     filter = 1;
             } else {
                 char buf[LONG_STR_SIZE];
@@ -629,7 +766,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
 
                 serverAssert(kobj->encoding == OBJ_ENCODING_INT);
                 len = ll2string(buf,sizeof(buf),(long)kobj->ptr);
-                if (!stringmatchlen(pat, patlen, buf, len, 0)) filter = 1;
+                if (!stringmatcherMatch(matcher, buf, len)) filter = 1;
             }
         }
 
@@ -670,6 +807,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     }
 
 cleanup:
+    if (matcher) stringmatcherFree(matcher);
     listSetFreeMethod(keys,decrRefCountVoid);
     listRelease(keys);
 }
@@ -850,21 +988,81 @@ void moveCommand(client *c) {
  * Expires API
  *----------------------------------------------------------------------------*/
 
+/* With keyspace-embedded-expires the DB has no expires dict: the expire
+ * time of every key is stored in the 8 bytes of metadata of its db->dict
+ * entry, zero meaning no expire, and only the number of volatile keys is
+ * tracked. Active expiry and the volatile-* eviction policies find volatile
+ * keys by sampling db->dict, see dbRandomVolatileKey(). */
+#define dbGetEntryMeta(db,de) ((dbEntryMeta*)dictMetadata((db)->dict,(de)))
+
+/* Clear the embedded expire of the key at the db->dict entry 'de'. Returns
+ * 1 if the key was volatile, otherwise 0. */
+static int dbClearEntryExpire(redisDb *db, dictEntry *de) {
+    dbEntryMeta *meta = dbGetEntryMeta(db,de);
+
+    if (meta->expire == 0) return 0;
+    meta->expire = 0;
+    db->volatile_count--;
+    return 1;
+}
+
+/* Remove the key at the db->dict entry 'de' from the expiry index, if the
+ * DB has one and the key has an expire. */
+static void dbUnindexExpire(redisDb *db, dictEntry *de) {
+    long long when;
+
+    if (db->expiry_index && (when = getEntryExpire(db,de)) != -1)
+        expireIdxDelete(db->expiry_index,when,dictGetKey(de));
+}
+
 int removeExpire(redisDb *db, robj *key) {
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
-    serverAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictDelete(db->expires,key->ptr) == DICT_OK;
+    dictEntry *de = dictFind(db->dict,key->ptr);
+
+    serverAssertWithInfo(NULL,key,de != NULL);
+    dbUnindexExpire(db,de);
+    if (db->expires) return dictDelete(db->expires,key->ptr) == DICT_OK;
+    return dbClearEntryExpire(db,de);
 }
 
 void setExpire(redisDb *db, robj *key, long long when) {
     dictEntry *kde, *de;
+    dbEntryMeta *meta;
 
     /* Reuse the sds from the main dict in the expire dict */
     kde = dictFind(db->dict,key->ptr);
     serverAssertWithInfo(NULL,key,kde != NULL);
-    de = dictReplaceRaw(db->expires,dictGetKey(kde));
-    dictSetSignedIntegerVal(de,when);
+    if (db->expiry_index) {
+        dbUnindexExpire(db,kde);
+        expireIdxInsert(db->expiry_index,when,dictGetKey(kde));
+    }
+    if (db->expires) {
+        de = dictReplaceRaw(db->expires,dictGetKey(kde));
+        dictSetSignedIntegerVal(de,when);
+        return;
+    }
+
+    /* Embedded expires: zero means no expire, so an expire of exactly the
+     * Unix epoch is stored as 1 ms later, which is equally in the past. */
+    meta = dbGetEntryMeta(db,kde);
+    if (meta->expire == 0) db->volatile_count++;
+    meta->expire = when ? when : 1;
+}
+
+/* Return the expire time of the key stored at the db->dict entry 'de',
+ * or -1 if the key is non volatile. With embedded expires this does not
+ * take any additional lookup. */
+long long getEntryExpire(redisDb *db, dictEntry *de) {
+    dictEntry *ede;
+
+    if (db->expires == NULL) {
+        dbEntryMeta *meta = dbGetEntryMeta(db,de);
+        return meta->expire ? meta->expire : -1;
+    }
+    if (dictSize(db->expires) == 0 ||
+       (ede = dictFind(db->expires,dictGetKey(de))) == NULL) return -1;
+    return dictGetSignedIntegerVal(ede);
 }
 
 /* Return the expire time of the specified key, or -1 if no expire
@@ -873,6 +1071,12 @@ void setExpire(redisDb *db, robj *key, long long when) {
 long long getExpire(redisDb *db, robj *key) {
     dictEntry *de;
 
+    if (db->expires == NULL) {
+        if (db->volatile_count == 0 ||
+           (de = dictFind(db->dict,key->ptr)) == NULL) return -1;
+        return getEntryExpire(db,de);
+    }
+
     /* No expire? return ASAP */
     if (dictSize(db->expires) == 0 ||
        (de = dictFind(db->expires,key->ptr)) == NULL) return -1;
@@ -883,6 +1087,68 @@ long long getExpire(redisDb *db, robj *key) {
     return dictGetSignedIntegerVal(de);
 }
 
+/* Forget the expire of 'key' as part of its deletion from the DB. The key
+ * must still be in db->dict, since the sds is shared. */
+void dbDeleteExpire(redisDb *db, sds key) {
+    dictEntry *de;
+
+    if (db->expires) {
+        if (dictSize(db->expires) == 0) return;
+        if (db->expiry_index && (de = dictFind(db->dict,key)))
+            dbUnindexExpire(db,de);
+        dictDelete(db->expires,key);
+    } else if (db->volatile_count > 0 && (de = dictFind(db->dict,key))) {
+        dbUnindexExpire(db,de);
+        dbClearEntryExpire(db,de);
+    }
+}
+
+/* Remove all the expires of 'db', as part of emptying it. */
+void dbEmptyExpires(redisDb *db, void(callback)(void*)) {
+    if (db->expires) dictEmpty(db->expires,callback);
+    if (db->expiry_index) {
+        expireIdxRelease(db->expiry_index);
+        db->expiry_index = expireIdxCreate();
+    }
+    db->volatile_count = 0;
+}
+
+/* Return the number of keys with an expire set in 'db'. */
+unsigned long dbExpiresCount(redisDb *db) {
+    return db->expires ? dictSize(db->expires) : db->volatile_count;
+}
+
+/* Return a random volatile key of 'db', storing its expire time into
+ * '*when' if not NULL, or NULL if there are no volatile keys. The returned
+ * sds is the one owned by db->dict.
+ *
+ * With embedded expires random keys of db->dict are sampled until a
+ * volatile one is found, giving up after DB_VOLATILE_SAMPLE_TRIES keys:
+ * NULL may then be returned even if there are volatile keys, when only a
+ * small fraction of the keys have an expire. */
+#define DB_VOLATILE_SAMPLE_TRIES 64
+sds dbRandomVolatileKey(redisDb *db, long long *when) {
+    dictEntry *de;
+    int tries;
+
+    if (db->expires) {
+        if ((de = dictGetRandomKey(db->expires)) == NULL) return NULL;
+        if (when) *when = dictGetSignedIntegerVal(de);
+        return dictGetKey(de);
+    }
+    if (db->volatile_count == 0) return NULL;
+    for (tries = 0; tries < DB_VOLATILE_SAMPLE_TRIES; tries++) {
+        long long expire;
+
+        de = dictGetRandomKey(db->dict);
+        if ((expire = dbGetEntryMeta(db,de)->expire) != 0) {
+            if (when) *when = expire;
+            return dictGetKey(de);
+        }
+    }
+    return NULL;
+}
+
 /* Propagate expires into slaves and the AOF file.
  * When a key expires in the master, a DEL operation for this key is sent
  * to all the slaves and the AOF file if enabled.
@@ -909,8 +1175,9 @@ void propagateExpire(redisDb *db, robj *key) {
     decrRefCount(argv[1]);
 }
 
-int expireIfNeeded(redisDb *db, robj *key) {
-    mstime_t when = getExpire(db,key);
+/* Delete 'key' if its expire time 'when' is already elapsed, like
+ * expireIfNeeded() does, for callers that already know the expire. */
+static int expireIfNeededGeneric(redisDb *db, robj *key, long long when) {
     mstime_t now;
 
     if (when < 0) return 0; /* No expire for this key */    // key不过期
@@ -943,7 +1210,12 @@ int expireIfNeeded(redisDb *db, robj *key) {
     propagateExpire(db,key);
     notifyKeyspaceEvent(NOTIFY_EXPIRED,
         "expired",key,db->id);
-    return dbDelete(db,key);    // 删除key
+    return server.lazyfree_lazy_expire ? dbAsyncDelete(db,key) :
+                                         dbSyncDelete(db,key);  // 删除key
+}
+
+int expireIfNeeded(redisDb *db, robj *key) {
+    return expireIfNeededGeneric(db,key,getExpire(db,key));
 }
 
 /*-----------------------------------------------------------------------------
@@ -1288,88 +1560,83 @@ int *georadiusGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numk
 
 /* Slot to Key API. This is used by Redis Cluster in order to obtain in
  * a fast way a key that belongs to a specified hash slot. This is useful
- * while rehashing the cluster. */
-void slotToKeyAdd(robj *key) {
-    unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+ * while rehashing the cluster.
+ *
+ * Every slot has its own dictionary, created the first time a key is added
+ * to the slot. The dictionaries reference the same sds strings used as keys
+ * by the main dictionary of the DB, so no additional copy of the key is
+ * needed: the entries must be removed before the key is deleted from the
+ * main dictionary, and the dictionaries have no destructors. */
+void slotToKeyAdd(sds key) {
+    unsigned int hashslot = keyHashSlot(key,sdslen(key));
+    dict **slots = server.cluster->slots_to_keys;
 
-    zslInsert(server.cluster->slots_to_keys,hashslot,key);
-    incrRefCount(key);
+    if (slots[hashslot] == NULL)
+        slots[hashslot] = dictCreate(&keyptrDictType,NULL);
+    dictAdd(slots[hashslot],key,NULL);
 }
 
 void slotToKeyDel(robj *key) {
     unsigned int hashslot = keyHashSlot(key->ptr,sdslen(key->ptr));
+    dict *d = server.cluster->slots_to_keys[hashslot];
 
-    zslDelete(server.cluster->slots_to_keys,hashslot,key);
+    if (d) dictDelete(d,key->ptr);
 }
 
-void slotToKeyFlush(void) {
-    zslFree(server.cluster->slots_to_keys);
-    server.cluster->slots_to_keys = zslCreate();
+/* Release the dictionaries of a slots map created by slotToKeyAdd(). */
+void slotToKeyFreeMap(dict **slots) {
+    int j;
+
+    for (j = 0; j < CLUSTER_SLOTS; j++)
+        if (slots[j]) dictRelease(slots[j]);
+    zfree(slots);
 }
 
-unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count) {
-    zskiplistNode *n;
-    zrangespec range;
-    int j = 0;
+void slotToKeyFlush(void) {
+    slotToKeyFreeMap(server.cluster->slots_to_keys);
+    server.cluster->slots_to_keys = zcalloc(sizeof(dict*)*CLUSTER_SLOTS);
+}
 
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
+/* Populate the 'keys' array with up to 'count' keys of the specified hash
+ * slot. The returned sds strings are owned by the keyspace, so they are only
+ * valid until the keys are modified. */
+unsigned int getKeysInSlot(unsigned int hashslot, sds *keys, unsigned int count) {
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictIterator *di;
+    dictEntry *de;
+    unsigned int j = 0;
 
-    n = zslFirstInRange(server.cluster->slots_to_keys, &range);
-    while(n && n->score == hashslot && count--) {
-        keys[j++] = n->obj;
-        n = n->level[0].forward;
-    }
+    if (d == NULL || count == 0) return 0;
+    di = dictGetIterator(d);
+    while(j < count && (de = dictNext(di)) != NULL)
+        keys[j++] = dictGetKey(de);
+    dictReleaseIterator(di);
     return j;
 }
 
 /* Remove all the keys in the specified hash slot.
  * The number of removed items is returned. */
 unsigned int delKeysInSlot(unsigned int hashslot) {
-    zskiplistNode *n;
-    zrangespec range;
-    int j = 0;
-
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
-
-    n = zslFirstInRange(server.cluster->slots_to_keys, &range);
-    while(n && n->score == hashslot) {
-        robj *key = n->obj;
-        n = n->level[0].forward; /* Go to the next item before freeing it. */
-        incrRefCount(key); /* Protect the object while freeing it. */
+    dict *d = server.cluster->slots_to_keys[hashslot];
+    dictIterator *di;
+    dictEntry *de;
+    unsigned int j = 0;
+
+    if (d == NULL) return 0;
+    di = dictGetSafeIterator(d);
+    while((de = dictNext(di)) != NULL) {
+        sds sdskey = dictGetKey(de);
+        robj *key = createStringObject(sdskey,sdslen(sdskey));
         dbDelete(&server.db[0],key);
         decrRefCount(key);
         j++;
     }
+    dictReleaseIterator(di);
     return j;
 }
 
 unsigned int countKeysInSlot(unsigned int hashslot) {
-    zskiplist *zsl = server.cluster->slots_to_keys;
-    zskiplistNode *zn;
-    zrangespec range;
-    int rank, count = 0;
-
-    range.min = range.max = hashslot;
-    range.minex = range.maxex = 0;
-
-    /* Find first element in range */
-    zn = zslFirstInRange(zsl, &range);
-
-    /* Use rank of first element, if any, to determine preliminary count */
-    if (zn != NULL) {
-        rank = zslGetRank(zsl, zn->score, zn->obj);
-        count = (zsl->length - (rank - 1));
+    dict *d = server.cluster->slots_to_keys[hashslot];
 
-        /* Find last element in range */
-        zn = zslLastInRange(zsl, &range);
-
-        /* Use rank of last element, if any, to determine the actual count */
-        if (zn != NULL) {
-            rank = zslGetRank(zsl, zn->score, zn->obj);
-            count -= (zsl->length - rank);
-        }
-    }
-    return count;
+    return d ? dictSize(d) : 0;
 }
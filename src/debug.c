@@ -149,7 +149,7 @@ void computeDatasetDigest(unsigned char *final) {
 
             aux = htonl(o->type);
             mixDigest(digest,&aux,sizeof(aux));
-            expiretime = getExpire(db,keyobj);
+            expiretime = getEntryExpire(db,de);
 
             /* Save the key and associated value */
             if (o->type == OBJ_STRING) {
@@ -174,7 +174,7 @@ void computeDatasetDigest(unsigned char *final) {
             } else if (o->type == OBJ_ZSET) {
                 unsigned char eledigest[20];
 
-                if (o->encoding == OBJ_ENCODING_ZIPLIST) {
+                if (o->encoding == OBJ_ENCODING_LISTPACK) {
                     unsigned char *zl = o->ptr;
                     unsigned char *eptr, *sptr;
                     unsigned char *vstr;
@@ -182,13 +182,13 @@ void computeDatasetDigest(unsigned char *final) {
                     long long vll;
                     double score;
 
-                    eptr = ziplistIndex(zl,0);
+                    eptr = lpSeek(zl,0);
                     serverAssert(eptr != NULL);
-                    sptr = ziplistNext(zl,eptr);
+                    sptr = lpNext(zl,eptr);
                     serverAssert(sptr != NULL);
 
                     while (eptr != NULL) {
-                        serverAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+                        vstr = lpGetValue(eptr,&vlen,&vll);
                         score = zzlGetScore(sptr);
 
                         memset(eledigest,0,20);
@@ -338,8 +338,8 @@ void debugCommand(client *c) {
             addReply(c,shared.err);
             return;
         }
-        emptyDb(NULL);
-        if (rdbLoad(server.rdb_filename) != C_OK) {
+        emptyDb(EMPTYDB_NO_FLAGS,NULL);
+        if (rdbLoad(server.rdb_filename,NULL) != C_OK) {
             addReplyError(c,"Error trying to load the RDB dump");
             return;
         }
@@ -347,7 +347,7 @@ void debugCommand(client *c) {
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"loadaof")) {
         if (server.aof_state == AOF_ON) flushAppendOnlyFile(1);
-        emptyDb(NULL);
+        emptyDb(EMPTYDB_NO_FLAGS,NULL);
         if (loadAppendOnlyFile(server.aof_filename) != C_OK) {
             addReply(c,shared.err);
             return;
@@ -381,8 +381,8 @@ void debugCommand(client *c) {
             used = snprintf(nextra, remaining, " ql_avg_node:%.2f", avg);
             nextra += used;
             remaining -= used;
-            /* Add quicklist fill level / max ziplist size */
-            used = snprintf(nextra, remaining, " ql_ziplist_max:%d", ql->fill);
+            /* Add quicklist fill level / max listpack size */
+            used = snprintf(nextra, remaining, " ql_listpack_max:%d", ql->fill);
             nextra += used;
             remaining -= used;
             /* Add isCompressed? */
@@ -517,9 +517,19 @@ void debugCommand(client *c) {
         dictGetStats(buf,sizeof(buf),server.db[dbid].dict);
         stats = sdscat(stats,buf);
 
-        stats = sdscatprintf(stats,"[Expires HT]\n");
-        dictGetStats(buf,sizeof(buf),server.db[dbid].expires);
-        stats = sdscat(stats,buf);
+        if (server.db[dbid].expires) {
+            stats = sdscatprintf(stats,"[Expires HT]\n");
+            dictGetStats(buf,sizeof(buf),server.db[dbid].expires);
+            stats = sdscat(stats,buf);
+        } else {
+            stats = sdscatprintf(stats,"[Embedded expires]\n"
+                " volatile keys: %lu\n", server.db[dbid].volatile_count);
+        }
+        if (server.db[dbid].expiry_index) {
+            stats = sdscatprintf(stats,"[Expiry index]\n"
+                " indexed keys: %lu\n",
+                expireIdxLength(server.db[dbid].expiry_index));
+        }
 
         addReplyBulkSds(c,stats);
     } else if (!strcasecmp(c->argv[1]->ptr,"jemalloc") && c->argc == 3) {
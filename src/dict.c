@@ -71,6 +71,41 @@ static unsigned long _dictNextPower(unsigned long size);    // 哈希表的容
 static int _dictKeyIndex(dict *ht, const void *key);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
 
+/* -------------------------- private types --------------------------------- */
+
+/* Entry of a chained table: the dictEntry returned to the user, followed by
+ * the link to the next entry of the same bucket, and by the entry metadata
+ * if the dict has any. Since the dictEntry is the first member, pointers to
+ * the two types can be converted freely. */
+typedef struct dictChainEntry {
+    dictEntry de;
+    struct dictChainEntry *next;
+} dictChainEntry;
+
+/* Bucket of a grouped table, see dictCreateGrouped(). The entries are stored
+ * inline, each with a one byte tag taken from the high bits of its hash, so
+ * that most of the entries not matching a lookup are skipped without
+ * touching their key. Free slots have a zero tag. When all the slots of a
+ * bucket are in use, further entries go into overflow groups, allocated on
+ * demand and released as soon as they are empty. Without entry metadata a
+ * group is exactly two cache lines on 64 bit systems. */
+typedef struct dictGroup {
+    uint8_t tags[DICT_GROUP_ENTRIES];
+    uint8_t used;               /* Number of slots in use. */
+    struct dictGroup *next;     /* Overflow group, or NULL. */
+    unsigned char slots[];      /* DICT_GROUP_ENTRIES entries, each one
+                                   followed by the entry metadata. */
+} dictGroup;
+
+#define _dictChainTable(ht) ((dictChainEntry**)(ht)->table)
+#define _dictSlotSize(d) (sizeof(dictEntry)+(d)->metasize)
+#define _dictGroupSize(d) \
+    (sizeof(dictGroup)+DICT_GROUP_ENTRIES*_dictSlotSize(d))
+#define _dictGroupEntry(d,g,j) \
+    ((dictEntry*)((g)->slots+(j)*_dictSlotSize(d)))
+#define _dictGroupBucket(d,ht,idx) \
+    ((dictGroup*)((char*)(ht)->table+(idx)*_dictGroupSize(d)))
+
 /* -------------------------- hash functions -------------------------------- */
 
 /* Thomas Wang's 32 bit Mix Function */
@@ -166,6 +201,177 @@ unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len) {
     return hash;
 }
 
+/* ------------------------- grouped tables --------------------------------- */
+
+/* Tag of an entry with hash 'h'. Never zero, that is the tag of free slots. */
+static inline uint8_t _dictGroupTag(unsigned int h) {
+    uint8_t tag = h >> 24;
+    return tag ? tag : 1;
+}
+
+/* Return non zero if one of the slots of the group may have the specified
+ * tag. The tags are compared all at once inside a 64 bit word, so groups
+ * without the tag, the common case, are skipped with a few instructions.
+ * The 'used' byte shares the word, so false positives are possible and the
+ * caller still has to check the single slots. */
+static inline int _dictGroupMayMatch(dictGroup *g, uint8_t tag) {
+    uint64_t word, x;
+
+    memcpy(&word,g->tags,sizeof(word));
+    x = word ^ (0x0101010101010101ULL * tag);
+    return ((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL) != 0;
+}
+
+/* Search 'key', having hash 'h', in the grouped table 'ht'. The table must
+ * be allocated. */
+static dictEntry *_dictGroupFind(dict *d, dictht *ht, const void *key,
+                                 unsigned int h)
+{
+    dictGroup *g = _dictGroupBucket(d,ht,h & ht->sizemask);
+    uint8_t tag = _dictGroupTag(h);
+    int j;
+
+    do {
+        if (_dictGroupMayMatch(g,tag)) {
+            for (j = 0; j < DICT_GROUP_ENTRIES; j++) {
+                dictEntry *he = _dictGroupEntry(d,g,j);
+
+                if (g->tags[j] == tag &&
+                    (key == he->key || dictCompareKeys(d, key, he->key)))
+                    return he;
+            }
+        }
+        g = g->next;
+    } while(g);
+    return NULL;
+}
+
+/* Take a free slot for an entry with hash 'h' in the grouped table 'ht',
+ * adding an overflow group to the bucket if it is full. The slot is marked
+ * as used and its metadata is zeroed, the caller has to fill the entry. */
+static dictEntry *_dictGroupTakeSlot(dict *d, dictht *ht, unsigned int h) {
+    dictEntry *de;
+    dictGroup *g = _dictGroupBucket(d,ht,h & ht->sizemask);
+    int j;
+
+    while(g->used == DICT_GROUP_ENTRIES) {
+        if (g->next == NULL) g->next = zcalloc(_dictGroupSize(d));
+        g = g->next;
+    }
+    for (j = 0; g->tags[j] != 0; j++);
+    g->tags[j] = _dictGroupTag(h);
+    g->used++;
+    ht->used++;
+    de = _dictGroupEntry(d,g,j);
+    if (d->metasize) memset(de+1,0,d->metasize);
+    return de;
+}
+
+/* Remove 'key', having hash 'h', from the grouped table 'ht'. The other
+ * entries are never moved, so dictEntry pointers to them, and the position
+ * of iterators, stay valid. */
+static int _dictGroupDelete(dict *d, dictht *ht, const void *key,
+                            unsigned int h, int nofree)
+{
+    dictGroup *g = _dictGroupBucket(d,ht,h & ht->sizemask), *prev = NULL;
+    uint8_t tag = _dictGroupTag(h);
+    int j;
+
+    do {
+        if (_dictGroupMayMatch(g,tag)) {
+            for (j = 0; j < DICT_GROUP_ENTRIES; j++) {
+                dictEntry *he = _dictGroupEntry(d,g,j);
+
+                if (g->tags[j] != tag ||
+                    !(key == he->key || dictCompareKeys(d, key, he->key)))
+                    continue;
+                if (!nofree) {
+                    dictFreeKey(d, he);
+                    dictFreeVal(d, he);
+                }
+                g->tags[j] = 0;
+                g->used--;
+                ht->used--;
+                /* The first group of the bucket is part of the table. */
+                if (g->used == 0 && prev) {
+                    prev->next = g->next;
+                    zfree(g);
+                }
+                return DICT_OK;
+            }
+        }
+        prev = g;
+        g = g->next;
+    } while(g);
+    return DICT_ERR;
+}
+
+/* Starting from the slot '*slot' of the group '*g', search the first slot in
+ * use of the bucket. If found it is returned and '*g' / '*slot' are updated
+ * to point to the slot after it, otherwise NULL is returned. */
+static dictEntry *_dictGroupSeek(dict *d, dictGroup **g, int *slot) {
+    dictGroup *cur = *g;
+    int j = *slot;
+
+    for (; cur; cur = cur->next, j = 0) {
+        if (cur->used == 0) continue;
+        for (; j < DICT_GROUP_ENTRIES; j++) {
+            if (cur->tags[j]) {
+                *g = cur;
+                *slot = j+1;
+                return _dictGroupEntry(d,cur,j);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Number of entries in the bucket starting with the group 'g'. */
+static unsigned long _dictGroupBucketLen(dictGroup *g) {
+    unsigned long len = 0;
+
+    for (; g; g = g->next) len += g->used;
+    return len;
+}
+
+/* Return a random entry of the non empty bucket starting with the group
+ * 'g'. */
+static dictEntry *_dictGroupRandomEntry(dict *d, dictGroup *g) {
+    unsigned long idx = random() % _dictGroupBucketLen(g);
+    int j;
+
+    while(idx >= g->used) {
+        idx -= g->used;
+        g = g->next;
+    }
+    for (j = 0; ; j++)
+        if (g->tags[j] && idx-- == 0) return _dictGroupEntry(d,g,j);
+}
+
+/* Release the overflow groups of the bucket starting with the group 'g' and
+ * mark all its slots as free. Only the group header is cleared, the content
+ * of free slots does not matter. */
+static void _dictGroupResetBucket(dictGroup *g) {
+    dictGroup *next = g->next;
+
+    memset(g,0,sizeof(*g));
+    while(next) {
+        dictGroup *tmp = next->next;
+
+        zfree(next);
+        next = tmp;
+    }
+}
+
+/* Return non zero if the bucket 'idx' of the table 'ht' has no entries. */
+static int _dictBucketIsEmpty(dict *d, dictht *ht, unsigned long idx) {
+    if (d->grouped) {
+        dictGroup *g = _dictGroupBucket(d,ht,idx);
+        return g->used == 0 && g->next == NULL;
+    }
+    return _dictChainTable(ht)[idx] == NULL;
+}
+
 /* ----------------------------- API implementation ------------------------- */
 
 /* Reset a hash table already initialized with ht_init().
@@ -190,6 +396,40 @@ dict *dictCreate(dictType *type,
     return d;
 }
 
+/* Create a new hash table storing the entries inline, in groups of
+ * DICT_GROUP_ENTRIES slots per bucket, instead of chaining entries allocated
+ * one by one. This saves an allocation and a pointer per entry, and most of
+ * the cache misses of lookups, so it is meant for big tables of small
+ * entries like the keyspace. The API is the same, however entries are moved
+ * when the table is rehashed, so a dictEntry pointer is only valid until the
+ * next call that may perform a rehashing step (add, find, delete, ...). */
+dict *dictCreateGrouped(dictType *type,
+        void *privDataPtr)
+{
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->grouped = 1;
+    return d;
+}
+
+/* Reserve 'size' bytes of metadata in every entry of the empty dict 'd'.
+ * The metadata of an entry is returned by dictMetadata(), is zeroed when the
+ * entry is added, and follows the entry when the dict is rehashed. The size
+ * must be a multiple of 8 so that the entries of grouped tables stay
+ * aligned. */
+void dictSetMetadataSize(dict *d, unsigned int size) {
+    assert(d->ht[0].table == NULL && size % 8 == 0);
+    d->metasize = size;
+}
+
+/* Return the metadata of the entry 'de' of the dict 'd'. Like the entry
+ * itself, for grouped dicts the pointer is only valid until the next call
+ * that may rehash the dict. */
+void *dictMetadata(dict *d, dictEntry *de) {
+    if (d->grouped) return (char*)de + sizeof(dictEntry);
+    return (char*)de + sizeof(dictChainEntry);
+}
+
 /* Initialize the hash table 
  * 初始化哈希表 */
 int _dictInit(dict *d, dictType *type,
@@ -201,6 +441,8 @@ int _dictInit(dict *d, dictType *type,
     d->privdata = privDataPtr;
     d->rehashidx = -1;  // dict默认没有做rehash操作
     d->iterators = 0;   // 迭代器数量初始化为0
+    d->grouped = 0;
+    d->metasize = 0;
     return DICT_OK; // 初始化成功，返回0
 }
 
@@ -224,7 +466,14 @@ int dictExpand(dict *d, unsigned long size)
 {
     dictht n; /* the new hash table */// 创建一个新的哈希表，用于替换旧的哈希表
     // 这里为了计算大于当然已使用的容量的最小2次幂，最为新的哈希表的容量
-    unsigned long realsize = _dictNextPower(size);
+    unsigned long realsize;
+
+    /* Grouped tables hold up to DICT_GROUP_MAX_FILL entries per bucket. */
+    if (d->grouped)
+        realsize = _dictNextPower(size/DICT_GROUP_MAX_FILL +
+                                  (size % DICT_GROUP_MAX_FILL != 0));
+    else
+        realsize = _dictNextPower(size);
 
     /* the size is invalid if it is smaller than the number of
      * elements already inside the hash table 
@@ -240,7 +489,8 @@ int dictExpand(dict *d, unsigned long size)
     // 为新的hash表分配空间
     n.size = realsize;
     n.sizemask = realsize-1;
-    n.table = zcalloc(realsize*sizeof(dictEntry*));
+    n.table = zcalloc(realsize*(d->grouped ? _dictGroupSize(d) :
+                                             sizeof(dictChainEntry*)));
     n.used = 0;
 
     /* Is this the first initialization? If so it's not really a rehashing
@@ -276,30 +526,51 @@ int dictRehash(dict *d, int n) {
     if (!dictIsRehashing(d)) return 0;  // 如果没有在进行rehash，则返回0
 
     while(n-- && d->ht[0].used != 0) { // 循环，如果还有数据
-        dictEntry *de, *nextde; // 定义当前条目和下一个条目
+        dictChainEntry *de, *nextde; // 定义当前条目和下一个条目
 
         /* Note that rehashidx can't overflow as we are sure there are more
          * elements because ht[0].used != 0 */
         assert(d->ht[0].size > (unsigned long)d->rehashidx);    // 如果rehashidx不小于dict的大小，说明rehash已经完成
-        while(d->ht[0].table[d->rehashidx] == NULL) {   // 只有hash表中某个hash表的entry是空的，则不需要移动，rehashidx直接+1
+        while(_dictBucketIsEmpty(d,&d->ht[0],d->rehashidx)) {   // 只有hash表中某个hash表的entry是空的，则不需要移动，rehashidx直接+1
             d->rehashidx++;
             if (--empty_visits == 0) return 1;  // XXX
         }
-        de = d->ht[0].table[d->rehashidx];  // rehashidx为多少，则本次要移动哪个条目
+        if (d->grouped) {
+            dictGroup *g, *first = _dictGroupBucket(d,&d->ht[0],d->rehashidx);
+            int j;
+
+            /* Copy the entries into the new table, the tags are computed
+             * again since the new bucket depends on the full hash anyway. */
+            for (g = first; g; g = g->next) {
+                for (j = 0; j < DICT_GROUP_ENTRIES; j++) {
+                    dictEntry *de = _dictGroupEntry(d,g,j);
+
+                    if (g->tags[j] == 0) continue;
+                    memcpy(_dictGroupTakeSlot(d,&d->ht[1],
+                                              dictHashKey(d, de->key)),
+                           de,_dictSlotSize(d));
+                    d->ht[0].used--;
+                }
+            }
+            _dictGroupResetBucket(first);
+            d->rehashidx++;
+            continue;
+        }
+        de = _dictChainTable(&d->ht[0])[d->rehashidx];  // rehashidx为多少，则本次要移动哪个条目
         /* Move all the keys in this bucket from the old to the new hash HT */
         while(de) { // 只要该索引还存在条目，就要继续循环并迁移
             unsigned int h;
 
             nextde = de->next;
             /* Get the index in the new hash table */
-            h = dictHashKey(d, de->key) & d->ht[1].sizemask;    // 获取当前key在新的哈希表中的索引
-            de->next = d->ht[1].table[h];
-            d->ht[1].table[h] = de;
+            h = dictHashKey(d, de->de.key) & d->ht[1].sizemask;    // 获取当前key在新的哈希表中的索引
+            de->next = _dictChainTable(&d->ht[1])[h];
+            _dictChainTable(&d->ht[1])[h] = de;
             d->ht[0].used--;    // 旧表数量-1
             d->ht[1].used++;    // 新表数量+1
             de = nextde;    // 迁移下一个条目
         }
-        d->ht[0].table[d->rehashidx] = NULL;    // 将第一个哈希表的已迁移的索引置空
+        _dictChainTable(&d->ht[0])[d->rehashidx] = NULL;    // 将第一个哈希表的已迁移的索引置空
         d->rehashidx++; // rehashidx值+1，下次循环迁移下一个索引的数据
     }
 
@@ -352,6 +623,25 @@ static void _dictRehashStep(dict *d) {
     if (d->iterators == 0) dictRehash(d,1);
 }
 
+/* dictAddRaw() for grouped tables. */
+static dictEntry *_dictGroupAddRaw(dict *d, void *key)
+{
+    dictEntry *entry;
+    unsigned int h;
+    int table;
+
+    if (_dictExpandIfNeeded(d) == DICT_ERR)
+        return NULL;
+    h = dictHashKey(d, key);
+    for (table = 0; table <= 1; table++) {
+        if (_dictGroupFind(d,&d->ht[table],key,h)) return NULL;
+        if (!dictIsRehashing(d)) break;
+    }
+    entry = _dictGroupTakeSlot(d,dictIsRehashing(d) ? &d->ht[1] : &d->ht[0],h);
+    dictSetKey(d, entry, key);
+    return entry;
+}
+
 /* Add an element to the target hash table */
 // 向哈希表中添加元素
 int dictAdd(dict *d, void *key, void *val)
@@ -382,10 +672,11 @@ int dictAdd(dict *d, void *key, void *val)
 dictEntry *dictAddRaw(dict *d, void *key)
 {
     int index;
-    dictEntry *entry;
+    dictChainEntry *entry;
     dictht *ht;
 
     if (dictIsRehashing(d)) _dictRehashStep(d); // 添加元素时，如果正在进行rehash操作，则会先主动执行一次rehash
+    if (d->grouped) return _dictGroupAddRaw(d,key);
 
     /* Get the index of the new element, or -1 if
      * the element already exists. */
@@ -397,14 +688,15 @@ dictEntry *dictAddRaw(dict *d, void *key)
      * system it is more likely that recently added entries are accessed
      * more frequently. */
     ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];    // 如果在进行rehash操作，则把数据存储在ht[1],否则存放在ht[0]中
-    entry = zmalloc(sizeof(*entry));
-    entry->next = ht->table[index]; // 这里假设新增的条目访问的频率会高一些，所以放到最前面
-    ht->table[index] = entry;
+    entry = zmalloc(sizeof(*entry)+d->metasize);
+    if (d->metasize) memset(entry+1,0,d->metasize);
+    entry->next = _dictChainTable(ht)[index]; // 这里假设新增的条目访问的频率会高一些，所以放到最前面
+    _dictChainTable(ht)[index] = entry;
     ht->used++;
 
     /* Set the hash entry fields. */
-    dictSetKey(d, entry, key);  // 设置key，此时这个key已经存储到哈希表中了，然后返回到dictAdd()函数设置value
-    return entry;
+    dictSetKey(d, &entry->de, key);  // 设置key，此时这个key已经存储到哈希表中了，然后返回到dictAdd()函数设置value
+    return &entry->de;
 }
 
 /* Add an element, discarding the old if the key already exists.
@@ -450,7 +742,7 @@ dictEntry *dictReplaceRaw(dict *d, void *key) {
 static int dictGenericDelete(dict *d, const void *key, int nofree)
 {
     unsigned int h, idx;
-    dictEntry *he, *prevHe;
+    dictChainEntry *he, *prevHe;
     int table;
 
     if (d->ht[0].size == 0) return DICT_ERR; /* d->ht[0].table is NULL */
@@ -458,19 +750,25 @@ static int dictGenericDelete(dict *d, const void *key, int nofree)
     h = dictHashKey(d, key);
 
     for (table = 0; table <= 1; table++) {
+        if (d->grouped) {
+            if (_dictGroupDelete(d,&d->ht[table],key,h,nofree) == DICT_OK)
+                return DICT_OK;
+            if (!dictIsRehashing(d)) break;
+            continue;
+        }
         idx = h & d->ht[table].sizemask;
-        he = d->ht[table].table[idx];
+        he = _dictChainTable(&d->ht[table])[idx];
         prevHe = NULL;
         while(he) {
-            if (key==he->key || dictCompareKeys(d, key, he->key)) {
+            if (key==he->de.key || dictCompareKeys(d, key, he->de.key)) {
                 /* Unlink the element from the list */
                 if (prevHe)
                     prevHe->next = he->next;
                 else
-                    d->ht[table].table[idx] = he->next;
+                    _dictChainTable(&d->ht[table])[idx] = he->next;
                 if (!nofree) {  // 是否使用dict中的方法释放entry
-                    dictFreeKey(d, he);
-                    dictFreeVal(d, he);
+                    dictFreeKey(d, &he->de);
+                    dictFreeVal(d, &he->de);
                 }
                 zfree(he);
                 d->ht[table].used--;
@@ -499,15 +797,30 @@ int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
 
     /* Free all the elements */
     for (i = 0; i < ht->size && ht->used > 0; i++) {
-        dictEntry *he, *nextHe;
+        dictChainEntry *he, *nextHe;
 
         if (callback && (i & 65535) == 0) callback(d->privdata);
 
-        if ((he = ht->table[i]) == NULL) continue;
+        if (d->grouped) {
+            dictGroup *g;
+            int j;
+
+            for (g = _dictGroupBucket(d,ht,i); g; g = g->next) {
+                for (j = 0; j < DICT_GROUP_ENTRIES && g->used; j++) {
+                    if (g->tags[j] == 0) continue;
+                    dictFreeKey(d, _dictGroupEntry(d,g,j));
+                    dictFreeVal(d, _dictGroupEntry(d,g,j));
+                    ht->used--;
+                }
+            }
+            _dictGroupResetBucket(_dictGroupBucket(d,ht,i));
+            continue;
+        }
+        if ((he = _dictChainTable(ht)[i]) == NULL) continue;
         while(he) {
             nextHe = he->next;
-            dictFreeKey(d, he);
-            dictFreeVal(d, he);
+            dictFreeKey(d, &he->de);
+            dictFreeVal(d, &he->de);
             zfree(he);
             ht->used--;
             he = nextHe;
@@ -532,18 +845,25 @@ void dictRelease(dict *d)
 // 字典查找
 dictEntry *dictFind(dict *d, const void *key)
 {
-    dictEntry *he;
+    dictChainEntry *he;
     unsigned int h, idx, table;
 
     if (d->ht[0].used + d->ht[1].used == 0) return NULL; /* dict is empty 字典为空，返回NULL */
     if (dictIsRehashing(d)) _dictRehashStep(d); // 如果字典正在进行rehash，则执行一次rehash操作
     h = dictHashKey(d, key);
     for (table = 0; table <= 1; table++) {  // 在两个hash表中查找
+        if (d->grouped) {
+            dictEntry *de = _dictGroupFind(d,&d->ht[table],key,h);
+
+            if (de) return de;
+            if (!dictIsRehashing(d)) return NULL;
+            continue;
+        }
         idx = h & d->ht[table].sizemask;    // https://www.cnblogs.com/meituantech/p/9376472.html
-        he = d->ht[table].table[idx];
+        he = _dictChainTable(&d->ht[table])[idx];
         while(he) {
-            if (key==he->key || dictCompareKeys(d, key, he->key))   // 和每个key进行对比
-                return he;
+            if (key==he->de.key || dictCompareKeys(d, key, he->de.key))   // 和每个key进行对比
+                return &he->de;
             he = he->next;
         }
         if (!dictIsRehashing(d)) return NULL;   // 如果字典当前没有在rehash，就只有ht[0]中有数据，不需要匹配ht[1]
@@ -611,6 +931,8 @@ dictIterator *dictGetIterator(dict *d)
     iter->safe = 0; // 默认为非安全迭代器
     iter->entry = NULL;
     iter->nextEntry = NULL;
+    iter->group = NULL;
+    iter->slot = 0;
     return iter;
 }
 
@@ -622,6 +944,16 @@ dictIterator *dictGetSafeIterator(dict *d) {
     return i;
 }
 
+/* Return the next entry of the current bucket of a grouped dict iterator,
+ * advancing its position past it, or NULL if the bucket is over. */
+static dictEntry *_dictIterGroupSeek(dictIterator *iter) {
+    dictGroup *g = iter->group;
+    dictEntry *de = _dictGroupSeek(iter->d,&g,&iter->slot);
+
+    iter->group = g;
+    return de;
+}
+
 // 通过迭代器获取下一个字典条目
 dictEntry *dictNext(dictIterator *iter)
 {
@@ -644,14 +976,24 @@ dictEntry *dictNext(dictIterator *iter)
                     break;  // 如果字典没有在做rehash，那么只有ht[0]有数据，又或者已经迭代完ht[1]，说明迭代完成，返回
                 }
             }
-            iter->entry = ht->table[iter->index];
+            if (iter->d->grouped) {
+                iter->group = _dictGroupBucket(iter->d,ht,iter->index);
+                iter->slot = 0;
+                iter->entry = _dictIterGroupSeek(iter);
+            } else {
+                iter->entry = (dictEntry*)_dictChainTable(ht)[iter->index];
+            }
         } else {
             iter->entry = iter->nextEntry;
         }
         if (iter->entry) {
             /* We need to save the 'next' here, the iterator user
              * may delete the entry we are returning. */
-            iter->nextEntry = iter->entry->next;
+            if (iter->d->grouped)
+                iter->nextEntry = _dictIterGroupSeek(iter);
+            else
+                iter->nextEntry = (dictEntry*)
+                    ((dictChainEntry*)iter->entry)->next;
             return iter->entry;
         }
     }
@@ -676,7 +1018,8 @@ void dictReleaseIterator(dictIterator *iter)
 // XXX
 dictEntry *dictGetRandomKey(dict *d)
 {
-    dictEntry *he, *orighe;
+    dictChainEntry *he, *orighe;
+    dictht *ht;
     unsigned int h;
     int listlen, listele;
 
@@ -689,15 +1032,21 @@ dictEntry *dictGetRandomKey(dict *d)
             h = d->rehashidx + (random() % (d->ht[0].size +
                                             d->ht[1].size -
                                             d->rehashidx));
-            he = (h >= d->ht[0].size) ? d->ht[1].table[h - d->ht[0].size] :
-                                      d->ht[0].table[h];
-        } while(he == NULL);
+            if (h >= d->ht[0].size) {
+                ht = &d->ht[1];
+                h -= d->ht[0].size;
+            } else {
+                ht = &d->ht[0];
+            }
+        } while(_dictBucketIsEmpty(d,ht,h));
     } else {
+        ht = &d->ht[0];
         do {
             h = random() & d->ht[0].sizemask;
-            he = d->ht[0].table[h];
-        } while(he == NULL);
+        } while(_dictBucketIsEmpty(d,ht,h));
     }
+    if (d->grouped) return _dictGroupRandomEntry(d,_dictGroupBucket(d,ht,h));
+    he = _dictChainTable(ht)[h];
 
     /* Now we found a non empty bucket, but it is a linked
      * list and we need to get a random element from the list.
@@ -712,7 +1061,7 @@ dictEntry *dictGetRandomKey(dict *d)
     listele = random() % listlen;
     he = orighe;
     while(listele--) he = he->next;
-    return he;
+    return &he->de;
 }
 
 /* This function samples the dictionary to return a few keys from random
@@ -780,22 +1129,35 @@ unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
                 continue;
             }
             if (i >= d->ht[j].size) continue; /* Out of range for this table. */
-            dictEntry *he = d->ht[j].table[i];
 
             /* Count contiguous empty buckets, and jump to other
              * locations if they reach 'count' (with a minimum of 5). */
-            if (he == NULL) {
+            if (_dictBucketIsEmpty(d,&d->ht[j],i)) {
                 emptylen++;
                 if (emptylen >= 5 && emptylen > count) {
                     i = random() & maxsizemask;
                     emptylen = 0;
                 }
+            } else if (d->grouped) {
+                dictGroup *g = _dictGroupBucket(d,&d->ht[j],i);
+                dictEntry *he;
+                int slot = 0;
+
+                emptylen = 0;
+                while ((he = _dictGroupSeek(d,&g,&slot)) != NULL) {
+                    *des = he;
+                    des++;
+                    stored++;
+                    if (stored == count) return stored;
+                }
             } else {
+                dictChainEntry *he = _dictChainTable(&d->ht[j])[i];
+
                 emptylen = 0;
                 while (he) {
                     /* Collect all the elements of the buckets found non
                      * empty while iterating. */
-                    *des = he;
+                    *des = &he->de;
                     des++;
                     he = he->next;
                     stored++;
@@ -822,6 +1184,27 @@ static unsigned long rev(unsigned long v) {
     return v;
 }
 
+/* Call 'fn' for every entry of the bucket 'idx' of the table 'ht'. */
+static void _dictScanBucket(dict *d, dictht *ht, unsigned long idx,
+                            dictScanFunction *fn, void *privdata)
+{
+    if (d->grouped) {
+        dictGroup *g = _dictGroupBucket(d,ht,idx);
+        const dictEntry *de;
+        int slot = 0;
+
+        while ((de = _dictGroupSeek(d,&g,&slot)) != NULL)
+            fn(privdata, de);
+    } else {
+        const dictChainEntry *de = _dictChainTable(ht)[idx];
+
+        while (de) {
+            fn(privdata, &de->de);
+            de = de->next;
+        }
+    }
+}
+
 /* dictScan() is used to iterate over the elements of a dictionary.
  *
  * Iterating works the following way:
@@ -913,7 +1296,6 @@ unsigned long dictScan(dict *d,
                        void *privdata)
 {
     dictht *t0, *t1;
-    const dictEntry *de;
     unsigned long m0, m1;
 
     if (dictSize(d) == 0) return 0;
@@ -923,11 +1305,7 @@ unsigned long dictScan(dict *d,
         m0 = t0->sizemask;
 
         /* Emit entries at cursor */
-        de = t0->table[v & m0];
-        while (de) {
-            fn(privdata, de);
-            de = de->next;
-        }
+        _dictScanBucket(d, t0, v & m0, fn, privdata);
 
         /* Set unmasked bits so incrementing the reversed cursor
          * operates on the masked bits */
@@ -952,21 +1330,13 @@ unsigned long dictScan(dict *d,
         m1 = t1->sizemask;
 
         /* Emit entries at cursor */
-        de = t0->table[v & m0];
-        while (de) {
-            fn(privdata, de);
-            de = de->next;
-        }
+        _dictScanBucket(d, t0, v & m0, fn, privdata);
 
         /* Iterate over indices in larger table that are the expansion
          * of the index pointed to by the cursor in the smaller table */
         do {
             /* Emit entries at cursor */
-            de = t1->table[v & m1];
-            while (de) {
-                fn(privdata, de);
-                de = de->next;
-            }
+            _dictScanBucket(d, t1, v & m1, fn, privdata);
 
             /* Increment the reverse cursor not covered by the smaller mask.*/
             v |= ~m1;
@@ -998,9 +1368,12 @@ static int _dictExpandIfNeeded(dict *d)
      * elements/buckets is over the "safe" threshold, we resize doubling
      * the number of buckets. */
     // 当负载因子达到1时，就可以扩容了，不过字典还要处于可以扩容状态，如果处于不可扩容状态的话，负载因子达到5也是可以扩容的（在最开始也提到了）
-    if (d->ht[0].used >= d->ht[0].size &&
+    unsigned long capacity = d->ht[0].size *
+                             (d->grouped ? DICT_GROUP_MAX_FILL : 1);
+
+    if (d->ht[0].used >= capacity &&
         (dict_can_resize ||
-         d->ht[0].used/d->ht[0].size > dict_force_resize_ratio))
+         d->ht[0].used/capacity > dict_force_resize_ratio))
     {
         return dictExpand(d, d->ht[0].used*2);
     }
@@ -1032,7 +1405,7 @@ static unsigned long _dictNextPower(unsigned long size)
 static int _dictKeyIndex(dict *d, const void *key)
 {
     unsigned int h, idx, table;
-    dictEntry *he;
+    dictChainEntry *he;
 
     /* Expand the hash table if needed */
     if (_dictExpandIfNeeded(d) == DICT_ERR) // XXX
@@ -1042,9 +1415,9 @@ static int _dictKeyIndex(dict *d, const void *key)
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
         /* Search if this slot does not already contain the given key */
-        he = d->ht[table].table[idx];
+        he = _dictChainTable(&d->ht[table])[idx];
         while(he) {
-            if (key==he->key || dictCompareKeys(d, key, he->key))
+            if (key==he->de.key || dictCompareKeys(d, key, he->de.key))
                 return -1;
             he = he->next;
         }
@@ -1071,9 +1444,9 @@ void dictDisableResize(void) {   // 设置dict的状态，不可以resize
 /* ------------------------------- Debugging ---------------------------------*/
 
 #define DICT_STATS_VECTLEN 50
-size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
+size_t _dictGetStatsHt(char *buf, size_t bufsize, dict *d, dictht *ht, int tableid) {
     unsigned long i, slots = 0, chainlen, maxchainlen = 0;
-    unsigned long totchainlen = 0;
+    unsigned long totchainlen = 0, overflows = 0;
     unsigned long clvector[DICT_STATS_VECTLEN];
     size_t l = 0;
 
@@ -1085,19 +1458,26 @@ size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
     /* Compute stats. */
     for (i = 0; i < DICT_STATS_VECTLEN; i++) clvector[i] = 0;
     for (i = 0; i < ht->size; i++) {
-        dictEntry *he;
+        dictChainEntry *he;
 
-        if (ht->table[i] == NULL) {
+        if (_dictBucketIsEmpty(d,ht,i)) {
             clvector[0]++;
             continue;
         }
         slots++;
         /* For each hash entry on this slot... */
         chainlen = 0;
-        he = ht->table[i];
-        while(he) {
-            chainlen++;
-            he = he->next;
+        if (d->grouped) {
+            dictGroup *g = _dictGroupBucket(d,ht,i);
+
+            chainlen = _dictGroupBucketLen(g);
+            for (g = g->next; g; g = g->next) overflows++;
+        } else {
+            he = _dictChainTable(ht)[i];
+            while(he) {
+                chainlen++;
+                he = he->next;
+            }
         }
         clvector[(chainlen < DICT_STATS_VECTLEN) ? chainlen : (DICT_STATS_VECTLEN-1)]++;
         if (chainlen > maxchainlen) maxchainlen = chainlen;
@@ -1117,6 +1497,11 @@ size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
         tableid, (tableid == 0) ? "main hash table" : "rehashing target",
         ht->size, ht->used, slots, maxchainlen,
         (float)totchainlen/slots, (float)ht->used/slots);
+    if (d->grouped && l < bufsize) {
+        l += snprintf(buf+l,bufsize-l,
+            " grouped buckets: %d slots per group, %ld overflow groups\n",
+            DICT_GROUP_ENTRIES, overflows);
+    }
 
     for (i = 0; i < DICT_STATS_VECTLEN-1; i++) {
         if (clvector[i] == 0) continue;
@@ -1137,11 +1522,11 @@ void dictGetStats(char *buf, size_t bufsize, dict *d) {
     char *orig_buf = buf;
     size_t orig_bufsize = bufsize;
 
-    l = _dictGetStatsHt(buf,bufsize,&d->ht[0],0);
+    l = _dictGetStatsHt(buf,bufsize,d,&d->ht[0],0);
     buf += l;
     bufsize -= l;
     if (dictIsRehashing(d) && bufsize > 0) {
-        _dictGetStatsHt(buf,bufsize,&d->ht[1],1);
+        _dictGetStatsHt(buf,bufsize,d,&d->ht[1],1);
     }
     /* Make sure there is a NULL term at the end. */
     if (orig_bufsize) orig_buf[orig_bufsize-1] = '\0';
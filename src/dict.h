@@ -54,7 +54,6 @@ typedef struct dictEntry {
         int64_t s64;    // XXX  好像是过期时间
         double d;       // XXX
     } v;
-    struct dictEntry *next; // 字典中的下一个节点
 } dictEntry;
 
 typedef struct dictType {
@@ -70,7 +69,7 @@ typedef struct dictType {
  * implement incremental rehashing, for the old to the new table. 
  * 哈希表的结构，每个dict都有两个，用来实现渐进式rehash*/
 typedef struct dictht {
-    dictEntry **table;  //XXX
+    void *table;        /* Bucket heads, or bucket groups if the dict is grouped. */
     unsigned long size; // 指针数组大小
     unsigned long sizemask; // 指针数组的长度掩码，用于计算索引值XXX
     unsigned long used; // 哈希表现有节点数量
@@ -82,6 +81,8 @@ typedef struct dict {
     dictht ht[2];   // 2个哈希表
     long rehashidx; // 记录rehash状态的标志，值为-1表示rehash未进行
     int iterators; // 正在运作的迭代器数量(这里其实指的是安全迭代器的数量，安全迭代器在迭代的时候不允许rehash)
+    int grouped;    /* Entries stored inline in bucket groups, see dictCreateGrouped(). */
+    unsigned int metasize;  /* Bytes of metadata of every entry, see dictMetadata(). */
 } dict;
 
 /* If safe is set to 1 this is a safe iterator, that means, you can call
@@ -95,6 +96,8 @@ typedef struct dictIterator {
     long index;
     int table, safe;    // 表0还是表1，是否为安全迭代器
     dictEntry *entry, *nextEntry;   // 当前条目和下一条目
+    void *group;    /* Grouped dicts: where the entry after nextEntry is searched. */
+    int slot;
     /* unsafe iterator fingerprint for misuse detection. */
     long long fingerprint;  // 
 } dictIterator;
@@ -104,6 +107,11 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4  // 每个哈希表初始大小
 
+/* Slots of every bucket group of grouped dicts, and the average number of
+ * entries per bucket a grouped dict is allowed to reach before growing. */
+#define DICT_GROUP_ENTRIES       7
+#define DICT_GROUP_MAX_FILL      6
+
 /* ------------------------------- Macros ------------------------------------*/
 #define dictFreeVal(d, entry) \
     if ((d)->type->valDestructor) \
@@ -111,19 +119,19 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 
 #define dictSetVal(d, entry, _val_) do { \
     if ((d)->type->valDup) \
-        entry->v.val = (d)->type->valDup((d)->privdata, _val_); \
+        (entry)->v.val = (d)->type->valDup((d)->privdata, _val_); \
     else \
-        entry->v.val = (_val_); \
+        (entry)->v.val = (_val_); \
 } while(0)
 
 #define dictSetSignedIntegerVal(entry, _val_) \
-    do { entry->v.s64 = _val_; } while(0)
+    do { (entry)->v.s64 = _val_; } while(0)
 
 #define dictSetUnsignedIntegerVal(entry, _val_) \
-    do { entry->v.u64 = _val_; } while(0)
+    do { (entry)->v.u64 = _val_; } while(0)
 
 #define dictSetDoubleVal(entry, _val_) \
-    do { entry->v.d = _val_; } while(0)
+    do { (entry)->v.d = _val_; } while(0)
 
 #define dictFreeKey(d, entry) \
     if ((d)->type->keyDestructor) \
@@ -131,9 +139,9 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 
 #define dictSetKey(d, entry, _key_) do { \
     if ((d)->type->keyDup) \
-        entry->key = (d)->type->keyDup((d)->privdata, _key_); \
+        (entry)->key = (d)->type->keyDup((d)->privdata, _key_); \
     else \
-        entry->key = (_key_); \
+        (entry)->key = (_key_); \
 } while(0)
 
 #define dictCompareKeys(d, key1, key2) \
@@ -147,13 +155,17 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 #define dictGetSignedIntegerVal(he) ((he)->v.s64)   // key指定的过期时间
 #define dictGetUnsignedIntegerVal(he) ((he)->v.u64)
 #define dictGetDoubleVal(he) ((he)->v.d)
-#define dictSlots(d) ((d)->ht[0].size+(d)->ht[1].size)
+#define dictSlots(d) (((d)->ht[0].size+(d)->ht[1].size)* \
+                      ((d)->grouped ? DICT_GROUP_MAX_FILL : 1))
 #define dictSize(d) ((d)->ht[0].used+(d)->ht[1].used)
 #define dictIsRehashing(d) ((d)->rehashidx != -1)
 
 /* API 
  * dict相关的api */
 dict *dictCreate(dictType *type, void *privDataPtr);    // 创建字典
+dict *dictCreateGrouped(dictType *type, void *privDataPtr);
+void dictSetMetadataSize(dict *d, unsigned int size);
+void *dictMetadata(dict *d, dictEntry *de);
 int dictExpand(dict *d, unsigned long size);    // 字典扩展
 int dictAdd(dict *d, void *key, void *val);     // 添加条目
 dictEntry *dictAddRaw(dict *d, void *key);
@@ -0,0 +1,156 @@
+/* Expiry index -- the volatile keys of a DB ordered by expire time.
+ *
+ * This is a skiplist, like the one used by sorted sets, but specialized
+ * for the expires: nodes only have forward pointers, the score is the
+ * expire time as an integer, and ties are broken by the address of the
+ * key, which is shared with the main dictionary and never freed here.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2026, agent <agent at local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "zmalloc.h"
+#include "expireidx.h"
+
+static expireIdxNode *expireIdxCreateNode(int level, long long when, sds key) {
+    expireIdxNode *node = zmalloc(sizeof(*node)+level*sizeof(expireIdxNode*));
+
+    node->when = when;
+    node->key = key;
+    return node;
+}
+
+/* Returns a random level for the new node we are going to create.
+ * The return value of this function is between 1 and EXPIREIDX_MAXLEVEL
+ * (both inclusive), with a powerlaw-alike distribution where higher
+ * levels are less likely to be returned. */
+static int expireIdxRandomLevel(void) {
+    int level = 1;
+    while ((random()&0xFFFF) < (EXPIREIDX_P * 0xFFFF))
+        level += 1;
+    return (level<EXPIREIDX_MAXLEVEL) ? level : EXPIREIDX_MAXLEVEL;
+}
+
+/* Return true if 'node' sorts before the (when,key) pair. */
+static inline int expireIdxBefore(expireIdxNode *node, long long when, sds key) {
+    return node->when < when ||
+           (node->when == when && (uintptr_t)node->key < (uintptr_t)key);
+}
+
+/* Fill 'update' with the rightmost node of every level that sorts before
+ * the (when,key) pair, and return the node at level 0 that follows it. */
+static expireIdxNode *expireIdxSeek(expireIdx *idx, long long when, sds key,
+                                    expireIdxNode **update)
+{
+    expireIdxNode *x = idx->header;
+    int i;
+
+    for (i = idx->level-1; i >= 0; i--) {
+        while (x->forward[i] && expireIdxBefore(x->forward[i],when,key))
+            x = x->forward[i];
+        update[i] = x;
+    }
+    return x->forward[0];
+}
+
+expireIdx *expireIdxCreate(void) {
+    expireIdx *idx = zmalloc(sizeof(*idx));
+    int j;
+
+    idx->level = 1;
+    idx->length = 0;
+    idx->header = expireIdxCreateNode(EXPIREIDX_MAXLEVEL,0,NULL);
+    for (j = 0; j < EXPIREIDX_MAXLEVEL; j++) idx->header->forward[j] = NULL;
+    return idx;
+}
+
+/* Free the index. The keys are not released, since they are owned by the
+ * main dictionary, and are not accessed at all: this is why the index of a
+ * DB can be released by the lazy free thread together with its dicts. */
+void expireIdxRelease(expireIdx *idx) {
+    expireIdxNode *node = idx->header->forward[0], *next;
+
+    zfree(idx->header);
+    while(node) {
+        next = node->forward[0];
+        zfree(node);
+        node = next;
+    }
+    zfree(idx);
+}
+
+/* Add 'key', expiring at 'when', to the index. The caller must make sure
+ * the key is not already indexed with the same expire. */
+void expireIdxInsert(expireIdx *idx, long long when, sds key) {
+    expireIdxNode *update[EXPIREIDX_MAXLEVEL], *x;
+    int i, level;
+
+    expireIdxSeek(idx,when,key,update);
+    level = expireIdxRandomLevel();
+    if (level > idx->level) {
+        for (i = idx->level; i < level; i++)
+            update[i] = idx->header;
+        idx->level = level;
+    }
+    x = expireIdxCreateNode(level,when,key);
+    for (i = 0; i < level; i++) {
+        x->forward[i] = update[i]->forward[i];
+        update[i]->forward[i] = x;
+    }
+    idx->length++;
+}
+
+/* Remove 'key', indexed with the expire 'when'. Returns 1 if the key was
+ * found and removed, otherwise 0. */
+int expireIdxDelete(expireIdx *idx, long long when, sds key) {
+    expireIdxNode *update[EXPIREIDX_MAXLEVEL], *x;
+    int i;
+
+    x = expireIdxSeek(idx,when,key,update);
+    if (x == NULL || x->when != when || x->key != key) return 0;
+    for (i = 0; i < idx->level; i++) {
+        if (update[i]->forward[i] != x) break;
+        update[i]->forward[i] = x->forward[i];
+    }
+    while(idx->level > 1 && idx->header->forward[idx->level-1] == NULL)
+        idx->level--;
+    idx->length--;
+    zfree(x);
+    return 1;
+}
+
+/* Return the node of the key with the nearest expire, or NULL if the
+ * index is empty. */
+expireIdxNode *expireIdxFirst(expireIdx *idx) {
+    return idx->header->forward[0];
+}
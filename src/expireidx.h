@@ -0,0 +1,66 @@
+/* Expiry index -- the volatile keys of a DB ordered by expire time, so that
+ * active expiry can reclaim them in deadline order.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2026, agent <agent at local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+
+#ifndef __EXPIREIDX_H
+#define __EXPIREIDX_H
+
+#include "sds.h"
+
+#define EXPIREIDX_MAXLEVEL 32 /* Should be enough for 2^32 keys */
+#define EXPIREIDX_P 0.25      /* Skiplist P = 1/4 */
+
+/* The index is a skiplist ordered by (expire time, key pointer). The keys
+ * are not owned by the index: they are the sds strings of the main DB
+ * dictionary, which is why they can be compared by address. */
+typedef struct expireIdxNode {
+    long long when;
+    sds key;
+    struct expireIdxNode *forward[];
+} expireIdxNode;
+
+typedef struct expireIdx {
+    expireIdxNode *header;
+    unsigned long length;
+    int level;
+} expireIdx;
+
+expireIdx *expireIdxCreate(void);
+void expireIdxRelease(expireIdx *idx);
+void expireIdxInsert(expireIdx *idx, long long when, sds key);
+int expireIdxDelete(expireIdx *idx, long long when, sds key);
+expireIdxNode *expireIdxFirst(expireIdx *idx);
+#define expireIdxLength(idx) ((idx)->length)
+
+#endif
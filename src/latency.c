@@ -34,6 +34,7 @@
  */
 
 #include "server.h"
+#include <math.h>
 
 /* Dictionary type for latency events. */
 int dictStringKeyCompare(void *privdata, const void *key1, const void *key2) {
@@ -557,12 +558,98 @@ sds latencyCommandGenSparkeline(char *event, struct latencyTimeSeries *ts) {
     return graph;
 }
 
+/* ---------------------- Command latency histograms ------------------------ */
+
+/* Return the bucket of the histogram where the value 'usec' is counted. */
+static int latencyHistogramIndex(uint64_t usec) {
+    int msb, shift;
+
+    if (usec < (1<<LATENCY_HIST_SUB_BITS)) return usec;
+    if (usec >= (1ULL<<LATENCY_HIST_MAX_BITS)) return LATENCY_HIST_BUCKETS-1;
+    msb = 63-__builtin_clzll(usec);
+    shift = msb-LATENCY_HIST_SUB_BITS;
+    return ((shift+1)<<LATENCY_HIST_SUB_BITS) +
+           ((usec>>shift) & ((1<<LATENCY_HIST_SUB_BITS)-1));
+}
+
+/* Return the highest value counted in the specified bucket. */
+static uint64_t latencyHistogramBucketMax(int idx) {
+    int shift, sub;
+
+    if (idx < (1<<LATENCY_HIST_SUB_BITS)) return idx;
+    shift = (idx>>LATENCY_HIST_SUB_BITS)-1;
+    sub = idx & ((1<<LATENCY_HIST_SUB_BITS)-1);
+    return ((((uint64_t)1<<LATENCY_HIST_SUB_BITS)+sub+1)<<shift)-1;
+}
+
+/* Record a value in the histogram. This is called for every command, so
+ * it is just a few arithmetic operations. */
+void latencyHistogramAdd(struct latencyHistogram *h, uint64_t usec) {
+    h->buckets[latencyHistogramIndex(usec)]++;
+    h->count++;
+    if (usec > h->max) h->max = usec;
+}
+
+/* Return the value below which 'p' percent of the recorded values fall.
+ * The upper bound of the bucket is returned, but never more than the max
+ * recorded value. */
+uint64_t latencyHistogramPercentile(struct latencyHistogram *h, double p) {
+    uint64_t target, seen = 0;
+    int j;
+
+    if (h->count == 0) return 0;
+    target = (uint64_t)ceil(p/100*h->count);
+    if (target == 0) target = 1;
+    for (j = 0; j < LATENCY_HIST_BUCKETS; j++) {
+        seen += h->buckets[j];
+        if (seen >= target) {
+            uint64_t value = latencyHistogramBucketMax(j);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* latencyCommand() helper to produce the reply for the HISTOGRAM
+ * subcommand: the number of calls of the command and the cumulative number
+ * of calls that took less than 1, 2, 4, 8, ... microseconds, up to the
+ * slowest call. Powers of two that add no calls are omitted. */
+void latencyCommandReplyWithHistogram(client *c, struct redisCommand *cmd) {
+    struct latencyHistogram *h = cmd->latency_histogram;
+    void *replylen;
+    uint64_t seen = 0, reported = 0;
+    int j, pairs = 0;
+
+    addReplyBulkCString(c,cmd->name);
+    addReplyMultiBulkLen(c,4);
+    addReplyBulkCString(c,"calls");
+    addReplyLongLong(c,h->count);
+    addReplyBulkCString(c,"histogram_usec");
+    replylen = addDeferredMultiBulkLength(c);
+    for (j = 0; j < LATENCY_HIST_BUCKETS && reported < h->count; j++) {
+        uint64_t limit = latencyHistogramBucketMax(j)+1;
+
+        seen += h->buckets[j];
+        /* Report only at power of two boundaries. */
+        if ((limit & (limit-1)) != 0 && j != LATENCY_HIST_BUCKETS-1) continue;
+        if (seen == reported) continue;
+        addReplyLongLong(c,limit);
+        addReplyLongLong(c,seen);
+        reported = seen;
+        pairs++;
+    }
+    setDeferredMultiBulkLength(c,replylen,pairs*2);
+}
+
 /* LATENCY command implementations.
  *
  * LATENCY SAMPLES: return time-latency samples for the specified event.
  * LATENCY LATEST: return the latest latency for all the events classes.
  * LATENCY DOCTOR: returns an human readable analysis of instance latency.
  * LATENCY GRAPH: provide an ASCII graph of the latency of the specified event.
+ * LATENCY HISTOGRAM [command ...]: return the latency histogram of the
+ *                                  specified commands (or all the commands
+ *                                  called so far).
  */
 void latencyCommand(client *c) {
     struct latencyTimeSeries *ts;
@@ -598,6 +685,32 @@ void latencyCommand(client *c) {
 
         addReplyBulkCBuffer(c,report,sdslen(report));
         sdsfree(report);
+    } else if (!strcasecmp(c->argv[1]->ptr,"histogram") && c->argc >= 2) {
+        /* LATENCY HISTOGRAM [command ...] */
+        struct redisCommand *cmd;
+        int j, found = 0;
+        void *replylen = addDeferredMultiBulkLength(c);
+
+        if (c->argc == 2) {
+            dictIterator *di = dictGetIterator(server.commands);
+            dictEntry *de;
+
+            while((de = dictNext(di)) != NULL) {
+                cmd = dictGetVal(de);
+                if (!cmd->latency_histogram) continue;
+                latencyCommandReplyWithHistogram(c,cmd);
+                found++;
+            }
+            dictReleaseIterator(di);
+        } else {
+            for (j = 2; j < c->argc; j++) {
+                cmd = dictFetchValue(server.commands,c->argv[j]->ptr);
+                if (!cmd || !cmd->latency_histogram) continue;
+                latencyCommandReplyWithHistogram(c,cmd);
+                found++;
+            }
+        }
+        setDeferredMultiBulkLength(c,replylen,found*2);
     } else if (!strcasecmp(c->argv[1]->ptr,"reset") && c->argc >= 2) {
         /* LATENCY RESET */
         if (c->argc == 2) {
@@ -61,9 +61,28 @@ struct latencyStats {
     time_t period;          /* Number of seconds since first event and now. */
 };
 
+/* Log-linear histogram of command latencies in microseconds. Values below
+ * 2^LATENCY_HIST_SUB_BITS are counted exactly, bigger values are grouped by
+ * power of two, and every power of two is split into 2^LATENCY_HIST_SUB_BITS
+ * linear buckets, so that the relative error is at most 1/16 (6.25%).
+ * Values of 2^LATENCY_HIST_MAX_BITS usec (about 19 hours) or more are
+ * counted in the last bucket. */
+#define LATENCY_HIST_SUB_BITS 4
+#define LATENCY_HIST_MAX_BITS 36
+#define LATENCY_HIST_BUCKETS \
+    ((LATENCY_HIST_MAX_BITS-LATENCY_HIST_SUB_BITS+1)<<LATENCY_HIST_SUB_BITS)
+
+struct latencyHistogram {
+    uint64_t count;     /* Number of recorded values. */
+    uint64_t max;       /* Max recorded value. */
+    uint64_t buckets[LATENCY_HIST_BUCKETS];
+};
+
 void latencyMonitorInit(void);
 void latencyAddSample(char *event, mstime_t latency);
 int THPIsEnabled(void);
+void latencyHistogramAdd(struct latencyHistogram *h, uint64_t usec);
+uint64_t latencyHistogramPercentile(struct latencyHistogram *h, double p);
 
 /* Latency monitoring macros. */
 
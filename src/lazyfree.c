@@ -0,0 +1,361 @@
+/* Lazy freeing of objects: large values removed from the keyspace are
+ * released by a background thread so that the main thread does not block
+ * reclaiming millions of allocations.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2026, agent <agent at local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+#include "bio.h"
+#include "atomicvar.h"
+#include "cluster.h"
+
+/* Number of objects (values or whole databases) queued for the lazy free
+ * thread and not yet reclaimed. */
+static size_t lazyfree_objects = 0;
+pthread_mutex_t lazyfree_objects_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Elements of aggregate values (hash fields, set members, ...) are Redis
+ * objects that may be referenced elsewhere as well: a client reply list,
+ * the slow log, the arguments of a queued MULTI command and so forth.
+ * The background thread can't touch the reference count of such objects
+ * since the main thread may update it at the same time, so when an element
+ * is not exclusively owned by the value being freed it is handed back to
+ * the main thread, that will release our reference in
+ * lazyfreeReleaseDeferredObjects(). */
+static list *lazyfree_deferred = NULL;
+static size_t lazyfree_deferred_objects = 0;
+pthread_mutex_t lazyfree_deferred_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Return the amount of work needed in order to free an object.
+ * The return value is not always the actual number of allocations the
+ * object is composed of, but a number proportional to it.
+ *
+ * For strings the function always returns 1.
+ *
+ * For aggregated objects represented by hash tables or other data structures
+ * the function just returns the number of elements the object is composed of.
+ *
+ * Objects composed of single allocations are always reported as having a
+ * single item even if they are actually logical composed of multiple
+ * elements.
+ *
+ * For lists the function returns the number of elements in the quicklist
+ * representing the list. */
+size_t lazyfreeGetFreeEffort(robj *obj) {
+    if (obj->type == OBJ_LIST) {
+        quicklist *ql = obj->ptr;
+        return ql->len;
+    } else if (obj->type == OBJ_SET && obj->encoding == OBJ_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else if (obj->type == OBJ_ZSET && obj->encoding == OBJ_ENCODING_SKIPLIST){
+        zset *zs = obj->ptr;
+        return zs->zsl->length;
+    } else if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else {
+        return 1; /* Everything else is a single allocation. */
+    }
+}
+
+/* Release an object if it is worth to do it in background, otherwise
+ * just decrement its reference count synchronously. The caller should no
+ * longer use 'obj' after calling this function.
+ *
+ * If there are enough allocations to free the value object may be put into
+ * a lazy free list instead of being freed synchronously. The lazy free list
+ * will be reclaimed in a different bio.c thread. */
+#define LAZYFREE_THRESHOLD 64
+void freeObjAsync(robj *obj) {
+    size_t free_effort = lazyfreeGetFreeEffort(obj);
+
+    /* Note that if the object is shared, to reclaim it now it is not
+     * possible. This rarely happens, however sometimes the implementation
+     * of parts of the Redis core may call incrRefCount() to protect
+     * objects, and then call dbDelete(). */
+    if (free_effort > LAZYFREE_THRESHOLD && obj->refcount == 1) {
+        atomicIncr(lazyfree_objects,1,lazyfree_objects_mutex);
+        bioCreateBackgroundJob(BIO_LAZY_FREE,obj,NULL,NULL);
+    } else {
+        decrRefCount(obj);
+    }
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * If there are enough allocations to free the value object may be put into
+ * a lazy free list instead of being freed synchronously. */
+int dbAsyncDelete(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    /* Deleting an entry from the expires dict will not free the sds of
+     * the key, because it is shared with the main dictionary. */
+    dbDeleteExpire(db,key->ptr);
+
+    de = dictFind(db->dict,key->ptr);
+    if (de == NULL) return 0;
+    if (server.cluster_enabled) slotToKeyDel(key);
+
+    /* Detach the value from the entry, so that dictDelete() will only
+     * release the key (the db dict value destructor ignores NULL values). */
+    freeObjAsync(dictGetVal(de));
+    dictSetVal(db->dict,de,NULL);
+    dictDelete(db->dict,key->ptr);
+    return 1;
+}
+
+/* Empty a Redis DB asynchronously. What the function does actually is to
+ * create a new empty set of hash tables and schedule the old ones for
+ * lazy freeing. */
+void emptyDbAsync(redisDb *db) {
+    dict *oldht1 = db->dict, *oldht2 = db->expires;
+    expireIdx *oldidx = db->expiry_index;
+
+    dbCreateDicts(db);
+    freeDbDictsAsync(oldht1,oldht2,oldidx);
+}
+
+/* Release in background the main and expires hash tables of a DB that were
+ * already detached from the server, like the old dataset kept by the slave
+ * during a repl-diskless-load swapdb load. 'ht2' is NULL when the DB uses
+ * embedded expires, and 'idx', the expiry index, is NULL unless
+ * active-expire-index is enabled. */
+void freeDbDictsAsync(dict *ht1, dict *ht2, expireIdx *idx) {
+    atomicIncr(lazyfree_objects,dictSize(ht1),lazyfree_objects_mutex);
+    bioCreateBackgroundJob(BIO_LAZY_FREE,idx,ht1,ht2);
+}
+
+/* Empty the slots-keys map of Redis Cluster asynchronously. The keys are
+ * not referenced by the dictionaries, only the entries are released. */
+void slotToKeyFlushAsync(void) {
+    dict **old = server.cluster->slots_to_keys;
+
+    server.cluster->slots_to_keys = zcalloc(sizeof(dict*)*CLUSTER_SLOTS);
+    freeSlotsMapAsync(old);
+}
+
+/* Release in background a slots-keys map detached from the cluster state. */
+void freeSlotsMapAsync(dict **slots) {
+    bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,NULL,slots);
+}
+
+/* Return the number of objects the background thread still has to free. */
+size_t lazyfreeGetPendingObjectsCount(void) {
+    size_t aux;
+    atomicGet(lazyfree_objects,aux,lazyfree_objects_mutex);
+    return aux;
+}
+
+/* Called by the main thread in order to drop the references to the
+ * objects the lazy free thread was not able to release by itself. */
+void lazyfreeReleaseDeferredObjects(void) {
+    size_t pending;
+    list *deferred;
+    listIter li;
+    listNode *ln;
+
+    atomicGet(lazyfree_deferred_objects,pending,lazyfree_deferred_mutex);
+    if (pending == 0) return;
+
+    pthread_mutex_lock(&lazyfree_deferred_mutex);
+    deferred = lazyfree_deferred;
+    lazyfree_deferred = NULL;
+    atomicSet(lazyfree_deferred_objects,0,lazyfree_deferred_mutex);
+    pthread_mutex_unlock(&lazyfree_deferred_mutex);
+    if (deferred == NULL) return;
+
+    listRewind(deferred,&li);
+    while((ln = listNext(&li))) decrRefCount(listNodeValue(ln));
+    listRelease(deferred);
+}
+
+/* ---------------------------------------------------------------------------
+ * Functions called by the lazy free thread
+ * ------------------------------------------------------------------------ */
+
+/* Drop 'owned' references to the element 'o', that the value being freed
+ * holds. If nobody else references the object it is freed right away,
+ * otherwise the references are passed to the main thread. */
+static void lazyfreeReleaseElement(robj *o, int owned) {
+    int refcount;
+
+    atomicGet(o->refcount,refcount,lazyfree_deferred_mutex);
+    if (refcount == OBJ_SHARED_REFCOUNT) return;
+    if (refcount == owned) {
+        /* No other reference exists, so nobody in the main thread can
+         * change the reference count under our feet. */
+        o->refcount = 1;
+        decrRefCount(o);
+        return;
+    }
+
+    pthread_mutex_lock(&lazyfree_deferred_mutex);
+    if (lazyfree_deferred == NULL) lazyfree_deferred = listCreate();
+    while(owned--) {
+        listAddNodeTail(lazyfree_deferred,o);
+        lazyfree_deferred_objects++;
+    }
+    pthread_mutex_unlock(&lazyfree_deferred_mutex);
+}
+
+static void lazyfreeElementDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    if (val == NULL) return;
+    lazyfreeReleaseElement(val,1);
+}
+
+static void lazyfreeValueDestructor(void *privdata, void *val) {
+    robj *o = val;
+    int refcount;
+
+    DICT_NOTUSED(privdata);
+
+    if (o == NULL) return;
+    atomicGet(o->refcount,refcount,lazyfree_deferred_mutex);
+    if (refcount == 1) {
+        lazyfreeFreeObjectFromBioThread(o);
+    } else {
+        /* Shared values are released like the elements of aggregates. */
+        lazyfreeReleaseElement(o,1);
+        atomicDecr(lazyfree_objects,1,lazyfree_objects_mutex);
+    }
+}
+
+static void lazyfreeSdsDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+
+    sdsfree(val);
+}
+
+/* Types used to release hash tables of objects from the lazy free thread.
+ * Only the destructors are relevant, the tables are never looked up. */
+static dictType lazyfreeElementsDictType = {
+    NULL,                       /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    lazyfreeElementDestructor,  /* key destructor */
+    lazyfreeElementDestructor   /* val destructor */
+};
+
+static dictType lazyfreeNoDestructorsDictType = {
+    NULL,                       /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+static dictType lazyfreeDbDictType = {
+    NULL,                       /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    lazyfreeSdsDestructor,      /* key destructor */
+    lazyfreeValueDestructor     /* val destructor */
+};
+
+/* Sorted set elements are referenced both by the hash table and by the
+ * skiplist, so we release the table without destructors and drop both
+ * references while walking the skiplist. */
+static void lazyfreeFreeZset(zset *zs) {
+    zskiplistNode *node, *next;
+
+    zs->dict->type = &lazyfreeNoDestructorsDictType;
+    dictRelease(zs->dict);
+
+    node = zs->zsl->header->level[0].forward;
+    zfree(zs->zsl->header);
+    while(node) {
+        next = node->level[0].forward;
+        lazyfreeReleaseElement(node->obj,2);
+        zfree(node);
+        node = next;
+    }
+    zfree(zs->zsl);
+    zfree(zs);
+}
+
+/* Release an object from the lazy free thread. The object is no longer
+ * reachable from the keyspace and its reference count is 1. */
+void lazyfreeFreeObjectFromBioThread(robj *o) {
+    dict *d;
+
+    switch(o->type) {
+    case OBJ_STRING:
+        freeStringObject(o);
+        break;
+    case OBJ_LIST:
+        freeListObject(o);
+        break;
+    case OBJ_SET:
+    case OBJ_HASH:
+        if (o->encoding == OBJ_ENCODING_HT) {
+            d = o->ptr;
+            d->type = &lazyfreeElementsDictType;
+            dictRelease(d);
+        } else {
+            zfree(o->ptr);
+        }
+        break;
+    case OBJ_ZSET:
+        if (o->encoding == OBJ_ENCODING_SKIPLIST)
+            lazyfreeFreeZset(o->ptr);
+        else
+            zfree(o->ptr);
+        break;
+    default:
+        serverPanic("Unknown object type in lazyfreeFreeObjectFromBioThread()");
+    }
+    zfree(o);
+    atomicDecr(lazyfree_objects,1,lazyfree_objects_mutex);
+}
+
+/* Release a database from the lazy free thread. Note that this function
+ * releases the main dictionary, the expires dictionary and the expiry
+ * index: the keys are shared between them, so they are freed only by the
+ * main dictionary. */
+void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2, expireIdx *idx) {
+    if (idx) expireIdxRelease(idx);
+    ht1->type = &lazyfreeDbDictType;
+    if (ht2) {
+        ht2->type = &lazyfreeNoDestructorsDictType;
+        dictRelease(ht2);
+    }
+    dictRelease(ht1);
+}
+
+/* Release the slots-keys map of Redis Cluster from the lazy free thread. */
+void lazyfreeFreeSlotsMapFromBioThread(dict **slots) {
+    slotToKeyFreeMap(slots);
+}
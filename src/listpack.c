@@ -0,0 +1,1179 @@
+/* Listpack -- A list of strings serialization format.
+ *
+ * The listpack is a compact, single allocation, list of strings and
+ * integers, used in place of the ziplist to encode small hashes and sorted
+ * sets. The difference with the ziplist is that every entry stores its own
+ * length at the end ("back length") instead of the length of the previous
+ * entry: updating an entry never changes the size of the entries that
+ * follow, so there are no cascading updates, and the smallest entries use
+ * a single byte of overhead instead of two.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * LISTPACK OVERALL LAYOUT:
+ *
+ * <total-bytes> <num-elements> <entry> <entry> ... <entry> <end>
+ *
+ * <total-bytes> is a 32 bit unsigned integer holding the total size in
+ * bytes of the listpack, header and terminator included.
+ *
+ * <num-elements> is a 16 bit unsigned integer holding the number of
+ * elements. When the number of elements is 65535 or more the field is set
+ * to 65535 and the listpack must be scanned to know how many elements it
+ * holds.
+ *
+ * <end> is a single byte set to 255 (0xFF).
+ *
+ * All the integers are stored in little endian.
+ *
+ * LISTPACK ENTRIES:
+ *
+ * <encoding-type><element-data><element-tot-len>
+ *
+ * The encoding type is the first byte of the entry, and specifies if the
+ * element is an integer or a string, and in the case of small strings and
+ * integers also holds the string length or the integer itself:
+ *
+ * 0xxxxxxx              7 bit unsigned integer (0-127).
+ * 10xxxxxx <string>     String of up to 63 bytes.
+ * 110xxxxx yyyyyyyy     13 bit signed integer (-4096..4095).
+ * 1110xxxx yyyyyyyy     String of up to 4095 bytes.
+ * 11110000 <4 bytes>    String with a 32 bit length.
+ * 11110001 <2 bytes>    16 bit signed integer.
+ * 11110010 <3 bytes>    24 bit signed integer.
+ * 11110011 <4 bytes>    32 bit signed integer.
+ * 11110100 <8 bytes>    64 bit signed integer.
+ * 11111111              End of listpack.
+ *
+ * Negative integers are stored in two's complement on the number of bits
+ * of their encoding.
+ *
+ * <element-tot-len> is the size of <encoding-type><element-data>, stored
+ * using 1 to 5 bytes, 7 bits per byte, in a way that can be parsed from
+ * right to left: the rightmost byte holds the least significant 7 bits, and
+ * every byte has the most significant bit set if more bytes are on its left.
+ * This is what allows to walk the listpack backward.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2026, agent <agent at local>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "listpack.h"
+#include "zmalloc.h"
+#include "util.h"
+#include "redisassert.h"
+
+#define LP_HDR_SIZE 6       /* 32 bit total len + 16 bit number of elements. */
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+#define LP_MAX_INT_ENCODING_LEN 9
+#define LP_MAX_BACKLEN_SIZE 5
+#define LP_EOF 0xFF
+
+#define LP_ENCODING_7BIT_UINT 0
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_IS_7BIT_UINT(byte) (((byte)&LP_ENCODING_7BIT_UINT_MASK)==LP_ENCODING_7BIT_UINT)
+
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_IS_6BIT_STR(byte) (((byte)&LP_ENCODING_6BIT_STR_MASK)==LP_ENCODING_6BIT_STR)
+
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_IS_13BIT_INT(byte) (((byte)&LP_ENCODING_13BIT_INT_MASK)==LP_ENCODING_13BIT_INT)
+
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_IS_12BIT_STR(byte) (((byte)&LP_ENCODING_12BIT_STR_MASK)==LP_ENCODING_12BIT_STR)
+
+#define LP_ENCODING_32BIT_STR 0xF0
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+
+#define LP_ENCODING_6BIT_STR_LEN(p) ((p)[0] & 0x3F)
+#define LP_ENCODING_12BIT_STR_LEN(p) ((((p)[0] & 0xF) << 8) | (p)[1])
+#define LP_ENCODING_32BIT_STR_LEN(p) (((uint32_t)(p)[1]<<0) | \
+                                      ((uint32_t)(p)[2]<<8) | \
+                                      ((uint32_t)(p)[3]<<16) | \
+                                      ((uint32_t)(p)[4]<<24))
+
+#define lpGetTotalBytes(p) (((uint32_t)(p)[0]<<0) | \
+                            ((uint32_t)(p)[1]<<8) | \
+                            ((uint32_t)(p)[2]<<16) | \
+                            ((uint32_t)(p)[3]<<24))
+
+#define lpGetNumElements(p) (((uint32_t)(p)[4]<<0) | \
+                             ((uint32_t)(p)[5]<<8))
+
+#define lpSetTotalBytes(p,v) do { \
+    (p)[0] = (v)&0xff; \
+    (p)[1] = ((v)>>8)&0xff; \
+    (p)[2] = ((v)>>16)&0xff; \
+    (p)[3] = ((v)>>24)&0xff; \
+} while(0)
+
+#define lpSetNumElements(p,v) do { \
+    (p)[4] = (v)&0xff; \
+    (p)[5] = ((v)>>8)&0xff; \
+} while(0)
+
+/* Element types returned by lpEncodeGetType(). */
+#define LP_ENCODING_INT 0
+#define LP_ENCODING_STRING 1
+
+/* Create a new, empty listpack. */
+unsigned char *lpNew(void) {
+    unsigned char *lp = zmalloc(LP_HDR_SIZE+1);
+
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+void lpFree(unsigned char *lp) {
+    zfree(lp);
+}
+
+/* Return the total number of bytes used by the listpack. */
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+/* Select the smallest integer encoding able to represent 'v', and write it
+ * into 'intenc', returning the length of the encoding. */
+static unsigned long lpEncodeIntegerGetType(int64_t v, unsigned char *intenc) {
+    if (v >= 0 && v <= 127) {
+        intenc[0] = v;
+        return 1;
+    } else if (v >= -4096 && v <= 4095) {
+        if (v < 0) v = ((int64_t)1<<13)+v;
+        intenc[0] = (v>>8)|LP_ENCODING_13BIT_INT;
+        intenc[1] = v&0xff;
+        return 2;
+    } else if (v >= -32768 && v <= 32767) {
+        if (v < 0) v = ((int64_t)1<<16)+v;
+        intenc[0] = LP_ENCODING_16BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = v>>8;
+        return 3;
+    } else if (v >= -8388608 && v <= 8388607) {
+        if (v < 0) v = ((int64_t)1<<24)+v;
+        intenc[0] = LP_ENCODING_24BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = v>>16;
+        return 4;
+    } else if (v >= INT32_MIN && v <= INT32_MAX) {
+        if (v < 0) v = ((int64_t)1<<32)+v;
+        intenc[0] = LP_ENCODING_32BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = (v>>16)&0xff;
+        intenc[4] = v>>24;
+        return 5;
+    } else {
+        uint64_t uv = v;
+        int j;
+
+        intenc[0] = LP_ENCODING_64BIT_INT;
+        for (j = 0; j < 8; j++) intenc[j+1] = (uv>>(j*8))&0xff;
+        return 9;
+    }
+}
+
+/* Return LP_ENCODING_INT if the element can be represented as an integer,
+ * in that case 'intenc' is populated with the encoded integer, otherwise
+ * LP_ENCODING_STRING. In both cases '*enclen' is set to the number of bytes
+ * of <encoding-type><element-data>. */
+static int lpEncodeGetType(unsigned char *ele, uint32_t size,
+                           unsigned char *intenc, uint64_t *enclen)
+{
+    long long v;
+
+    if (size <= 20 && string2ll((char*)ele,size,&v)) {
+        *enclen = lpEncodeIntegerGetType(v,intenc);
+        return LP_ENCODING_INT;
+    }
+    if (size < 64) *enclen = 1+size;
+    else if (size < 4096) *enclen = 2+size;
+    else *enclen = 5+(uint64_t)size;
+    return LP_ENCODING_STRING;
+}
+
+/* Store in 'buf' the back length 'l', returning the number of bytes used.
+ * When 'buf' is NULL just the number of bytes needed is returned. */
+static unsigned long lpEncodeBacklen(unsigned char *buf, uint64_t l) {
+    if (l <= 127) {
+        if (buf) buf[0] = l;
+        return 1;
+    } else if (l < 16383) {
+        if (buf) {
+            buf[0] = l>>7;
+            buf[1] = (l&127)|128;
+        }
+        return 2;
+    } else if (l < 2097151) {
+        if (buf) {
+            buf[0] = l>>14;
+            buf[1] = ((l>>7)&127)|128;
+            buf[2] = (l&127)|128;
+        }
+        return 3;
+    } else if (l < 268435455) {
+        if (buf) {
+            buf[0] = l>>21;
+            buf[1] = ((l>>14)&127)|128;
+            buf[2] = ((l>>7)&127)|128;
+            buf[3] = (l&127)|128;
+        }
+        return 4;
+    } else {
+        if (buf) {
+            buf[0] = l>>28;
+            buf[1] = ((l>>21)&127)|128;
+            buf[2] = ((l>>14)&127)|128;
+            buf[3] = ((l>>7)&127)|128;
+            buf[4] = (l&127)|128;
+        }
+        return 5;
+    }
+}
+
+/* Decode the back length ending at 'p' (that points to its last byte,
+ * scanning from right to left). Returns UINT64_MAX on invalid encodings. */
+static uint64_t lpDecodeBacklen(unsigned char *p) {
+    uint64_t val = 0;
+    uint64_t shift = 0;
+
+    do {
+        val |= (uint64_t)(p[0] & 127) << shift;
+        if (!(p[0] & 128)) break;
+        shift += 7;
+        p--;
+        if (shift > 28) return UINT64_MAX;
+    } while (1);
+    return val;
+}
+
+/* Write the string encoding header and the string itself at 'buf'. */
+static void lpEncodeString(unsigned char *buf, unsigned char *s, uint32_t len) {
+    if (len < 64) {
+        buf[0] = len | LP_ENCODING_6BIT_STR;
+        memcpy(buf+1,s,len);
+    } else if (len < 4096) {
+        buf[0] = (len >> 8) | LP_ENCODING_12BIT_STR;
+        buf[1] = len & 0xff;
+        memcpy(buf+2,s,len);
+    } else {
+        buf[0] = LP_ENCODING_32BIT_STR;
+        buf[1] = len & 0xff;
+        buf[2] = (len >> 8) & 0xff;
+        buf[3] = (len >> 16) & 0xff;
+        buf[4] = (len >> 24) & 0xff;
+        memcpy(buf+5,s,len);
+    }
+}
+
+/* Return the number of bytes of <encoding-type><element-data> of the
+ * entry at 'p'. */
+static uint32_t lpCurrentEncodedSize(unsigned char *p) {
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(p[0])) return 1+LP_ENCODING_6BIT_STR_LEN(p);
+    if (LP_ENCODING_IS_13BIT_INT(p[0])) return 2;
+    if (LP_ENCODING_IS_12BIT_STR(p[0])) return 2+LP_ENCODING_12BIT_STR_LEN(p);
+    switch(p[0]) {
+    case LP_ENCODING_16BIT_INT: return 3;
+    case LP_ENCODING_24BIT_INT: return 4;
+    case LP_ENCODING_32BIT_INT: return 5;
+    case LP_ENCODING_64BIT_INT: return 9;
+    case LP_ENCODING_32BIT_STR: return 5+LP_ENCODING_32BIT_STR_LEN(p);
+    case LP_EOF: return 1;
+    }
+    return 0;
+}
+
+/* Return the address of the entry after the one at 'p', that may be the
+ * terminator. */
+static unsigned char *lpSkip(unsigned char *p) {
+    unsigned long entrylen = lpCurrentEncodedSize(p);
+
+    entrylen += lpEncodeBacklen(NULL,entrylen);
+    return p+entrylen;
+}
+
+/* Return the entry after 'p', or NULL if 'p' is the last entry. 'p' may
+ * also be the terminator, in which case NULL is returned as well. */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    assert(p);
+    if (p[0] == LP_EOF) return NULL;
+    p = lpSkip(p);
+    assert(p < lp+lpGetTotalBytes(lp));
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return the entry before 'p', or NULL if 'p' is the first entry. 'p' may
+ * also be the terminator, to get the last entry. */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    uint64_t prevlen;
+
+    assert(p);
+    if (p-lp == LP_HDR_SIZE) return NULL;
+    p--; /* Last byte of the back length of the previous entry. */
+    prevlen = lpDecodeBacklen(p);
+    prevlen += lpEncodeBacklen(NULL,prevlen);
+    p -= prevlen-1;
+    assert(p >= lp+LP_HDR_SIZE);
+    return p;
+}
+
+/* Return the first entry of the listpack, or NULL if it is empty. */
+unsigned char *lpFirst(unsigned char *lp) {
+    unsigned char *p = lp+LP_HDR_SIZE;
+
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return the last entry of the listpack, or NULL if it is empty. */
+unsigned char *lpLast(unsigned char *lp) {
+    unsigned char *p = lp+lpGetTotalBytes(lp)-1; /* Terminator. */
+
+    return lpPrev(lp,p);
+}
+
+/* Return the number of elements. When the header field is saturated the
+ * listpack is scanned, and the header updated if the count now fits. */
+unsigned long lpLength(unsigned char *lp) {
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned long count = 0;
+    unsigned char *p;
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) return numele;
+    p = lpFirst(lp);
+    while (p) {
+        count++;
+        p = lpNext(lp,p);
+    }
+    if (count < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,count);
+    return count;
+}
+
+/* Decode the entry at 'p'. If it is a string, return a pointer to it and
+ * set '*count' to its length. If it is an integer and 'intbuf' is not NULL,
+ * the integer is converted to a string inside 'intbuf' (that must be at
+ * least LP_INTBUF_SIZE bytes) and handled as a string, otherwise NULL is
+ * returned and '*count' is set to the integer value. */
+unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
+    int64_t val;
+    uint64_t uval, negstart, negmax;
+
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) {
+        negstart = UINT64_MAX; /* 7 bit ints are always positive. */
+        negmax = 0;
+        uval = p[0] & 0x7f;
+    } else if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+        *count = LP_ENCODING_6BIT_STR_LEN(p);
+        return p+1;
+    } else if (LP_ENCODING_IS_13BIT_INT(p[0])) {
+        uval = ((p[0]&0x1f)<<8) | p[1];
+        negstart = (uint64_t)1<<12;
+        negmax = 8191;
+    } else if (p[0] == LP_ENCODING_16BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8;
+        negstart = (uint64_t)1<<15;
+        negmax = UINT16_MAX;
+    } else if (p[0] == LP_ENCODING_24BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16;
+        negstart = (uint64_t)1<<23;
+        negmax = UINT32_MAX>>8;
+    } else if (p[0] == LP_ENCODING_32BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16 |
+               (uint64_t)p[4]<<24;
+        negstart = (uint64_t)1<<31;
+        negmax = UINT32_MAX;
+    } else if (p[0] == LP_ENCODING_64BIT_INT) {
+        int j;
+
+        uval = 0;
+        for (j = 8; j >= 1; j--) uval = (uval<<8) | p[j];
+        negstart = (uint64_t)1<<63;
+        negmax = UINT64_MAX;
+    } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
+        *count = LP_ENCODING_12BIT_STR_LEN(p);
+        return p+2;
+    } else if (p[0] == LP_ENCODING_32BIT_STR) {
+        *count = LP_ENCODING_32BIT_STR_LEN(p);
+        return p+5;
+    } else {
+        assert(0); /* Invalid encoding: the listpack is corrupted. */
+        return NULL;
+    }
+
+    /* Convert the two's complement representation back to a signed
+     * integer, without relying on implementation defined casts. */
+    if (uval >= negstart) {
+        uval = negmax-uval;
+        val = uval;
+        val = -val-1;
+    } else {
+        val = uval;
+    }
+
+    if (intbuf) {
+        *count = ll2string((char*)intbuf,LP_INTBUF_SIZE,(long long)val);
+        return intbuf;
+    } else {
+        *count = val;
+        return NULL;
+    }
+}
+
+/* Like lpGet(), with an interface similar to ziplistGet(): if the entry is
+ * a string its address is returned and '*slen' is set to its length,
+ * otherwise NULL is returned and '*lval' is set to the integer value. */
+unsigned char *lpGetValue(unsigned char *p, unsigned int *slen, long long *lval) {
+    unsigned char *vstr;
+    int64_t ele_len;
+
+    vstr = lpGet(p,&ele_len,NULL);
+    if (vstr) {
+        *slen = ele_len;
+    } else {
+        *lval = ele_len;
+    }
+    return vstr;
+}
+
+/* Insert, delete or replace the element 'ele' of 'size' bytes at the
+ * entry 'p':
+ *
+ * LP_BEFORE inserts the element before 'p', LP_AFTER after it, and
+ * LP_REPLACE replaces the entry at 'p'. When 'ele' is NULL the entry at
+ * 'p' is deleted ('where' must be LP_REPLACE). 'p' may also be the
+ * terminator, to append with LP_BEFORE.
+ *
+ * Elements that are valid integers are stored with an integer encoding.
+ *
+ * The function returns the new listpack, that may have been reallocated,
+ * or NULL if the listpack would be larger than 2^32-1 bytes. If 'newp' is
+ * not NULL it is set to the address of the inserted or replaced entry, or,
+ * when deleting, of the entry that followed the deleted one (NULL if it was
+ * the last). */
+unsigned char *lpInsert(unsigned char *lp, unsigned char *ele, uint32_t size, unsigned char *p, int where, unsigned char **newp) {
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    unsigned char backlen[LP_MAX_BACKLEN_SIZE];
+    uint64_t enclen = 0;    /* Bytes of the new <encoding><data>. */
+    unsigned long backlen_size = 0;
+    unsigned long replaced_len = 0;
+    uint64_t old_listpack_bytes, new_listpack_bytes;
+    unsigned long poff;
+    unsigned char *dst;
+    int enctype = LP_ENCODING_STRING;
+
+    if (ele == NULL) where = LP_REPLACE;    /* Deletion. */
+    if (where == LP_AFTER) {
+        p = lpSkip(p);
+        where = LP_BEFORE;
+    }
+    poff = p-lp;
+
+    if (ele) {
+        enctype = lpEncodeGetType(ele,size,intenc,&enclen);
+        backlen_size = lpEncodeBacklen(backlen,enclen);
+    }
+    if (where == LP_REPLACE) {
+        replaced_len = lpCurrentEncodedSize(p);
+        replaced_len += lpEncodeBacklen(NULL,replaced_len);
+    }
+
+    old_listpack_bytes = lpGetTotalBytes(lp);
+    new_listpack_bytes = old_listpack_bytes+enclen+backlen_size-replaced_len;
+    if (new_listpack_bytes > UINT32_MAX) return NULL;
+
+    /* Grow before moving the tail on the right, or shrink after moving it
+     * on the left. */
+    dst = lp+poff;
+    if (new_listpack_bytes > old_listpack_bytes) {
+        lp = zrealloc(lp,new_listpack_bytes);
+        dst = lp+poff;
+    }
+    memmove(dst+enclen+backlen_size,dst+replaced_len,
+            old_listpack_bytes-poff-replaced_len);
+    if (new_listpack_bytes < old_listpack_bytes) {
+        lp = zrealloc(lp,new_listpack_bytes);
+        dst = lp+poff;
+    }
+
+    if (newp) {
+        *newp = dst;
+        /* When deleting the last element there is no next entry. */
+        if (!ele && dst[0] == LP_EOF) *newp = NULL;
+    }
+    if (ele) {
+        if (enctype == LP_ENCODING_INT)
+            memcpy(dst,intenc,enclen);
+        else
+            lpEncodeString(dst,ele,size);
+        dst += enclen;
+        memcpy(dst,backlen,backlen_size);
+    }
+
+    /* Update the header. */
+    if (where != LP_REPLACE || ele == NULL) {
+        uint32_t numele = lpGetNumElements(lp);
+        if (numele != LP_HDR_NUMELE_UNKNOWN) {
+            if (ele) numele++;
+            else numele--;
+            lpSetNumElements(lp,numele);
+        }
+    }
+    lpSetTotalBytes(lp,new_listpack_bytes);
+    return lp;
+}
+
+/* Append the element at the end of the listpack. */
+unsigned char *lpAppend(unsigned char *lp, unsigned char *ele, uint32_t size) {
+    unsigned char *eofptr = lp+lpGetTotalBytes(lp)-1;
+
+    return lpInsert(lp,ele,size,eofptr,LP_BEFORE,NULL);
+}
+
+/* Prepend the element at the start of the listpack. */
+unsigned char *lpPrepend(unsigned char *lp, unsigned char *ele, uint32_t size) {
+    return lpInsert(lp,ele,size,lp+LP_HDR_SIZE,LP_BEFORE,NULL);
+}
+
+/* Append an integer at the end of the listpack. */
+unsigned char *lpAppendInteger(unsigned char *lp, long long lval) {
+    char buf[LP_INTBUF_SIZE];
+    int len = ll2string(buf,sizeof(buf),lval);
+
+    return lpAppend(lp,(unsigned char*)buf,len);
+}
+
+/* Replace the entry at '*p' with the element, updating '*p' to the address
+ * of the new entry. */
+unsigned char *lpReplace(unsigned char *lp, unsigned char **p, unsigned char *ele, uint32_t size) {
+    return lpInsert(lp,ele,size,*p,LP_REPLACE,p);
+}
+
+/* Delete the entry at 'p'. See lpInsert() for the meaning of 'newp'. */
+unsigned char *lpDelete(unsigned char *lp, unsigned char *p, unsigned char **newp) {
+    return lpInsert(lp,NULL,0,p,LP_REPLACE,newp);
+}
+
+/* Delete 'num' entries starting at the entry 'p'. On return '*p' points to
+ * the entry that followed the deleted range, or to the terminator. */
+unsigned char *lpDeleteRangeWithEntry(unsigned char *lp, unsigned char **p, unsigned long num) {
+    unsigned char *first = *p, *tail;
+    unsigned long deleted = 0;
+    size_t offset = first-lp;
+    uint32_t bytes, numele;
+
+    if (num == 0) return lp;
+
+    tail = first;
+    while (num-- && tail[0] != LP_EOF) {
+        tail = lpSkip(tail);
+        deleted++;
+    }
+
+    bytes = lpGetTotalBytes(lp);
+    memmove(first,tail,lp+bytes-tail);
+    bytes -= tail-first;
+    lpSetTotalBytes(lp,bytes);
+    numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(lp,numele-deleted);
+    lp = zrealloc(lp,bytes);
+    *p = lp+offset;
+    return lp;
+}
+
+/* Delete 'num' entries starting at the entry with the specified index
+ * (negative indexes start from the tail, -1 is the last element). */
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned long num) {
+    unsigned char *first;
+
+    if (num == 0) return lp;
+    if ((first = lpSeek(lp,index)) == NULL) return lp;
+    return lpDeleteRangeWithEntry(lp,&first,num);
+}
+
+/* Merge the listpacks '*first' and '*second' into a single listpack with
+ * the entries of '*first' followed by the ones of '*second'. The larger of
+ * the two is reallocated to hold the result, and the other one is freed:
+ * on return the pointer to the freed listpack is set to NULL, and the other
+ * one to the merged listpack, that is also returned. NULL is returned,
+ * without changes, if the arguments are not two distinct listpacks or if
+ * the result would be larger than 2^32-1 bytes. */
+unsigned char *lpMerge(unsigned char **first, unsigned char **second) {
+    unsigned char *target, *source;
+    size_t fbytes, sbytes, lpbytes;
+    unsigned long numele;
+    int append;
+
+    if (first == NULL || *first == NULL || second == NULL ||
+        *second == NULL || *first == *second) return NULL;
+
+    fbytes = lpGetTotalBytes(*first);
+    sbytes = lpGetTotalBytes(*second);
+    lpbytes = fbytes+sbytes-LP_HDR_SIZE-1;
+    if (lpbytes > UINT32_MAX) return NULL;
+    numele = lpLength(*first)+lpLength(*second);
+
+    /* Reallocate the larger listpack, so that less data is moved. */
+    append = fbytes >= sbytes;
+    target = append ? *first : *second;
+    source = append ? *second : *first;
+    target = zrealloc(target,lpbytes);
+    if (append) {
+        /* Copy the entries of 'second' and its terminator over the
+         * terminator of 'first'. */
+        memcpy(target+fbytes-1,source+LP_HDR_SIZE,sbytes-LP_HDR_SIZE);
+    } else {
+        /* Move the entries of 'second' to the right, and copy the ones of
+         * 'first' before them. */
+        memmove(target+fbytes-1,target+LP_HDR_SIZE,sbytes-LP_HDR_SIZE);
+        memcpy(target+LP_HDR_SIZE,source+LP_HDR_SIZE,fbytes-LP_HDR_SIZE-1);
+    }
+    lpSetTotalBytes(target,lpbytes);
+    if (numele > LP_HDR_NUMELE_UNKNOWN) numele = LP_HDR_NUMELE_UNKNOWN;
+    lpSetNumElements(target,numele);
+    lpFree(source);
+
+    *first = append ? target : NULL;
+    *second = append ? NULL : target;
+    return target;
+}
+
+/* Return the entry at the specified index (negative indexes start from the
+ * tail, -1 is the last element), or NULL if out of range. The listpack is
+ * walked from the nearest end when the number of elements is known. */
+unsigned char *lpSeek(unsigned char *lp, long index) {
+    int forward = 1;
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned char *ele;
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) {
+        if (index < 0) index = (long)numele+index;
+        if (index < 0) return NULL;
+        if (index >= (long)numele) return NULL;
+        /* Seek from the tail when the index is in the second half. */
+        if (index > (long)numele/2) {
+            forward = 0;
+            index -= numele;
+        }
+    } else if (index < 0) {
+        forward = 0;
+    }
+
+    if (forward) {
+        ele = lpFirst(lp);
+        while (index > 0 && ele) {
+            ele = lpNext(lp,ele);
+            index--;
+        }
+    } else {
+        ele = lpLast(lp);
+        while (index < -1 && ele) {
+            ele = lpPrev(lp,ele);
+            index++;
+        }
+    }
+    return ele;
+}
+
+/* Return 1 if the entry at 'p' is equal to the string 's', 0 otherwise. */
+int lpCompare(unsigned char *p, unsigned char *s, uint32_t slen) {
+    unsigned char *value;
+    int64_t sz;
+
+    if (p[0] == LP_EOF) return 0;
+    value = lpGet(p,&sz,NULL);
+    if (value) {
+        return (slen == sz) && memcmp(value,s,slen) == 0;
+    } else {
+        long long sval;
+
+        /* Integers are always stored with an integer encoding, so a string
+         * that can't be parsed as an integer never matches. */
+        if (slen <= 20 && string2ll((char*)s,slen,&sval))
+            return sz == sval;
+    }
+    return 0;
+}
+
+/* Find the entry equal to 's' starting at 'p', comparing only one entry
+ * every 'skip'+1 entries (for instance 1 to compare only the fields of a
+ * field/value listpack). Returns NULL when not found. */
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, uint32_t slen, unsigned int skip) {
+    int skipcnt = 0;
+    int vencoding = 0;      /* 0 unknown, 1 integer, 2 not an integer. */
+    long long vll = 0;
+
+    while (p) {
+        if (skipcnt == 0) {
+            unsigned char *value;
+            int64_t ll;
+
+            value = lpGet(p,&ll,NULL);
+            if (value) {
+                if (slen == ll && memcmp(value,s,slen) == 0) return p;
+            } else {
+                /* Parse 's' as an integer only once, the first time an
+                 * integer entry is found. */
+                if (vencoding == 0) {
+                    if (slen <= 20 && string2ll((char*)s,slen,&vll))
+                        vencoding = 1;
+                    else
+                        vencoding = 2;
+                }
+                if (vencoding == 1 && ll == vll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpNext(lp,p);
+    }
+    return NULL;
+}
+
+/* Validate the listpack of 'size' bytes (for instance just loaded from an
+ * RDB file): the header must match the size, every entry must be inside
+ * the listpack with a consistent back length, and the number of elements
+ * must match the header. Returns 1 if valid, 0 otherwise. */
+int lpValidateIntegrity(unsigned char *lp, size_t size) {
+    unsigned char *p, *end;
+    unsigned long count = 0;
+    uint32_t numele;
+
+    if (size < LP_HDR_SIZE+1) return 0;
+    if (lpGetTotalBytes(lp) != size) return 0;
+    if (lp[size-1] != LP_EOF) return 0;
+
+    p = lp+LP_HDR_SIZE;
+    end = lp+size-1;
+    while (p < end) {
+        uint64_t enclen, backlen_size, hdrlen = 1;
+
+        /* The bytes holding the string length must be inside the listpack
+         * before they can be read. */
+        if (LP_ENCODING_IS_13BIT_INT(p[0]) || LP_ENCODING_IS_12BIT_STR(p[0]))
+            hdrlen = 2;
+        else if (p[0] == LP_ENCODING_32BIT_STR)
+            hdrlen = 5;
+        if ((uint64_t)(end-p) < hdrlen) return 0;
+        enclen = lpCurrentEncodedSize(p);
+        if (enclen == 0 || p[0] == LP_EOF) return 0;
+        backlen_size = lpEncodeBacklen(NULL,enclen);
+        if ((uint64_t)(end-p) < enclen+backlen_size) return 0;
+        if (lpDecodeBacklen(p+enclen+backlen_size-1) != enclen) return 0;
+        p += enclen+backlen_size;
+        count++;
+    }
+    if (p != end) return 0;
+    numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN && numele != count) return 0;
+    return 1;
+}
+
+#ifdef REDIS_TEST
+#include <sys/time.h>
+#include "ziplist.h"
+
+#define UNUSED(x) (void)(x)
+#define TEST(descr) printf("%s: ", descr);
+#define PASSED() printf("PASSED\n")
+#define lpassert(_e) do { \
+    if (!(_e)) { \
+        printf("\n\n=== ASSERTION FAILED ===\n"); \
+        printf("==> %s:%d '%s' is not true\n",__FILE__,__LINE__,#_e); \
+        exit(1); \
+    } \
+} while(0)
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Return the element at 'p' as a string in 'buf'. */
+static char *lpGetString(unsigned char *p, char *buf) {
+    unsigned char intbuf[LP_INTBUF_SIZE];
+    unsigned char *s;
+    int64_t len;
+
+    s = lpGet(p,&len,intbuf);
+    memcpy(buf,s,len);
+    buf[len] = '\0';
+    return buf;
+}
+
+int listpackTest(int argc, char *argv[]) {
+    unsigned char *lp, *p;
+    char buf[8192];
+    int j;
+    UNUSED(argc);
+    UNUSED(argv);
+
+    TEST("Create an empty listpack") {
+        lp = lpNew();
+        lpassert(lpLength(lp) == 0);
+        lpassert(lpBytes(lp) == LP_HDR_SIZE+1);
+        lpassert(lpFirst(lp) == NULL && lpLast(lp) == NULL);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Integers round trip with the smallest encoding") {
+        long long values[] = {0, 1, 127, 128, -1, -4096, 4095, 4096, -4097,
+            32767, -32768, 32768, 8388607, -8388608, 8388608, 2147483647,
+            -2147483648LL, 2147483648LL, LLONG_MAX, LLONG_MIN};
+        size_t sizes[] = {1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 5, 5, 5,
+            9, 9, 9};
+        int n = sizeof(values)/sizeof(values[0]);
+
+        lp = lpNew();
+        for (j = 0; j < n; j++) {
+            size_t before = lpBytes(lp);
+            lp = lpAppendInteger(lp,values[j]);
+            /* Encoding + 1 byte of back length. */
+            lpassert(lpBytes(lp)-before == sizes[j]+1);
+        }
+        lpassert(lpLength(lp) == (unsigned long)n);
+        p = lpFirst(lp);
+        for (j = 0; j < n; j++) {
+            unsigned int slen;
+            long long lval;
+            lpassert(lpGetValue(p,&slen,&lval) == NULL);
+            lpassert(lval == values[j]);
+            p = lpNext(lp,p);
+        }
+        lpassert(p == NULL);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Strings of every length class, forward and backward") {
+        int lens[] = {0, 1, 63, 64, 127, 128, 4095, 4096, 5000};
+        int n = sizeof(lens)/sizeof(lens[0]);
+        char *s = zmalloc(5000);
+
+        memset(s,'x',5000);
+        lp = lpNew();
+        for (j = 0; j < n; j++) lp = lpAppend(lp,(unsigned char*)s,lens[j]);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        p = lpLast(lp);
+        for (j = n-1; j >= 0; j--) {
+            int64_t len;
+            lpassert(lpGet(p,&len,NULL) != NULL);
+            lpassert(len == lens[j]);
+            p = lpPrev(lp,p);
+        }
+        lpassert(p == NULL);
+        lpFree(lp);
+        zfree(s);
+        PASSED();
+    }
+
+    TEST("Insert, replace and delete in the middle") {
+        lp = lpNew();
+        lp = lpAppend(lp,(unsigned char*)"a",1);
+        lp = lpAppend(lp,(unsigned char*)"c",1);
+        p = lpFirst(lp);
+        lp = lpInsert(lp,(unsigned char*)"b",1,p,LP_AFTER,&p);
+        lpassert(!strcmp(lpGetString(p,buf),"b"));
+        lp = lpPrepend(lp,(unsigned char*)"1234",4);
+        lpassert(lpLength(lp) == 4);
+        lpassert(!strcmp(lpGetString(lpSeek(lp,0),buf),"1234"));
+        lpassert(!strcmp(lpGetString(lpSeek(lp,-1),buf),"c"));
+        lpassert(!strcmp(lpGetString(lpSeek(lp,2),buf),"b"));
+        lpassert(lpSeek(lp,4) == NULL && lpSeek(lp,-5) == NULL);
+
+        p = lpSeek(lp,2);
+        lp = lpReplace(lp,&p,(unsigned char*)"a much longer string",20);
+        lpassert(!strcmp(lpGetString(p,buf),"a much longer string"));
+        lpassert(!strcmp(lpGetString(lpNext(lp,p),buf),"c"));
+        lpassert(lpLength(lp) == 4);
+
+        p = lpSeek(lp,1);
+        lp = lpDelete(lp,p,&p);
+        lpassert(!strcmp(lpGetString(p,buf),"a much longer string"));
+        p = lpLast(lp);
+        lp = lpDelete(lp,p,&p);
+        lpassert(p == NULL);
+        lpassert(lpLength(lp) == 2);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Find and compare, with skip") {
+        lp = lpNew();
+        lp = lpAppend(lp,(unsigned char*)"field",5);
+        lp = lpAppend(lp,(unsigned char*)"100",3);
+        lp = lpAppend(lp,(unsigned char*)"100",3);
+        lp = lpAppend(lp,(unsigned char*)"value",5);
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"100",3,1);
+        lpassert(p == lpSeek(lp,2));
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"value",5,1);
+        lpassert(p == NULL);
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"value",5,0);
+        lpassert(p == lpSeek(lp,3));
+        lpassert(lpCompare(lpSeek(lp,1),(unsigned char*)"100",3));
+        lpassert(!lpCompare(lpSeek(lp,1),(unsigned char*)"0100",4));
+        lpassert(!lpCompare(lpSeek(lp,0),(unsigned char*)"fiel",4));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Delete ranges") {
+        lp = lpNew();
+        for (j = 0; j < 10; j++) lp = lpAppendInteger(lp,j);
+        lp = lpDeleteRange(lp,2,3);
+        lpassert(lpLength(lp) == 7);
+        lpassert(!strcmp(lpGetString(lpSeek(lp,2),buf),"5"));
+        lp = lpDeleteRange(lp,-2,10);
+        lpassert(lpLength(lp) == 5);
+        lpassert(!strcmp(lpGetString(lpLast(lp),buf),"7"));
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Merge listpacks") {
+        unsigned char *a, *b;
+
+        /* The larger listpack is the one reallocated, in both orders. */
+        for (j = 0; j < 2; j++) {
+            int k, small = j ? 3 : 50, large = j ? 50 : 3;
+
+            a = lpNew();
+            b = lpNew();
+            for (k = 0; k < small; k++) a = lpAppendInteger(a,k);
+            for (k = 0; k < large; k++) b = lpAppendInteger(b,small+k);
+            lp = lpMerge(&a,&b);
+            lpassert(lp != NULL);
+            lpassert(j ? (a == NULL && b == lp) : (b == NULL && a == lp));
+            lpassert(lpLength(lp) == (unsigned long)(small+large));
+            lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+            p = lpFirst(lp);
+            for (k = 0; k < small+large; k++) {
+                lpassert(atoi(lpGetString(p,buf)) == k);
+                p = lpNext(lp,p);
+            }
+            lpassert(p == NULL);
+            lpFree(lp);
+        }
+        a = lpNew();
+        lpassert(lpMerge(&a,&a) == NULL);
+        lpFree(a);
+        PASSED();
+    }
+
+    TEST("More than 65535 elements") {
+        lp = lpNew();
+        for (j = 0; j < 70000; j++) lp = lpAppendInteger(lp,j);
+        lpassert(lpLength(lp) == 70000);
+        lpassert(!strcmp(lpGetString(lpSeek(lp,-1),buf),"69999"));
+        lp = lpDeleteRange(lp,0,10000);
+        lpassert(lpLength(lp) == 60000);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Corrupted listpacks are detected") {
+        lp = lpNew();
+        lp = lpAppend(lp,(unsigned char*)"hello",5);
+        lp = lpAppendInteger(lp,1000);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        lpassert(!lpValidateIntegrity(lp,lpBytes(lp)-1));
+        lp[LP_HDR_SIZE] = LP_ENCODING_6BIT_STR|40; /* Too long string. */
+        lpassert(!lpValidateIntegrity(lp,lpBytes(lp)));
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Random operations against a reference array") {
+        char *ref[256];
+        int len = 0, iter;
+
+        srand(1234);
+        lp = lpNew();
+        for (iter = 0; iter < 20000; iter++) {
+            int op = rand() % 4, idx;
+            char ele[64];
+
+            if (rand() % 2)
+                snprintf(ele,sizeof(ele),"%lld",
+                    (long long)(rand() - RAND_MAX/2) * (rand() % 3 ? 1 : 65536));
+            else
+                snprintf(ele,sizeof(ele),"str%.*s",rand() % 50,
+                    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+            if (len == 0 || (op <= 1 && len < 256)) {
+                idx = len ? rand() % (len+1) : 0;
+                if (idx == len)
+                    lp = lpAppend(lp,(unsigned char*)ele,strlen(ele));
+                else
+                    lp = lpInsert(lp,(unsigned char*)ele,strlen(ele),
+                                  lpSeek(lp,idx),LP_BEFORE,NULL);
+                memmove(ref+idx+1,ref+idx,sizeof(char*)*(len-idx));
+                ref[idx] = zstrdup(ele);
+                len++;
+            } else if (op == 2) {
+                idx = rand() % len;
+                p = lpSeek(lp,idx);
+                lp = lpReplace(lp,&p,(unsigned char*)ele,strlen(ele));
+                zfree(ref[idx]);
+                ref[idx] = zstrdup(ele);
+            } else {
+                idx = rand() % len;
+                lp = lpDelete(lp,lpSeek(lp,idx),NULL);
+                zfree(ref[idx]);
+                memmove(ref+idx,ref+idx+1,sizeof(char*)*(len-idx-1));
+                len--;
+            }
+        }
+        lpassert(lpLength(lp) == (unsigned long)len);
+        lpassert(lpValidateIntegrity(lp,lpBytes(lp)));
+        p = lpFirst(lp);
+        for (j = 0; j < len; j++) {
+            lpassert(!strcmp(lpGetString(p,buf),ref[j]));
+            p = lpNext(lp,p);
+            zfree(ref[j]);
+        }
+        lpFree(lp);
+        PASSED();
+    }
+
+    TEST("Benchmark: insert in the middle of 500 entries") {
+        long long start;
+
+        lp = lpNew();
+        for (j = 0; j < 500; j++) lp = lpAppend(lp,(unsigned char*)"quux",4);
+        start = usec();
+        for (j = 0; j < 100000; j++) {
+            lp = lpInsert(lp,(unsigned char*)"foo",3,lpSeek(lp,250),
+                          LP_BEFORE,NULL);
+            lp = lpDeleteRange(lp,250,1);
+        }
+        printf("%lld usec for 100k insert+delete ",usec()-start);
+        lpFree(lp);
+        PASSED();
+    }
+
+    /* A ziplist entry of 250 bytes takes 253 bytes, with the 1 byte prevlen
+     * of its successor: inserting or growing an entry to 254 bytes or more
+     * before a run of such entries makes every one of them grow to a 5 bytes
+     * prevlen, one reallocation at a time. Listpack entries only store their
+     * own length, so the same operations only move the tail once. */
+    TEST("Benchmark: cascade near the 254 bytes prevlen boundary") {
+        unsigned char *zl, *copy, val[260];
+        long long zl_insert = 0, zl_update = 0, lp_insert = 0, lp_update = 0;
+        long long start;
+        size_t zlbytes, lpbytes;
+        int iter;
+
+        memset(val,'x',sizeof(val));
+        zl = ziplistNew();
+        lp = lpNew();
+        for (j = 0; j < 500; j++) {
+            zl = ziplistPush(zl,val,250,ZIPLIST_TAIL);
+            lp = lpAppend(lp,val,250);
+        }
+        zlbytes = ziplistBlobLen(zl);
+        lpbytes = lpBytes(lp);
+
+        for (iter = 0; iter < 100; iter++) {
+            /* Insert a 254 bytes entry in the middle. */
+            copy = zmalloc(zlbytes);
+            memcpy(copy,zl,zlbytes);
+            start = usec();
+            copy = ziplistInsert(copy,ziplistIndex(copy,250),val,254);
+            zl_insert += usec()-start;
+            zfree(copy);
+
+            copy = zmalloc(lpbytes);
+            memcpy(copy,lp,lpbytes);
+            start = usec();
+            copy = lpInsert(copy,val,254,lpSeek(copy,250),LP_BEFORE,NULL);
+            lp_insert += usec()-start;
+            lpassert(lpLength(copy) == 501);
+            lpFree(copy);
+
+            /* Grow the entry in the middle from 250 to 254 bytes. */
+            copy = zmalloc(zlbytes);
+            memcpy(copy,zl,zlbytes);
+            start = usec();
+            p = ziplistIndex(copy,250);
+            copy = ziplistDelete(copy,&p);
+            copy = ziplistInsert(copy,p,val,254);
+            zl_update += usec()-start;
+            zfree(copy);
+
+            copy = zmalloc(lpbytes);
+            memcpy(copy,lp,lpbytes);
+            start = usec();
+            p = lpSeek(copy,250);
+            copy = lpReplace(copy,&p,val,254);
+            lp_update += usec()-start;
+            lpassert(lpLength(copy) == 500);
+            lpFree(copy);
+        }
+        printf("\n  insert: ziplist %lld usec, listpack %lld usec (100 ops)",
+            zl_insert,lp_insert);
+        printf("\n  update: ziplist %lld usec, listpack %lld usec (100 ops) ",
+            zl_update,lp_update);
+        zfree(zl);
+        lpFree(lp);
+        PASSED();
+    }
+    return 0;
+}
+#endif
@@ -114,7 +114,7 @@ void execCommandPropagateMulti(client *c) {
 void execCommand(client *c) {
     int j;
     robj **orig_argv;
-    int orig_argc;
+    int orig_argc, orig_argv_len;
     struct redisCommand *orig_cmd;
     int must_propagate = 0; /* Need to propagate MULTI/EXEC to AOF / slaves? */
 
@@ -140,6 +140,7 @@ void execCommand(client *c) {
     unwatchAllKeys(c); /* Unwatch ASAP otherwise we'll waste CPU cycles */
     orig_argv = c->argv;
     orig_argc = c->argc;
+    orig_argv_len = c->argv_len;
     orig_cmd = c->cmd;
     addReplyMultiBulkLen(c,c->mstate.count);
     for (j = 0; j < c->mstate.count; j++) {
@@ -165,6 +166,7 @@ void execCommand(client *c) {
     }
     c->argv = orig_argv;
     c->argc = orig_argc;
+    c->argv_len = orig_argv_len;
     c->cmd = orig_cmd;
     discardTransaction(c);
     /* Make sure the EXEC command will be propagated as well if MULTI
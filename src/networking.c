@@ -28,10 +28,28 @@
  */
 
 #include "server.h"
+#include "atomicvar.h"
 #include <sys/uio.h>
 #include <math.h>
-
-static void setProtocolError(client *c, int pos);
+#include <limits.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static void setProtocolError(client *c);
+int postponeClientRead(client *c);
+int ProcessingEventsWhileBlocked = 0; /* See processEventsWhileBlocked(). */
+
+/* Threaded I/O state, see the "Threaded I/O" section at the end of the file
+ * for the details. The operation is only set to IO_THREADS_OP_READ or
+ * IO_THREADS_OP_WRITE while the I/O threads (and the main thread with them)
+ * are serving a slice of the clients. */
+#define IO_THREADS_OP_IDLE 0
+#define IO_THREADS_OP_READ 1
+#define IO_THREADS_OP_WRITE 2
+static int io_threads_op = IO_THREADS_OP_IDLE;
+pthread_mutex_t io_threads_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* Return the size consumed from the allocator, for the specified SDS string,
  * including internal fragmentation. This function is used in order to compute
@@ -88,10 +106,13 @@ client *createClient(int fd) {
     c->name = NULL;
     c->bufpos = 0;
     c->querybuf = sdsempty();
+    c->qb_pos = 0;
     c->querybuf_peak = 0;
     c->reqtype = 0;
     c->argc = 0;
     c->argv = NULL;
+    c->argv_len = 0;
+    c->argv_pool_len = 0;
     c->cmd = c->lastcmd = NULL;
     c->multibulklen = 0;
     c->bulklen = -1;
@@ -101,6 +122,7 @@ client *createClient(int fd) {
     c->authenticated = 0;
     c->replstate = REPL_STATE_NONE;
     c->repl_put_online_on_ack = 0;
+    c->read_reploff = 0;
     c->reploff = 0;
     c->repl_ack_off = 0;
     c->repl_ack_time = 0;
@@ -123,6 +145,7 @@ client *createClient(int fd) {
     c->pubsub_channels = dictCreate(&setDictType,NULL);
     c->pubsub_patterns = listCreate();
     c->peerid = NULL;
+    c->pending_querybuf = sdsempty();
     listSetFreeMethod(c->pubsub_patterns,decrRefCountVoid);
     listSetMatchMethod(c->pubsub_patterns,listMatchObjects);
     if (fd != -1) listAddNodeTail(server.clients,c);
@@ -167,12 +190,31 @@ int prepareClientToWrite(client *c) {
 
     if (c->fd <= 0) return C_ERR; /* Fake client for AOF loading. */
 
+    /* Schedule the client to write the output buffers to the socket, unless
+     * it should already be setup to do so (it has already pending data).
+     *
+     * If CLIENT_PENDING_READ is set, we're in an I/O thread and should
+     * not install a write handler. Instead, it will be done by
+     * handleClientsWithPendingReadsUsingThreads() upon return. */
+    if (!clientHasPendingReplies(c) && !(c->flags & CLIENT_PENDING_READ))
+        clientInstallWriteHandler(c);
+
+    /* Authorize the caller to queue in the output buffer of this client. */
+    return C_OK;
+}
+
+/* This function puts the client in the queue of clients that should write
+ * their output buffers to the socket. Note that it does not *yet* install
+ * the write handler, to start clients are put in a queue of clients that need
+ * to write, so we try to do that before returning in the event loop (see the
+ * handleClientsWithPendingWrites() function).
+ * If we fail and there is more data to write, compared to what the socket
+ * buffers can hold, then we'll really install the handler. */
+void clientInstallWriteHandler(client *c) {
     /* Schedule the client to write the output buffers to the socket only
-     * if not already done (there were no pending writes already and the client
-     * was yet not flagged), and, for slaves, if the slave can actually
-     * receive writes at this stage. */
-    if (!clientHasPendingReplies(c) &&
-        !(c->flags & CLIENT_PENDING_WRITE) &&
+     * if not already done (the client was yet not flagged), and, for slaves,
+     * if the slave can actually receive writes at this stage. */
+    if (!(c->flags & CLIENT_PENDING_WRITE) &&
         (c->replstate == REPL_STATE_NONE ||
          (c->replstate == SLAVE_STATE_ONLINE && !c->repl_put_online_on_ack)))
     {
@@ -183,33 +225,25 @@ int prepareClientToWrite(client *c) {
          * a system call. We'll only really install the write handler if
          * we'll not be able to write the whole reply at once. */
         c->flags |= CLIENT_PENDING_WRITE;
-        listAddNodeHead(server.clients_pending_write,c);
-    }
-
-    /* Authorize the caller to queue in the output buffer of this client. */
-    return C_OK;
-}
-
-/* Create a duplicate of the last object in the reply list when
- * it is not exclusively owned by the reply list. */
-robj *dupLastObjectIfNeeded(list *reply) {
-    robj *new, *cur;
-    listNode *ln;
-    serverAssert(listLength(reply) > 0);
-    ln = listLast(reply);
-    cur = listNodeValue(ln);
-    if (cur->refcount > 1) {
-        new = dupStringObject(cur);
-        decrRefCount(cur);
-        listNodeValue(ln) = new;
+        c->pending_write_node.value = c;
+        listLinkNodeHead(server.clients_pending_write,&c->pending_write_node);
     }
-    return listNodeValue(ln);
 }
 
 /* -----------------------------------------------------------------------------
  * Low level functions to add more data to output buffers.
  * -------------------------------------------------------------------------- */
 
+/* Return true if more data can be appended to the object 'o' at the tail of
+ * a client reply list. Objects that are not exclusively owned by the reply
+ * list, like shared objects, values of the keyspace or replies shared
+ * among clients (see addReplyShared()), are never modified: a new node is
+ * added instead, so that we don't need to copy them. */
+static int replyObjectIsAppendable(robj *o) {
+    return o->ptr != NULL && o->encoding == OBJ_ENCODING_RAW &&
+           o->refcount == 1;
+}
+
 int _addReplyToBuffer(client *c, const char *s, size_t len) {
     size_t available = sizeof(c->buf)-c->bufpos;
 
@@ -227,6 +261,12 @@ int _addReplyToBuffer(client *c, const char *s, size_t len) {
     return C_OK;
 }
 
+/* Add the object to the reply list. Unless it is small enough to be
+ * appended to the tail, the object itself is linked with its reference
+ * count incremented, so that big values (like the ones returned by GET) are
+ * written directly from the keyspace without being copied. Commands that
+ * modify strings in place call dbUnshareStringValue(), which creates a
+ * private copy of the value if a reply is still referencing it. */
 void _addReplyObjectToList(client *c, robj *o) {
     robj *tail;
 
@@ -240,12 +280,10 @@ void _addReplyObjectToList(client *c, robj *o) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            tail->encoding == OBJ_ENCODING_RAW &&
+        if (replyObjectIsAppendable(tail) &&
             sdslen(tail->ptr)+sdslen(o->ptr) <= PROTO_REPLY_CHUNK_BYTES)
         {
             c->reply_bytes -= sdsZmallocSize(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
             c->reply_bytes += sdsZmallocSize(tail->ptr);
         } else {
@@ -274,11 +312,10 @@ void _addReplySdsToList(client *c, sds s) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == OBJ_ENCODING_RAW &&
+        if (replyObjectIsAppendable(tail) &&
             sdslen(tail->ptr)+sdslen(s) <= PROTO_REPLY_CHUNK_BYTES)
         {
             c->reply_bytes -= sdsZmallocSize(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
             c->reply_bytes += sdsZmallocSize(tail->ptr);
             sdsfree(s);
@@ -304,11 +341,10 @@ void _addReplyStringToList(client *c, const char *s, size_t len) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == OBJ_ENCODING_RAW &&
+        if (replyObjectIsAppendable(tail) &&
             sdslen(tail->ptr)+len <= PROTO_REPLY_CHUNK_BYTES)
         {
             c->reply_bytes -= sdsZmallocSize(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,len);
             c->reply_bytes += sdsZmallocSize(tail->ptr);
         } else {
@@ -362,6 +398,26 @@ void addReply(client *c, robj *obj) {
     }
 }
 
+/* Add a reply already in protocol format that is shared among many clients,
+ * like the message PUBLISH sends to every subscriber. Small replies are
+ * copied as usually, while big ones are just referenced by the client reply
+ * list, so that sending the same payload to N clients does not cost N
+ * copies of it. The object must not be modified after this call. */
+void addReplyShared(client *c, robj *obj) {
+    size_t len = sdslen(obj->ptr);
+
+    if (len < PROTO_SHARED_REPLY_MIN_BYTES) {
+        addReply(c,obj);
+        return;
+    }
+    if (prepareClientToWrite(c) != C_OK) return;
+    if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
+    incrRefCount(obj);
+    listAddNodeTail(c->reply,obj);
+    c->reply_bytes += getStringObjectSdsUsedMemory(obj);
+    asyncCloseClientOnOutputBufferLimitReached(c);
+}
+
 void addReplySds(client *c, sds s) {
     if (prepareClientToWrite(c) != C_OK) {
         /* The caller expects the sds to be free'd. */
@@ -722,14 +778,77 @@ void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
 }
 
+/* Release the arguments of the current command. Embedded string arguments
+ * that nobody else references are kept in the client argv_pool (up to
+ * PROTO_ARGV_POOL_SIZE objects), so that createClientArgObject() can reuse
+ * them to parse the next command without allocating memory. */
 static void freeClientArgv(client *c) {
     int j;
-    for (j = 0; j < c->argc; j++)
-        decrRefCount(c->argv[j]);
+    for (j = 0; j < c->argc; j++) {
+        robj *o = c->argv[j];
+
+        if (o->refcount == 1 && o->encoding == OBJ_ENCODING_EMBSTR &&
+            c->argv_pool_len < PROTO_ARGV_POOL_SIZE)
+        {
+            c->argv_pool[c->argv_pool_len++] = o;
+        } else {
+            decrRefCount(o);
+        }
+    }
     c->argc = 0;
     c->cmd = NULL;
 }
 
+/* Release the argument objects cached by freeClientArgv(). */
+void freeClientArgvPool(client *c) {
+    while(c->argv_pool_len) decrRefCount(c->argv_pool[--c->argv_pool_len]);
+}
+
+/* Return a string object for the argument 'ptr' of 'len' bytes. Arguments
+ * that fit an embedded string reuse the smallest object of the client
+ * argv_pool that can hold them, if any. */
+static robj *createClientArgObject(client *c, const char *ptr, size_t len) {
+    struct sdshdr8 *sh;
+    robj *o;
+    int j, best = -1;
+
+    if (len > OBJ_ENCODING_EMBSTR_SIZE_LIMIT)
+        return createRawStringObject(ptr,len);
+
+    for (j = 0; j < c->argv_pool_len; j++) {
+        size_t room = sdsalloc(c->argv_pool[j]->ptr);
+        if (room >= len &&
+            (best == -1 || room < sdsalloc(c->argv_pool[best]->ptr)))
+            best = j;
+    }
+
+    if (best == -1) {
+        o = createEmbeddedStringObject(ptr,len);
+#ifdef HAVE_MALLOC_SIZE
+        /* Use all the room the allocator reserved: the object will be able
+         * to hold longer arguments once recycled. */
+        sh = (void*)(o+1);
+        sh->alloc = zmalloc_size(o)-sizeof(robj)-sizeof(*sh)-1;
+        if (sh->alloc > OBJ_ENCODING_EMBSTR_SIZE_LIMIT)
+            sh->alloc = OBJ_ENCODING_EMBSTR_SIZE_LIMIT;
+#endif
+        return o;
+    }
+
+    o = c->argv_pool[best];
+    c->argv_pool[best] = c->argv_pool[--c->argv_pool_len];
+    sh = (void*)(o+1);
+    memcpy(sh->buf,ptr,len);
+    sh->buf[len] = '\0';
+    sh->len = len;
+    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+        o->lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
+    } else {
+        o->lru = LRU_CLOCK();
+    }
+    return o;
+}
+
 /* Close all the slaves connections. This is useful in chained replication
  * when we resync with our own master and want to force all our slaves to
  * resync with us as well. */
@@ -767,12 +886,18 @@ void unlinkClient(client *c) {
 
     /* Remove from the list of pending writes if needed. */
     if (c->flags & CLIENT_PENDING_WRITE) {
-        ln = listSearchKey(server.clients_pending_write,c);
-        serverAssert(ln != NULL);
-        listDelNode(server.clients_pending_write,ln);
+        listUnlinkNode(server.clients_pending_write,&c->pending_write_node);
         c->flags &= ~CLIENT_PENDING_WRITE;
     }
 
+    /* Remove from the list of pending reads if needed. */
+    if (c->flags & CLIENT_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        serverAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+        c->flags &= ~CLIENT_PENDING_READ;
+    }
+
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list of unblocked clients. */
     if (c->flags & CLIENT_UNBLOCKED) {
@@ -811,6 +936,7 @@ void freeClient(client *c) {
 
     /* Free the query buffer */
     sdsfree(c->querybuf);
+    sdsfree(c->pending_querybuf);
     c->querybuf = NULL;
 
     /* Deallocate structures used to block on blocking ops. */
@@ -830,6 +956,7 @@ void freeClient(client *c) {
     /* Free data structures. */
     listRelease(c->reply);
     freeClientArgv(c);
+    freeClientArgvPool(c);
 
     /* Unlink the client: this will close the socket, remove the I/O
      * handlers, and remove references of the client from different
@@ -881,9 +1008,32 @@ void freeClient(client *c) {
  * a context where calling freeClient() is not possible, because the client
  * should be valid for the continuation of the flow of the program. */
 void freeClientAsync(client *c) {
+    /* We need to handle concurrent access to the server.clients_to_close list
+     * only in the freeClientAsync() function, since it's the only function that
+     * may access the list while Redis uses I/O threads. All the other accesses
+     * are in the context of the main thread while the other threads are
+     * idle. */
+    static pthread_mutex_t async_free_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+
     if (c->flags & CLIENT_CLOSE_ASAP || c->flags & CLIENT_LUA) return;
     c->flags |= CLIENT_CLOSE_ASAP;
+    if (server.io_threads_num == 1) {
+        /* no need to bother with locking if there's just one thread (the main thread) */
+        listAddNodeTail(server.clients_to_close,c);
+        return;
+    }
+    pthread_mutex_lock(&async_free_queue_mutex);
     listAddNodeTail(server.clients_to_close,c);
+    pthread_mutex_unlock(&async_free_queue_mutex);
+}
+
+/* Free the client synchronously, unless we are in the context of an I/O
+ * thread, in which case the client is scheduled for asynchronous freeing. */
+void freeClientMaybeAsync(client *c) {
+    if (c->flags & CLIENT_PENDING_READ)
+        freeClientAsync(c);
+    else
+        freeClient(c);
 }
 
 void freeClientsInAsyncFreeQueue(void) {
@@ -897,16 +1047,120 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
+/* Remove the object at the head of the reply list of the client.
+ *
+ * Objects in the reply list may be shared among different clients (think
+ * of the replication stream sent to multiple slaves, or a big value that
+ * two clients are fetching at the same time). When the I/O threads are
+ * writing, clients sharing the same object may be served by different
+ * threads, so the reference is released with an atomic decrement: all the
+ * other refcount updates are performed by the main thread while the I/O
+ * threads are idle. */
+static void delClientReplyHead(client *c) {
+    listNode *ln = listFirst(c->reply);
+    robj *o;
+    int refcount;
+
+    if (io_threads_op == IO_THREADS_OP_IDLE) {
+        listDelNode(c->reply,ln);
+        return;
+    }
+
+    o = listNodeValue(ln);
+    listSetFreeMethod(c->reply,NULL);
+    listDelNode(c->reply,ln);
+    listSetFreeMethod(c->reply,decrRefCountVoid);
+    if (o->refcount == OBJ_SHARED_REFCOUNT) return;
+    atomicDecrGet(o->refcount,refcount,1,io_threads_stats_mutex);
+    if (refcount == 0) {
+        /* We were the last owner: no other thread can reach the object
+         * anymore, release it with the usual code path. */
+        o->refcount = 1;
+        decrRefCount(o);
+    }
+}
+
+/* Send the static buffer and as many reply list objects as possible with a
+ * single writev() call, so that pipelined clients and replies composed of
+ * many objects don't require a syscall for each object. At most IOV_MAX
+ * objects and about NET_MAX_WRITES_PER_EVENT bytes are handed to the kernel
+ * at once. The data that was written is removed from the client output
+ * buffers, and the number of bytes written (or -1 on error) is returned. */
+static ssize_t writevToClient(int fd, client *c) {
+    struct iovec iov[IOV_MAX];
+    int iovcnt = 0;
+    size_t iovbytes = 0, objlen, sentlen = c->sentlen;
+    ssize_t nwritten, left;
+    listIter li;
+    listNode *ln;
+    robj *o;
+
+    if (c->bufpos > 0) {
+        iov[iovcnt].iov_base = c->buf+sentlen;
+        iov[iovcnt].iov_len = c->bufpos-sentlen;
+        iovbytes += iov[iovcnt].iov_len;
+        iovcnt++;
+        sentlen = 0; /* The offset only applies to the first object. */
+    }
+    listRewind(c->reply,&li);
+    while(iovcnt < IOV_MAX && iovbytes < NET_MAX_WRITES_PER_EVENT &&
+          (ln = listNext(&li)) != NULL)
+    {
+        o = listNodeValue(ln);
+        objlen = sdslen(o->ptr);
+        if (objlen == sentlen) continue; /* Empty object. */
+        iov[iovcnt].iov_base = ((char*)o->ptr)+sentlen;
+        iov[iovcnt].iov_len = objlen-sentlen;
+        iovbytes += iov[iovcnt].iov_len;
+        iovcnt++;
+        sentlen = 0;
+    }
+
+    if (iovcnt == 0) {
+        nwritten = 0;
+    } else {
+        nwritten = writev(fd,iov,iovcnt);
+        if (nwritten <= 0) return nwritten;
+    }
+
+    /* Consume what was written: first the static buffer, then the objects
+     * on the head of the list. Empty objects are released as well. */
+    left = nwritten;
+    if (c->bufpos > 0) {
+        if ((size_t)left < c->bufpos-c->sentlen) {
+            c->sentlen += left;
+            return nwritten;
+        }
+        left -= c->bufpos-c->sentlen;
+        c->bufpos = 0;
+        c->sentlen = 0;
+    }
+    while(listLength(c->reply)) {
+        o = listNodeValue(listFirst(c->reply));
+        objlen = sdslen(o->ptr);
+        if ((size_t)left < objlen-c->sentlen) {
+            c->sentlen += left;
+            break;
+        }
+        left -= objlen-c->sentlen;
+        c->reply_bytes -= getStringObjectSdsUsedMemory(o);
+        delClientReplyHead(c);
+        c->sentlen = 0;
+    }
+    return nwritten;
+}
+
 /* Write data in output buffers to client. Return C_OK if the client
- * is still valid after the call, C_ERR if it was freed. */
+ * is still valid after the call, C_ERR if it was freed.
+ *
+ * When called from an I/O thread the client is never freed synchronously,
+ * it is scheduled for asynchronous freeing instead, so the function always
+ * returns C_OK in that context. */
 int writeToClient(int fd, client *c, int handler_installed) {
     ssize_t nwritten = 0, totwritten = 0;
-    size_t objlen;
-    size_t objmem;
-    robj *o;
 
     while(clientHasPendingReplies(c)) {
-        if (c->bufpos > 0) {
+        if (listLength(c->reply) == 0) {
             nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
             if (nwritten <= 0) break;
             c->sentlen += nwritten;
@@ -919,27 +1173,11 @@ int writeToClient(int fd, client *c, int handler_installed) {
                 c->sentlen = 0;
             }
         } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = getStringObjectSdsUsedMemory(o);
-
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->reply_bytes -= objmem;
-                continue;
-            }
-
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
+            /* The buffer is followed by objects in the reply list: send
+             * them together. */
+            nwritten = writevToClient(fd,c);
             if (nwritten <= 0) break;
-            c->sentlen += nwritten;
             totwritten += nwritten;
-
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objmem;
-            }
         }
         /* Note that we avoid to send more than NET_MAX_WRITES_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
@@ -953,13 +1191,21 @@ int writeToClient(int fd, client *c, int handler_installed) {
             (server.maxmemory == 0 ||
              zmalloc_used_memory() < server.maxmemory)) break;
     }
-    server.stat_net_output_bytes += totwritten;
+    if (io_threads_op == IO_THREADS_OP_IDLE)
+        server.stat_net_output_bytes += totwritten;
+    else
+        atomicIncr(server.stat_net_output_bytes,totwritten,
+                   io_threads_stats_mutex);
     if (nwritten == -1) {
         if (errno == EAGAIN) {
             nwritten = 0;
         } else {
             serverLog(LL_VERBOSE,
                 "Error writing to client: %s", strerror(errno));
+            if (io_threads_op != IO_THREADS_OP_IDLE) {
+                freeClientAsync(c);
+                return C_OK;
+            }
             freeClient(c);
             return C_ERR;
         }
@@ -977,6 +1223,10 @@ int writeToClient(int fd, client *c, int handler_installed) {
 
         /* Close connection after entire reply has been sent. */
         if (c->flags & CLIENT_CLOSE_AFTER_REPLY) {
+            if (io_threads_op != IO_THREADS_OP_IDLE) {
+                freeClientAsync(c);
+                return C_OK;
+            }
             freeClient(c);
             return C_ERR;
         }
@@ -1004,7 +1254,7 @@ int handleClientsWithPendingWrites(void) {
     while((ln = listNext(&li))) {
         client *c = listNodeValue(ln);
         c->flags &= ~CLIENT_PENDING_WRITE;
-        listDelNode(server.clients_pending_write,ln);
+        listUnlinkNode(server.clients_pending_write,ln);
 
         /* Try to write buffers to the client socket. */
         if (writeToClient(c->fd,c,0) == C_ERR) continue;
@@ -1059,34 +1309,37 @@ void resetClient(client *c) {
 
 int processInlineBuffer(client *c) {
     char *newline;
-    int argc, j;
+    int argc, j, linefeed_chars = 1;
     sds *argv, aux;
     size_t querylen;
 
     /* Search for end of line */
-    newline = strchr(c->querybuf,'\n');
+    newline = memchr(c->querybuf+c->qb_pos,'\n',
+                     sdslen(c->querybuf)-c->qb_pos);
 
     /* Nothing to do without a \r\n */
     if (newline == NULL) {
-        if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+        if (sdslen(c->querybuf)-c->qb_pos > PROTO_INLINE_MAX_SIZE) {
             addReplyError(c,"Protocol error: too big inline request");
-            setProtocolError(c,0);
+            setProtocolError(c);
         }
         return C_ERR;
     }
 
     /* Handle the \r\n case. */
-    if (newline && newline != c->querybuf && *(newline-1) == '\r')
+    if (newline != c->querybuf+c->qb_pos && *(newline-1) == '\r') {
         newline--;
+        linefeed_chars++;
+    }
 
     /* Split the input buffer up to the \r\n */
-    querylen = newline-(c->querybuf);
-    aux = sdsnewlen(c->querybuf,querylen);
+    querylen = newline-(c->querybuf+c->qb_pos);
+    aux = sdsnewlen(c->querybuf+c->qb_pos,querylen);
     argv = sdssplitargs(aux,&argc);
     sdsfree(aux);
     if (argv == NULL) {
         addReplyError(c,"Protocol error: unbalanced quotes in request");
-        setProtocolError(c,0);
+        setProtocolError(c);
         return C_ERR;
     }
 
@@ -1096,13 +1349,15 @@ int processInlineBuffer(client *c) {
     if (querylen == 0 && c->flags & CLIENT_SLAVE)
         c->repl_ack_time = server.unixtime;
 
-    /* Leave data after the first line of the query in the buffer */
-    sdsrange(c->querybuf,querylen+2,-1);
+    /* Move past the first line of the query, the buffer is trimmed by
+     * processInputBuffer(). */
+    c->qb_pos += querylen+linefeed_chars;
 
     /* Setup argv array on client structure */
     if (argc) {
         if (c->argv) zfree(c->argv);
         c->argv = zmalloc(sizeof(robj*)*argc);
+        c->argv_len = argc;
     }
 
     /* Create redis objects for all arguments. */
@@ -1118,9 +1373,9 @@ int processInlineBuffer(client *c) {
     return C_OK;
 }
 
-/* Helper function. Trims query buffer to make the function that processes
- * multi bulk requests idempotent. */
-static void setProtocolError(client *c, int pos) {
+/* Helper function. Flags the client so that it is closed after the error
+ * reply is sent: the rest of the query buffer is never processed. */
+static void setProtocolError(client *c) {
     if (server.verbosity <= LL_VERBOSE) {
         sds client = catClientInfoString(sdsempty(),c);
         serverLog(LL_VERBOSE,
@@ -1128,12 +1383,54 @@ static void setProtocolError(client *c, int pos) {
         sdsfree(client);
     }
     c->flags |= CLIENT_CLOSE_AFTER_REPLY;
-    sdsrange(c->querybuf,pos,-1);
+}
+
+/* Parse the length of a "*<count>\r\n" or "$<len>\r\n" protocol line. 'p'
+ * points to the first byte after the type character and 'end' to the end of
+ * the query buffer. The digits are converted while looking for the CR, so
+ * that the line is scanned just once, instead of searching the newline with
+ * strchr() and then parsing the number with string2ll().
+ *
+ * On success PROTO_LEN_OK is returned, the length is stored in '*ll' and
+ * '*next' is set to the first byte after the CRLF. PROTO_LEN_INCOMPLETE is
+ * returned when the buffer does not yet contain the whole line, and
+ * PROTO_LEN_INVALID when the line is not a valid length (the same numbers
+ * accepted by string2ll() are accepted, with at most 18 digits). */
+#define PROTO_LEN_OK 0
+#define PROTO_LEN_INCOMPLETE 1
+#define PROTO_LEN_INVALID 2
+static int parseProtoLength(const char *p, const char *end, long long *ll,
+                            const char **next)
+{
+    const char *digits;
+    unsigned long long v = 0;
+    int negative = 0;
+
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    digits = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v*10+(*p-'0');
+        p++;
+        if (p-digits > 18) return PROTO_LEN_INVALID;
+    }
+    if (p < end && *p != '\r') return PROTO_LEN_INVALID;
+    if (end-p < 2) return PROTO_LEN_INCOMPLETE;
+
+    /* No digits, leading zeroes and "-0" are not valid. */
+    if (p == digits || (digits[0] == '0' && (p-digits > 1 || negative)))
+        return PROTO_LEN_INVALID;
+    *ll = negative ? -(long long)v : (long long)v;
+    *next = p+2;
+    return PROTO_LEN_OK;
 }
 
 int processMultibulkBuffer(client *c) {
-    char *newline = NULL;
-    int pos = 0, ok;
+    const char *next, *end;
+    size_t pos = c->qb_pos;
+    int ret;
     long long ll;
 
     if (c->multibulklen == 0) {
@@ -1141,77 +1438,58 @@ int processMultibulkBuffer(client *c) {
         serverAssertWithInfo(c,NULL,c->argc == 0);
 
         /* Multi bulk length cannot be read without a \r\n */
-        newline = strchr(c->querybuf,'\r');
-        if (newline == NULL) {
-            if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
-                addReplyError(c,"Protocol error: too big mbulk count string");
-                setProtocolError(c,0);
-            }
-            return C_ERR;
-        }
-
-        /* Buffer should also contain \n */
-        if (newline-(c->querybuf) > ((signed)sdslen(c->querybuf)-2))
-            return C_ERR;
-
-        /* We know for sure there is a whole line since newline != NULL,
-         * so go ahead and find out the multi bulk length. */
-        serverAssertWithInfo(c,NULL,c->querybuf[0] == '*');
-        ok = string2ll(c->querybuf+1,newline-(c->querybuf+1),&ll);
-        if (!ok || ll > 1024*1024) {
+        serverAssertWithInfo(c,NULL,c->querybuf[pos] == '*');
+        end = c->querybuf+sdslen(c->querybuf);
+        ret = parseProtoLength(c->querybuf+pos+1,end,&ll,&next);
+        if (ret == PROTO_LEN_INCOMPLETE) return C_ERR;
+        if (ret == PROTO_LEN_INVALID || ll > 1024*1024) {
             addReplyError(c,"Protocol error: invalid multibulk length");
-            setProtocolError(c,pos);
+            setProtocolError(c);
             return C_ERR;
         }
 
-        pos = (newline-c->querybuf)+2;
+        pos = next-c->querybuf;
         if (ll <= 0) {
-            sdsrange(c->querybuf,pos,-1);
+            c->qb_pos = pos;
             return C_OK;
         }
 
         c->multibulklen = ll;
 
-        /* Setup argv array on client structure */
-        if (c->argv) zfree(c->argv);
-        c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+        /* Setup argv array on client structure. The array of the previous
+         * command is reused if big enough, unless it is a huge one. */
+        if (c->multibulklen > c->argv_len || c->argv_len > 1024) {
+            zfree(c->argv);
+            c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+            c->argv_len = c->multibulklen;
+        }
     }
 
     serverAssertWithInfo(c,NULL,c->multibulklen > 0);
     while(c->multibulklen) {
         /* Read bulk length if unknown */
         if (c->bulklen == -1) {
-            newline = strchr(c->querybuf+pos,'\r');
-            if (newline == NULL) {
-                if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
-                    addReplyError(c,
-                        "Protocol error: too big bulk count string");
-                    setProtocolError(c,0);
-                    return C_ERR;
-                }
-                break;
-            }
-
-            /* Buffer should also contain \n */
-            if (newline-(c->querybuf) > ((signed)sdslen(c->querybuf)-2))
-                break;
-
+            /* The query buffer may be reallocated below: don't cache its
+             * end across iterations. */
+            end = c->querybuf+sdslen(c->querybuf);
+            if (c->querybuf+pos == end) break;
             if (c->querybuf[pos] != '$') {
                 addReplyErrorFormat(c,
                     "Protocol error: expected '$', got '%c'",
                     c->querybuf[pos]);
-                setProtocolError(c,pos);
+                setProtocolError(c);
                 return C_ERR;
             }
 
-            ok = string2ll(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
-            if (!ok || ll < 0 || ll > 512*1024*1024) {
+            ret = parseProtoLength(c->querybuf+pos+1,end,&ll,&next);
+            if (ret == PROTO_LEN_INCOMPLETE) break;
+            if (ret == PROTO_LEN_INVALID || ll < 0 || ll > 512*1024*1024) {
                 addReplyError(c,"Protocol error: invalid bulk length");
-                setProtocolError(c,pos);
+                setProtocolError(c);
                 return C_ERR;
             }
 
-            pos += newline-(c->querybuf+pos)+2;
+            pos = next-c->querybuf;
             if (ll >= PROTO_MBULK_BIG_ARG) {
                 size_t qblen;
 
@@ -1251,7 +1529,7 @@ int processMultibulkBuffer(client *c) {
                 pos = 0;
             } else {
                 c->argv[c->argc++] =
-                    createStringObject(c->querybuf+pos,c->bulklen);
+                    createClientArgObject(c,c->querybuf+pos,c->bulklen);
                 pos += c->bulklen+2;
             }
             c->bulklen = -1;
@@ -1259,8 +1537,9 @@ int processMultibulkBuffer(client *c) {
         }
     }
 
-    /* Trim to pos */
-    if (pos) sdsrange(c->querybuf,pos,-1);
+    /* Remember what was consumed: the buffer is trimmed just once by
+     * processInputBuffer(), instead of after every command. */
+    c->qb_pos = pos;
 
     /* We're done when c->multibulk == 0 */
     if (c->multibulklen == 0) return C_OK;
@@ -1269,12 +1548,47 @@ int processMultibulkBuffer(client *c) {
     return C_ERR;
 }
 
-void processInputBuffer(client *c) {
+/* Execute the command the client has in its argument vector, resetting
+ * the client when done. Returns C_ERR if the client is no longer valid
+ * after the command was processed, for instance because freeMemoryIfNeeded()
+ * flushed the output buffers of the slave we are serving. */
+int processCommandAndResetClient(client *c) {
     server.current_client = c;
+    /* Only reset the client when the command was executed. */
+    if (processCommand(c) == C_OK) {
+        if (c->flags & CLIENT_MASTER && !(c->flags & CLIENT_MULTI)) {
+            /* Update the applied replication offset of our master. */
+            c->reploff = c->read_reploff - sdslen(c->querybuf) + c->qb_pos;
+        }
+        resetClient(c);
+    }
+    /* freeMemoryIfNeeded may flush slave output buffers. This may result
+     * into a slave, that may be the active client, to be freed. */
+    return server.current_client == NULL ? C_ERR : C_OK;
+}
+
+/* Parse the query buffer and execute the commands found there.
+ *
+ * When the client is flagged with CLIENT_PENDING_READ we are running in the
+ * context of an I/O thread: in that case we only parse the first command
+ * and flag the client with CLIENT_PENDING_COMMAND, the command will be
+ * executed by the main thread in handleClientsWithPendingReadsUsingThreads(). */
+void processInputBuffer(client *c) {
+    int io_thread = (c->flags & CLIENT_PENDING_READ) != 0;
+
+    if (!io_thread) server.current_client = c;
     /* Keep processing while there is something in the input buffer */
-    while(sdslen(c->querybuf)) {
-        /* Return if clients are paused. */
-        if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) break;
+    while(c->qb_pos < sdslen(c->querybuf)) {
+        /* Return if clients are paused. I/O threads can't call
+         * clientsArePaused() since it may unpause the clients, so they just
+         * stop parsing and leave the work to the main thread. */
+        if (!(c->flags & CLIENT_SLAVE)) {
+            if (io_thread) {
+                if (server.clients_paused) break;
+            } else if (clientsArePaused()) {
+                break;
+            }
+        }
 
         /* Immediately abort if the client is in the middle of something. */
         if (c->flags & CLIENT_BLOCKED) break;
@@ -1288,7 +1602,7 @@ void processInputBuffer(client *c) {
 
         /* Determine request type when unknown. */
         if (!c->reqtype) {
-            if (c->querybuf[0] == '*') {
+            if (c->querybuf[c->qb_pos] == '*') {
                 c->reqtype = PROTO_REQ_MULTIBULK;
             } else {
                 c->reqtype = PROTO_REQ_INLINE;
@@ -1307,15 +1621,46 @@ void processInputBuffer(client *c) {
         if (c->argc == 0) {
             resetClient(c);
         } else {
-            /* Only reset the client when the command was executed. */
-            if (processCommand(c) == C_OK)
-                resetClient(c);
-            /* freeMemoryIfNeeded may flush slave output buffers. This may result
-             * into a slave, that may be the active client, to be freed. */
-            if (server.current_client == NULL) break;
+            /* If we are in the context of an I/O thread, we can't really
+             * execute the command here. All we can do is to flag the client
+             * as one that needs to process the command. */
+            if (io_thread) {
+                c->flags |= CLIENT_PENDING_COMMAND;
+                break;
+            }
+            if (processCommandAndResetClient(c) == C_ERR) {
+                /* The client is no longer valid: don't touch it. */
+                server.current_client = NULL;
+                return;
+            }
+        }
+    }
+
+    /* Trim the query buffer to the current position. */
+    if (c->qb_pos) {
+        sdsrange(c->querybuf,c->qb_pos,-1);
+        c->qb_pos = 0;
+    }
+    if (!io_thread) server.current_client = NULL;
+}
+
+/* This is a wrapper for processInputBuffer that also cares about handling
+ * the replication forwarding to the sub-slaves, in case the client 'c'
+ * is flagged as master. Usually you want to call this instead of the
+ * raw processInputBuffer(). */
+void processInputBufferAndReplicate(client *c) {
+    if (!(c->flags & CLIENT_MASTER)) {
+        processInputBuffer(c);
+    } else {
+        size_t prev_offset = c->reploff;
+        processInputBuffer(c);
+        size_t applied = c->reploff - prev_offset;
+        if (applied) {
+            replicationFeedSlavesFromMasterStream(server.slaves,
+                    c->pending_querybuf, applied);
+            sdsrange(c->pending_querybuf,applied,-1);
         }
     }
-    server.current_client = NULL;
 }
 
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
@@ -1325,6 +1670,10 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     UNUSED(el);
     UNUSED(mask);
 
+    /* Check if we want to read from the client later when exiting from
+     * the event loop. This is the case if threaded I/O is enabled. */
+    if (postponeClientRead(c)) return;
+
     readlen = PROTO_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1349,19 +1698,26 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
             return;
         } else {
             serverLog(LL_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
+            freeClientMaybeAsync(c);
             return;
         }
     } else if (nread == 0) {
         serverLog(LL_VERBOSE, "Client closed connection");
-        freeClient(c);
+        freeClientMaybeAsync(c);
         return;
     }
 
     sdsIncrLen(c->querybuf,nread);
     c->lastinteraction = server.unixtime;
-    if (c->flags & CLIENT_MASTER) c->reploff += nread;
-    server.stat_net_input_bytes += nread;
+    if (c->flags & CLIENT_MASTER) {
+        c->pending_querybuf = sdscatlen(c->pending_querybuf,
+                                        c->querybuf+qblen,nread);
+        c->read_reploff += nread;
+    }
+    if (c->flags & CLIENT_PENDING_READ)
+        atomicIncr(server.stat_net_input_bytes,nread,io_threads_stats_mutex);
+    else
+        server.stat_net_input_bytes += nread;
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = catClientInfoString(sdsempty(),c), bytes = sdsempty();
 
@@ -1369,10 +1725,10 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         serverLog(LL_WARNING,"Closing client that reached max query buffer length: %s (qbuf initial bytes: %s)", ci, bytes);
         sdsfree(ci);
         sdsfree(bytes);
-        freeClient(c);
+        freeClientMaybeAsync(c);
         return;
     }
-    processInputBuffer(c);
+    processInputBufferAndReplicate(c);
 }
 
 void getClientsMaxBuffers(unsigned long *longest_output_list,
@@ -1472,7 +1828,7 @@ sds catClientInfoString(sds s, client *client) {
         (int) dictSize(client->pubsub_channels),
         (int) listLength(client->pubsub_patterns),
         (client->flags & CLIENT_MULTI) ? client->mstate.count : -1,
-        (unsigned long long) sdslen(client->querybuf),
+        (unsigned long long) sdslen(client->querybuf)-client->qb_pos,
         (unsigned long long) sdsavail(client->querybuf),
         (unsigned long long) client->bufpos,
         (unsigned long long) listLength(client->reply),
@@ -1696,6 +2052,7 @@ void rewriteClientCommandVector(client *c, int argc, ...) {
     /* Replace argv and argc with our new versions. */
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     serverAssertWithInfo(c,NULL,c->cmd != NULL);
     va_end(ap);
@@ -1707,6 +2064,7 @@ void replaceClientCommandVector(client *c, int argc, robj **argv) {
     zfree(c->argv);
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     serverAssertWithInfo(c,NULL,c->cmd != NULL);
 }
@@ -1728,6 +2086,7 @@ void rewriteClientCommandArgument(client *c, int i, robj *newval) {
     if (i >= c->argc) {
         c->argv = zrealloc(c->argv,sizeof(robj*)*(i+1));
         c->argc = i+1;
+        c->argv_len = i+1;
         c->argv[i] = NULL;
     }
     oldval = c->argv[i];
@@ -1954,6 +2313,13 @@ int clientsArePaused(void) {
 int processEventsWhileBlocked(void) {
     int iterations = 4; /* See the function top-comment. */
     int count = 0;
+
+    /* Note: when we are processing events while blocked (for instance during
+     * busy Lua scripts), we set a global flag. When such flag is set, we
+     * avoid handling the read part of clients using threaded I/O, since
+     * nobody would call handleClientsWithPendingReadsUsingThreads() before
+     * we return to the event loop. */
+    ProcessingEventsWhileBlocked = 1;
     while (iterations--) {
         int events = 0;
         events += aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
@@ -1961,5 +2327,507 @@ int processEventsWhileBlocked(void) {
         if (!events) break;
         count += events;
     }
+    ProcessingEventsWhileBlocked = 0;
     return count;
 }
+
+/* ==========================================================================
+ * Threaded I/O
+ * ==========================================================================
+ *
+ * When io-threads is greater than one, the main thread delegates a slice of
+ * the read(2) + protocol parsing and of the write(2) work to a pool of I/O
+ * threads, while command execution (processCommand() and call()) is always
+ * performed by the main thread.
+ *
+ * The design is simple: before returning to the event loop the main thread
+ * distributes the clients with pending reads (or writes) in N lists, one
+ * per thread, signals the threads by setting the number of pending jobs of
+ * every thread, serves the first list itself, and finally busy-waits for
+ * all the other threads to finish. So while the threads are working the
+ * main thread does nothing else than I/O: this is what makes it safe for
+ * the threads to access the clients state without locking.
+ *
+ * When there is little work to do the threads are parked on a mutex owned
+ * by the main thread, so that they don't burn CPU spinning. */
+
+static pthread_t io_threads[IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_mutex[IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_pending_mutex[IO_THREADS_MAX_NUM];
+static unsigned long io_threads_pending[IO_THREADS_MAX_NUM];
+static list *io_threads_list[IO_THREADS_MAX_NUM];
+static int io_threads_active; /* Are the threads currently spinning? */
+
+/* Return true if the I/O threads are currently active. */
+int ioThreadsActive(void) {
+    return io_threads_active;
+}
+
+static unsigned long getIOPendingCount(int i) {
+    unsigned long count;
+    atomicGet(io_threads_pending[i],count,io_threads_pending_mutex[i]);
+    return count;
+}
+
+static void setIOPendingCount(int i, unsigned long count) {
+    atomicSet(io_threads_pending[i],count,io_threads_pending_mutex[i]);
+}
+
+void *IOThreadMain(void *myid) {
+    /* The ID is the thread number (from 0 to server.io_threads_num-1), and is
+     * used by the thread to just manipulate a single sub-array of clients. */
+    long id = (unsigned long)myid;
+    listIter li;
+    listNode *ln;
+    int j;
+
+    while(1) {
+        /* Wait for start */
+        for (j = 0; j < 1000000; j++) {
+            if (getIOPendingCount(id) != 0) break;
+        }
+
+        /* Give the main thread a chance to stop this thread. */
+        if (getIOPendingCount(id) == 0) {
+            pthread_mutex_lock(&io_threads_mutex[id]);
+            pthread_mutex_unlock(&io_threads_mutex[id]);
+            continue;
+        }
+
+        /* Process: note that the main thread will never touch our list
+         * before we drop the pending count to 0. */
+        listRewind(io_threads_list[id],&li);
+        while((ln = listNext(&li))) {
+            client *c = listNodeValue(ln);
+            if (io_threads_op == IO_THREADS_OP_WRITE) {
+                writeToClient(c->fd,c,0);
+            } else if (io_threads_op == IO_THREADS_OP_READ) {
+                readQueryFromClient(NULL,c->fd,c,0);
+            } else {
+                serverPanic("io_threads_op value is unknown");
+            }
+        }
+        listEmpty(io_threads_list[id]);
+        setIOPendingCount(id,0);
+    }
+    return NULL;
+}
+
+/* Initialize the data structures needed for threaded I/O. */
+void initThreadedIO(void) {
+    pthread_attr_t attr;
+    size_t stacksize;
+    int i;
+
+    io_threads_active = 0; /* We start with threads not active. */
+
+    /* Don't spawn any thread if the user selected a single thread:
+     * we'll handle I/O directly from the main thread. */
+    if (server.io_threads_num == 1) return;
+
+    if (server.io_threads_num > IO_THREADS_MAX_NUM) {
+        serverLog(LL_WARNING,"Fatal: too many I/O threads configured. "
+                             "The maximum number is %d.", IO_THREADS_MAX_NUM);
+        exit(1);
+    }
+
+    /* Set the stack size as by default it may be small in some system */
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr,&stacksize);
+    if (!stacksize) stacksize = 1; /* The world is full of Solaris Fixes */
+    while (stacksize < REDIS_THREAD_STACK_SIZE) stacksize *= 2;
+    pthread_attr_setstacksize(&attr, stacksize);
+
+    /* Spawn and initialize the I/O threads. */
+    for (i = 0; i < server.io_threads_num; i++) {
+        /* Things we do for all the threads including the main thread. */
+        io_threads_list[i] = listCreate();
+        if (i == 0) continue; /* Thread 0 is the main thread. */
+
+        /* Things we do only for the additional threads. */
+        pthread_t tid;
+        pthread_mutex_init(&io_threads_mutex[i],NULL);
+        pthread_mutex_init(&io_threads_pending_mutex[i],NULL);
+        setIOPendingCount(i,0);
+        pthread_mutex_lock(&io_threads_mutex[i]); /* Thread will be stopped. */
+        if (pthread_create(&tid,&attr,IOThreadMain,(void*)(long)i) != 0) {
+            serverLog(LL_WARNING,"Fatal: Can't initialize IO thread.");
+            exit(1);
+        }
+        io_threads[i] = tid;
+    }
+}
+
+static void startThreadedIO(void) {
+    int j;
+
+    serverAssert(io_threads_active == 0);
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_unlock(&io_threads_mutex[j]);
+    io_threads_active = 1;
+}
+
+static void stopThreadedIO(void) {
+    int j;
+
+    /* We may have still clients with pending reads when this function
+     * is called: handle them before stopping the threads. */
+    handleClientsWithPendingReadsUsingThreads();
+    serverAssert(io_threads_active == 1);
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_lock(&io_threads_mutex[j]);
+    io_threads_active = 0;
+}
+
+/* This function checks if there are not enough pending clients to justify
+ * taking the I/O threads active: in that case I/O threads are stopped if
+ * currently active. We track the pending writes as a measure of clients
+ * we need to handle in parallel, however the I/O threading is disabled
+ * globally for reads as well if we have too little pending clients.
+ *
+ * The function returns 0 if the I/O threading should be used because there
+ * are enough active threads, otherwise 1 is returned and the I/O threads
+ * could be possibly stopped (if already active) as a side effect. */
+int stopThreadedIOIfNeeded(void) {
+    int pending = listLength(server.clients_pending_write);
+
+    /* Return ASAP if I/O threads are disabled (single threaded mode). */
+    if (server.io_threads_num == 1) return 1;
+
+    if (pending < (server.io_threads_num*2)) {
+        if (io_threads_active) stopThreadedIO();
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Distribute the clients of the specified list among the I/O threads,
+ * let the threads (and the main thread itself, that serves the first slice)
+ * perform the operation 'op', and wait for all the threads to finish. */
+static void processClientsUsingThreads(list *clients, int op) {
+    listIter li;
+    listNode *ln;
+    int item_id = 0, j;
+
+    /* Distribute the clients across N different lists. */
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        int target_id = item_id % server.io_threads_num;
+        listAddNodeTail(io_threads_list[target_id],c);
+        item_id++;
+    }
+
+    /* Give the start condition to the waiting threads, by setting the
+     * start condition atomic var. */
+    io_threads_op = op;
+    for (j = 1; j < server.io_threads_num; j++) {
+        int count = listLength(io_threads_list[j]);
+        setIOPendingCount(j,count);
+    }
+
+    /* Also use the main thread to process a slice of clients. */
+    listRewind(io_threads_list[0],&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (op == IO_THREADS_OP_WRITE)
+            writeToClient(c->fd,c,0);
+        else
+            readQueryFromClient(NULL,c->fd,c,0);
+    }
+    listEmpty(io_threads_list[0]);
+
+    /* Wait for all the other threads to end their work. */
+    while(1) {
+        unsigned long pending = 0;
+        for (j = 1; j < server.io_threads_num; j++)
+            pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+    io_threads_op = IO_THREADS_OP_IDLE;
+}
+
+/* Threaded version of handleClientsWithPendingWrites(): the write(2) calls
+ * are performed by the I/O threads, while the main thread installs the
+ * write handler for the clients that still have data to send. When there
+ * are too few clients to justify the threads synchronization the function
+ * falls back to the single threaded implementation. */
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+    listIter li;
+    listNode *ln;
+
+    if (processed == 0) return 0; /* Return ASAP if there are no clients. */
+
+    /* If I/O threads are disabled or we have few clients to serve, don't
+     * use I/O threads, but the boring synchronous code. */
+    if (server.io_threads_num == 1 || stopThreadedIOIfNeeded()) {
+        return handleClientsWithPendingWrites();
+    }
+
+    /* Start threads if needed. */
+    if (!io_threads_active) startThreadedIO();
+
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        c->flags &= ~CLIENT_PENDING_WRITE;
+    }
+    processClientsUsingThreads(server.clients_pending_write,
+                               IO_THREADS_OP_WRITE);
+
+    /* Run the list of clients again to install the write handler where
+     * needed. */
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+
+        /* Install the write handler if there are pending writes in some
+         * of the clients. */
+        if (!(c->flags & CLIENT_CLOSE_ASAP) && clientHasPendingReplies(c)) {
+            int ae_flags = AE_WRITABLE;
+            /* See handleClientsWithPendingWrites() for AE_BARRIER. */
+            if (server.aof_state == AOF_ON &&
+                server.aof_fsync == AOF_FSYNC_ALWAYS)
+            {
+                ae_flags |= AE_BARRIER;
+            }
+            if (aeCreateFileEvent(server.el, c->fd, ae_flags,
+                sendReplyToClient, c) == AE_ERR)
+            {
+                freeClientAsync(c);
+            }
+        }
+    }
+    /* The nodes are embedded in the clients: unlink them, don't free them. */
+    while(listLength(server.clients_pending_write))
+        listUnlinkNode(server.clients_pending_write,
+                       listFirst(server.clients_pending_write));
+    server.stat_io_writes_processed += processed;
+    return processed;
+}
+
+/* Return 1 if we want to handle the client read later using threaded I/O.
+ * This is called by the readable handler of the event loop.
+ * As a side effect of calling this function the client is put in the
+ * pending read clients and flagged as such. */
+int postponeClientRead(client *c) {
+    if (io_threads_active &&
+        server.io_threads_do_reads &&
+        !ProcessingEventsWhileBlocked &&
+        !(c->flags & (CLIENT_MASTER|CLIENT_SLAVE|CLIENT_PENDING_READ|
+                      CLIENT_BLOCKED)))
+    {
+        c->flags |= CLIENT_PENDING_READ;
+        listAddNodeHead(server.clients_pending_read,c);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* When threaded I/O is also enabled for the reading + parsing side, the
+ * readable handler will just put normal clients into a queue of clients to
+ * process (instead of serving them synchronously). This function runs
+ * the queue using the I/O threads, and process them in order to accumulate
+ * the reads in the buffers, and also parse the first command available
+ * rendering it in the client structures. */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed;
+    listNode *ln;
+
+    if (!io_threads_active || !server.io_threads_do_reads) return 0;
+    processed = listLength(server.clients_pending_read);
+    if (processed == 0) return 0;
+
+    processClientsUsingThreads(server.clients_pending_read,
+                               IO_THREADS_OP_READ);
+
+    /* Run the list of clients again to process the new buffers. */
+    while(listLength(server.clients_pending_read)) {
+        ln = listFirst(server.clients_pending_read);
+        client *c = listNodeValue(ln);
+        c->flags &= ~CLIENT_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        /* Clients may have been scheduled for freeing by the I/O thread
+         * because of a read error or because the query buffer is too big. */
+        if (c->flags & CLIENT_CLOSE_ASAP) continue;
+
+        if (c->flags & CLIENT_PENDING_COMMAND) {
+            c->flags &= ~CLIENT_PENDING_COMMAND;
+            if (processCommandAndResetClient(c) == C_ERR) {
+                /* If the client is no longer valid, we avoid
+                 * processing the client later. So we just go
+                 * to the next. */
+                server.current_client = NULL;
+                continue;
+            }
+        }
+        processInputBuffer(c);
+
+        /* We may have pending replies if a thread readQueryFromClient()
+         * produced replies and did not install a write handler (it
+         * can't). */
+        if (!(c->flags & CLIENT_PENDING_WRITE) && clientHasPendingReplies(c))
+            clientInstallWriteHandler(c);
+    }
+    server.current_client = NULL;
+    server.stat_io_reads_processed += processed;
+    return processed;
+}
+
+#ifdef REDIS_TEST
+#include <sys/time.h>
+
+#define assert(_e) ((_e)?(void)0:(_assert(#_e,__FILE__,__LINE__),exit(1)))
+static void _assert(char *estr, char *file, int line) {
+    printf("\n\n=== ASSERTION FAILED ===\n");
+    printf("==> %s:%d '%s' is not true\n",file,line,estr);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Feed 'len' bytes of protocol to the client, 'chunk' bytes at a time like
+ * readQueryFromClient() would do, parsing every complete command. The
+ * number of parsed commands is returned, and the arguments of the last
+ * one are left in the client. */
+static long long networkingTestFeed(client *c, const char *proto, size_t len,
+                                    size_t chunk)
+{
+    long long commands = 0;
+    size_t fed = 0;
+
+    while(fed < len) {
+        size_t n = len-fed < chunk ? len-fed : chunk;
+        c->querybuf = sdscatlen(c->querybuf,proto+fed,n);
+        fed += n;
+        while(c->qb_pos < sdslen(c->querybuf)) {
+            if (c->argc && c->multibulklen == 0) {
+                /* Release the previous command, like resetClient(). */
+                freeClientArgv(c);
+                c->multibulklen = 0;
+                c->bulklen = -1;
+            }
+            if (processMultibulkBuffer(c) != C_OK) break;
+            if (c->argc) commands++;
+        }
+        sdsrange(c->querybuf,c->qb_pos,-1);
+        c->qb_pos = 0;
+    }
+    return commands;
+}
+
+int networkingTest(int argc, char *argv[]) {
+    client *c = zcalloc(sizeof(*c));
+    sds proto = sdsempty();
+    long long start, commands;
+    int j;
+    UNUSED(argc);
+    UNUSED(argv);
+
+    c->querybuf = sdsempty();
+    c->bulklen = -1;
+
+    printf("Lengths are parsed like string2ll(): ");
+    {
+        const char *valid[] = {"0","7","-1","123456","999999999999999999"};
+        const char *invalid[] = {"","-","01","-0","+1","1a","12 ",
+                                 "1234567890123456789"};
+        long long ll;
+        const char *next;
+        char buf[64];
+
+        for (j = 0; j < (int)(sizeof(valid)/sizeof(valid[0])); j++) {
+            int len = snprintf(buf,sizeof(buf),"%s\r\n",valid[j]);
+            long long expected;
+
+            assert(string2ll(valid[j],strlen(valid[j]),&expected));
+            assert(parseProtoLength(buf,buf+len,&ll,&next) == PROTO_LEN_OK);
+            assert(ll == expected && next == buf+len);
+            /* A truncated line is never an error. */
+            assert(parseProtoLength(buf,buf+len-1,&ll,&next) ==
+                   PROTO_LEN_INCOMPLETE);
+        }
+        for (j = 0; j < (int)(sizeof(invalid)/sizeof(invalid[0])); j++) {
+            int len = snprintf(buf,sizeof(buf),"%s\r\n",invalid[j]);
+            assert(parseProtoLength(buf,buf+len,&ll,&next) ==
+                   PROTO_LEN_INVALID);
+        }
+        printf("[ok]\n");
+    }
+
+    printf("Commands split at every byte are parsed correctly: ");
+    {
+        const char *cmd = "*3\r\n$3\r\nSET\r\n$5\r\nkey:1\r\n$0\r\n\r\n"
+                          "*2\r\n$3\r\nGET\r\n$5\r\nkey:1\r\n";
+
+        for (j = 1; j <= (int)strlen(cmd); j++) {
+            commands = networkingTestFeed(c,cmd,strlen(cmd),j);
+            assert(commands == 2 && c->argc == 2);
+            assert(!strcmp(c->argv[0]->ptr,"GET"));
+            assert(!strcmp(c->argv[1]->ptr,"key:1"));
+            assert(sdslen(c->querybuf) == 0);
+        }
+        printf("[ok]\n");
+    }
+
+    printf("Benchmark: parse 1M pipelined SET commands: ");
+    {
+        for (j = 0; j < 1000000; j++) {
+            char key[32];
+            int keylen = snprintf(key,sizeof(key),"key:%d",j);
+
+            proto = sdscatprintf(proto,
+                "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$10\r\nvalue:%04d\r\n",
+                keylen,key,j%10000);
+        }
+        start = usec();
+        commands = networkingTestFeed(c,proto,sdslen(proto),PROTO_IOBUF_LEN);
+        assert(commands == 1000000);
+        printf("%lld usec (%.1f ns/command)\n",usec()-start,
+            (double)(usec()-start)*1000/commands);
+    }
+
+    printf("Benchmark: parse the 4M length lines of the same commands:\n");
+    {
+        const char *p = proto, *end = proto+sdslen(proto), *next;
+        long long ll, sum1 = 0, sum2 = 0;
+
+        /* What processMultibulkBuffer() used to do: find the CR, then
+         * parse the digits again with string2ll(). */
+        start = usec();
+        for (p = proto; p < end; p = next) {
+            const char *cr = memchr(p+1,'\r',end-p-1);
+
+            assert(string2ll(p+1,cr-(p+1),&ll));
+            sum1 += ll;
+            next = cr+2;
+            if (*p == '$') next += ll+2;
+        }
+        printf("  memchr() + string2ll(): %lld usec\n",usec()-start);
+
+        start = usec();
+        for (p = proto; p < end; p = next) {
+            assert(parseProtoLength(p+1,end,&ll,&next) == PROTO_LEN_OK);
+            sum2 += ll;
+            if (*p == '$') next += ll+2;
+        }
+        printf("  parseProtoLength(): %lld usec\n",usec()-start);
+        assert(sum1 == sum2);
+    }
+
+    freeClientArgv(c);
+    freeClientArgvPool(c);
+    zfree(c->argv);
+    sdsfree(c->querybuf);
+    sdsfree(proto);
+    zfree(c);
+    return 0;
+}
+#endif
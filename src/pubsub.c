@@ -37,6 +37,7 @@ void freePubsubPattern(void *p) {
     pubsubPattern *pat = p;
 
     decrRefCount(pat->pattern);
+    stringmatcherFree(pat->matcher);
     zfree(pat);
 }
 
@@ -47,6 +48,273 @@ int listMatchPubsubPattern(void *a, void *b) {
            (equalStringObjects(pa->pattern,pb->pattern));
 }
 
+/*-----------------------------------------------------------------------------
+ * Pattern index
+ *
+ * In order to avoid matching every published channel against every pattern,
+ * patterns are indexed by their literal prefix, that is, the part of the
+ * pattern before the first glob special char. The index is a radix tree:
+ * every node has an edge label and the list of the patterns whose literal
+ * prefix is the concatenation of the labels from the root to the node.
+ * Patterns starting with a special char (like "*foo") are stored in the
+ * root node.
+ *
+ * When a message is published, only the patterns stored in the nodes along
+ * the path matching the channel name are candidates, and are matched with
+ * the stringmatcher compiled when the client subscribed the pattern.
+ *----------------------------------------------------------------------------*/
+
+typedef struct pubsubPatternNode {
+    sds label;          /* Edge label from the parent. Empty for the root. */
+    list *patterns;     /* pubsubPattern structures, or NULL if none. */
+    int numchildren;
+    struct pubsubPatternNode **children;
+} pubsubPatternNode;
+
+static pubsubPatternNode *pubsubCreatePatternNode(const char *label,
+                                                  size_t len)
+{
+    pubsubPatternNode *n = zmalloc(sizeof(*n));
+
+    n->label = sdsnewlen(label,len);
+    n->patterns = NULL;
+    n->numchildren = 0;
+    n->children = NULL;
+    return n;
+}
+
+static void pubsubFreePatternNode(pubsubPatternNode *n) {
+    sdsfree(n->label);
+    if (n->patterns) listRelease(n->patterns);
+    zfree(n->children);
+    zfree(n);
+}
+
+pubsubPatternNode *pubsubCreatePatternIndex(void) {
+    return pubsubCreatePatternNode("",0);
+}
+
+/* Return the length of the literal prefix of the glob pattern 'p'. */
+static size_t pubsubPatternPrefixLen(const char *p, size_t len) {
+    size_t j;
+
+    for (j = 0; j < len; j++) {
+        if (p[j] == '*' || p[j] == '?' || p[j] == '[' || p[j] == '\\')
+            break;
+    }
+    return j;
+}
+
+/* Return the index of the child of 'n' whose label starts with 'c',
+ * or -1 if there is no such child. */
+static int pubsubPatternNodeChild(pubsubPatternNode *n, unsigned char c) {
+    int j;
+
+    for (j = 0; j < n->numchildren; j++)
+        if ((unsigned char)n->children[j]->label[0] == c) return j;
+    return -1;
+}
+
+static void pubsubPatternNodeAddChild(pubsubPatternNode *n,
+                                      pubsubPatternNode *child)
+{
+    n->children = zrealloc(n->children,
+                           sizeof(pubsubPatternNode*)*(n->numchildren+1));
+    n->children[n->numchildren++] = child;
+}
+
+/* Add the pattern to the index. */
+static void pubsubIndexPattern(pubsubPattern *pat) {
+    pubsubPatternNode *n = server.pubsub_patterns_index;
+    sds p = pat->pattern->ptr;
+    size_t plen = pubsubPatternPrefixLen(p,sdslen(p)), pos = 0;
+
+    while (pos < plen) {
+        int idx = pubsubPatternNodeChild(n,p[pos]);
+        pubsubPatternNode *child;
+        size_t common = 0, lablen;
+
+        if (idx == -1) {
+            child = pubsubCreatePatternNode(p+pos,plen-pos);
+            pubsubPatternNodeAddChild(n,child);
+            n = child;
+            break;
+        }
+        child = n->children[idx];
+        lablen = sdslen(child->label);
+        while (common < lablen && pos+common < plen &&
+               child->label[common] == p[pos+common]) common++;
+
+        if (common < lablen) {
+            /* Split the edge: the new node takes the common part of the
+             * label, and the old child becomes its only child. */
+            pubsubPatternNode *mid =
+                pubsubCreatePatternNode(child->label,common);
+            sdsrange(child->label,common,-1);
+            pubsubPatternNodeAddChild(mid,child);
+            n->children[idx] = mid;
+            child = mid;
+        }
+        n = child;
+        pos += common;
+    }
+    if (n->patterns == NULL) {
+        n->patterns = listCreate();
+        listSetMatchMethod(n->patterns,listMatchPubsubPattern);
+    }
+    listAddNodeTail(n->patterns,pat);
+}
+
+/* Return the node holding the patterns with the specified literal prefix,
+ * or NULL if there is no such node. */
+static pubsubPatternNode *pubsubLookupPatternNode(const char *p, size_t plen) {
+    pubsubPatternNode *n = server.pubsub_patterns_index;
+    size_t pos = 0;
+
+    while (pos < plen) {
+        int idx = pubsubPatternNodeChild(n,p[pos]);
+
+        if (idx == -1) return NULL;
+        n = n->children[idx];
+        if (sdslen(n->label) > plen-pos ||
+            memcmp(n->label,p+pos,sdslen(n->label)) != 0) return NULL;
+        pos += sdslen(n->label);
+    }
+    return n;
+}
+
+/* Return the indexed pubsubPattern with the same client and pattern of
+ * 'pat', or NULL if not found. */
+static pubsubPattern *pubsubLookupPattern(pubsubPattern *pat) {
+    sds p = pat->pattern->ptr;
+    pubsubPatternNode *n;
+    listNode *ln;
+
+    n = pubsubLookupPatternNode(p,pubsubPatternPrefixLen(p,sdslen(p)));
+    if (n == NULL || n->patterns == NULL) return NULL;
+    ln = listSearchKey(n->patterns,pat);
+    return ln ? ln->value : NULL;
+}
+
+/* Remove the child at index 'idx' of 'n' if it holds no patterns and has
+ * no children, or merge it with its only child if it holds no patterns,
+ * so that the tree stays compressed. */
+static void pubsubCompactPatternNode(pubsubPatternNode *n, int idx) {
+    pubsubPatternNode *child = n->children[idx];
+
+    if (child->patterns) return;
+    if (child->numchildren == 0) {
+        n->children[idx] = n->children[n->numchildren-1];
+        if (--n->numchildren == 0) {
+            zfree(n->children);
+            n->children = NULL;
+        }
+        pubsubFreePatternNode(child);
+    } else if (child->numchildren == 1) {
+        pubsubPatternNode *grandchild = child->children[0];
+        sds label = sdscatsds(sdsdup(child->label),grandchild->label);
+
+        sdsfree(grandchild->label);
+        grandchild->label = label;
+        n->children[idx] = grandchild;
+        pubsubFreePatternNode(child);
+    }
+}
+
+/* Remove the pattern from the index. The pattern must be indexed. */
+static void pubsubUnindexPattern(pubsubPattern *pat) {
+    pubsubPatternNode *n = server.pubsub_patterns_index;
+    sds p = pat->pattern->ptr;
+    size_t plen = pubsubPatternPrefixLen(p,sdslen(p)), pos = 0;
+    pubsubPatternNode **parents;
+    int *indexes, depth = 0;
+    listNode *ln;
+
+    /* Every edge is at least one byte long, so the path from the root to
+     * the node has at most plen+1 nodes. */
+    parents = zmalloc(sizeof(pubsubPatternNode*)*(plen+1));
+    indexes = zmalloc(sizeof(int)*(plen+1));
+    while (pos < plen) {
+        int idx = pubsubPatternNodeChild(n,p[pos]);
+
+        serverAssert(idx != -1);
+        parents[depth] = n;
+        indexes[depth] = idx;
+        depth++;
+        n = n->children[idx];
+        pos += sdslen(n->label);
+    }
+    serverAssert(pos == plen && n->patterns != NULL);
+    ln = listSearchKey(n->patterns,pat);
+    serverAssert(ln != NULL);
+    listDelNode(n->patterns,ln);
+    if (listLength(n->patterns) == 0) {
+        listRelease(n->patterns);
+        n->patterns = NULL;
+    }
+
+    /* Compact the path from the node to the root. */
+    while (depth--) pubsubCompactPatternNode(parents[depth],indexes[depth]);
+    zfree(parents);
+    zfree(indexes);
+}
+
+/* Append the string object 'o' to 's' as a bulk string. */
+static sds pubsubCatBulk(sds s, robj *o) {
+    o = getDecodedObject(o);
+    s = sdsMakeRoomFor(s,sdslen(o->ptr)+32);
+    s = sdscatfmt(s,"$%U\r\n",(unsigned long long)sdslen(o->ptr));
+    s = sdscatlen(s,o->ptr,sdslen(o->ptr));
+    s = sdscatlen(s,"\r\n",2);
+    decrRefCount(o);
+    return s;
+}
+
+/* Send the message to the clients subscribed to patterns matching the
+ * channel. Return the number of receivers. */
+static int pubsubPublishToPatterns(robj *channel, robj *message) {
+    pubsubPatternNode *n = server.pubsub_patterns_index;
+    sds name = channel->ptr;
+    size_t len = sdslen(name), pos = 0;
+    int receivers = 0;
+    robj *bulk = NULL; /* The message as a bulk string, created once. */
+
+    while (1) {
+        if (n->patterns) {
+            listNode *ln;
+            listIter li;
+
+            listRewind(n->patterns,&li);
+            while ((ln = listNext(&li)) != NULL) {
+                pubsubPattern *pat = ln->value;
+
+                if (stringmatcherMatch(pat->matcher,name,len)) {
+                    if (bulk == NULL) bulk = createObject(OBJ_STRING,
+                        pubsubCatBulk(sdsempty(),message));
+                    addReply(pat->client,shared.mbulkhdr[4]);
+                    addReply(pat->client,shared.pmessagebulk);
+                    addReplyBulk(pat->client,pat->pattern);
+                    addReplyBulk(pat->client,channel);
+                    addReplyShared(pat->client,bulk);
+                    receivers++;
+                }
+            }
+        }
+
+        /* Descend into the child whose label is the next part of the
+         * channel name, if any. */
+        int idx;
+        if (pos == len || (idx = pubsubPatternNodeChild(n,name[pos])) == -1)
+            break;
+        n = n->children[idx];
+        if (sdslen(n->label) > len-pos ||
+            memcmp(n->label,name+pos,sdslen(n->label)) != 0) break;
+        pos += sdslen(n->label);
+    }
+    if (bulk) decrRefCount(bulk);
+    return receivers;
+}
+
 /* Return the number of channels + patterns a client is subscribed to. */
 int clientSubscriptionsCount(client *c) {
     return dictSize(c->pubsub_channels)+
@@ -134,8 +402,12 @@ int pubsubSubscribePattern(client *c, robj *pattern) {
         incrRefCount(pattern);
         pat = zmalloc(sizeof(*pat));
         pat->pattern = getDecodedObject(pattern);
+        pat->matcher = stringmatcherCompile(pat->pattern->ptr,
+                                            sdslen(pat->pattern->ptr),0);
         pat->client = c;
         listAddNodeTail(server.pubsub_patterns,pat);
+        pat->node = listLast(server.pubsub_patterns);
+        pubsubIndexPattern(pat);
     }
     /* Notify the client */
     addReply(c,shared.mbulkhdr[3]);
@@ -149,17 +421,23 @@ int pubsubSubscribePattern(client *c, robj *pattern) {
  * 0 if the client was not subscribed to the specified channel. */
 int pubsubUnsubscribePattern(client *c, robj *pattern, int notify) {
     listNode *ln;
-    pubsubPattern pat;
+    pubsubPattern pat, *found;
     int retval = 0;
 
     incrRefCount(pattern); /* Protect the object. May be the same we remove */
     if ((ln = listSearchKey(c->pubsub_patterns,pattern)) != NULL) {
         retval = 1;
         listDelNode(c->pubsub_patterns,ln);
+        /* Find the pattern in the index, where it is in a (usually short)
+         * list of patterns sharing the same prefix, instead of scanning
+         * all the patterns. */
         pat.client = c;
-        pat.pattern = pattern;
-        ln = listSearchKey(server.pubsub_patterns,&pat);
-        listDelNode(server.pubsub_patterns,ln);
+        pat.pattern = getDecodedObject(pattern);
+        found = pubsubLookupPattern(&pat);
+        decrRefCount(pat.pattern);
+        serverAssertWithInfo(c,NULL,found != NULL);
+        pubsubUnindexPattern(found);
+        listDelNode(server.pubsub_patterns,found->node);
     }
     /* Notify the client */
     if (notify) {
@@ -225,46 +503,34 @@ int pubsubUnsubscribeAllPatterns(client *c, int notify) {
 int pubsubPublishMessage(robj *channel, robj *message) {
     int receivers = 0;
     dictEntry *de;
-    listNode *ln;
-    listIter li;
 
-    /* Send to clients listening for that channel */
+    /* Send to clients listening for that channel. The message is
+     * serialized only once, and referenced by the output buffers of all
+     * the subscribers (see addReplyShared()). */
     de = dictFind(server.pubsub_channels,channel);
     if (de) {
         list *list = dictGetVal(de);
         listNode *ln;
         listIter li;
+        sds proto = sdsnewlen("*3\r\n$7\r\nmessage\r\n",17);
+        robj *msg;
 
+        proto = pubsubCatBulk(proto,channel);
+        proto = pubsubCatBulk(proto,message);
+        msg = createObject(OBJ_STRING,proto);
         listRewind(list,&li);
         while ((ln = listNext(&li)) != NULL) {
             client *c = ln->value;
 
-            addReply(c,shared.mbulkhdr[3]);
-            addReply(c,shared.messagebulk);
-            addReplyBulk(c,channel);
-            addReplyBulk(c,message);
+            addReplyShared(c,msg);
             receivers++;
         }
+        decrRefCount(msg);
     }
     /* Send to clients listening to matching channels */
     if (listLength(server.pubsub_patterns)) {
-        listRewind(server.pubsub_patterns,&li);
         channel = getDecodedObject(channel);
-        while ((ln = listNext(&li)) != NULL) {
-            pubsubPattern *pat = ln->value;
-
-            if (stringmatchlen((char*)pat->pattern->ptr,
-                                sdslen(pat->pattern->ptr),
-                                (char*)channel->ptr,
-                                sdslen(channel->ptr),0)) {
-                addReply(pat->client,shared.mbulkhdr[4]);
-                addReply(pat->client,shared.pmessagebulk);
-                addReplyBulk(pat->client,pat->pattern);
-                addReplyBulk(pat->client,channel);
-                addReplyBulk(pat->client,message);
-                receivers++;
-            }
-        }
+        receivers += pubsubPublishToPatterns(channel,message);
         decrRefCount(channel);
     }
     return receivers;
@@ -332,22 +598,23 @@ void pubsubCommand(client *c) {
         sds pat = (c->argc == 2) ? NULL : c->argv[2]->ptr;
         dictIterator *di = dictGetIterator(server.pubsub_channels);
         dictEntry *de;
+        stringmatcher *matcher = NULL;
         long mblen = 0;
         void *replylen;
 
+        if (pat) matcher = stringmatcherCompile(pat,sdslen(pat),0);
         replylen = addDeferredMultiBulkLength(c);
         while((de = dictNext(di)) != NULL) {
             robj *cobj = dictGetKey(de);
             sds channel = cobj->ptr;
 
-            if (!pat || stringmatchlen(pat, sdslen(pat),
-                                       channel, sdslen(channel),0))
-            {
+            if (!pat || stringmatcherMatch(matcher,channel,sdslen(channel))) {
                 addReplyBulk(c,cobj);
                 mblen++;
             }
         }
         dictReleaseIterator(di);
+        if (matcher) stringmatcherFree(matcher);
         setDeferredMultiBulkLength(c,replylen,mblen);
     } else if (!strcasecmp(c->argv[1]->ptr,"numsub") && c->argc >= 2) {
         /* PUBSUB NUMSUB [Channel_1 ... Channel_N] */
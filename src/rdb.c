@@ -29,6 +29,7 @@
 
 #include "server.h"
 #include "lzf.h"    /* LZF compression library */
+#include "lz4.h"    /* LZ4 compression library */
 #include "zipmap.h"
 #include "endianconv.h"
 
@@ -51,6 +52,12 @@ extern int rdbCheckMode;
 void rdbCheckError(const char *fmt, ...);
 void rdbCheckSetError(const char *fmt, ...);
 
+/* When set, corrupted data found while loading is logged and reported to the
+ * caller of rdbLoadRio() as an error, instead of terminating the server.
+ * This is used when the caller is able to recover, like a slave that keeps
+ * its old dataset while loading the payload of its master. */
+int rdbLoadCorruptionIsError = 0;
+
 // 检查rdb并退出
 void rdbCheckThenExit(int linenum, char *reason, ...) {
     va_list ap;
@@ -63,12 +70,15 @@ void rdbCheckThenExit(int linenum, char *reason, ...) {
     vsnprintf(msg+len,sizeof(msg)-len,reason,ap);
     va_end(ap);
 
-    if (!rdbCheckMode) {
+    if (rdbCheckMode) {
+        rdbCheckError("%s",msg);
+    } else if (rdbLoadCorruptionIsError) {
+        serverLog(LL_WARNING, "%s", msg);
+        return;
+    } else {
         serverLog(LL_WARNING, "%s", msg);
         char *argv[2] = {"",server.rdb_filename};
         redis_check_rdb_main(2,argv);
-    } else {
-        rdbCheckError("%s",msg);
     }
     exit(1);
 }
@@ -167,7 +177,7 @@ uint32_t rdbLoadLen(rio *rdb, int *isencoded) {
     } else {
         rdbExitReportCorruptRDB(
             "Unknown length encoding %d in rdbLoadLen()",type);
-        return -1; /* Never reached. */
+        return RDB_LENERR;
     }
 }
 
@@ -200,7 +210,7 @@ int rdbEncodeInteger(long long value, unsigned char *enc) {
 /* Loads an integer-encoded object with the specified encoding type "enctype".
  * The returned value changes according to the flags, see
  * rdbGenerincLoadStringObject() for more info. */
-void *rdbLoadIntegerObject(rio *rdb, int enctype, int flags) {
+void *rdbLoadIntegerObject(rio *rdb, int enctype, int flags, size_t *lenptr) {
     int plain = flags & RDB_LOAD_PLAIN;
     int encode = flags & RDB_LOAD_ENC;
     unsigned char enc[4];
@@ -220,14 +230,15 @@ void *rdbLoadIntegerObject(rio *rdb, int enctype, int flags) {
         v = enc[0]|(enc[1]<<8)|(enc[2]<<16)|(enc[3]<<24);
         val = (int32_t)v;
     } else {
-        val = 0; /* anti-warning */
         rdbExitReportCorruptRDB("Unknown RDB integer encoding type %d",enctype);
+        return NULL;
     }
     if (plain) {
         char buf[LONG_STR_SIZE], *p;
         int len = ll2string(buf,sizeof(buf),val);
         p = zmalloc(len);
         memcpy(p,buf,len);
+        if (lenptr) *lenptr = len;
         return p;
     } else if (encode) {
         return createStringObjectFromLongLong(val);
@@ -255,13 +266,16 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-ssize_t rdbSaveLzfBlob(rio *rdb, void *data, size_t compress_len,
-                       size_t original_len) {
+/* Save a string compressed with the codec specified by 'enctype', one of
+ * RDB_ENC_LZF or RDB_ENC_LZ4. */
+static ssize_t rdbSaveCompressedBlob(rio *rdb, int enctype, void *data,
+                                     size_t compress_len, size_t original_len)
+{
     unsigned char byte;
     ssize_t n, nwritten = 0;
 
     /* Data compressed! Let's save it on disk */
-    byte = (RDB_ENCVAL<<6)|RDB_ENC_LZF;
+    byte = (RDB_ENCVAL<<6)|enctype;
     if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
     nwritten += n;
 
@@ -280,28 +294,49 @@ writeerr:
     return -1;
 }
 
-ssize_t rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+ssize_t rdbSaveLzfBlob(rio *rdb, void *data, size_t compress_len,
+                       size_t original_len) {
+    return rdbSaveCompressedBlob(rdb,RDB_ENC_LZF,data,compress_len,
+                                 original_len);
+}
+
+/* Try to save the string compressed with the codec selected by the
+ * rdb-compression-codec option. Returns 0 if the string can't be
+ * compressed enough, so that the caller can save it verbatim.
+ *
+ * LZ4 is not used for streams with the RIO_FLAG_NO_LZ4 flag, like DUMP
+ * payloads, that must be understood by servers without LZ4 support. */
+ssize_t rdbSaveCompressedStringObject(rio *rdb, unsigned char *s, size_t len) {
     size_t comprlen, outlen;
+    int enctype;
     void *out;
 
     /* We require at least four bytes compression for this to be worth it */
     if (len <= 4) return 0;
     outlen = len-4;
     if ((out = zmalloc(outlen+1)) == NULL) return 0;
-    comprlen = lzf_compress(s, len, out, outlen);
+    if (server.rdb_compression_codec == RDB_COMPRESSION_LZ4 &&
+        !(rdb && rdb->flags & RIO_FLAG_NO_LZ4))
+    {
+        enctype = RDB_ENC_LZ4;
+        comprlen = lz4_compress(s, len, out, outlen);
+    } else {
+        enctype = RDB_ENC_LZF;
+        comprlen = lzf_compress(s, len, out, outlen);
+    }
     if (comprlen == 0) {
         zfree(out);
         return 0;
     }
-    ssize_t nwritten = rdbSaveLzfBlob(rdb, out, comprlen, len);
+    ssize_t nwritten = rdbSaveCompressedBlob(rdb, enctype, out, comprlen, len);
     zfree(out);
     return nwritten;
 }
 
-/* Load an LZF compressed string in RDB format. The returned value
- * changes according to 'flags'. For more info check the
- * rdbGenericLoadStringObject() function. */
-void *rdbLoadLzfStringObject(rio *rdb, int flags) {
+/* Load a string compressed with LZF or LZ4 (according to 'enctype') in RDB
+ * format. The returned value changes according to 'flags'. For more info
+ * check the rdbGenericLoadStringObject() function. */
+void *rdbLoadCompressedStringObject(rio *rdb, int flags, int enctype, size_t *lenptr) {
     int plain = flags & RDB_LOAD_PLAIN;
     unsigned int len, clen;
     unsigned char *c = NULL;
@@ -320,14 +355,21 @@ void *rdbLoadLzfStringObject(rio *rdb, int flags) {
 
     /* Load the compressed representation and uncompress it to target. */
     if (rioRead(rdb,c,clen) == 0) goto err;
-    if (lzf_decompress(c,clen,val,len) == 0) {
+    if (enctype == RDB_ENC_LZ4) {
+        if (lz4_decompress(c,clen,val,len) != len) {
+            if (rdbCheckMode) rdbCheckSetError("Invalid LZ4 compressed string");
+            goto err;
+        }
+    } else if (lzf_decompress(c,clen,val,len) == 0) {
         if (rdbCheckMode) rdbCheckSetError("Invalid LZF compressed string");
         goto err;
     }
     zfree(c);
 
-    if (plain)
+    if (plain) {
+        if (lenptr) *lenptr = len;
         return val;
+    }
     else
         return createObject(OBJ_STRING,val);
 err:
@@ -354,10 +396,10 @@ ssize_t rdbSaveRawString(rio *rdb, unsigned char *s, size_t len) {
         }
     }
 
-    /* Try LZF compression - under 20 bytes it's unable to compress even
+    /* Try compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
     if (server.rdb_compression && len > 20) {
-        n = rdbSaveLzfStringObject(rdb,s,len);
+        n = rdbSaveCompressedStringObject(rdb,s,len);
         if (n == -1) return -1;
         if (n > 0) return n;
         /* Return value of 0 means data can't be compressed, save the old way */
@@ -414,8 +456,11 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
  * RDB_LOAD_PLAIN: Return a plain string allocated with zmalloc()
  *                 instead of a Redis object with an sds in it.
  * RDB_LOAD_SDS: Return an SDS string instead of a Redis object.
+ *
+ * When a plain string is returned and 'lenptr' is not NULL, its length is
+ * stored in '*lenptr'.
  */
-void *rdbGenericLoadStringObject(rio *rdb, int flags) {
+void *rdbGenericLoadStringObject(rio *rdb, int flags, size_t *lenptr) {
     int encode = flags & RDB_LOAD_ENC;
     int plain = flags & RDB_LOAD_PLAIN;
     int isencoded;
@@ -427,11 +472,13 @@ void *rdbGenericLoadStringObject(rio *rdb, int flags) {
         case RDB_ENC_INT8:
         case RDB_ENC_INT16:
         case RDB_ENC_INT32:
-            return rdbLoadIntegerObject(rdb,len,flags);
+            return rdbLoadIntegerObject(rdb,len,flags,lenptr);
         case RDB_ENC_LZF:
-            return rdbLoadLzfStringObject(rdb,flags);
+        case RDB_ENC_LZ4:
+            return rdbLoadCompressedStringObject(rdb,flags,len,lenptr);
         default:
             rdbExitReportCorruptRDB("Unknown RDB string encoding type %d",len);
+            return NULL;
         }
     }
 
@@ -450,16 +497,17 @@ void *rdbGenericLoadStringObject(rio *rdb, int flags) {
             zfree(buf);
             return NULL;
         }
+        if (lenptr) *lenptr = len;
         return buf;
     }
 }
 
 robj *rdbLoadStringObject(rio *rdb) {
-    return rdbGenericLoadStringObject(rdb,RDB_LOAD_NONE);
+    return rdbGenericLoadStringObject(rdb,RDB_LOAD_NONE,NULL);
 }
 
 robj *rdbLoadEncodedStringObject(rio *rdb) {
-    return rdbGenericLoadStringObject(rdb,RDB_LOAD_ENC);
+    return rdbGenericLoadStringObject(rdb,RDB_LOAD_ENC,NULL);
 }
 
 /* Save a double value. Doubles are saved as strings prefixed by an unsigned
@@ -529,7 +577,7 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         return rdbSaveType(rdb,RDB_TYPE_STRING);
     case OBJ_LIST:
         if (o->encoding == OBJ_ENCODING_QUICKLIST)
-            return rdbSaveType(rdb,RDB_TYPE_LIST_QUICKLIST);
+            return rdbSaveType(rdb,RDB_TYPE_LIST_QUICKLIST_LISTPACK);
         else
             serverPanic("Unknown list encoding");
     case OBJ_SET:
@@ -540,15 +588,15 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         else
             serverPanic("Unknown set encoding");
     case OBJ_ZSET:
-        if (o->encoding == OBJ_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,RDB_TYPE_ZSET_ZIPLIST);
+        if (o->encoding == OBJ_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,RDB_TYPE_ZSET_LISTPACK);
         else if (o->encoding == OBJ_ENCODING_SKIPLIST)
             return rdbSaveType(rdb,RDB_TYPE_ZSET);
         else
             serverPanic("Unknown sorted set encoding");
     case OBJ_HASH:
-        if (o->encoding == OBJ_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == OBJ_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,RDB_TYPE_HASH_LISTPACK);
         else if (o->encoding == OBJ_ENCODING_HT)
             return rdbSaveType(rdb,RDB_TYPE_HASH);
         else
@@ -592,7 +640,7 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
                     if ((n = rdbSaveLzfBlob(rdb,data,compress_len,node->sz)) == -1) return -1;
                     nwritten += n;
                 } else {
-                    if ((n = rdbSaveRawString(rdb,node->zl,node->sz)) == -1) return -1;
+                    if ((n = rdbSaveRawString(rdb,node->entry,node->sz)) == -1) return -1;
                     nwritten += n;
                 }
                 node = node->next;
@@ -626,8 +674,8 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == OBJ_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -654,8 +702,8 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == OBJ_HASH) {
         /* Save a hash value */
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -742,17 +790,50 @@ int rdbSaveAuxFieldStrInt(rio *rdb, char *key, long long val) {
 }
 
 /* Save a few default AUX fields with information about the RDB generated. */
-int rdbSaveInfoAuxFields(rio *rdb) {
+int rdbSaveInfoAuxFields(rio *rdb, int flags) {
     int redis_bits = (sizeof(void*) == 8) ? 64 : 32;
+    int aof_preamble = (flags & RDB_SAVE_AOF_PREAMBLE) != 0;
 
     /* Add a few fields about the state when the RDB was created. */
     if (rdbSaveAuxFieldStrStr(rdb,"redis-ver",REDIS_VERSION) == -1) return -1;
     if (rdbSaveAuxFieldStrInt(rdb,"redis-bits",redis_bits) == -1) return -1;
     if (rdbSaveAuxFieldStrInt(rdb,"ctime",time(NULL)) == -1) return -1;
     if (rdbSaveAuxFieldStrInt(rdb,"used-mem",zmalloc_used_memory()) == -1) return -1;
+    if (rdbSaveAuxFieldStrInt(rdb,"aof-preamble",aof_preamble) == -1) return -1;
+
+    /* Handle saving options that generate aux fields: the replication ID
+     * and offset, together with the DB currently selected in the replication
+     * stream, allow a restarted slave (or a master turned into a slave) to
+     * continue with a partial resynchronization. This does not apply to the
+     * AOF preamble, since the AOF tail moves the dataset past that offset. */
+    int stream_db = aof_preamble ? -1 : rdbReplicationStreamDb();
+    if (stream_db != -1) {
+        if (rdbSaveAuxFieldStrInt(rdb,"repl-stream-db",stream_db) == -1)
+            return -1;
+        if (rdbSaveAuxFieldStrStr(rdb,"repl-id",server.replid) == -1)
+            return -1;
+        if (rdbSaveAuxFieldStrInt(rdb,"repl-offset",server.master_repl_offset)
+            == -1) return -1;
+    }
     return 1;
 }
 
+/* Return the DB that is currently selected in the replication stream, or
+ * -1 if we have no replication stream at all, so that the replication
+ * info should not be stored in the RDB file. */
+int rdbReplicationStreamDb(void) {
+    /* A master with a backlog: the next command in the stream will be
+     * preceded by a SELECT if slaveseldb is -1, so any DB will do. */
+    if (!server.masterhost && server.repl_backlog)
+        return server.slaveseldb == -1 ? 0 : server.slaveseldb;
+
+    /* A slave: the DB is the one selected by our master client, or by the
+     * cached master if we are disconnected. */
+    if (server.master) return server.master->db->id;
+    if (server.cached_master) return server.cached_master->db->id;
+    return -1;
+}
+
 /* Produces a dump of the database in RDB format sending it to the specified
  * Redis I/O channel. On success C_OK is returned, otherwise C_ERR
  * is returned and part of the output, or all the output, can be
@@ -760,20 +841,25 @@ int rdbSaveInfoAuxFields(rio *rdb) {
  *
  * When the function returns C_ERR and if 'error' is not NULL, the
  * integer pointed by 'error' is set to the value of errno just after the I/O
- * error. */
-int rdbSaveRio(rio *rdb, int *error) {
+ * error.
+ *
+ * If 'flags' has RDB_SAVE_AOF_PREAMBLE set, the dump is the preamble of
+ * an AOF rewrite: the function then reads the accumulated differences from
+ * the parent from time to time, like rewriteAppendOnlyFileRio() does. */
+int rdbSaveRio(rio *rdb, int *error, int flags) {
     dictIterator *di = NULL;
     dictEntry *de;
     char magic[10];
     int j;
     long long now = mstime();
     uint64_t cksum;
+    size_t processed = 0;
 
     if (server.rdb_checksum)
         rdb->update_cksum = rioGenericUpdateChecksum;
     snprintf(magic,sizeof(magic),"REDIS%04d",RDB_VERSION);
     if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
-    if (rdbSaveInfoAuxFields(rdb) == -1) goto werr;
+    if (rdbSaveInfoAuxFields(rdb,flags) == -1) goto werr;
 
     for (j = 0; j < server.dbnum; j++) {
         redisDb *db = server.db+j;
@@ -794,8 +880,8 @@ int rdbSaveRio(rio *rdb, int *error) {
         db_size = (dictSize(db->dict) <= UINT32_MAX) ?
                                 dictSize(db->dict) :
                                 UINT32_MAX;
-        expires_size = (dictSize(db->expires) <= UINT32_MAX) ?
-                                dictSize(db->expires) :
+        expires_size = (dbExpiresCount(db) <= UINT32_MAX) ?
+                                dbExpiresCount(db) :
                                 UINT32_MAX;
         if (rdbSaveType(rdb,RDB_OPCODE_RESIZEDB) == -1) goto werr;
         if (rdbSaveLen(rdb,db_size) == -1) goto werr;
@@ -808,8 +894,18 @@ int rdbSaveRio(rio *rdb, int *error) {
             long long expire;
 
             initStaticStringObject(key,keystr);
-            expire = getExpire(db,&key);
+            expire = getEntryExpire(db,de);
             if (rdbSaveKeyValuePair(rdb,&key,o,expire,now) == -1) goto werr;
+
+            /* When this RDB is produced as part of an AOF rewrite, move
+             * accumulated diff from parent to child while rewriting in
+             * order to have a smaller final write. */
+            if (flags & RDB_SAVE_AOF_PREAMBLE &&
+                rdb->processed_bytes > processed+AOF_READ_DIFF_INTERVAL_BYTES)
+            {
+                processed = rdb->processed_bytes;
+                aofReadDiffFromParent();
+            }
         }
         dictReleaseIterator(di);
     }
@@ -847,7 +943,7 @@ int rdbSaveRioWithEOFMark(rio *rdb, int *error) {
     if (rioWrite(rdb,"$EOF:",5) == 0) goto werr;
     if (rioWrite(rdb,eofmark,RDB_EOF_MARK_SIZE) == 0) goto werr;
     if (rioWrite(rdb,"\r\n",2) == 0) goto werr;
-    if (rdbSaveRio(rdb,error) == C_ERR) goto werr;
+    if (rdbSaveRio(rdb,error,RDB_SAVE_NONE) == C_ERR) goto werr;
     if (rioWrite(rdb,eofmark,RDB_EOF_MARK_SIZE) == 0) goto werr;
     return C_OK;
 
@@ -879,7 +975,7 @@ int rdbSave(char *filename) {
     }
 
     rioInitWithFile(&rdb,fp);
-    if (rdbSaveRio(&rdb,&error) == C_ERR) {
+    if (rdbSaveRio(&rdb,&error,RDB_SAVE_NONE) == C_ERR) {
         errno = error;
         goto werr;
     }
@@ -972,6 +1068,33 @@ void rdbRemoveTempFile(pid_t childpid) {
     unlink(tmpfile);
 }
 
+/* Convert a ziplist loaded from an RDB file of an older version into a
+ * listpack with the same entries. The ziplist is freed. NULL is returned
+ * if the ziplist is corrupted. */
+static unsigned char *rdbZiplistToListpack(unsigned char *zl) {
+    unsigned char *lp = lpNew();
+    unsigned char *p = ziplistIndex(zl,0);
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+
+    while (p != NULL) {
+        if (!ziplistGet(p,&vstr,&vlen,&vll)) {
+            rdbExitReportCorruptRDB("Invalid ziplist entry.");
+            lpFree(lp);
+            zfree(zl);
+            return NULL;
+        }
+        if (vstr)
+            lp = lpAppend(lp,vstr,vlen);
+        else
+            lp = lpAppendInteger(lp,vll);
+        p = ziplistNext(zl,p);
+    }
+    zfree(zl);
+    return lp;
+}
+
 /* Load a Redis object of the specified type from the specified file.
  * On success a newly allocated object is returned, otherwise NULL. */
 robj *rdbLoadObject(int rdbtype, rio *rdb) {
@@ -1071,7 +1194,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Convert *after* loading, since sorted sets are not stored ordered. */
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,OBJ_ENCODING_ZIPLIST);
+                zsetConvert(o,OBJ_ENCODING_LISTPACK);
     } else if (rdbtype == RDB_TYPE_HASH) {
         size_t len;
         int ret;
@@ -1085,8 +1208,8 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.hash_max_ziplist_entries)
             hashTypeConvert(o, OBJ_ENCODING_HT);
 
-        /* Load every field and value into the ziplist */
-        while (o->encoding == OBJ_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        while (o->encoding == OBJ_ENCODING_LISTPACK && len > 0) {
             robj *field, *value;
 
             len--;
@@ -1098,9 +1221,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             if (value == NULL) return NULL;
             serverAssert(sdsEncodedObject(value));
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            o->ptr = lpAppend(o->ptr, field->ptr, sdslen(field->ptr));
+            o->ptr = lpAppend(o->ptr, value->ptr, sdslen(value->ptr));
             /* Convert to hash table if size threshold is exceeded */
             if (sdslen(field->ptr) > server.hash_max_ziplist_value ||
                 sdslen(value->ptr) > server.hash_max_ziplist_value)
@@ -1132,29 +1255,61 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             ret = dictAdd((dict*)o->ptr, field, value);
             if (ret == DICT_ERR) {
                 rdbExitReportCorruptRDB("Duplicate keys detected");
+                decrRefCount(field);
+                decrRefCount(value);
+                decrRefCount(o);
+                return NULL;
             }
         }
 
         /* All pairs should be read by now */
         serverAssert(len == 0);
-    } else if (rdbtype == RDB_TYPE_LIST_QUICKLIST) {
+    } else if (rdbtype == RDB_TYPE_LIST_QUICKLIST ||
+               rdbtype == RDB_TYPE_LIST_QUICKLIST_LISTPACK)
+    {
         if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
         o = createQuicklistObject();
         quicklistSetOptions(o->ptr, server.list_max_ziplist_size,
                             server.list_compress_depth);
 
         while (len--) {
-            unsigned char *zl = rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN);
-            if (zl == NULL) return NULL;
-            quicklistAppendZiplist(o->ptr, zl);
+            size_t encoded_len;
+            unsigned char *lp =
+                rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,&encoded_len);
+            if (lp == NULL) {
+                decrRefCount(o);
+                return NULL;
+            }
+            if (rdbtype == RDB_TYPE_LIST_QUICKLIST) {
+                /* Older RDB versions: convert every node to a listpack. */
+                lp = rdbZiplistToListpack(lp);
+            } else if (!lpValidateIntegrity(lp,encoded_len)) {
+                rdbExitReportCorruptRDB("List listpack integrity check failed.");
+                zfree(lp);
+                lp = NULL;
+            }
+            if (lp == NULL) {
+                decrRefCount(o);
+                return NULL;
+            }
+            /* Don't create empty nodes. */
+            if (lpLength(lp) == 0) {
+                lpFree(lp);
+                continue;
+            }
+            quicklistAppendListpack(o->ptr, lp);
         }
     } else if (rdbtype == RDB_TYPE_HASH_ZIPMAP  ||
                rdbtype == RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == RDB_TYPE_SET_INTSET   ||
                rdbtype == RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == RDB_TYPE_HASH_LISTPACK ||
+               rdbtype == RDB_TYPE_ZSET_LISTPACK)
     {
-        unsigned char *encoded = rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN);
+        size_t encoded_len;
+        unsigned char *encoded =
+            rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,&encoded_len);
         if (encoded == NULL) return NULL;
         o = createObject(OBJ_STRING,encoded); /* Obj type fixed below. */
 
@@ -1166,10 +1321,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
          * converted. */
         switch(rdbtype) {
             case RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *lp = lpNew();
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -1178,14 +1333,14 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        lp = lpAppend(lp, fstr, flen);
+                        lp = lpAppend(lp, vstr, vlen);
                     }
 
                     zfree(o->ptr);
-                    o->ptr = zl;
+                    o->ptr = lp;
                     o->type = OBJ_HASH;
-                    o->encoding = OBJ_ENCODING_ZIPLIST;
+                    o->encoding = OBJ_ENCODING_LISTPACK;
 
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
@@ -1206,41 +1361,417 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     setTypeConvert(o,OBJ_ENCODING_HT);
                 break;
             case RDB_TYPE_ZSET_ZIPLIST:
+            case RDB_TYPE_ZSET_LISTPACK:
+                if (rdbtype == RDB_TYPE_ZSET_ZIPLIST) {
+                    /* Older RDB versions: convert to a listpack. */
+                    o->ptr = rdbZiplistToListpack(o->ptr);
+                } else if (!lpValidateIntegrity(o->ptr,encoded_len) ||
+                           lpLength(o->ptr) % 2 != 0)
+                {
+                    rdbExitReportCorruptRDB("Zset listpack integrity check failed.");
+                    zfree(o->ptr);
+                    o->ptr = NULL;
+                }
+                if (o->ptr == NULL) {
+                    zfree(o);
+                    return NULL;
+                }
                 o->type = OBJ_ZSET;
-                o->encoding = OBJ_ENCODING_ZIPLIST;
+                o->encoding = OBJ_ENCODING_LISTPACK;
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
                     zsetConvert(o,OBJ_ENCODING_SKIPLIST);
                 break;
             case RDB_TYPE_HASH_ZIPLIST:
+            case RDB_TYPE_HASH_LISTPACK:
+                if (rdbtype == RDB_TYPE_HASH_ZIPLIST) {
+                    /* Older RDB versions: convert to a listpack. */
+                    o->ptr = rdbZiplistToListpack(o->ptr);
+                } else if (!lpValidateIntegrity(o->ptr,encoded_len) ||
+                           lpLength(o->ptr) % 2 != 0)
+                {
+                    rdbExitReportCorruptRDB("Hash listpack integrity check failed.");
+                    zfree(o->ptr);
+                    o->ptr = NULL;
+                }
+                if (o->ptr == NULL) {
+                    zfree(o);
+                    return NULL;
+                }
                 o->type = OBJ_HASH;
-                o->encoding = OBJ_ENCODING_ZIPLIST;
+                o->encoding = OBJ_ENCODING_LISTPACK;
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
                     hashTypeConvert(o, OBJ_ENCODING_HT);
                 break;
             default:
                 rdbExitReportCorruptRDB("Unknown RDB encoding type %d",rdbtype);
-                break;
+                zfree(o->ptr);
+                zfree(o);
+                return NULL;
         }
     } else {
         rdbExitReportCorruptRDB("Unknown RDB encoding type %d",rdbtype);
+        return NULL;
     }
     return o;
 }
 
+/* -----------------------------------------------------------------------------
+ * Multi threaded loading
+ *
+ * When rdb-load-threads is greater than one, rdbLoad() does not decode the
+ * values itself. The main thread only reads the stream, copying the
+ * serialized value of every key into a batch, that is decoded by one of the
+ * loading threads with rdbLoadObject(). Batches are then added to the
+ * database by the main thread in the same order they were read, so the
+ * only work left in the main thread is I/O and the dictionary insertion,
+ * while LZF decompression and the creation of the objects happen in
+ * parallel.
+ * -------------------------------------------------------------------------- */
+
+#define RDB_LOAD_BATCH_KEYS 256             /* Max keys per batch. */
+#define RDB_LOAD_BATCH_BYTES (1024*64)      /* Max bytes per batch. */
+#define RDB_LOAD_BATCHES_PER_THREAD 4       /* Size of the batches ring. */
+
+typedef struct rdbLoadJob {
+    redisDb *db;
+    robj *key;
+    int rdbtype;
+    long long expiretime;
+    robj *val;              /* Set by the loading thread. */
+} rdbLoadJob;
+
+typedef struct rdbLoadBatch {
+    rdbLoadJob jobs[RDB_LOAD_BATCH_KEYS];
+    int count;
+    rio raw;                /* Serialized values of the jobs, in order. */
+    int done;               /* Set by the loading thread when decoded. */
+} rdbLoadBatch;
+
+static struct {
+    pthread_t *threads;
+    int numthreads;
+    rdbLoadBatch *batches;  /* Ring of batches. */
+    unsigned long size;     /* Number of batches in the ring. */
+    unsigned long head;     /* Batches submitted so far. */
+    unsigned long next;     /* Batches taken by loading threads so far. */
+    unsigned long tail;     /* Batches added to the DB so far. */
+    long long now;          /* Time used to skip already expired keys. */
+    int stop;               /* Loading threads should exit. */
+    int error;              /* Corrupted data found: discard the values. */
+    pthread_mutex_t mutex;
+    pthread_cond_t job_cond;    /* Signaled when a batch is submitted. */
+    pthread_cond_t done_cond;   /* Signaled when a batch is decoded. */
+} rdbLoadPipeline;
+
+/* Copy 'len' bytes from 'rdb' to 'out'. */
+static int rdbCopyBytes(rio *rdb, rio *out, size_t len) {
+    char buf[1024*16];
+
+    while (len) {
+        size_t n = len > sizeof(buf) ? sizeof(buf) : len;
+        if (rioRead(rdb,buf,n) == 0) return -1;
+        if (rioWrite(out,buf,n) == 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Like rdbLoadLen() but also copies the length to 'out'. */
+static uint32_t rdbCopyLen(rio *rdb, rio *out, int *isencoded) {
+    int enc;
+    uint32_t len = rdbLoadLen(rdb,&enc);
+
+    if (isencoded) *isencoded = enc;
+    if (len == RDB_LENERR) return len;
+    if (enc) {
+        if (rdbSaveType(out,(RDB_ENCVAL<<6)|len) == -1) return RDB_LENERR;
+    } else {
+        if (rdbSaveLen(out,len) == -1) return RDB_LENERR;
+    }
+    return len;
+}
+
+/* Copy a string, as serialized by rdbSaveRawString(), from 'rdb' to 'out'
+ * without decoding it. */
+static int rdbCopyString(rio *rdb, rio *out) {
+    int isencoded;
+    uint32_t len, clen;
+
+    if ((len = rdbCopyLen(rdb,out,&isencoded)) == RDB_LENERR) return -1;
+    if (isencoded) {
+        switch(len) {
+        case RDB_ENC_INT8: len = 1; break;
+        case RDB_ENC_INT16: len = 2; break;
+        case RDB_ENC_INT32: len = 4; break;
+        case RDB_ENC_LZF:
+        case RDB_ENC_LZ4:
+            if ((clen = rdbCopyLen(rdb,out,NULL)) == RDB_LENERR) return -1;
+            if (rdbCopyLen(rdb,out,NULL) == RDB_LENERR) return -1;
+            len = clen;
+            break;
+        default:
+            rdbExitReportCorruptRDB("Unknown RDB string encoding type %d",len);
+            return -1;
+        }
+    }
+    return rdbCopyBytes(rdb,out,len);
+}
+
+/* Copy a double, as serialized by rdbSaveDoubleValue(), from 'rdb' to
+ * 'out'. */
+static int rdbCopyDoubleValue(rio *rdb, rio *out) {
+    unsigned char len;
+
+    if (rioRead(rdb,&len,1) == 0) return -1;
+    if (rioWrite(out,&len,1) == 0) return -1;
+    if (len >= 253) return 0; /* Infinite or NaN, no payload. */
+    return rdbCopyBytes(rdb,out,len);
+}
+
+/* Copy the serialized value of the specified RDB type from 'rdb' to 'out',
+ * so that it can be later decoded by rdbLoadObject(). Only lengths are
+ * parsed here: strings are not decompressed and no object is created.
+ * Returns 0 on success, -1 on read error. */
+static int rdbCopyObject(int rdbtype, rio *rdb, rio *out) {
+    uint32_t len, strings;
+
+    if (rdbtype == RDB_TYPE_STRING ||
+        rdbtype == RDB_TYPE_HASH_ZIPMAP ||
+        rdbtype == RDB_TYPE_LIST_ZIPLIST ||
+        rdbtype == RDB_TYPE_SET_INTSET ||
+        rdbtype == RDB_TYPE_ZSET_ZIPLIST ||
+        rdbtype == RDB_TYPE_HASH_ZIPLIST ||
+        rdbtype == RDB_TYPE_HASH_LISTPACK ||
+        rdbtype == RDB_TYPE_ZSET_LISTPACK)
+    {
+        return rdbCopyString(rdb,out);
+    }
+
+    if (!rdbIsObjectType(rdbtype)) {
+        rdbExitReportCorruptRDB("Unknown RDB encoding type %d",rdbtype);
+        return -1;
+    }
+    if ((len = rdbCopyLen(rdb,out,NULL)) == RDB_LENERR) return -1;
+    strings = (rdbtype == RDB_TYPE_HASH) ? 2 : 1;
+    while (len--) {
+        uint32_t j;
+
+        for (j = 0; j < strings; j++)
+            if (rdbCopyString(rdb,out) == -1) return -1;
+        if (rdbtype == RDB_TYPE_ZSET && rdbCopyDoubleValue(rdb,out) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/* Body of the loading threads: decode the values of the submitted batches,
+ * in order, until rdbLoadPipelineStop() is called. */
+static void *rdbLoadThreadMain(void *arg) {
+    UNUSED(arg);
+
+    while (1) {
+        rdbLoadBatch *b;
+        rio raw;
+        int j;
+
+        pthread_mutex_lock(&rdbLoadPipeline.mutex);
+        while (rdbLoadPipeline.next == rdbLoadPipeline.head &&
+               !rdbLoadPipeline.stop)
+        {
+            pthread_cond_wait(&rdbLoadPipeline.job_cond,
+                              &rdbLoadPipeline.mutex);
+        }
+        if (rdbLoadPipeline.next == rdbLoadPipeline.head) {
+            pthread_mutex_unlock(&rdbLoadPipeline.mutex);
+            return NULL;
+        }
+        b = rdbLoadPipeline.batches +
+            (rdbLoadPipeline.next++ % rdbLoadPipeline.size);
+        pthread_mutex_unlock(&rdbLoadPipeline.mutex);
+
+        /* A NULL value signals the main thread that the data is corrupted,
+         * and the following values of the batch are not decoded. */
+        rioInitWithBuffer(&raw,b->raw.io.buffer.ptr);
+        for (j = 0; j < b->count; j++) {
+            b->jobs[j].val = rdbLoadObject(b->jobs[j].rdbtype,&raw);
+            if (b->jobs[j].val == NULL) break;
+        }
+
+        pthread_mutex_lock(&rdbLoadPipeline.mutex);
+        b->done = 1;
+        pthread_cond_signal(&rdbLoadPipeline.done_cond);
+        pthread_mutex_unlock(&rdbLoadPipeline.mutex);
+    }
+}
+
+/* Start 'numthreads' loading threads. */
+static void rdbLoadPipelineStart(int numthreads, long long now) {
+    unsigned long j;
+
+    rdbLoadPipeline.numthreads = numthreads;
+    rdbLoadPipeline.size = numthreads*RDB_LOAD_BATCHES_PER_THREAD;
+    rdbLoadPipeline.batches =
+        zmalloc(sizeof(rdbLoadBatch)*rdbLoadPipeline.size);
+    for (j = 0; j < rdbLoadPipeline.size; j++) {
+        rdbLoadPipeline.batches[j].count = 0;
+        rdbLoadPipeline.batches[j].done = 0;
+        rioInitWithBuffer(&rdbLoadPipeline.batches[j].raw,sdsempty());
+    }
+    rdbLoadPipeline.head = rdbLoadPipeline.next = rdbLoadPipeline.tail = 0;
+    rdbLoadPipeline.now = now;
+    rdbLoadPipeline.stop = 0;
+    rdbLoadPipeline.error = 0;
+    pthread_mutex_init(&rdbLoadPipeline.mutex,NULL);
+    pthread_cond_init(&rdbLoadPipeline.job_cond,NULL);
+    pthread_cond_init(&rdbLoadPipeline.done_cond,NULL);
+
+    rdbLoadPipeline.threads = zmalloc(sizeof(pthread_t)*numthreads);
+    for (j = 0; j < (unsigned long)numthreads; j++) {
+        if (pthread_create(&rdbLoadPipeline.threads[j],NULL,
+                           rdbLoadThreadMain,NULL) != 0)
+        {
+            serverLog(LL_WARNING,"Fatal: Can't initialize RDB loading threads.");
+            exit(1);
+        }
+    }
+}
+
+/* Wait for the oldest submitted batch to be decoded, and add its keys to
+ * the database. */
+static void rdbLoadPipelineApplyBatch(void) {
+    rdbLoadBatch *b = rdbLoadPipeline.batches +
+                      (rdbLoadPipeline.tail % rdbLoadPipeline.size);
+    int j;
+
+    pthread_mutex_lock(&rdbLoadPipeline.mutex);
+    while (!b->done)
+        pthread_cond_wait(&rdbLoadPipeline.done_cond,&rdbLoadPipeline.mutex);
+    pthread_mutex_unlock(&rdbLoadPipeline.mutex);
+
+    for (j = 0; j < b->count; j++) {
+        rdbLoadJob *job = b->jobs+j;
+
+        if (job->val == NULL && !rdbLoadPipeline.error) {
+            serverLog(LL_WARNING,"Short read or OOM loading DB. Unrecoverable error, aborting now.");
+            rdbExitReportCorruptRDB("Unexpected EOF reading RDB file");
+            rdbLoadPipeline.error = 1;
+        }
+        /* After an error the remaining values are just released. */
+        if (rdbLoadPipeline.error) {
+            decrRefCount(job->key);
+            if (job->val) decrRefCount(job->val);
+            continue;
+        }
+        /* See rdbLoad() for why expired keys are only skipped by masters. */
+        if (server.masterhost == NULL && job->expiretime != -1 &&
+            job->expiretime < rdbLoadPipeline.now)
+        {
+            decrRefCount(job->key);
+            decrRefCount(job->val);
+            continue;
+        }
+        dbAdd(job->db,job->key,job->val);
+        if (job->expiretime != -1)
+            setExpire(job->db,job->key,job->expiretime);
+        decrRefCount(job->key);
+    }
+
+    /* Make the batch reusable. */
+    b->count = 0;
+    b->done = 0;
+    sdsclear(b->raw.io.buffer.ptr);
+    rioInitWithBuffer(&b->raw,b->raw.io.buffer.ptr);
+    rdbLoadPipeline.tail++;
+}
+
+/* Hand the batch being filled to the loading threads. */
+static void rdbLoadPipelineSubmitBatch(void) {
+    pthread_mutex_lock(&rdbLoadPipeline.mutex);
+    rdbLoadPipeline.head++;
+    pthread_cond_signal(&rdbLoadPipeline.job_cond);
+    pthread_mutex_unlock(&rdbLoadPipeline.mutex);
+
+    /* If the ring is full, make room for the next batch. */
+    if (rdbLoadPipeline.head - rdbLoadPipeline.tail == rdbLoadPipeline.size)
+        rdbLoadPipelineApplyBatch();
+}
+
+/* Read the value of type 'rdbtype' associated with 'key' from 'rdb', and
+ * queue it to be decoded by the loading threads. The reference to 'key' is
+ * owned by the pipeline from now on. Returns -1 on read error, or if
+ * corrupted data was found in the values decoded so far. */
+static int rdbLoadPipelineAdd(rio *rdb, redisDb *db, robj *key, int rdbtype,
+                              long long expiretime)
+{
+    rdbLoadBatch *b = rdbLoadPipeline.batches +
+                      (rdbLoadPipeline.head % rdbLoadPipeline.size);
+    rdbLoadJob *job = b->jobs+b->count;
+
+    if (rdbCopyObject(rdbtype,rdb,&b->raw) == -1) {
+        decrRefCount(key);
+        return -1;
+    }
+    job->db = db;
+    job->key = key;
+    job->rdbtype = rdbtype;
+    job->expiretime = expiretime;
+    job->val = NULL;
+    b->count++;
+
+    if (b->count == RDB_LOAD_BATCH_KEYS ||
+        sdslen(b->raw.io.buffer.ptr) >= RDB_LOAD_BATCH_BYTES)
+    {
+        rdbLoadPipelineSubmitBatch();
+    }
+    return rdbLoadPipeline.error ? -1 : 0;
+}
+
+/* Add all the pending keys to the database and terminate the loading
+ * threads. Returns C_ERR if corrupted data was found. */
+static int rdbLoadPipelineStop(void) {
+    unsigned long j;
+    rdbLoadBatch *b = rdbLoadPipeline.batches +
+                      (rdbLoadPipeline.head % rdbLoadPipeline.size);
+
+    if (b->count) rdbLoadPipelineSubmitBatch();
+    while (rdbLoadPipeline.tail != rdbLoadPipeline.head)
+        rdbLoadPipelineApplyBatch();
+
+    pthread_mutex_lock(&rdbLoadPipeline.mutex);
+    rdbLoadPipeline.stop = 1;
+    pthread_cond_broadcast(&rdbLoadPipeline.job_cond);
+    pthread_mutex_unlock(&rdbLoadPipeline.mutex);
+    for (j = 0; j < (unsigned long)rdbLoadPipeline.numthreads; j++)
+        pthread_join(rdbLoadPipeline.threads[j],NULL);
+
+    for (j = 0; j < rdbLoadPipeline.size; j++)
+        sdsfree(rdbLoadPipeline.batches[j].raw.io.buffer.ptr);
+    zfree(rdbLoadPipeline.batches);
+    zfree(rdbLoadPipeline.threads);
+    pthread_mutex_destroy(&rdbLoadPipeline.mutex);
+    pthread_cond_destroy(&rdbLoadPipeline.job_cond);
+    pthread_cond_destroy(&rdbLoadPipeline.done_cond);
+    return rdbLoadPipeline.error ? C_ERR : C_OK;
+}
+
 /* Mark that we are loading in the global state and setup the fields
  * needed to provide loading stats. */
 void startLoading(FILE *fp) {
     struct stat sb;
 
+    if (fstat(fileno(fp), &sb) == -1) sb.st_size = 0;
+    startLoadingWithSize(sb.st_size);
+}
+
+/* Like startLoading() but for payloads not backed by a file, like the RDB
+ * read directly from the master socket: 'size' is the expected payload size,
+ * or zero if unknown. */
+void startLoadingWithSize(off_t size) {
     /* Load the DB */
     server.loading = 1;
     server.loading_start_time = time(NULL);
     server.loading_loaded_bytes = 0;
-    if (fstat(fileno(fp), &sb) == -1) {
-        server.loading_total_bytes = 0;
-    } else {
-        server.loading_total_bytes = sb.st_size;
-    }
+    server.loading_total_bytes = size;
 }
 
 /* Refresh the loading progress info */
@@ -1274,73 +1805,79 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
-int rdbLoad(char *filename) {
+/* Load an RDB payload from the rio stream 'rdb'. The caller is responsible
+ * for calling startLoading() / stopLoading() around this function.
+ *
+ * Corrupted payloads are a fatal error, as well as short reads, unless the
+ * rio backend flags the short read as a read error (RIO_FLAG_READ_ERROR),
+ * like when loading from a socket: in that case C_ERR is returned and the
+ * caller should discard the partially loaded dataset. Corrupted payloads
+ * are reported with C_ERR as well if rdbLoadCorruptionIsError is set. */
+int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
     uint32_t dbid;
     int type, rdbver;
     redisDb *db = server.db+0;
     char buf[1024];
     long long expiretime, now = mstime();
-    FILE *fp;
-    rio rdb;
+    int threaded = 0;
 
-    if ((fp = fopen(filename,"r")) == NULL) return C_ERR;
-
-    rioInitWithFile(&rdb,fp);
-    rdb.update_cksum = rdbLoadProgressCallback;
-    rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
-    if (rioRead(&rdb,buf,9) == 0) goto eoferr;
+    rdb->update_cksum = rdbLoadProgressCallback;
+    rdb->max_processing_chunk = server.loading_process_events_interval_bytes;
+    if (rioRead(rdb,buf,9) == 0) goto eoferr;
     buf[9] = '\0';
     if (memcmp(buf,"REDIS",5) != 0) {
-        fclose(fp);
         serverLog(LL_WARNING,"Wrong signature trying to load DB from file");
         errno = EINVAL;
         return C_ERR;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > RDB_VERSION) {
-        fclose(fp);
+    if (!rdbIsKnownVersion(rdbver)) {
         serverLog(LL_WARNING,"Can't handle RDB format version %d",rdbver);
         errno = EINVAL;
         return C_ERR;
     }
 
-    startLoading(fp);
+    if (server.rdb_load_threads > 1) {
+        rdbLoadPipelineStart(server.rdb_load_threads,now);
+        threaded = 1;
+    }
     while(1) {
         robj *key, *val;
         expiretime = -1;
 
         /* Read type. */
-        if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+        if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
 
         /* Handle special types. */
         if (type == RDB_OPCODE_EXPIRETIME) {
             /* EXPIRETIME: load an expire associated with the next key
              * to load. Note that after loading an expire we need to
              * load the actual type, and continue. */
-            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
+            if ((expiretime = rdbLoadTime(rdb)) == -1) goto eoferr;
             /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+            if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
             /* the EXPIRETIME opcode specifies time in seconds, so convert
              * into milliseconds. */
             expiretime *= 1000;
         } else if (type == RDB_OPCODE_EXPIRETIME_MS) {
             /* EXPIRETIME_MS: milliseconds precision expire times introduced
              * with RDB v3. Like EXPIRETIME but no with more precision. */
-            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
+            if ((expiretime = rdbLoadMillisecondTime(rdb)) == -1) goto eoferr;
             /* We read the time so we need to read the object type again. */
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+            if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
         } else if (type == RDB_OPCODE_EOF) {
             /* EOF: End of file, exit the main loop. */
             break;
         } else if (type == RDB_OPCODE_SELECTDB) {
             /* SELECTDB: Select the specified database. */
-            if ((dbid = rdbLoadLen(&rdb,NULL)) == RDB_LENERR)
+            if ((dbid = rdbLoadLen(rdb,NULL)) == RDB_LENERR)
                 goto eoferr;
             if (dbid >= (unsigned)server.dbnum) {
                 serverLog(LL_WARNING,
                     "FATAL: Data file was created with a Redis "
                     "server configured to handle more than %d "
                     "databases. Exiting\n", server.dbnum);
+                if (rdbLoadCorruptionIsError) goto eoferr;
                 exit(1);
             }
             db = server.db+dbid;
@@ -1349,12 +1886,12 @@ int rdbLoad(char *filename) {
             /* RESIZEDB: Hint about the size of the keys in the currently
              * selected data base, in order to avoid useless rehashing. */
             uint32_t db_size, expires_size;
-            if ((db_size = rdbLoadLen(&rdb,NULL)) == RDB_LENERR)
+            if ((db_size = rdbLoadLen(rdb,NULL)) == RDB_LENERR)
                 goto eoferr;
-            if ((expires_size = rdbLoadLen(&rdb,NULL)) == RDB_LENERR)
+            if ((expires_size = rdbLoadLen(rdb,NULL)) == RDB_LENERR)
                 goto eoferr;
             dictExpand(db->dict,db_size);
-            dictExpand(db->expires,expires_size);
+            if (db->expires) dictExpand(db->expires,expires_size);
             continue; /* Read type again. */
         } else if (type == RDB_OPCODE_AUX) {
             /* AUX: generic string-string fields. Use to add state to RDB
@@ -1363,8 +1900,8 @@ int rdbLoad(char *filename) {
              *
              * An AUX field is composed of two strings: key and value. */
             robj *auxkey, *auxval;
-            if ((auxkey = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
-            if ((auxval = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
+            if ((auxkey = rdbLoadStringObject(rdb)) == NULL) goto eoferr;
+            if ((auxval = rdbLoadStringObject(rdb)) == NULL) goto eoferr;
 
             if (((char*)auxkey->ptr)[0] == '%') {
                 /* All the fields with a name staring with '%' are considered
@@ -1373,6 +1910,15 @@ int rdbLoad(char *filename) {
                 serverLog(LL_NOTICE,"RDB '%s': %s",
                     (char*)auxkey->ptr,
                     (char*)auxval->ptr);
+            } else if (rsi && !strcasecmp(auxkey->ptr,"repl-stream-db")) {
+                rsi->repl_stream_db = atoi(auxval->ptr);
+            } else if (rsi && !strcasecmp(auxkey->ptr,"repl-id")) {
+                if (sdslen(auxval->ptr) == CONFIG_RUN_ID_SIZE) {
+                    memcpy(rsi->repl_id,auxval->ptr,CONFIG_RUN_ID_SIZE+1);
+                    rsi->repl_id_is_set = 1;
+                }
+            } else if (rsi && !strcasecmp(auxkey->ptr,"repl-offset")) {
+                rsi->repl_offset = strtoll(auxval->ptr,NULL,10);
             } else {
                 /* We ignore fields we don't understand, as by AUX field
                  * contract. */
@@ -1386,9 +1932,15 @@ int rdbLoad(char *filename) {
         }
 
         /* Read key */
-        if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
+        if ((key = rdbLoadStringObject(rdb)) == NULL) goto eoferr;
+        /* Let the loading threads decode the value if enabled. */
+        if (threaded) {
+            if (rdbLoadPipelineAdd(rdb,db,key,type,expiretime) == -1)
+                goto eoferr;
+            continue;
+        }
         /* Read value */
-        if ((val = rdbLoadObject(type,&rdb)) == NULL) goto eoferr;
+        if ((val = rdbLoadObject(type,rdb)) == NULL) goto eoferr;
         /* Check if the key already expired. This function is used when loading
          * an RDB file from disk, either at startup, or when an RDB was
          * received from the master. In the latter case, the master is
@@ -1407,28 +1959,59 @@ int rdbLoad(char *filename) {
 
         decrRefCount(key);
     }
-    /* Verify the checksum if RDB version is >= 5 */
-    if (rdbver >= 5 && server.rdb_checksum) {
-        uint64_t cksum, expected = rdb.cksum;
+    if (threaded) {
+        threaded = 0;
+        if (rdbLoadPipelineStop() == C_ERR) return C_ERR;
+    }
+    /* Verify the checksum if RDB version is >= 5. The checksum is always
+     * consumed, so that streams carrying more data after the RDB payload
+     * stay in sync even if the check is disabled. */
+    if (rdbver >= 5) {
+        uint64_t cksum, expected = rdb->cksum;
 
-        if (rioRead(&rdb,&cksum,8) == 0) goto eoferr;
+        if (rioRead(rdb,&cksum,8) == 0) goto eoferr;
         memrev64ifbe(&cksum);
-        if (cksum == 0) {
+        if (!server.rdb_checksum) {
+            /* Check disabled. */
+        } else if (cksum == 0) {
             serverLog(LL_WARNING,"RDB file was saved with checksum disabled: no check performed.");
         } else if (cksum != expected) {
             serverLog(LL_WARNING,"Wrong RDB checksum. Aborting now.");
             rdbExitReportCorruptRDB("RDB CRC error");
+            return C_ERR;
         }
     }
 
-    fclose(fp);
-    stopLoading();
     return C_OK;
 
 eoferr: /* unexpected end of file is handled here with a fatal exit */
+    if (threaded && rdbLoadPipelineStop() == C_ERR) return C_ERR;
+    if (rdb->flags & RIO_FLAG_READ_ERROR) {
+        serverLog(LL_WARNING,"Short read loading DB: %s", strerror(errno));
+        return C_ERR;
+    }
     serverLog(LL_WARNING,"Short read or OOM loading DB. Unrecoverable error, aborting now.");
     rdbExitReportCorruptRDB("Unexpected EOF reading RDB file");
-    return C_ERR; /* Just to avoid warning */
+    return C_ERR; /* Only reached if rdbLoadCorruptionIsError is set. */
+}
+
+/* Load the RDB file 'filename' into memory. Returns C_ERR if the file
+ * can't be opened or is not a valid RDB file, otherwise C_OK.
+ *
+ * If 'rsi' is not NULL it is populated with the replication info stored
+ * in the RDB aux fields, if any. */
+int rdbLoad(char *filename, rdbSaveInfo *rsi) {
+    FILE *fp;
+    rio rdb;
+    int retval;
+
+    if ((fp = fopen(filename,"r")) == NULL) return C_ERR;
+    startLoading(fp);
+    rioInitWithFile(&rdb,fp);
+    retval = rdbLoadRio(&rdb,rsi);
+    fclose(fp);
+    stopLoading();
+    return retval;
 }
 
 /* A background saving child (BGSAVE) terminated its work. Handle this.
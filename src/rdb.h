@@ -37,8 +37,23 @@
 #include "server.h"
 
 /* The current RDB version. When the format changes in a way that is no longer
- * backward compatible this number gets incremented. */
-#define RDB_VERSION 7
+ * backward compatible this number gets incremented.
+ *
+ * Versions from 8 to 99 are left to the formats of the upstream Redis
+ * releases, that this server can't load: the versions of the formats
+ * introduced here start at 100, so that files and DUMP payloads can't be
+ * mistaken for upstream ones, in either direction. */
+#define RDB_VERSION 100
+#define RDB_FOREIGN_VERSION_MIN 8
+#define RDB_FOREIGN_VERSION_MAX 99
+
+/* Version of the DUMP payloads only using the format of RDB version 7, so
+ * that they can be restored by Redis 3.2 and by the upstream releases. */
+#define RDB_DUMP_COMPAT_VERSION 7
+
+/* Test if a version is one this server is able to load. */
+#define rdbIsKnownVersion(v) ((v) >= 1 && (v) <= RDB_VERSION && \
+    ((v) < RDB_FOREIGN_VERSION_MIN || (v) > RDB_FOREIGN_VERSION_MAX))
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -66,6 +81,7 @@
 #define RDB_ENC_INT16 1       /* 16 bit signed integer */
 #define RDB_ENC_INT32 2       /* 32 bit signed integer */
 #define RDB_ENC_LZF 3         /* string compressed with FASTLZ */
+#define RDB_ENC_LZ4 4         /* string compressed with LZ4 (block format) */
 
 /* Dup object types to RDB object types. Only reason is readability (are we
  * dealing with RDB types or with in-memory object types?). */
@@ -83,10 +99,16 @@
 #define RDB_TYPE_ZSET_ZIPLIST  12
 #define RDB_TYPE_HASH_ZIPLIST  13
 #define RDB_TYPE_LIST_QUICKLIST 14
+/* Types of the formats introduced by RDB version 100. Upstream Redis uses
+ * the ids after 14 for other types, so these start at 64. */
+#define RDB_TYPE_HASH_LISTPACK 64
+#define RDB_TYPE_ZSET_LISTPACK 65
+#define RDB_TYPE_LIST_QUICKLIST_LISTPACK 66
 /* NOTE: WHEN ADDING NEW RDB TYPE, UPDATE rdbIsObjectType() BELOW */
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 14))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 14) || \
+                            (t >= 64 && t <= 66))
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
 #define RDB_OPCODE_AUX        250
@@ -96,6 +118,10 @@
 #define RDB_OPCODE_SELECTDB   254
 #define RDB_OPCODE_EOF        255
 
+/* rdbSaveRio() flags. */
+#define RDB_SAVE_NONE 0
+#define RDB_SAVE_AOF_PREAMBLE (1<<0)
+
 int rdbSaveType(rio *rdb, unsigned char type);
 int rdbLoadType(rio *rdb);
 int rdbSaveTime(rio *rdb, time_t t);
@@ -104,11 +130,17 @@ int rdbSaveLen(rio *rdb, uint32_t len);
 uint32_t rdbLoadLen(rio *rdb, int *isencoded);
 int rdbSaveObjectType(rio *rdb, robj *o);
 int rdbLoadObjectType(rio *rdb);
-int rdbLoad(char *filename);
+int rdbSaveStringObject(rio *rdb, robj *obj);
+int rdbSaveDoubleValue(rio *rdb, double val);
+extern int rdbLoadCorruptionIsError;
+int rdbLoad(char *filename, rdbSaveInfo *rsi);
+int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi);
+int rdbReplicationStreamDb(void);
 int rdbSaveBackground(char *filename);
 int rdbSaveToSlavesSockets(void);
 void rdbRemoveTempFile(pid_t childpid);
 int rdbSave(char *filename);
+int rdbSaveRio(rio *rdb, int *error, int flags);
 ssize_t rdbSaveObject(rio *rdb, robj *o);
 size_t rdbSavedObjectLen(robj *o);
 robj *rdbLoadObject(int type, rio *rdb);
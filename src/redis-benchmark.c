@@ -39,18 +39,53 @@
 #include <sys/time.h>
 #include <signal.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <sds.h> /* Use hiredis sds. */
 #include "ae.h"
 #include "hiredis.h"
 #include "adlist.h"
 #include "zmalloc.h"
+#include "atomicvar.h"
 
 #define UNUSED(V) ((void) V)
 #define RANDPTR_INITIAL_SIZE 8
 
-static struct config {
+/* Request latencies are recorded in microseconds in a log-linear histogram,
+ * in the spirit of HdrHistogram: values below 2^LATENCY_SUB_BITS are exact,
+ * bigger values are grouped by power of two, and every power of two is split
+ * into 2^LATENCY_SUB_BITS linear buckets. This way every percentile is known
+ * with a relative error below 1/128, using a fixed amount of memory whatever
+ * the number of requests. Latencies of 2^LATENCY_MAX_BITS usec or more are
+ * counted in the last bucket. */
+#define LATENCY_SUB_BITS 7
+#define LATENCY_MAX_BITS 36
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS-LATENCY_SUB_BITS+1)<<LATENCY_SUB_BITS)
+
+typedef struct latencyHistogram {
+    long long count;        /* Number of recorded latencies. */
+    long long sum;          /* Sum of the recorded latencies, for the avg. */
+    long long min, max;     /* Min and max recorded latencies. */
+    long long buckets[LATENCY_BUCKETS];
+} latencyHistogram;
+
+/* With --threads the clients are spread among several threads, every one
+ * running its own event loop and recording latencies in its own histogram,
+ * so that the benchmark is not limited by the speed of a single core. The
+ * counters shared by all the threads are updated atomically. Without
+ * --threads a single benchmarkThread is run by the main thread. */
+typedef struct benchmarkThread {
+    int index;
+    pthread_t thread;
     aeEventLoop *el;
+    list *clients;          /* Clients served by this thread. */
+    int numclients;         /* Number of clients this thread should run. */
+    int liveclients;        /* Number of connected clients of this thread. */
+    long long end;          /* Time the thread finished its part of a test. */
+    latencyHistogram latency;
+} benchmarkThread;
+
+static struct config {
     const char *hostip;
     int hostport;
     const char *hostsocket;
@@ -59,6 +94,16 @@ static struct config {
     int requests;
     int requests_issued;
     int requests_finished;
+    long long latency_sum;  /* Sum of the latencies of finished requests. */
+    int num_threads;        /* --threads, 0 means no threads. */
+    benchmarkThread **threads;
+    aeEventLoop *el;        /* Shows the throughput while threads run. */
+    int running_threads;    /* Threads that did not finish the test yet. */
+    pthread_mutex_t requests_issued_mutex;
+    pthread_mutex_t requests_finished_mutex;
+    pthread_mutex_t liveclients_mutex;
+    pthread_mutex_t latency_sum_mutex;
+    pthread_mutex_t running_threads_mutex;
     int keysize;
     int datasize;
     int randomkeys;
@@ -68,11 +113,17 @@ static struct config {
     int showerrors;
     long long start;
     long long totlatency;
-    long long *latency;
+    latencyHistogram latency;
     const char *title;
-    list *clients;
     int quiet;
     int csv;
+    int json;
+    int csv_header_shown;
+    long long interval_start;       /* Start of the current interval (ms). */
+    int interval_requests;          /* requests_finished at interval start. */
+    long long interval_latency;     /* Latency sum at interval start. */
+    float interval_rps;             /* Requests per second, last interval. */
+    float interval_avg;             /* Avg latency (msec), last interval. */
     int loop;
     int idlemode;
     int dbnum;
@@ -95,11 +146,13 @@ typedef struct _client {
                                such as auth and select are prefixed to the pipeline of
                                benchmark commands and discarded after the first send. */
     int prefixlen;          /* Size in bytes of the pending prefix commands */
+    benchmarkThread *thread; /* Thread running the client. */
 } *client;
 
 /* Prototypes */
 static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 static void createMissingClients(client c);
+int showThroughput(struct aeEventLoop *eventLoop, long long id, void *clientData);
 
 /* Implementation */
 static long long ustime(void) {
@@ -122,34 +175,185 @@ static long long mstime(void) {
     return mst;
 }
 
+/* ------------------------- Latency histogram ----------------------------- */
+
+/* Return the bucket where the latency 'usec' is counted. */
+static int latencyBucketIndex(long long usec) {
+    int msb, shift;
+
+    if (usec < 0) usec = 0;
+    if (usec < (1<<LATENCY_SUB_BITS)) return usec;
+    if (usec >= (1LL<<LATENCY_MAX_BITS)) return LATENCY_BUCKETS-1;
+    msb = 63-__builtin_clzll(usec);
+    shift = msb-LATENCY_SUB_BITS;
+    return ((shift+1)<<LATENCY_SUB_BITS) +
+           ((usec>>shift) & ((1<<LATENCY_SUB_BITS)-1));
+}
+
+/* Return the highest latency counted in the specified bucket. */
+static long long latencyBucketMax(int idx) {
+    int shift, sub;
+
+    if (idx < (1<<LATENCY_SUB_BITS)) return idx;
+    shift = (idx>>LATENCY_SUB_BITS)-1;
+    sub = idx & ((1<<LATENCY_SUB_BITS)-1);
+    return (((1LL<<LATENCY_SUB_BITS)+sub+1)<<shift)-1;
+}
+
+static void latencyReset(latencyHistogram *h) {
+    memset(h,0,sizeof(*h));
+}
+
+/* Add the latencies recorded in 'src' to 'dst'. */
+static void latencyMerge(latencyHistogram *dst, latencyHistogram *src) {
+    int j;
+
+    if (src->count == 0) return;
+    for (j = 0; j < LATENCY_BUCKETS; j++) dst->buckets[j] += src->buckets[j];
+    if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+}
+
+static void latencyRecord(latencyHistogram *h, long long usec) {
+    h->buckets[latencyBucketIndex(usec)]++;
+    if (h->count == 0 || usec < h->min) h->min = usec;
+    if (usec > h->max) h->max = usec;
+    h->count++;
+    h->sum += usec;
+}
+
+/* Return the latency below which 'perc' percent of the requests fall, that
+ * is the highest value of the bucket reaching the percentile, but never
+ * more than the max recorded latency. */
+static long long latencyPercentile(latencyHistogram *h, double perc) {
+    long long target, seen = 0;
+    int j;
+
+    if (h->count == 0) return 0;
+    target = (long long)(perc*h->count/100);
+    if (target < (perc*h->count/100)) target++;
+    if (target == 0) target = 1;
+    for (j = 0; j < LATENCY_BUCKETS; j++) {
+        seen += h->buckets[j];
+        if (seen >= target) {
+            long long value = latencyBucketMax(j);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* -------------------------------- Threads --------------------------------- */
+
+static benchmarkThread *createBenchmarkThread(int index) {
+    benchmarkThread *t = zmalloc(sizeof(*t));
+
+    t->index = index;
+    t->el = aeCreateEventLoop(1024*10);
+    t->clients = listCreate();
+    t->numclients = 0;
+    t->liveclients = 0;
+    latencyReset(&t->latency);
+    return t;
+}
+
+/* Create the threads (at least one, run by the main thread when --threads
+ * is not given) and spread the clients among them. Without --threads the
+ * throughput is shown by the single event loop, otherwise by an event loop
+ * of the main thread that runs until the last thread is done, since the
+ * threads may finish at different times. */
+static void createBenchmarkThreads(void) {
+    int j, count = config.num_threads ? config.num_threads : 1;
+
+    config.threads = zmalloc(sizeof(benchmarkThread*)*count);
+    for (j = 0; j < count; j++) {
+        config.threads[j] = createBenchmarkThread(j);
+        config.threads[j]->numclients = config.numclients/count +
+                                        (j < config.numclients%count);
+    }
+    config.el = config.num_threads ? aeCreateEventLoop(64) :
+                                     config.threads[0]->el;
+    aeCreateTimeEvent(config.el,1,showThroughput,NULL,NULL);
+}
+
+static void *runBenchmarkThread(void *ptr) {
+    benchmarkThread *t = ptr;
+
+    aeMain(t->el);
+    t->end = mstime();
+    atomicDecr(config.running_threads,1,config.running_threads_mutex);
+    return NULL;
+}
+
+/* Run the event loops of all the threads until the benchmark is done, and
+ * return the time the last thread finished. */
+static long long runBenchmarkThreads(void) {
+    long long end = 0;
+    int j;
+
+    if (config.num_threads == 0) {
+        aeMain(config.threads[0]->el);
+        return mstime();
+    }
+    config.running_threads = config.num_threads;
+    for (j = 0; j < config.num_threads; j++) {
+        benchmarkThread *t = config.threads[j];
+        if (pthread_create(&t->thread,NULL,runBenchmarkThread,t) != 0) {
+            fprintf(stderr,"Error: can't create benchmark thread.\n");
+            exit(1);
+        }
+    }
+    /* Show the throughput until showThroughput() sees no running thread. */
+    aeMain(config.el);
+    for (j = 0; j < config.num_threads; j++) {
+        pthread_join(config.threads[j]->thread,NULL);
+        if (config.threads[j]->end > end) end = config.threads[j]->end;
+    }
+    return end;
+}
+
+/* --------------------------------- Clients -------------------------------- */
+
 static void freeClient(client c) {
+    benchmarkThread *t = c->thread;
     listNode *ln;
-    aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-    aeDeleteFileEvent(config.el,c->context->fd,AE_READABLE);
+
+    aeDeleteFileEvent(t->el,c->context->fd,AE_WRITABLE);
+    aeDeleteFileEvent(t->el,c->context->fd,AE_READABLE);
     redisFree(c->context);
     sdsfree(c->obuf);
     zfree(c->randptr);
     zfree(c);
-    config.liveclients--;
-    ln = listSearchKey(config.clients,c);
+    atomicDecr(config.liveclients,1,config.liveclients_mutex);
+    ln = listSearchKey(t->clients,c);
     assert(ln != NULL);
-    listDelNode(config.clients,ln);
+    listDelNode(t->clients,ln);
+    /* A thread without clients has nothing left to do in this test. */
+    if (--t->liveclients == 0) aeStop(t->el);
 }
 
 static void freeAllClients(void) {
-    listNode *ln = config.clients->head, *next;
+    int j, count = config.num_threads ? config.num_threads : 1;
 
-    while(ln) {
-        next = ln->next;
-        freeClient(ln->value);
-        ln = next;
+    for (j = 0; j < count; j++) {
+        listNode *ln = config.threads[j]->clients->head, *next;
+
+        while(ln) {
+            next = ln->next;
+            freeClient(ln->value);
+            ln = next;
+        }
     }
 }
 
 static void resetClient(client c) {
-    aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-    aeDeleteFileEvent(config.el,c->context->fd,AE_READABLE);
-    aeCreateFileEvent(config.el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    aeEventLoop *el = c->thread->el;
+
+    aeDeleteFileEvent(el,c->context->fd,AE_WRITABLE);
+    aeDeleteFileEvent(el,c->context->fd,AE_READABLE);
+    aeCreateFileEvent(el,c->context->fd,AE_WRITABLE,writeHandler,c);
     c->written = 0;
     c->pending = config.pipeline;
 }
@@ -171,17 +375,21 @@ static void randomizeClientKey(client c) {
 }
 
 static void clientDone(client c) {
-    if (config.requests_finished == config.requests) {
+    int requests_finished;
+
+    atomicGet(config.requests_finished,requests_finished,
+              config.requests_finished_mutex);
+    if (requests_finished >= config.requests) {
+        aeStop(c->thread->el);
         freeClient(c);
-        aeStop(config.el);
         return;
     }
     if (config.keepalive) {
         resetClient(c);
     } else {
-        config.liveclients--;
+        c->thread->liveclients--;
         createMissingClients(c);
-        config.liveclients++;
+        c->thread->liveclients++;
         freeClient(c);
     }
 }
@@ -241,8 +449,15 @@ static void readHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
                     continue;
                 }
 
-                if (config.requests_finished < config.requests)
-                    config.latency[config.requests_finished++] = c->latency;
+                int requests_finished;
+
+                atomicIncrGet(config.requests_finished,requests_finished,1,
+                              config.requests_finished_mutex);
+                if (requests_finished <= config.requests) {
+                    latencyRecord(&c->thread->latency,c->latency);
+                    atomicIncr(config.latency_sum,c->latency,
+                               config.latency_sum_mutex);
+                }
                 c->pending--;
                 if (c->pending == 0) {
                     clientDone(c);
@@ -264,7 +479,11 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
     /* Initialize request when nothing was written. */
     if (c->written == 0) {
         /* Enforce upper bound to number of requests. */
-        if (config.requests_issued++ >= config.requests) {
+        int requests_issued;
+
+        atomicIncrGet(config.requests_issued,requests_issued,1,
+                      config.requests_issued_mutex);
+        if (requests_issued > config.requests) {
             freeClient(c);
             return;
         }
@@ -286,8 +505,8 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         c->written += nwritten;
         if (sdslen(c->obuf) == c->written) {
-            aeDeleteFileEvent(config.el,c->context->fd,AE_WRITABLE);
-            aeCreateFileEvent(config.el,c->context->fd,AE_READABLE,readHandler,c);
+            aeDeleteFileEvent(c->thread->el,c->context->fd,AE_WRITABLE);
+            aeCreateFileEvent(c->thread->el,c->context->fd,AE_READABLE,readHandler,c);
         }
     }
 }
@@ -312,11 +531,18 @@ static void writeHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
  * 2) The offsets of the __rand_int__ elements inside the command line, used
  *    for arguments randomization.
  *
+ * The client is served by the thread 't', or by the thread of 'from' when
+ * cloning another client.
+ *
  * Even when cloning another client, prefix commands are applied if needed.*/
-static client createClient(char *cmd, size_t len, client from) {
+static client createClient(char *cmd, size_t len, client from,
+                           benchmarkThread *t) {
     int j;
     client c = zmalloc(sizeof(struct _client));
 
+    if (from) t = from->thread;
+    c->thread = t;
+
     if (config.hostsocket == NULL) {
         c->context = redisConnectNonBlock(config.hostip,config.hostport);
     } else {
@@ -404,17 +630,21 @@ static client createClient(char *cmd, size_t len, client from) {
         }
     }
     if (config.idlemode == 0)
-        aeCreateFileEvent(config.el,c->context->fd,AE_WRITABLE,writeHandler,c);
-    listAddNodeTail(config.clients,c);
-    config.liveclients++;
+        aeCreateFileEvent(t->el,c->context->fd,AE_WRITABLE,writeHandler,c);
+    listAddNodeTail(t->clients,c);
+    t->liveclients++;
+    atomicIncr(config.liveclients,1,config.liveclients_mutex);
     return c;
 }
 
+/* Create clients cloning 'c' until its thread runs the number of clients
+ * assigned to it. */
 static void createMissingClients(client c) {
+    benchmarkThread *t = c->thread;
     int n = 0;
 
-    while(config.liveclients < config.numclients) {
-        createClient(NULL,0,c);
+    while(t->liveclients < t->numclients) {
+        createClient(NULL,0,c,NULL);
 
         /* Listen backlog is quite limited on most systems */
         if (++n > 64) {
@@ -424,16 +654,48 @@ static void createMissingClients(client c) {
     }
 }
 
-static int compareLatency(const void *a, const void *b) {
-    return (*(long long*)a)-(*(long long*)b);
-}
+/* Percentiles shown in the latency reports. */
+static double reportPercentiles[] = {50, 95, 99, 99.9};
+#define REPORT_PERCENTILES (sizeof(reportPercentiles)/sizeof(double))
 
 static void showLatencyReport(void) {
-    int i, curlat = 0;
-    float perc, reqpersec;
+    latencyHistogram *h = &config.latency;
+    float reqpersec, avg, min, max;
+    float perc[REPORT_PERCENTILES];
+    unsigned int j;
 
     reqpersec = (float)config.requests_finished/((float)config.totlatency/1000);
-    if (!config.quiet && !config.csv) {
+    avg = h->count ? (float)h->sum/h->count/1000 : 0;
+    min = (float)h->min/1000;
+    max = (float)h->max/1000;
+    for (j = 0; j < REPORT_PERCENTILES; j++)
+        perc[j] = (float)latencyPercentile(h,reportPercentiles[j])/1000;
+
+    if (config.json) {
+        printf("{\"test\":\"%s\",\"rps\":%.2f,\"avg_latency_ms\":%.3f,"
+               "\"min_latency_ms\":%.3f,\"p50_latency_ms\":%.3f,"
+               "\"p95_latency_ms\":%.3f,\"p99_latency_ms\":%.3f,"
+               "\"p99.9_latency_ms\":%.3f,\"max_latency_ms\":%.3f}\n",
+            config.title, reqpersec, avg, min, perc[0], perc[1], perc[2],
+            perc[3], max);
+    } else if (config.csv) {
+        if (!config.csv_header_shown) {
+            printf("\"test\",\"rps\",\"avg_latency_ms\",\"min_latency_ms\","
+                   "\"p50_latency_ms\",\"p95_latency_ms\",\"p99_latency_ms\","
+                   "\"p99.9_latency_ms\",\"max_latency_ms\"\n");
+            config.csv_header_shown = 1;
+        }
+        printf("\"%s\",\"%.2f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\",\"%.3f\","
+               "\"%.3f\",\"%.3f\"\n",
+            config.title, reqpersec, avg, min, perc[0], perc[1], perc[2],
+            perc[3], max);
+    } else if (config.quiet) {
+        printf("%s: %.2f requests per second, p50=%.3f msec\n",
+            config.title, reqpersec, perc[0]);
+    } else {
+        long long seen = 0;
+        int i, curlat = -1;
+
         printf("====== %s ======\n", config.title);
         printf("  %d requests completed in %.2f seconds\n", config.requests_finished,
             (float)config.totlatency/1000);
@@ -442,35 +704,69 @@ static void showLatencyReport(void) {
         printf("  keep alive: %d\n", config.keepalive);
         printf("\n");
 
-        qsort(config.latency,config.requests,sizeof(long long),compareLatency);
-        for (i = 0; i < config.requests; i++) {
-            if (config.latency[i]/1000 != curlat || i == (config.requests-1)) {
-                curlat = config.latency[i]/1000;
-                perc = ((float)(i+1)*100)/config.requests;
-                printf("%.2f%% <= %d milliseconds\n", perc, curlat);
-            }
+        /* Cumulative distribution, one line per millisecond. */
+        for (i = 0; i < LATENCY_BUCKETS; i++) {
+            int lat;
+
+            if (h->buckets[i] == 0) continue;
+            lat = latencyBucketMax(i)/1000;
+            if (curlat != -1 && lat != curlat)
+                printf("%.2f%% <= %d milliseconds\n",
+                    (float)seen*100/h->count, curlat);
+            seen += h->buckets[i];
+            curlat = lat;
         }
+        if (curlat != -1)
+            printf("%.2f%% <= %d milliseconds\n",
+                (float)seen*100/h->count, curlat);
+        printf("\n  latency summary (msec):\n");
+        printf("  %9s %9s %9s %9s %9s %9s %9s\n",
+            "avg","min","p50","p95","p99","p99.9","max");
+        printf("  %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+            avg, min, perc[0], perc[1], perc[2], perc[3], max);
         printf("%.2f requests per second\n\n", reqpersec);
-    } else if (config.csv) {
-        printf("\"%s\",\"%.2f\"\n", config.title, reqpersec);
-    } else {
-        printf("%s: %.2f requests per second\n", config.title, reqpersec);
+    }
+}
+
+/* Create the clients of every thread, sending the command 'cmd'. */
+static void createAllClients(char *cmd, int len) {
+    int j, count = config.num_threads ? config.num_threads : 1;
+
+    for (j = 0; j < count; j++) {
+        benchmarkThread *t = config.threads[j];
+        client c;
+
+        if (t->numclients == 0) continue;
+        c = createClient(cmd,len,NULL,t);
+        createMissingClients(c);
     }
 }
 
 static void benchmark(char *title, char *cmd, int len) {
-    client c;
+    int j, count = config.num_threads ? config.num_threads : 1;
 
     config.title = title;
     config.requests_issued = 0;
     config.requests_finished = 0;
+    config.latency_sum = 0;
+    latencyReset(&config.latency);
+    for (j = 0; j < count; j++) latencyReset(&config.threads[j]->latency);
 
-    c = createClient(cmd,len,NULL);
-    createMissingClients(c);
+    createAllClients(cmd,len);
 
     config.start = mstime();
-    aeMain(config.el);
-    config.totlatency = mstime()-config.start;
+    config.interval_start = config.start;
+    config.interval_requests = 0;
+    config.interval_latency = 0;
+    config.interval_rps = 0;
+    config.interval_avg = 0;
+    config.totlatency = runBenchmarkThreads()-config.start;
+
+    /* With pipelining more replies than requests may be received. */
+    if (config.requests_finished > config.requests)
+        config.requests_finished = config.requests;
+    for (j = 0; j < count; j++)
+        latencyMerge(&config.latency,&config.threads[j]->latency);
 
     showLatencyReport();
     freeAllClients();
@@ -525,6 +821,8 @@ int parseOptions(int argc, const char **argv) {
             config.quiet = 1;
         } else if (!strcmp(argv[i],"--csv")) {
             config.csv = 1;
+        } else if (!strcmp(argv[i],"--json")) {
+            config.json = 1;
         } else if (!strcmp(argv[i],"-l")) {
             config.loop = 1;
         } else if (!strcmp(argv[i],"-I")) {
@@ -542,6 +840,11 @@ int parseOptions(int argc, const char **argv) {
             config.tests = sdscat(config.tests,(char*)argv[++i]);
             config.tests = sdscat(config.tests,",");
             sdstolower(config.tests);
+        } else if (!strcmp(argv[i],"--threads")) {
+            if (lastarg) goto invalid;
+            config.num_threads = atoi(argv[++i]);
+            if (config.num_threads < 0) config.num_threads = 0;
+            if (config.num_threads > 256) config.num_threads = 256;
         } else if (!strcmp(argv[i],"--dbnum")) {
             if (lastarg) goto invalid;
             config.dbnum = atoi(argv[++i]);
@@ -585,11 +888,16 @@ usage:
 " -e                 If server replies with errors, show them on stdout.\n"
 "                    (no more than 1 error per second is displayed)\n"
 " -q                 Quiet. Just show query/sec values\n"
-" --csv              Output in CSV format\n"
+" --csv              Output in CSV format, with a header line: requests per\n"
+"                    second and latency avg, min, p50, p95, p99, p99.9, max\n"
+" --json             Output the same fields as --csv, one JSON object per\n"
+"                    test and per line\n"
 " -l                 Loop. Run the tests forever\n"
 " -t <tests>         Only run the comma separated list of tests. The test\n"
 "                    names are the same as the ones produced as output.\n"
-" -I                 Idle mode. Just open N idle connections and wait.\n\n"
+" -I                 Idle mode. Just open N idle connections and wait.\n"
+" --threads <num>    Spread the clients among <num> threads, each running\n"
+"                    its own event loop (default 0, no threads).\n\n"
 "Examples:\n\n"
 " Run the benchmark with the default configuration against 127.0.0.1:6379:\n"
 "   $ redis-benchmark\n\n"
@@ -599,6 +907,8 @@ usage:
 "   $ redis-benchmark -t set -n 1000000 -r 100000000\n\n"
 " Benchmark 127.0.0.1:6379 for a few commands producing CSV output:\n"
 "   $ redis-benchmark -t ping,set,get -n 100000 --csv\n\n"
+" Use 4 threads to saturate a server running on a many cores machine:\n"
+"   $ redis-benchmark -t set,get -n 1000000 -c 200 -P 16 --threads 4\n\n"
 " Benchmark a specific command line:\n"
 "   $ redis-benchmark -r 10000 -n 10000 eval 'return redis.call(\"ping\")' 0\n\n"
 " Fill a list with 10000 random elements:\n"
@@ -610,23 +920,59 @@ usage:
 }
 
 int showThroughput(struct aeEventLoop *eventLoop, long long id, void *clientData) {
-    UNUSED(eventLoop);
     UNUSED(id);
     UNUSED(clientData);
 
-    if (config.liveclients == 0) {
+    int liveclients, requests_finished, running_threads;
+    long long latency_sum;
+
+    if (config.num_threads) {
+        atomicGet(config.running_threads,running_threads,
+                  config.running_threads_mutex);
+        if (running_threads == 0) {
+            aeStop(eventLoop);
+            return 250;
+        }
+    }
+    atomicGet(config.liveclients,liveclients,config.liveclients_mutex);
+    atomicGet(config.requests_finished,requests_finished,
+              config.requests_finished_mutex);
+    atomicGet(config.latency_sum,latency_sum,config.latency_sum_mutex);
+    if (liveclients == 0 && requests_finished < config.requests) {
         fprintf(stderr,"All clients disconnected... aborting.\n");
         exit(1);
     }
-    if (config.csv) return 250;
+    if (config.csv || config.json) return 250;
     if (config.idlemode == 1) {
-        printf("clients: %d\r", config.liveclients);
+        printf("clients: %d\r", liveclients);
         fflush(stdout);
 	return 250;
     }
-    float dt = (float)(mstime()-config.start)/1000.0;
-    float rps = (float)config.requests_finished/dt;
-    printf("%s: %.2f\r", config.title, rps);
+    long long now = mstime();
+    float dt = (float)(now-config.start)/1000.0;
+    float rps = dt > 0 ? (float)requests_finished/dt : 0;
+    float avg = requests_finished ?
+                (float)latency_sum/requests_finished/1000 : 0;
+
+    /* Every second compute the throughput and the average latency of the
+     * requests finished in the last interval, that show stalls and
+     * slowdowns that the overall values would hide. */
+    if (now-config.interval_start >= 1000) {
+        int requests = requests_finished-config.interval_requests;
+
+        config.interval_rps = (float)requests*1000/(now-config.interval_start);
+        config.interval_avg = requests ?
+            (float)(latency_sum-config.interval_latency)/requests/1000 : 0;
+        config.interval_start = now;
+        config.interval_requests = requests_finished;
+        config.interval_latency = latency_sum;
+    }
+    if (config.interval_requests == 0) {
+        printf("%s: rps=%.2f avg_msec=%.3f\r", config.title, rps, avg);
+    } else {
+        printf("%s: rps=%.2f (overall: %.2f) avg_msec=%.3f (overall: %.3f)\r",
+            config.title, config.interval_rps, rps, config.interval_avg, avg);
+    }
     fflush(stdout);
     return 250; /* every 250ms */
 }
@@ -650,8 +996,6 @@ int main(int argc, const char **argv) {
     char *data, *cmd;
     int len;
 
-    client c;
-
     srandom(time(NULL));
     signal(SIGHUP, SIG_IGN);
     signal(SIGPIPE, SIG_IGN);
@@ -659,8 +1003,6 @@ int main(int argc, const char **argv) {
     config.numclients = 50;
     config.requests = 100000;
     config.liveclients = 0;
-    config.el = aeCreateEventLoop(1024*10);
-    aeCreateTimeEvent(config.el,1,showThroughput,NULL,NULL);
     config.keepalive = 1;
     config.datasize = 3;
     config.pipeline = 1;
@@ -669,10 +1011,16 @@ int main(int argc, const char **argv) {
     config.randomkeys_keyspacelen = 0;
     config.quiet = 0;
     config.csv = 0;
+    config.json = 0;
+    config.csv_header_shown = 0;
     config.loop = 0;
     config.idlemode = 0;
-    config.latency = NULL;
-    config.clients = listCreate();
+    config.num_threads = 0;
+    pthread_mutex_init(&config.requests_issued_mutex,NULL);
+    pthread_mutex_init(&config.requests_finished_mutex,NULL);
+    pthread_mutex_init(&config.liveclients_mutex,NULL);
+    pthread_mutex_init(&config.latency_sum_mutex,NULL);
+    pthread_mutex_init(&config.running_threads_mutex,NULL);
     config.hostip = "127.0.0.1";
     config.hostport = 6379;
     config.hostsocket = NULL;
@@ -684,7 +1032,10 @@ int main(int argc, const char **argv) {
     argc -= i;
     argv += i;
 
-    config.latency = zmalloc(sizeof(long long)*config.requests);
+    if (config.num_threads > config.numclients)
+        config.num_threads = config.numclients;
+    if (config.num_threads) zmalloc_enable_thread_safeness();
+    createBenchmarkThreads();
 
     if (config.keepalive == 0) {
         printf("WARNING: keepalive disabled, you probably need 'echo 1 > /proc/sys/net/ipv4/tcp_tw_reuse' for Linux and 'sudo sysctl -w net.inet.tcp.msl=1000' for Mac OS X in order to use a lot of clients/requests\n");
@@ -692,9 +1043,8 @@ int main(int argc, const char **argv) {
 
     if (config.idlemode) {
         printf("Creating %d idle connections and waiting forever (Ctrl+C when done)\n", config.numclients);
-        c = createClient("",0,NULL); /* will never receive a reply */
-        createMissingClients(c);
-        aeMain(config.el);
+        createAllClients("",0); /* will never receive a reply */
+        runBenchmarkThreads();
         /* and will wait for every */
     }
 
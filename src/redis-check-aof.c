@@ -185,6 +185,17 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    /* AOF files rewritten with aof-use-rdb-preamble start with an RDB
+     * payload that this tool is not able to parse: refuse to check (and
+     * especially to fix) them instead of truncating the whole file. */
+    char sig[5];
+    if (fread(sig,1,5,fp) == 5 && memcmp(sig,"REDIS",5) == 0) {
+        printf("The AOF starts with an RDB preamble: checking it is not "
+               "supported by this tool.\n");
+        exit(1);
+    }
+    rewind(fp);
+
     off_t pos = process(fp);
     off_t diff = size-pos;
     printf("AOF analyzed: size=%lld, ok_up_to=%lld, diff=%lld\n",
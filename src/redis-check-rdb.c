@@ -85,7 +85,10 @@ char *rdb_type_string[] = {
     "set-intset",
     "zset-ziplist",
     "hash-ziplist",
-    "quicklist"
+    "quicklist",
+    [RDB_TYPE_HASH_LISTPACK] = "hash-listpack",
+    [RDB_TYPE_ZSET_LISTPACK] = "zset-listpack",
+    [RDB_TYPE_LIST_QUICKLIST_LISTPACK] = "quicklist-listpack"
 };
 
 /* Show a few stats collected into 'rdbstate' */
@@ -118,7 +121,8 @@ void rdbCheckError(const char *fmt, ...) {
         printf("[additional info] Reading type %d (%s)\n",
             rdbstate.key_type,
             ((unsigned)rdbstate.key_type <
-             sizeof(rdb_type_string)/sizeof(char*)) ?
+             sizeof(rdb_type_string)/sizeof(char*) &&
+             rdb_type_string[rdbstate.key_type]) ?
                 rdb_type_string[rdbstate.key_type] : "unknown");
     rdbShowGenericInfo();
 }
@@ -193,7 +197,7 @@ int redis_check_rdb(char *rdbfilename) {
         return 1;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > RDB_VERSION) {
+    if (!rdbIsKnownVersion(rdbver)) {
         rdbCheckError("Can't handle RDB format version %d",rdbver);
         return 1;
     }
@@ -26,7 +26,7 @@ require 'redis'
 
 ClusterHashSlots = 16384
 MigrateDefaultTimeout = 60000
-MigrateDefaultPipeline = 10
+MigrateDefaultPipeline = 100
 RebalanceDefaultThreshold = 2
 
 $verbose = false
@@ -931,6 +931,7 @@ class RedisTrib
             source.r.cluster("setslot",slot,"migrating",target.info[:name])
         end
         # Migrate all the keys from source to target using the MIGRATE command
+        moved = 0
         while true
             keys = source.r.cluster("getkeysinslot",slot,o[:pipeline])
             break if keys.length == 0
@@ -946,11 +947,12 @@ class RedisTrib
                     exit 1
                 end
             end
+            moved += keys.length
             print "."*keys.length if o[:dots]
             STDOUT.flush
         end
 
-        puts if !o[:quiet]
+        puts " #{moved} keys" if !o[:quiet]
         # Set the new node as the owner of the slot in all the known nodes.
         if !o[:cold]
             @nodes.each{|n|
@@ -0,0 +1,3 @@
+#define REDIS_GIT_SHA1 "e7cb3bad"
+#define REDIS_GIT_DIRTY "527"
+#define REDIS_BUILD_ID "vm-1792173646"
@@ -94,6 +94,7 @@ static const rio rioBufferIO = {
     0,              /* current checksum */
     0,              /* bytes read or written */
     0,              /* read/write chunk size */
+    0,              /* flags */
     { { NULL, 0 } } /* union for io-specific vars */
 };
 
@@ -147,6 +148,7 @@ static const rio rioFileIO = {
     0,              /* current checksum */
     0,              /* bytes read or written */
     0,              /* read/write chunk size */
+    0,              /* flags */
     { { NULL, 0 } } /* union for io-specific vars */
 };
 
@@ -260,6 +262,7 @@ static const rio rioFdsetIO = {
     0,              /* current checksum */
     0,              /* bytes read or written */
     0,              /* read/write chunk size */
+    0,              /* flags */
     { { NULL, 0 } } /* union for io-specific vars */
 };
 
@@ -283,6 +286,128 @@ void rioFreeFdset(rio *r) {
     sdsfree(r->io.fdset.buf);
 }
 
+/* ------------------- Read only file descriptor implementation ---------------
+ * This target reads from a non blocking socket, waiting up to 'timeout'
+ * milliseconds for new data to arrive. It is used by slaves in order to load
+ * the RDB payload sent by the master without storing it on disk first. */
+
+/* Returns 1 or 0 for success/failure. */
+static size_t rioFdRead(rio *r, void *buf, size_t len) {
+    size_t avail = sdslen(r->io.fd.buf)-r->io.fd.bpos;
+
+    /* Serve what we can from the read ahead buffer. */
+    if (avail) {
+        size_t count = avail < len ? avail : len;
+        memcpy(buf,r->io.fd.buf+r->io.fd.bpos,count);
+        r->io.fd.bpos += count;
+        r->io.fd.pos += count;
+        buf = (char*)buf + count;
+        len -= count;
+    }
+
+    while(len) {
+        size_t toread = PROTO_IOBUF_LEN;
+        ssize_t nread;
+
+        /* Refill the buffer, never reading past the configured limit:
+         * whatever follows the payload belongs to the caller. */
+        if (len > toread) toread = len;
+        if (r->io.fd.read_limit) {
+            off_t left = r->io.fd.read_limit - r->io.fd.read_so_far;
+            if ((off_t)len > left) {
+                errno = EOVERFLOW;
+                r->flags |= RIO_FLAG_READ_ERROR;
+                return 0;
+            }
+            if ((off_t)toread > left) toread = left;
+        }
+        sdsclear(r->io.fd.buf);
+        r->io.fd.bpos = 0;
+        r->io.fd.buf = sdsMakeRoomFor(r->io.fd.buf,toread);
+        nread = read(r->io.fd.fd,r->io.fd.buf,toread);
+        if (nread == -1 && errno == EAGAIN) {
+            if (aeWait(r->io.fd.fd,AE_READABLE,r->io.fd.timeout) <= 0) {
+                errno = ETIMEDOUT;
+                r->flags |= RIO_FLAG_READ_ERROR;
+                return 0;
+            }
+            continue;
+        }
+        if (nread <= 0) {
+            if (nread == 0) errno = ECONNRESET;
+            r->flags |= RIO_FLAG_READ_ERROR;
+            return 0;
+        }
+        sdsIncrLen(r->io.fd.buf,nread);
+        r->io.fd.read_so_far += nread;
+
+        size_t count = (size_t)nread < len ? (size_t)nread : len;
+        memcpy(buf,r->io.fd.buf,count);
+        r->io.fd.bpos = count;
+        r->io.fd.pos += count;
+        buf = (char*)buf + count;
+        len -= count;
+    }
+    return 1;
+}
+
+/* Returns 0 or 1 for failure/success. */
+static size_t rioFdWrite(rio *r, const void *buf, size_t len) {
+    UNUSED(r);
+    UNUSED(buf);
+    UNUSED(len);
+    return 0; /* Error, this target does not support writing. */
+}
+
+/* Returns the number of bytes consumed so far. */
+static off_t rioFdTell(rio *r) {
+    return r->io.fd.pos;
+}
+
+/* Nothing to flush on a read only target. */
+static int rioFdFlush(rio *r) {
+    UNUSED(r);
+    return 1;
+}
+
+static const rio rioFdIO = {
+    rioFdRead,
+    rioFdWrite,
+    rioFdTell,
+    rioFdFlush,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    0,              /* flags */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+/* Init a read only rio reading from the non blocking socket 'fd'. If
+ * 'read_limit' is non zero, no more than 'read_limit' bytes are read from
+ * the socket, otherwise the target may read ahead of what was consumed, and
+ * the exceeding data is returned by rioFreeFd(). */
+void rioInitWithFd(rio *r, int fd, off_t read_limit, long long timeout) {
+    *r = rioFdIO;
+    r->io.fd.fd = fd;
+    r->io.fd.pos = 0;
+    r->io.fd.buf = sdsempty();
+    r->io.fd.bpos = 0;
+    r->io.fd.read_limit = read_limit;
+    r->io.fd.read_so_far = 0;
+    r->io.fd.timeout = timeout;
+}
+
+/* Release the rio stream. If 'remaining' is not NULL, it is set to a new sds
+ * string with the data that was read from the socket but not consumed. */
+void rioFreeFd(rio *r, sds *remaining) {
+    if (remaining) {
+        *remaining = sdsnewlen(r->io.fd.buf+r->io.fd.bpos,
+                               sdslen(r->io.fd.buf)-r->io.fd.bpos);
+    }
+    sdsfree(r->io.fd.buf);
+}
+
 /* ---------------------------- Generic functions ---------------------------- */
 
 /* This function can be installed both in memory and file streams when checksum
@@ -66,6 +66,9 @@ struct _rio {
     /* maximum single read or write chunk size */
     size_t max_processing_chunk;    // 单次读或写最大数据长度
 
+    /* Backend-independent state, see the RIO_FLAG_* defines. */
+    uint64_t flags;
+
     /* Backend-specific vars. */
     union {
         /* In-memory buffer target. 
@@ -90,11 +93,26 @@ struct _rio {
             off_t pos;      /* 偏移量 */
             sds buf;
         } fdset;
+        /* Read only FD target (used to load an RDB from a socket).
+           只读的文件描述符（用于从socket直接加载RDB） */
+        struct {
+            int fd;         /* File descriptor, non blocking. */
+            off_t pos;      /* Bytes consumed by the reader. */
+            sds buf;        /* Read ahead buffer. */
+            size_t bpos;    /* Position of the next byte to consume in 'buf'. */
+            off_t read_limit; /* Never read past this offset, 0 = no limit. */
+            off_t read_so_far; /* Bytes actually read from the fd. */
+            long long timeout; /* Max milliseconds to wait for data. */
+        } fd;
     } io;
 };
 
 typedef struct _rio rio;
 
+/* rio->flags values. */
+#define RIO_FLAG_READ_ERROR (1<<0) /* The backend failed reading data. */
+#define RIO_FLAG_NO_LZ4 (1<<1) /* Don't compress strings with LZ4. */
+
 /* The following functions are our interface with the stream. They'll call the
  * actual implementation of read / write / tell, and will update the checksum
  * if needed. 
@@ -141,8 +159,10 @@ static inline int rioFlush(rio *r) {
 void rioInitWithFile(rio *r, FILE *fp);
 void rioInitWithBuffer(rio *r, sds s);
 void rioInitWithFdset(rio *r, int *fds, int numfds);
+void rioInitWithFd(rio *r, int fd, off_t read_limit, long long timeout);
 
 void rioFreeFdset(rio *r);
+void rioFreeFd(rio *r, sds *remaining);
 
 size_t rioWriteBulkCount(rio *r, char prefix, int count);
 size_t rioWriteBulkString(rio *r, const char *buf, size_t len);
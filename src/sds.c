@@ -1137,13 +1137,15 @@ void *sds_malloc(size_t size) { return s_malloc(size); }
 void *sds_realloc(void *ptr, size_t size) { return s_realloc(ptr,size); }
 void sds_free(void *ptr) { s_free(ptr); }
 
-#if defined(SDS_TEST_MAIN)
+#if defined(SDS_TEST_MAIN) || defined(REDIS_TEST)
 #include <stdio.h>
 #include "testhelp.h"
 #include "limits.h"
 
 #define UNUSED(x) (void)(x)
-int sdsTest(void) {
+int sdsTest(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
     {
         sds x = sdsnew("foo"), y;
 
@@ -1308,7 +1310,7 @@ int sdsTest(void) {
 #endif
 
 #ifdef SDS_TEST_MAIN
-int main(void) {
-    return sdsTest();
+int main(int argc, char *argv[]) {
+    return sdsTest(argc,argv);
 }
 #endif
@@ -88,9 +88,10 @@ struct redisServer server; /* server global state */
  *           in MSET the step is two since arguments are key,val,key,val,...
  * microseconds: microseconds of total execution time for this command.
  * calls: total number of calls of this command.
+ * latency_histogram: distribution of the execution time, see latency.c.
  *
- * The flags, microseconds and calls fields are computed by Redis and should
- * always be set to zero.
+ * The flags, microseconds, calls and latency_histogram fields are computed by
+ * Redis and should always be set to zero (NULL for the histogram).
  *
  * Command flags are expressed using strings where every character represents
  * a flag. Later the populateCommandTable() function will take care of
@@ -123,182 +124,183 @@ struct redisServer server; /* server global state */
  *    are not fast commands.
  */
 struct redisCommand redisCommandTable[] = {
-    {"get",getCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"set",setCommand,-3,"wm",0,NULL,1,1,1,0,0},
-    {"setnx",setnxCommand,3,"wmF",0,NULL,1,1,1,0,0},
-    {"setex",setexCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"psetex",psetexCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"strlen",strlenCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0},
-    {"exists",existsCommand,-2,"rF",0,NULL,1,-1,1,0,0},
-    {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"getbit",getbitCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"bitfield",bitfieldCommand,-2,"wm",0,NULL,1,1,1,0,0},
-    {"setrange",setrangeCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"getrange",getrangeCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"substr",getrangeCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"incr",incrCommand,2,"wmF",0,NULL,1,1,1,0,0},
-    {"decr",decrCommand,2,"wmF",0,NULL,1,1,1,0,0},
-    {"mget",mgetCommand,-2,"r",0,NULL,1,-1,1,0,0},
-    {"rpush",rpushCommand,-3,"wmF",0,NULL,1,1,1,0,0},
-    {"lpush",lpushCommand,-3,"wmF",0,NULL,1,1,1,0,0},
-    {"rpushx",rpushxCommand,3,"wmF",0,NULL,1,1,1,0,0},
-    {"lpushx",lpushxCommand,3,"wmF",0,NULL,1,1,1,0,0},
-    {"linsert",linsertCommand,5,"wm",0,NULL,1,1,1,0,0},
-    {"rpop",rpopCommand,2,"wF",0,NULL,1,1,1,0,0},
-    {"lpop",lpopCommand,2,"wF",0,NULL,1,1,1,0,0},
-    {"brpop",brpopCommand,-3,"ws",0,NULL,1,-2,1,0,0},
-    {"brpoplpush",brpoplpushCommand,4,"wms",0,NULL,1,2,1,0,0},
-    {"blpop",blpopCommand,-3,"ws",0,NULL,1,-2,1,0,0},
-    {"llen",llenCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"lindex",lindexCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"lset",lsetCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"lrange",lrangeCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"ltrim",ltrimCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"lrem",lremCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"rpoplpush",rpoplpushCommand,3,"wm",0,NULL,1,2,1,0,0},
-    {"sadd",saddCommand,-3,"wmF",0,NULL,1,1,1,0,0},
-    {"srem",sremCommand,-3,"wF",0,NULL,1,1,1,0,0},
-    {"smove",smoveCommand,4,"wF",0,NULL,1,2,1,0,0},
-    {"sismember",sismemberCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"scard",scardCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"spop",spopCommand,-2,"wRF",0,NULL,1,1,1,0,0},
-    {"srandmember",srandmemberCommand,-2,"rR",0,NULL,1,1,1,0,0},
-    {"sinter",sinterCommand,-2,"rS",0,NULL,1,-1,1,0,0},
-    {"sinterstore",sinterstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
-    {"sunion",sunionCommand,-2,"rS",0,NULL,1,-1,1,0,0},
-    {"sunionstore",sunionstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
-    {"sdiff",sdiffCommand,-2,"rS",0,NULL,1,-1,1,0,0},
-    {"sdiffstore",sdiffstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
-    {"smembers",sinterCommand,2,"rS",0,NULL,1,1,1,0,0},
-    {"sscan",sscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-    {"zadd",zaddCommand,-4,"wmF",0,NULL,1,1,1,0,0},
-    {"zincrby",zincrbyCommand,4,"wmF",0,NULL,1,1,1,0,0},
-    {"zrem",zremCommand,-3,"wF",0,NULL,1,1,1,0,0},
-    {"zremrangebyscore",zremrangebyscoreCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"zremrangebyrank",zremrangebyrankCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"zremrangebylex",zremrangebylexCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"zunionstore",zunionstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
-    {"zinterstore",zinterstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
-    {"zrange",zrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrangebyscore",zrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrangebylex",zrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrevrangebylex",zrevrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zcount",zcountCommand,4,"rF",0,NULL,1,1,1,0,0},
-    {"zlexcount",zlexcountCommand,4,"rF",0,NULL,1,1,1,0,0},
-    {"zrevrange",zrevrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zcard",zcardCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"zscore",zscoreCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"zrank",zrankCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"zrevrank",zrevrankCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"zscan",zscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-    {"hset",hsetCommand,4,"wmF",0,NULL,1,1,1,0,0},
-    {"hsetnx",hsetnxCommand,4,"wmF",0,NULL,1,1,1,0,0},
-    {"hget",hgetCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"hmset",hmsetCommand,-4,"wm",0,NULL,1,1,1,0,0},
-    {"hmget",hmgetCommand,-3,"r",0,NULL,1,1,1,0,0},
-    {"hincrby",hincrbyCommand,4,"wmF",0,NULL,1,1,1,0,0},
-    {"hincrbyfloat",hincrbyfloatCommand,4,"wmF",0,NULL,1,1,1,0,0},
-    {"hdel",hdelCommand,-3,"wF",0,NULL,1,1,1,0,0},
-    {"hlen",hlenCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"hstrlen",hstrlenCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"hkeys",hkeysCommand,2,"rS",0,NULL,1,1,1,0,0},
-    {"hvals",hvalsCommand,2,"rS",0,NULL,1,1,1,0,0},
-    {"hgetall",hgetallCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"hexists",hexistsCommand,3,"rF",0,NULL,1,1,1,0,0},
-    {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-    {"incrby",incrbyCommand,3,"wmF",0,NULL,1,1,1,0,0},
-    {"decrby",decrbyCommand,3,"wmF",0,NULL,1,1,1,0,0},
-    {"incrbyfloat",incrbyfloatCommand,3,"wmF",0,NULL,1,1,1,0,0},
-    {"getset",getsetCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"mset",msetCommand,-3,"wm",0,NULL,1,-1,2,0,0},
-    {"msetnx",msetnxCommand,-3,"wm",0,NULL,1,-1,2,0,0},
-    {"randomkey",randomkeyCommand,1,"rR",0,NULL,0,0,0,0,0},
-    {"select",selectCommand,2,"lF",0,NULL,0,0,0,0,0},
-    {"move",moveCommand,3,"wF",0,NULL,1,1,1,0,0},
-    {"rename",renameCommand,3,"w",0,NULL,1,2,1,0,0},
-    {"renamenx",renamenxCommand,3,"wF",0,NULL,1,2,1,0,0},
-    {"expire",expireCommand,3,"wF",0,NULL,1,1,1,0,0},
-    {"expireat",expireatCommand,3,"wF",0,NULL,1,1,1,0,0},
-    {"pexpire",pexpireCommand,3,"wF",0,NULL,1,1,1,0,0},
-    {"pexpireat",pexpireatCommand,3,"wF",0,NULL,1,1,1,0,0},
-    {"keys",keysCommand,2,"rS",0,NULL,0,0,0,0,0},
-    {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0},
-    {"dbsize",dbsizeCommand,1,"rF",0,NULL,0,0,0,0,0},
-    {"auth",authCommand,2,"sltF",0,NULL,0,0,0,0,0},
-    {"ping",pingCommand,-1,"tF",0,NULL,0,0,0,0,0},
-    {"echo",echoCommand,2,"F",0,NULL,0,0,0,0,0},
-    {"save",saveCommand,1,"as",0,NULL,0,0,0,0,0},
-    {"bgsave",bgsaveCommand,-1,"a",0,NULL,0,0,0,0,0},
-    {"bgrewriteaof",bgrewriteaofCommand,1,"a",0,NULL,0,0,0,0,0},
-    {"shutdown",shutdownCommand,-1,"alt",0,NULL,0,0,0,0,0},
-    {"lastsave",lastsaveCommand,1,"RF",0,NULL,0,0,0,0,0},
-    {"type",typeCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"multi",multiCommand,1,"sF",0,NULL,0,0,0,0,0},
-    {"exec",execCommand,1,"sM",0,NULL,0,0,0,0,0},
-    {"discard",discardCommand,1,"sF",0,NULL,0,0,0,0,0},
-    {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
-    {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
-    {"replconf",replconfCommand,-1,"aslt",0,NULL,0,0,0,0,0},
-    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0},
-    {"info",infoCommand,-1,"lt",0,NULL,0,0,0,0,0},
-    {"monitor",monitorCommand,1,"as",0,NULL,0,0,0,0,0},
-    {"ttl",ttlCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"touch",touchCommand,-2,"rF",0,NULL,1,1,1,0,0},
-    {"pttl",pttlCommand,2,"rF",0,NULL,1,1,1,0,0},
-    {"persist",persistCommand,2,"wF",0,NULL,1,1,1,0,0},
-    {"slaveof",slaveofCommand,3,"ast",0,NULL,0,0,0,0,0},
-    {"role",roleCommand,1,"lst",0,NULL,0,0,0,0,0},
-    {"debug",debugCommand,-1,"as",0,NULL,0,0,0,0,0},
-    {"config",configCommand,-2,"lat",0,NULL,0,0,0,0,0},
-    {"subscribe",subscribeCommand,-2,"pslt",0,NULL,0,0,0,0,0},
-    {"unsubscribe",unsubscribeCommand,-1,"pslt",0,NULL,0,0,0,0,0},
-    {"psubscribe",psubscribeCommand,-2,"pslt",0,NULL,0,0,0,0,0},
-    {"punsubscribe",punsubscribeCommand,-1,"pslt",0,NULL,0,0,0,0,0},
-    {"publish",publishCommand,3,"pltF",0,NULL,0,0,0,0,0},
-    {"pubsub",pubsubCommand,-2,"pltR",0,NULL,0,0,0,0,0},
-    {"watch",watchCommand,-2,"sF",0,NULL,1,-1,1,0,0},
-    {"unwatch",unwatchCommand,1,"sF",0,NULL,0,0,0,0,0},
-    {"cluster",clusterCommand,-2,"a",0,NULL,0,0,0,0,0},
-    {"restore",restoreCommand,-4,"wm",0,NULL,1,1,1,0,0},
-    {"restore-asking",restoreCommand,-4,"wmk",0,NULL,1,1,1,0,0},
-    {"migrate",migrateCommand,-6,"w",0,migrateGetKeys,0,0,0,0,0},
-    {"asking",askingCommand,1,"F",0,NULL,0,0,0,0,0},
-    {"readonly",readonlyCommand,1,"F",0,NULL,0,0,0,0,0},
-    {"readwrite",readwriteCommand,1,"F",0,NULL,0,0,0,0,0},
-    {"dump",dumpCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"object",objectCommand,3,"r",0,NULL,2,2,2,0,0},
-    {"client",clientCommand,-2,"as",0,NULL,0,0,0,0,0},
-    {"eval",evalCommand,-3,"s",0,evalGetKeys,0,0,0,0,0},
-    {"evalsha",evalShaCommand,-3,"s",0,evalGetKeys,0,0,0,0,0},
-    {"slowlog",slowlogCommand,-2,"a",0,NULL,0,0,0,0,0},
-    {"script",scriptCommand,-2,"s",0,NULL,0,0,0,0,0},
-    {"time",timeCommand,1,"RF",0,NULL,0,0,0,0,0},
-    {"bitop",bitopCommand,-4,"wm",0,NULL,2,-1,1,0,0},
-    {"bitcount",bitcountCommand,-2,"r",0,NULL,1,1,1,0,0},
-    {"bitpos",bitposCommand,-3,"r",0,NULL,1,1,1,0,0},
-    {"wait",waitCommand,3,"s",0,NULL,0,0,0,0,0},
-    {"command",commandCommand,0,"lt",0,NULL,0,0,0,0,0},
-    {"geoadd",geoaddCommand,-5,"wm",0,NULL,1,1,1,0,0},
-    {"georadius",georadiusCommand,-6,"w",0,georadiusGetKeys,1,1,1,0,0},
-    {"georadius_ro",georadiusroCommand,-6,"r",0,georadiusGetKeys,1,1,1,0,0},
-    {"georadiusbymember",georadiusbymemberCommand,-5,"w",0,georadiusGetKeys,1,1,1,0,0},
-    {"georadiusbymember_ro",georadiusbymemberroCommand,-5,"r",0,georadiusGetKeys,1,1,1,0,0},
-    {"geohash",geohashCommand,-2,"r",0,NULL,1,1,1,0,0},
-    {"geopos",geoposCommand,-2,"r",0,NULL,1,1,1,0,0},
-    {"geodist",geodistCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"pfselftest",pfselftestCommand,1,"a",0,NULL,0,0,0,0,0},
-    {"pfadd",pfaddCommand,-2,"wmF",0,NULL,1,1,1,0,0},
-    {"pfcount",pfcountCommand,-2,"r",0,NULL,1,-1,1,0,0},
-    {"pfmerge",pfmergeCommand,-2,"wm",0,NULL,1,-1,1,0,0},
-    {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0},
-    {"post",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0},
-    {"host:",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0},
-    {"latency",latencyCommand,-2,"aslt",0,NULL,0,0,0,0,0}
+    {"get",getCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"set",setCommand,-3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"setnx",setnxCommand,3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"setex",setexCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"psetex",psetexCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"strlen",strlenCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0,NULL},
+    {"unlink",unlinkCommand,-2,"wF",0,NULL,1,-1,1,0,0,NULL},
+    {"exists",existsCommand,-2,"rF",0,NULL,1,-1,1,0,0,NULL},
+    {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"getbit",getbitCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"bitfield",bitfieldCommand,-2,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"setrange",setrangeCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"getrange",getrangeCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"substr",getrangeCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"incr",incrCommand,2,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"decr",decrCommand,2,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"mget",mgetCommand,-2,"r",0,NULL,1,-1,1,0,0,NULL},
+    {"rpush",rpushCommand,-3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"lpush",lpushCommand,-3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"rpushx",rpushxCommand,3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"lpushx",lpushxCommand,3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"linsert",linsertCommand,5,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"rpop",rpopCommand,2,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"lpop",lpopCommand,2,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"brpop",brpopCommand,-3,"ws",0,NULL,1,-2,1,0,0,NULL},
+    {"brpoplpush",brpoplpushCommand,4,"wms",0,NULL,1,2,1,0,0,NULL},
+    {"blpop",blpopCommand,-3,"ws",0,NULL,1,-2,1,0,0,NULL},
+    {"llen",llenCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"lindex",lindexCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"lset",lsetCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"lrange",lrangeCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"ltrim",ltrimCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"lrem",lremCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"rpoplpush",rpoplpushCommand,3,"wm",0,NULL,1,2,1,0,0,NULL},
+    {"sadd",saddCommand,-3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"srem",sremCommand,-3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"smove",smoveCommand,4,"wF",0,NULL,1,2,1,0,0,NULL},
+    {"sismember",sismemberCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"scard",scardCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"spop",spopCommand,-2,"wRF",0,NULL,1,1,1,0,0,NULL},
+    {"srandmember",srandmemberCommand,-2,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"sinter",sinterCommand,-2,"rS",0,NULL,1,-1,1,0,0,NULL},
+    {"sinterstore",sinterstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"sunion",sunionCommand,-2,"rS",0,NULL,1,-1,1,0,0,NULL},
+    {"sunionstore",sunionstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"sdiff",sdiffCommand,-2,"rS",0,NULL,1,-1,1,0,0,NULL},
+    {"sdiffstore",sdiffstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"smembers",sinterCommand,2,"rS",0,NULL,1,1,1,0,0,NULL},
+    {"sscan",sscanCommand,-3,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"zadd",zaddCommand,-4,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"zincrby",zincrbyCommand,4,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"zrem",zremCommand,-3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"zremrangebyscore",zremrangebyscoreCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zremrangebyrank",zremrangebyrankCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zremrangebylex",zremrangebylexCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zunionstore",zunionstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0,NULL},
+    {"zinterstore",zinterstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0,NULL},
+    {"zrange",zrangeCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrangebyscore",zrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrangebylex",zrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrangebylex",zrevrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zcount",zcountCommand,4,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"zlexcount",zlexcountCommand,4,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrange",zrevrangeCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zcard",zcardCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"zscore",zscoreCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"zrank",zrankCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrank",zrevrankCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"zscan",zscanCommand,-3,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"hset",hsetCommand,4,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"hsetnx",hsetnxCommand,4,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"hget",hgetCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"hmset",hmsetCommand,-4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"hmget",hmgetCommand,-3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hincrby",hincrbyCommand,4,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"hincrbyfloat",hincrbyfloatCommand,4,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"hdel",hdelCommand,-3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"hlen",hlenCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"hstrlen",hstrlenCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"hkeys",hkeysCommand,2,"rS",0,NULL,1,1,1,0,0,NULL},
+    {"hvals",hvalsCommand,2,"rS",0,NULL,1,1,1,0,0,NULL},
+    {"hgetall",hgetallCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hexists",hexistsCommand,3,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"incrby",incrbyCommand,3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"decrby",decrbyCommand,3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"incrbyfloat",incrbyfloatCommand,3,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"getset",getsetCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"mset",msetCommand,-3,"wm",0,NULL,1,-1,2,0,0,NULL},
+    {"msetnx",msetnxCommand,-3,"wm",0,NULL,1,-1,2,0,0,NULL},
+    {"randomkey",randomkeyCommand,1,"rR",0,NULL,0,0,0,0,0,NULL},
+    {"select",selectCommand,2,"lF",0,NULL,0,0,0,0,0,NULL},
+    {"move",moveCommand,3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"rename",renameCommand,3,"w",0,NULL,1,2,1,0,0,NULL},
+    {"renamenx",renamenxCommand,3,"wF",0,NULL,1,2,1,0,0,NULL},
+    {"expire",expireCommand,3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"expireat",expireatCommand,3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"pexpire",pexpireCommand,3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"pexpireat",pexpireatCommand,3,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"keys",keysCommand,2,"rS",0,NULL,0,0,0,0,0,NULL},
+    {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0,NULL},
+    {"dbsize",dbsizeCommand,1,"rF",0,NULL,0,0,0,0,0,NULL},
+    {"auth",authCommand,2,"sltF",0,NULL,0,0,0,0,0,NULL},
+    {"ping",pingCommand,-1,"tF",0,NULL,0,0,0,0,0,NULL},
+    {"echo",echoCommand,2,"F",0,NULL,0,0,0,0,0,NULL},
+    {"save",saveCommand,1,"as",0,NULL,0,0,0,0,0,NULL},
+    {"bgsave",bgsaveCommand,-1,"a",0,NULL,0,0,0,0,0,NULL},
+    {"bgrewriteaof",bgrewriteaofCommand,1,"a",0,NULL,0,0,0,0,0,NULL},
+    {"shutdown",shutdownCommand,-1,"alt",0,NULL,0,0,0,0,0,NULL},
+    {"lastsave",lastsaveCommand,1,"RF",0,NULL,0,0,0,0,0,NULL},
+    {"type",typeCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"multi",multiCommand,1,"sF",0,NULL,0,0,0,0,0,NULL},
+    {"exec",execCommand,1,"sM",0,NULL,0,0,0,0,0,NULL},
+    {"discard",discardCommand,1,"sF",0,NULL,0,0,0,0,0,NULL},
+    {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0,NULL},
+    {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0,NULL},
+    {"replconf",replconfCommand,-1,"aslt",0,NULL,0,0,0,0,0,NULL},
+    {"flushdb",flushdbCommand,-1,"w",0,NULL,0,0,0,0,0,NULL},
+    {"flushall",flushallCommand,-1,"w",0,NULL,0,0,0,0,0,NULL},
+    {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0,NULL},
+    {"info",infoCommand,-1,"lt",0,NULL,0,0,0,0,0,NULL},
+    {"monitor",monitorCommand,1,"as",0,NULL,0,0,0,0,0,NULL},
+    {"ttl",ttlCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"touch",touchCommand,-2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"pttl",pttlCommand,2,"rF",0,NULL,1,1,1,0,0,NULL},
+    {"persist",persistCommand,2,"wF",0,NULL,1,1,1,0,0,NULL},
+    {"slaveof",slaveofCommand,3,"ast",0,NULL,0,0,0,0,0,NULL},
+    {"role",roleCommand,1,"lst",0,NULL,0,0,0,0,0,NULL},
+    {"debug",debugCommand,-1,"as",0,NULL,0,0,0,0,0,NULL},
+    {"config",configCommand,-2,"lat",0,NULL,0,0,0,0,0,NULL},
+    {"subscribe",subscribeCommand,-2,"pslt",0,NULL,0,0,0,0,0,NULL},
+    {"unsubscribe",unsubscribeCommand,-1,"pslt",0,NULL,0,0,0,0,0,NULL},
+    {"psubscribe",psubscribeCommand,-2,"pslt",0,NULL,0,0,0,0,0,NULL},
+    {"punsubscribe",punsubscribeCommand,-1,"pslt",0,NULL,0,0,0,0,0,NULL},
+    {"publish",publishCommand,3,"pltF",0,NULL,0,0,0,0,0,NULL},
+    {"pubsub",pubsubCommand,-2,"pltR",0,NULL,0,0,0,0,0,NULL},
+    {"watch",watchCommand,-2,"sF",0,NULL,1,-1,1,0,0,NULL},
+    {"unwatch",unwatchCommand,1,"sF",0,NULL,0,0,0,0,0,NULL},
+    {"cluster",clusterCommand,-2,"a",0,NULL,0,0,0,0,0,NULL},
+    {"restore",restoreCommand,-4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"restore-asking",restoreCommand,-4,"wmk",0,NULL,1,1,1,0,0,NULL},
+    {"migrate",migrateCommand,-6,"w",0,migrateGetKeys,0,0,0,0,0,NULL},
+    {"asking",askingCommand,1,"F",0,NULL,0,0,0,0,0,NULL},
+    {"readonly",readonlyCommand,1,"F",0,NULL,0,0,0,0,0,NULL},
+    {"readwrite",readwriteCommand,1,"F",0,NULL,0,0,0,0,0,NULL},
+    {"dump",dumpCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"object",objectCommand,3,"r",0,NULL,2,2,2,0,0,NULL},
+    {"client",clientCommand,-2,"as",0,NULL,0,0,0,0,0,NULL},
+    {"eval",evalCommand,-3,"s",0,evalGetKeys,0,0,0,0,0,NULL},
+    {"evalsha",evalShaCommand,-3,"s",0,evalGetKeys,0,0,0,0,0,NULL},
+    {"slowlog",slowlogCommand,-2,"a",0,NULL,0,0,0,0,0,NULL},
+    {"script",scriptCommand,-2,"s",0,NULL,0,0,0,0,0,NULL},
+    {"time",timeCommand,1,"RF",0,NULL,0,0,0,0,0,NULL},
+    {"bitop",bitopCommand,-4,"wm",0,NULL,2,-1,1,0,0,NULL},
+    {"bitcount",bitcountCommand,-2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"bitpos",bitposCommand,-3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"wait",waitCommand,3,"s",0,NULL,0,0,0,0,0,NULL},
+    {"command",commandCommand,0,"lt",0,NULL,0,0,0,0,0,NULL},
+    {"geoadd",geoaddCommand,-5,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"georadius",georadiusCommand,-6,"w",0,georadiusGetKeys,1,1,1,0,0,NULL},
+    {"georadius_ro",georadiusroCommand,-6,"r",0,georadiusGetKeys,1,1,1,0,0,NULL},
+    {"georadiusbymember",georadiusbymemberCommand,-5,"w",0,georadiusGetKeys,1,1,1,0,0,NULL},
+    {"georadiusbymember_ro",georadiusbymemberroCommand,-5,"r",0,georadiusGetKeys,1,1,1,0,0,NULL},
+    {"geohash",geohashCommand,-2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"geopos",geoposCommand,-2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"geodist",geodistCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"pfselftest",pfselftestCommand,1,"a",0,NULL,0,0,0,0,0,NULL},
+    {"pfadd",pfaddCommand,-2,"wmF",0,NULL,1,1,1,0,0,NULL},
+    {"pfcount",pfcountCommand,-2,"r",0,NULL,1,-1,1,0,0,NULL},
+    {"pfmerge",pfmergeCommand,-2,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0,NULL},
+    {"post",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0,NULL},
+    {"host:",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0,NULL},
+    {"latency",latencyCommand,-2,"aslt",0,NULL,0,0,0,0,0,NULL}
 };
 
 struct evictionPoolEntry *evictionPoolAlloc(void);
@@ -596,7 +598,7 @@ dictType commandTableDictType = {
     NULL                       /* val destructor */
 };
 
-/* Hash type hash table (note that small hashes are represented with ziplists) */
+/* Hash type hash table (note that small hashes are represented with listpacks) */
 dictType hashDictType = {
     dictEncObjHash,             /* hash function */
     NULL,                       /* key dup */
@@ -677,7 +679,7 @@ int htNeedsResize(dict *dict) {
 void tryResizeHashTables(int dbid) {
     if (htNeedsResize(server.db[dbid].dict))
         dictResize(server.db[dbid].dict);
-    if (htNeedsResize(server.db[dbid].expires))
+    if (server.db[dbid].expires && htNeedsResize(server.db[dbid].expires))
         dictResize(server.db[dbid].expires);
 }
 
@@ -695,7 +697,7 @@ int incrementallyRehash(int dbid) {
         return 1; /* already used our millisecond for this loop... */
     }
     /* Expires */
-    if (dictIsRehashing(server.db[dbid].expires)) {
+    if (server.db[dbid].expires && dictIsRehashing(server.db[dbid].expires)) {
         dictRehashMilliseconds(server.db[dbid].expires,1);
         return 1; /* already used our millisecond for this loop... */
     }
@@ -718,8 +720,8 @@ void updateDictResizePolicy(void) {
 /* ======================= Cron: called every 100 ms ======================== */
 
 /* Helper function for the activeExpireCycle() function.
- * This function will try to expire the key that is stored in the hash table
- * entry 'de' of the 'expires' hash table of a Redis database.
+ * This function will try to expire the volatile key 'key' of a Redis
+ * database, whose expire time is 'when'.
  *
  * If the key is found to be expired, it is removed from the database and
  * 1 is returned. Otherwise no operation is performed and 0 is returned.
@@ -728,14 +730,15 @@ void updateDictResizePolicy(void) {
  *
  * The parameter 'now' is the current time in milliseconds as is passed
  * to the function to avoid too many gettimeofday() syscalls. */
-int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
-    long long t = dictGetSignedIntegerVal(de);
-    if (now > t) {
-        sds key = dictGetKey(de);
+int activeExpireCycleTryExpire(redisDb *db, sds key, long long when, long long now) {
+    if (now > when) {
         robj *keyobj = createStringObject(key,sdslen(key));
 
         propagateExpire(db,keyobj);
-        dbDelete(db,keyobj);
+        if (server.lazyfree_lazy_expire)
+            dbAsyncDelete(db,keyobj);
+        else
+            dbSyncDelete(db,keyobj);
         notifyKeyspaceEvent(NOTIFY_EXPIRED,
             "expired",keyobj,db->id);
         decrRefCount(keyobj);
@@ -749,7 +752,9 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
- * keys that can be removed from the keyspace.
+ * keys that can be removed from the keyspace. With active-expire-index
+ * enabled the keys are not sampled: the ones with an elapsed deadline are
+ * reclaimed in deadline order, within the same time limits.
  *
  * No more than CRON_DBS_PER_CALL databases are tested at every
  * iteration.
@@ -791,6 +796,8 @@ void activeExpireCycle(int type) {
         if (!timelimit_exit) return;
         if (start < last_fast_cycle + ACTIVE_EXPIRE_CYCLE_FAST_DURATION*2) return;
         last_fast_cycle = start;
+    } else {
+        server.stat_expire_cycle_lag = 0;
     }
 
     /* We usually should test CRON_DBS_PER_CALL per iteration, with
@@ -831,39 +838,74 @@ void activeExpireCycle(int type) {
             int ttl_samples;
 
             /* If there is nothing to expire try next DB ASAP. */
-            if ((num = dictSize(db->expires)) == 0) {
+            if ((num = dbExpiresCount(db)) == 0) {
                 db->avg_ttl = 0;
                 break;
             }
-            slots = dictSlots(db->expires);
             now = mstime();
 
-            /* When there are less than 1% filled slots getting random
-             * keys is expensive, so stop here waiting for better times...
-             * The dictionary will be resized asap. */
-            if (num && slots > DICT_HT_INITIAL_SIZE &&
-                (num*100/slots < 1)) break;
-
-            /* The main collection cycle. Sample random keys among keys
-             * with an expire set, checking for expired ones. */
             expired = 0;
             ttl_sum = 0;
             ttl_samples = 0;
 
-            if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)
-                num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+            if (db->expiry_index) {
+                expireIdxNode *first;
+                sds key;
+                long long when;
+
+                /* With the expiry index there is no need to sample: the
+                 * keys are reclaimed in deadline order, in batches of
+                 * ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP keys, stopping as
+                 * soon as the nearest deadline is in the future. */
+                while (expired < ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP &&
+                       (first = expireIdxFirst(db->expiry_index)) != NULL &&
+                       first->when < now)
+                {
+                    activeExpireCycleTryExpire(db,first->key,first->when,now);
+                    expired++;
+                }
 
-            while (num--) {
-                dictEntry *de;
-                long long ttl;
+                /* A single random key is enough to keep the average TTL
+                 * stats updated. */
+                if ((key = dbRandomVolatileKey(db,&when)) != NULL &&
+                    when > now)
+                {
+                    ttl_sum = when-now;
+                    ttl_samples = 1;
+                }
+            } else {
+                /* When there are less than 1% filled slots getting random
+                 * keys is expensive, so stop here waiting for better
+                 * times... The dictionary will be resized asap. With
+                 * embedded expires the volatile keys are sampled from the
+                 * main dictionary, see dbRandomVolatileKey(). */
+                if (db->expires) {
+                    slots = dictSlots(db->expires);
+                    if (num && slots > DICT_HT_INITIAL_SIZE &&
+                        (num*100/slots < 1)) break;
+                }
 
-                if ((de = dictGetRandomKey(db->expires)) == NULL) break;
-                ttl = dictGetSignedIntegerVal(de)-now;
-                if (activeExpireCycleTryExpire(db,de,now)) expired++;
-                if (ttl > 0) {
-                    /* We want the average TTL of keys yet not expired. */
-                    ttl_sum += ttl;
-                    ttl_samples++;
+                /* The main collection cycle. Sample random keys among keys
+                 * with an expire set, checking for expired ones. */
+                if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)
+                    num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+
+                while (num--) {
+                    sds key;
+                    long long when, ttl;
+
+                    if ((key = dbRandomVolatileKey(db,&when)) == NULL) break;
+                    ttl = when-now;
+                    if (activeExpireCycleTryExpire(db,key,when,now)) {
+                        expired++;
+                        if (-ttl > server.stat_expire_cycle_lag)
+                            server.stat_expire_cycle_lag = -ttl;
+                    }
+                    if (ttl > 0) {
+                        /* We want the average TTL of keys yet not expired. */
+                        ttl_sum += ttl;
+                        ttl_samples++;
+                    }
                 }
             }
 
@@ -890,8 +932,11 @@ void activeExpireCycle(int type) {
             }
             if (timelimit_exit) return;
             /* We don't repeat the cycle if there are less than 25% of keys
-             * found expired in the current DB. */
-        } while (expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4);
+             * found expired in the current DB, or, with the expiry index,
+             * if there are no more keys with an elapsed deadline. */
+        } while (db->expiry_index ?
+                 expired == ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP :
+                 expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4);
     }
 }
 
@@ -988,6 +1033,16 @@ int clientsCronResizeQueryBuffer(client *c) {
     return 0;
 }
 
+/* Idle clients don't need the argument objects cached by freeClientArgv():
+ * release them.
+ *
+ * The function always returns 0 as it never terminates the client. */
+int clientsCronTrimArgvPool(client *c) {
+    if (c->argv_pool_len && server.unixtime - c->lastinteraction > 2)
+        freeClientArgvPool(c);
+    return 0;
+}
+
 #define CLIENTS_CRON_MIN_ITERATIONS 5
 void clientsCron(void) {
     /* Make sure to process at least numclients/server.hz of clients
@@ -1020,6 +1075,7 @@ void clientsCron(void) {
          * terminated. */
         if (clientsCronHandleTimeout(c,now)) continue;
         if (clientsCronResizeQueryBuffer(c)) continue;
+        if (clientsCronTrimArgvPool(c)) continue;
     }
 }
 
@@ -1155,7 +1211,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 
             size = dictSlots(server.db[j].dict);
             used = dictSize(server.db[j].dict);
-            vkeys = dictSize(server.db[j].expires);
+            vkeys = dbExpiresCount(server.db+j);
             if (used || vkeys) {
                 serverLog(LL_VERBOSE,"DB %d: %lld keys (%lld volatile) in %lld slots HT.",j,used,vkeys,size);
                 /* dictPrintStats(server.dict); */
@@ -1324,6 +1380,10 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 void beforeSleep(struct aeEventLoop *eventLoop) {
     UNUSED(eventLoop);
 
+    /* Handle the clients we postponed in order to read and parse their
+     * queries using the I/O threads. */
+    handleClientsWithPendingReadsUsingThreads();
+
     /* Call the Redis Cluster before sleep function. Note that this function
      * may change the state of Redis Cluster (from ok to fail or vice versa),
      * so it's a good idea to call it before serving the unblocked clients
@@ -1362,8 +1422,16 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     /* Write the AOF buffer on disk */
     flushAppendOnlyFile(0);
 
+    /* Release the objects the lazy free thread could not free by itself
+     * because they were still referenced elsewhere. */
+    lazyfreeReleaseDeferredObjects();
+
     /* Handle writes with pending output buffers. */
-    handleClientsWithPendingWrites();
+    handleClientsWithPendingWritesUsingThreads();
+
+    /* Close clients that need to be closed asynchronous, for instance
+     * clients the I/O threads found in an error state. */
+    if (server.io_threads_num > 1) freeClientsInAsyncFreeQueue();
 }
 
 /* =========================== Server initialization ======================== */
@@ -1441,7 +1509,8 @@ void createSharedObjects(void) {
     shared.lpop = createStringObject("LPOP",4);
     shared.lpush = createStringObject("LPUSH",5);
     for (j = 0; j < OBJ_SHARED_INTEGERS; j++) {
-        shared.integers[j] = createObject(OBJ_STRING,(void*)(long)j);
+        shared.integers[j] =
+            makeObjectShared(createObject(OBJ_STRING,(void*)(long)j));
         shared.integers[j]->encoding = OBJ_ENCODING_INT;
     }
     for (j = 0; j < OBJ_SHARED_BULKHDR_LEN; j++) {
@@ -1466,6 +1535,8 @@ void initServerConfig(void) {
     server.executable = NULL;
     server.hz = CONFIG_DEFAULT_HZ;
     server.runid[CONFIG_RUN_ID_SIZE] = '\0';
+    changeReplicationId();
+    clearReplicationId2();
     server.arch_bits = (sizeof(long) == 8) ? 64 : 32;
     server.port = CONFIG_DEFAULT_SERVER_PORT;
     server.tcp_backlog = CONFIG_DEFAULT_TCP_BACKLOG;
@@ -1480,6 +1551,8 @@ void initServerConfig(void) {
     server.maxidletime = CONFIG_DEFAULT_CLIENT_TIMEOUT;
     server.tcpkeepalive = CONFIG_DEFAULT_TCP_KEEPALIVE;
     server.active_expire_enabled = 1;
+    server.io_threads_num = CONFIG_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = CONFIG_DEFAULT_IO_THREADS_DO_READS;
     server.client_max_querybuf_len = PROTO_MAX_QUERYBUF_LEN;
     server.saveparams = NULL;
     server.loading = 0;
@@ -1507,20 +1580,32 @@ void initServerConfig(void) {
     server.aof_flush_postponed_start = 0;
     server.aof_rewrite_incremental_fsync = CONFIG_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC;
     server.aof_load_truncated = CONFIG_DEFAULT_AOF_LOAD_TRUNCATED;
+    server.aof_use_rdb_preamble = CONFIG_DEFAULT_AOF_USE_RDB_PREAMBLE;
     server.pidfile = NULL;
     server.rdb_filename = zstrdup(CONFIG_DEFAULT_RDB_FILENAME);
     server.aof_filename = zstrdup(CONFIG_DEFAULT_AOF_FILENAME);
     server.requirepass = NULL;
     server.rdb_compression = CONFIG_DEFAULT_RDB_COMPRESSION;
     server.rdb_checksum = CONFIG_DEFAULT_RDB_CHECKSUM;
+    server.rdb_compression_codec = CONFIG_DEFAULT_RDB_COMPRESSION_CODEC;
+    server.rdb_load_threads = CONFIG_DEFAULT_RDB_LOAD_THREADS;
     server.stop_writes_on_bgsave_err = CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = CONFIG_DEFAULT_ACTIVE_REHASHING;
+    server.keyspace_grouped_buckets = CONFIG_DEFAULT_KEYSPACE_GROUPED_BUCKETS;
+    server.keyspace_embedded_expires = CONFIG_DEFAULT_KEYSPACE_EMBEDDED_EXPIRES;
+    server.active_expire_index = CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX;
     server.notify_keyspace_events = 0;
     server.maxclients = CONFIG_DEFAULT_MAX_CLIENTS;
     server.bpop_blocked_clients = 0;
     server.maxmemory = CONFIG_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = CONFIG_DEFAULT_MAXMEMORY_POLICY;
     server.maxmemory_samples = CONFIG_DEFAULT_MAXMEMORY_SAMPLES;
+    server.lfu_log_factor = CONFIG_DEFAULT_LFU_LOG_FACTOR;
+    server.lfu_decay_time = CONFIG_DEFAULT_LFU_DECAY_TIME;
+    server.lazyfree_lazy_eviction = CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION;
+    server.lazyfree_lazy_expire = CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE;
+    server.lazyfree_lazy_server_del = CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
+    server.repl_slave_lazy_flush = CONFIG_DEFAULT_SLAVE_LAZY_FLUSH;
     server.hash_max_ziplist_entries = OBJ_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
@@ -1566,6 +1651,7 @@ void initServerConfig(void) {
     server.repl_disable_tcp_nodelay = CONFIG_DEFAULT_REPL_DISABLE_TCP_NODELAY;
     server.repl_diskless_sync = CONFIG_DEFAULT_REPL_DISKLESS_SYNC;
     server.repl_diskless_sync_delay = CONFIG_DEFAULT_REPL_DISKLESS_SYNC_DELAY;
+    server.repl_diskless_load = CONFIG_DEFAULT_REPL_DISKLESS_LOAD;
     server.slave_priority = CONFIG_DEFAULT_SLAVE_PRIORITY;
     server.slave_announce_ip = CONFIG_DEFAULT_SLAVE_ANNOUNCE_IP;
     server.slave_announce_port = CONFIG_DEFAULT_SLAVE_ANNOUNCE_PORT;
@@ -1612,6 +1698,7 @@ void initServerConfig(void) {
 
     /* Latency monitor */
     server.latency_monitor_threshold = CONFIG_DEFAULT_LATENCY_MONITOR_THRESHOLD;
+    server.latency_tracking = CONFIG_DEFAULT_LATENCY_TRACKING;
 
     /* Debugging */
     server.assert_failed = "<no assertion failed>";
@@ -1851,6 +1938,7 @@ void resetServerStats(void) {
     server.stat_numcommands = 0;
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
+    server.stat_expire_cycle_lag = 0;
     server.stat_evictedkeys = 0;
     server.stat_keyspace_misses = 0;
     server.stat_keyspace_hits = 0;
@@ -1869,6 +1957,9 @@ void resetServerStats(void) {
     }
     server.stat_net_input_bytes = 0;
     server.stat_net_output_bytes = 0;
+    server.stat_io_reads_processed = 0;
+    server.stat_io_writes_processed = 0;
+    server.stat_allocations_reset = zmalloc_allocations();
     server.aof_delayed_fsync = 0;
 }
 
@@ -1891,6 +1982,7 @@ void initServer(void) {
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.clients_pending_write = listCreate();
+    server.clients_pending_read = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
     server.unblocked_clients = listCreate();
     server.ready_keys = listCreate();
@@ -1929,8 +2021,7 @@ void initServer(void) {
 
     /* Create the Redis databases, and initialize other internal state. */
     for (j = 0; j < server.dbnum; j++) {
-        server.db[j].dict = dictCreate(&dbDictType,NULL);
-        server.db[j].expires = dictCreate(&keyptrDictType,NULL);
+        dbCreateDicts(&server.db[j]);
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&setDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
@@ -1942,6 +2033,7 @@ void initServer(void) {
     server.pubsub_patterns = listCreate();
     listSetFreeMethod(server.pubsub_patterns,freePubsubPattern);
     listSetMatchMethod(server.pubsub_patterns,listMatchPubsubPattern);
+    server.pubsub_patterns_index = pubsubCreatePatternIndex();
     server.cronloops = 0;
     server.rdb_child_pid = -1;
     server.aof_child_pid = -1;
@@ -2012,6 +2104,7 @@ void initServer(void) {
     slowlogInit();
     latencyMonitorInit();
     bioInit();
+    initThreadedIO();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -2062,6 +2155,8 @@ void resetCommandTableStats(void) {
 
         c->microseconds = 0;
         c->calls = 0;
+        zfree(c->latency_histogram);
+        c->latency_histogram = NULL;
     }
 }
 
@@ -2293,6 +2388,12 @@ void call(client *c, int flags) {
     if (flags & CMD_CALL_STATS) {
         c->lastcmd->microseconds += duration;
         c->lastcmd->calls++;
+        if (server.latency_tracking) {
+            if (c->lastcmd->latency_histogram == NULL)
+                c->lastcmd->latency_histogram =
+                    zcalloc(sizeof(struct latencyHistogram));
+            latencyHistogramAdd(c->lastcmd->latency_histogram,duration);
+        }
     }
 
     /* Propagate the command into the AOF and replication link */
@@ -2852,6 +2953,24 @@ void bytesToHuman(char *s, unsigned long long n) {
     }
 }
 
+/* Return the "expired memory lag" reported by INFO: how many milliseconds
+ * ago elapsed the deadline of the oldest key that was not reclaimed yet.
+ * It is exact with the expiry index, otherwise the largest lag of the keys
+ * reclaimed by the last active expire cycle is used as an estimate. */
+static long long getExpiredMemoryLag(void) {
+    long long now, lag = 0;
+    int j;
+
+    if (!server.active_expire_index) return server.stat_expire_cycle_lag;
+    now = mstime();
+    for (j = 0; j < server.dbnum; j++) {
+        expireIdxNode *first = expireIdxFirst(server.db[j].expiry_index);
+
+        if (first && now-first->when > lag) lag = now-first->when;
+    }
+    return lag;
+}
+
 /* Create the string returned by the INFO command. This is decoupled
  * by the INFO command itself as we need to report the same information
  * on memory corruption problems. */
@@ -2992,7 +3111,8 @@ sds genRedisInfoString(char *section) {
             "maxmemory_human:%s\r\n"
             "maxmemory_policy:%s\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
-            "mem_allocator:%s\r\n",
+            "mem_allocator:%s\r\n"
+            "lazyfree_pending_objects:%zu\r\n",
             zmalloc_used,
             hmem,
             server.resident_set_size,
@@ -3007,7 +3127,8 @@ sds genRedisInfoString(char *section) {
             maxmemory_hmem,
             evict_policy,
             zmalloc_get_fragmentation_ratio(server.resident_set_size),
-            ZMALLOC_LIB
+            ZMALLOC_LIB,
+            lazyfreeGetPendingObjectsCount()
             );
     }
 
@@ -3114,13 +3235,19 @@ sds genRedisInfoString(char *section) {
             "sync_partial_ok:%lld\r\n"
             "sync_partial_err:%lld\r\n"
             "expired_keys:%lld\r\n"
+            "expired_memory_lag:%lld\r\n"
             "evicted_keys:%lld\r\n"
             "keyspace_hits:%lld\r\n"
             "keyspace_misses:%lld\r\n"
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
             "latest_fork_usec:%lld\r\n"
-            "migrate_cached_sockets:%ld\r\n",
+            "migrate_cached_sockets:%ld\r\n"
+            "io_threads_active:%d\r\n"
+            "total_reads_processed_by_io_threads:%lld\r\n"
+            "total_writes_processed_by_io_threads:%lld\r\n"
+            "total_allocations:%zu\r\n"
+            "allocations_per_command:%.2f\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
@@ -3133,13 +3260,20 @@ sds genRedisInfoString(char *section) {
             server.stat_sync_partial_ok,
             server.stat_sync_partial_err,
             server.stat_expiredkeys,
+            getExpiredMemoryLag(),
             server.stat_evictedkeys,
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
             dictSize(server.pubsub_channels),
             listLength(server.pubsub_patterns),
             server.stat_fork_time,
-            dictSize(server.migrate_cached_sockets));
+            dictSize(server.migrate_cached_sockets),
+            ioThreadsActive(),
+            server.stat_io_reads_processed,
+            server.stat_io_writes_processed,
+            zmalloc_allocations(),
+            server.stat_numcommands ? (double)(zmalloc_allocations()-
+                server.stat_allocations_reset)/server.stat_numcommands : 0);
     }
 
     /* Replication */
@@ -3252,12 +3386,18 @@ sds genRedisInfoString(char *section) {
             }
         }
         info = sdscatprintf(info,
+            "master_replid:%s\r\n"
+            "master_replid2:%s\r\n"
             "master_repl_offset:%lld\r\n"
+            "second_repl_offset:%lld\r\n"
             "repl_backlog_active:%d\r\n"
             "repl_backlog_size:%lld\r\n"
             "repl_backlog_first_byte_offset:%lld\r\n"
             "repl_backlog_histlen:%lld\r\n",
+            server.replid,
+            server.replid2,
             server.master_repl_offset,
+            server.second_replid_offset,
             server.repl_backlog != NULL,
             server.repl_backlog_size,
             server.repl_backlog_off,
@@ -3295,6 +3435,26 @@ sds genRedisInfoString(char *section) {
         }
     }
 
+    /* Latency percentiles */
+    if (allsections || !strcasecmp(section,"latencystats")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Latencystats\r\n");
+        numcommands = sizeof(redisCommandTable)/sizeof(struct redisCommand);
+        for (j = 0; j < numcommands; j++) {
+            struct redisCommand *c = redisCommandTable+j;
+            struct latencyHistogram *h = c->latency_histogram;
+
+            if (!h) continue;
+            info = sdscatprintf(info,
+                "latency_percentiles_usec_%s:p50=%llu,p99=%llu,p99.9=%llu,"
+                "max=%llu\r\n", c->name,
+                (unsigned long long) latencyHistogramPercentile(h,50),
+                (unsigned long long) latencyHistogramPercentile(h,99),
+                (unsigned long long) latencyHistogramPercentile(h,99.9),
+                (unsigned long long) h->max);
+        }
+    }
+
     /* Cluster */
     if (allsections || defsections || !strcasecmp(section,"cluster")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -3312,7 +3472,7 @@ sds genRedisInfoString(char *section) {
             long long keys, vkeys;
 
             keys = dictSize(server.db[j].dict);
-            vkeys = dictSize(server.db[j].expires);
+            vkeys = dbExpiresCount(server.db+j);
             if (keys || vkeys) {
                 info = sdscatprintf(info,
                     "db%d:keys=%lld,expires=%lld,avg_ttl=%lld\r\n",
@@ -3362,7 +3522,7 @@ void monitorCommand(client *c) {
  *
  * ------------------------------------------------------------------------
  *
- * LRU approximation algorithm
+ * LRU / LFU approximation algorithm
  *
  * Redis uses an approximation of the LRU algorithm that runs in constant
  * memory. Every time there is a key to expire, we sample N keys (with
@@ -3373,6 +3533,10 @@ void monitorCommand(client *c) {
  * with an old access time) if they are better than one of the current keys
  * in the pool.
  *
+ * The same pool is used by the LFU policies: in that case the score of
+ * a key is its logarithmic access counter (see the LFU implementation in
+ * object.c) inverted, so that less frequently used keys are evicted first.
+ *
  * After the pool is populated, the best key we have in the pool is expired.
  * However note that we don't remove keys from the pool when they are deleted
  * so the pool may contain keys that no longer exist.
@@ -3405,7 +3569,7 @@ struct evictionPoolEntry *evictionPoolAlloc(void) {
  * right. */
 
 #define EVICTION_SAMPLES_ARRAY_SIZE 16
-void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEntry *pool) {
+void evictionPoolPopulate(redisDb *db, dict *sampledict, struct evictionPoolEntry *pool) {
     int j, k, count;
     dictEntry *_samples[EVICTION_SAMPLES_ARRAY_SIZE];
     dictEntry **samples;
@@ -3418,21 +3582,47 @@ void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEn
         samples = zmalloc(sizeof(samples[0])*server.maxmemory_samples);
     }
 
-    count = dictGetSomeKeys(sampledict,samples,server.maxmemory_samples);
+    /* A NULL 'sampledict' means that the DB uses embedded expires, so the
+     * volatile keys are sampled one by one from the main dictionary. */
+    if (sampledict)
+        count = dictGetSomeKeys(sampledict,samples,server.maxmemory_samples);
+    else
+        count = server.maxmemory_samples;
     for (j = 0; j < count; j++) {
         unsigned long long idle;
         sds key;
         robj *o;
         dictEntry *de;
 
-        de = samples[j];
-        key = dictGetKey(de);
+        if (sampledict) {
+            de = samples[j];
+            key = dictGetKey(de);
+        } else {
+            key = dbRandomVolatileKey(db,NULL);
+            if (key == NULL) continue;
+            de = NULL; /* Looked up in the main dictionary below. */
+        }
         /* If the dictionary we are sampling from is not the main
          * dictionary (but the expires one) we need to lookup the key
          * again in the key dictionary to obtain the value object. */
-        if (sampledict != keydict) de = dictFind(keydict, key);
+        if (sampledict != db->dict) de = dictFind(db->dict, key);
         o = dictGetVal(de);
-        idle = estimateObjectIdleTime(o);
+
+        /* Calculate the idle time according to the policy. This is called
+         * idle just because the code initially handled LRU, but is in fact
+         * just a score where an higher score means better candidate. */
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_LRU) {
+            idle = estimateObjectIdleTime(o);
+        } else {
+            /* When we use an LRU policy, we sort the keys by idle time
+             * so that we expire keys starting from greater idle time.
+             * However when the policy is an LFU one, we have a frequency
+             * estimation, and we want to evict keys with lower frequency
+             * first. So inside the pool we put objects using the inverted
+             * frequency subtracting the actual frequency to the maximum
+             * frequency of 255. */
+            idle = 255-LFUDecrAndReturn(o);
+        }
 
         /* Insert the element inside the pool.
          * First, find the first empty bucket or the first populated
@@ -3470,20 +3660,14 @@ void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEn
     if (samples != _samples) zfree(samples);
 }
 
-int freeMemoryIfNeeded(void) {
-    size_t mem_used, mem_tofree, mem_freed;
-    int slaves = listLength(server.slaves);
-    mstime_t latency, eviction_latency;
-
-    /* When clients are paused the dataset should be static not just from the
-     * POV of clients not being able to write, but also from the POV of
-     * expires and evictions of keys not being performed. */
-    if (clientsArePaused()) return C_OK;
+/* Return the amount of used memory to compare with maxmemory: the slaves
+ * output buffers and the AOF buffers are not counted. */
+size_t freeMemoryGetUsedMemory(void) {
+    size_t mem_used = zmalloc_used_memory();
 
     /* Remove the size of slaves output buffers and AOF buffer from the
      * count of used memory. */
-    mem_used = zmalloc_used_memory();
-    if (slaves) {
+    if (listLength(server.slaves)) {
         listIter li;
         listNode *ln;
 
@@ -3501,56 +3685,79 @@ int freeMemoryIfNeeded(void) {
         mem_used -= sdslen(server.aof_buf);
         mem_used -= aofRewriteBufferSize();
     }
+    return mem_used;
+}
+
+int freeMemoryIfNeeded(void) {
+    size_t mem_reported, mem_used, mem_tofree, mem_freed;
+    int slaves = listLength(server.slaves);
+    mstime_t latency, eviction_latency;
+
+    /* When clients are paused the dataset should be static not just from the
+     * POV of clients not being able to write, but also from the POV of
+     * expires and evictions of keys not being performed. */
+    if (clientsArePaused()) return C_OK;
+
+    mem_reported = zmalloc_used_memory();
+    mem_used = freeMemoryGetUsedMemory();
 
     /* Check if we are over the memory limit. */
     if (mem_used <= server.maxmemory) return C_OK;
 
-    if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION)
-        return C_ERR; /* We need to free memory, but policy forbids. */
-
     /* Compute how much memory we need to free. */
     mem_tofree = mem_used - server.maxmemory;
     mem_freed = 0;
+
+    if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION)
+        goto cant_free; /* We need to free memory, but policy forbids. */
     latencyStartMonitor(latency);
     while (mem_freed < mem_tofree) {
         int j, k, keys_freed = 0;
 
         for (j = 0; j < server.dbnum; j++) {
-            long bestval = 0; /* just to prevent warning */
+            long long bestval = 0; /* just to prevent warning */
             sds bestkey = NULL;
             dictEntry *de;
             redisDb *db = server.db+j;
             dict *dict;
 
-            if (server.maxmemory_policy == MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM)
-            {
+            /* Note that 'dict' is NULL for the volatile policies when
+             * the DB uses embedded expires. */
+            if (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS) {
                 dict = server.db[j].dict;
+                if (dictSize(dict) == 0) continue;
             } else {
                 dict = server.db[j].expires;
+                if (dbExpiresCount(db) == 0) continue;
             }
-            if (dictSize(dict) == 0) continue;
 
-            /* volatile-random and allkeys-random policy */
-            if (server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM ||
-                server.maxmemory_policy == MAXMEMORY_VOLATILE_RANDOM)
-            {
+            /* allkeys-random policy */
+            if (server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM) {
                 de = dictGetRandomKey(dict);
                 bestkey = dictGetKey(de);
             }
 
-            /* volatile-lru and allkeys-lru policy */
-            else if (server.maxmemory_policy == MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == MAXMEMORY_VOLATILE_LRU)
+            /* volatile-random policy */
+            else if (server.maxmemory_policy == MAXMEMORY_VOLATILE_RANDOM) {
+                bestkey = dbRandomVolatileKey(db,NULL);
+            }
+
+            /* volatile-lru, allkeys-lru, volatile-lfu and allkeys-lfu */
+            else if (server.maxmemory_policy &
+                     (MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_LFU))
             {
                 struct evictionPoolEntry *pool = db->eviction_pool;
 
                 while(bestkey == NULL) {
-                    evictionPoolPopulate(dict, db->dict, db->eviction_pool);
+                    evictionPoolPopulate(db, dict, db->eviction_pool);
                     /* Go backward from best to worst element to evict. */
                     for (k = MAXMEMORY_EVICTION_POOL_SIZE-1; k >= 0; k--) {
                         if (pool[k].key == NULL) continue;
-                        de = dictFind(dict,pool[k].key);
+                        de = dictFind(dict ? dict : db->dict,pool[k].key);
+                        /* With embedded expires a key that is no longer
+                         * volatile is a ghost as well. */
+                        if (de && dict == NULL && getEntryExpire(db,de) == -1)
+                            de = NULL;
 
                         /* Remove the entry from the pool. */
                         sdsfree(pool[k].key);
@@ -3579,11 +3786,10 @@ int freeMemoryIfNeeded(void) {
             else if (server.maxmemory_policy == MAXMEMORY_VOLATILE_TTL) {
                 for (k = 0; k < server.maxmemory_samples; k++) {
                     sds thiskey;
-                    long thisval;
+                    long long thisval;
 
-                    de = dictGetRandomKey(dict);
-                    thiskey = dictGetKey(de);
-                    thisval = (long) dictGetVal(de);
+                    thiskey = dbRandomVolatileKey(db,&thisval);
+                    if (thiskey == NULL) continue;
 
                     /* Expire sooner (minor expire unix timestamp) is better
                      * candidate for deletion */
@@ -3610,7 +3816,10 @@ int freeMemoryIfNeeded(void) {
                  * we only care about memory used by the key space. */
                 delta = (long long) zmalloc_used_memory();
                 latencyStartMonitor(eviction_latency);
-                dbDelete(db,keyobj);
+                if (server.lazyfree_lazy_eviction)
+                    dbAsyncDelete(db,keyobj);
+                else
+                    dbSyncDelete(db,keyobj);
                 latencyEndMonitor(eviction_latency);
                 latencyAddSampleIfNeeded("eviction-del",eviction_latency);
                 latencyRemoveNestedEvent(latency,eviction_latency);
@@ -3627,17 +3836,44 @@ int freeMemoryIfNeeded(void) {
                  * deliver data to the slaves fast enough, so we force the
                  * transmission here inside the loop. */
                 if (slaves) flushSlavesOutputBuffers();
+
+                /* Normally our stop condition is the ability to release
+                 * a fixed, pre-computed amount of memory. However when we
+                 * are deleting objects in another thread, it's better to
+                 * check, from time to time, if we already reached our target
+                 * memory, since the "mem_freed" amount is computed only
+                 * across the dbAsyncDelete() call, while the thread can
+                 * release the memory all the time. */
+                if (server.lazyfree_lazy_eviction && !(keys_freed % 16)) {
+                    if (freeMemoryGetUsedMemory() <= server.maxmemory) {
+                        /* Let's satisfy our stop condition. */
+                        mem_freed = mem_tofree;
+                    }
+                }
             }
         }
         if (!keys_freed) {
             latencyEndMonitor(latency);
             latencyAddSampleIfNeeded("eviction-cycle",latency);
-            return C_ERR; /* nothing to free... */
+            goto cant_free; /* nothing to free... */
         }
     }
     latencyEndMonitor(latency);
     latencyAddSampleIfNeeded("eviction-cycle",latency);
     return C_OK;
+
+cant_free:
+    /* We are here if we are not able to reclaim memory. There is only one
+     * last thing we can try: check if the lazyfree thread has jobs in queue
+     * and wait... */
+    while(bioPendingJobsOfType(BIO_LAZY_FREE)) {
+        size_t mem_now = zmalloc_used_memory();
+
+        if (mem_now < mem_reported &&
+            (mem_reported - mem_now) + mem_freed >= mem_tofree) break;
+        usleep(1000);
+    }
+    return C_ERR;
 }
 
 /* =================================== Main! ================================ */
@@ -3831,9 +4067,24 @@ void loadDataFromDisk(void) {
         if (loadAppendOnlyFile(server.aof_filename) == C_OK)
             serverLog(LL_NOTICE,"DB loaded from append only file: %.3f seconds",(float)(ustime()-start)/1000000);
     } else {
-        if (rdbLoad(server.rdb_filename) == C_OK) {
+        rdbSaveInfo rsi = RDB_SAVE_INFO_INIT;
+        if (rdbLoad(server.rdb_filename,&rsi) == C_OK) {
             serverLog(LL_NOTICE,"DB loaded from disk: %.3f seconds",
                 (float)(ustime()-start)/1000000);
+
+            /* Restore the replication ID / offset from the RDB file, so
+             * that a restarted slave can PSYNC with its master. */
+            if (server.masterhost && rsi.repl_id_is_set &&
+                rsi.repl_offset != -1 && rsi.repl_stream_db != -1)
+            {
+                memcpy(server.replid,rsi.repl_id,sizeof(server.replid));
+                server.master_repl_offset = rsi.repl_offset;
+                /* If we are a slave, create a cached master from this
+                 * information, in order to allow partial resynchronizations
+                 * with masters. */
+                replicationCacheMasterUsingMyself();
+                selectDb(server.cached_master,rsi.repl_stream_db);
+            }
         } else if (errno != ENOENT) {
             serverLog(LL_WARNING,"Fatal error loading the DB: %s. Exiting.",strerror(errno));
             exit(1);
@@ -3967,6 +4218,8 @@ int main(int argc, char **argv) {
     if (argc == 3 && !strcasecmp(argv[1], "test")) {
         if (!strcasecmp(argv[2], "ziplist")) {
             return ziplistTest(argc, argv);
+        } else if (!strcasecmp(argv[2], "listpack")) {
+            return listpackTest(argc, argv);
         } else if (!strcasecmp(argv[2], "quicklist")) {
             quicklistTest(argc, argv);
         } else if (!strcasecmp(argv[2], "intset")) {
@@ -3983,6 +4236,10 @@ int main(int argc, char **argv) {
             return endianconvTest(argc, argv);
         } else if (!strcasecmp(argv[2], "crc64")) {
             return crc64Test(argc, argv);
+        } else if (!strcasecmp(argv[2], "ae")) {
+            return aeTest(argc, argv);
+        } else if (!strcasecmp(argv[2], "networking")) {
+            return networkingTest(argc, argv);
         }
 
         return -1; /* test not found */
@@ -42,128 +42,406 @@
 
 #include "util.h"
 #include "sha1.h"
+#include "zmalloc.h"
 
-/* Glob-style pattern matching. */
-int stringmatchlen(const char *pattern, int patternLen,
-        const char *string, int stringLen, int nocase)
+/* Glob-style pattern matching.
+ *
+ * Patterns are compiled into a stringmatcher, that can then be matched
+ * against any number of strings. The pattern is split at its '*' chars
+ * into segments, where every position matches exactly one char of the
+ * string. So the first segment must match at the start of the string and
+ * the last one at the end of it (unless the pattern starts or ends with '*'),
+ * while the others are searched from left to right: taking the leftmost
+ * occurrence of every segment is always correct, since segments have a fixed
+ * length. This way there is no recursion or backtracking, and the worst case
+ * is O(string length * pattern length). Literal segments are compared with
+ * memcmp(), and searched with memchr(), that are vectorized by the libc.
+ *
+ * A position is a literal char, '?', or a [...] class. Only classes need the
+ * set of the chars they accept, and identical classes share the same set, so
+ * a compiled pattern takes about the memory of the pattern itself. */
+
+/* Set of the chars accepted by a class. */
+#define SM_SET_SIZE 32
+#define smSetAdd(set,c) ((set)[(unsigned char)(c)>>3] |= 1<<((unsigned char)(c)&7))
+#define smSetHas(set,c) ((set)[(unsigned char)(c)>>3] & (1<<((unsigned char)(c)&7)))
+
+/* Kinds of pattern positions. */
+#define SM_LITERAL 0    /* The char in 'chars', lowercase if nocase. */
+#define SM_ANY 1        /* Any char. */
+#define SM_SET 2        /* The chars in the set of the next class. */
+#define SM_STAR 3       /* Segments separator. */
+
+struct stringmatcher {
+    int nocase;
+    int stars;              /* Pattern has at least a '*'. */
+    int anchor_start;       /* Pattern does not start with '*'. */
+    int anchor_end;         /* Pattern does not end with '*'. */
+    size_t len;             /* Number of positions, stars included. */
+    char *chars;            /* Literal char of every position. */
+    unsigned char *kinds;   /* Kind of every position. */
+    uint32_t *classes;      /* Set index of every SM_SET position, in order. */
+    size_t lastpos;         /* First position of the last segment, */
+    size_t lastclass;       /* and its first class. */
+    size_t numsets;
+    unsigned char *sets;    /* 'numsets' distinct sets of SM_SET_SIZE bytes. */
+};
+
+/* A segment of a compiled pattern. */
+typedef struct stringmatcherSegment {
+    const char *chars;
+    const unsigned char *kinds;
+    const uint32_t *classes;
+    size_t len;
+    int literal;            /* True if all the positions are SM_LITERAL. */
+} stringmatcherSegment;
+
+/* State used only while compiling a pattern. */
+typedef struct stringmatcherBuilder {
+    size_t numclasses;
+    size_t setscap;
+    uint32_t *table;        /* Open addressing table of set index + 1, used
+                               to find identical sets. */
+    size_t tablesize;       /* Power of two, or zero. */
+} stringmatcherBuilder;
+
+/* Add to 'set' the char 'c', and its other case if 'nocase' is true. */
+static void smSetAddChar(unsigned char *set, char c, int nocase) {
+    smSetAdd(set,c);
+    if (nocase) {
+        smSetAdd(set,tolower((int)c));
+        smSetAdd(set,toupper((int)c));
+    }
+}
+
+/* Add to 'set' the chars between 'start' and 'end', in any order. Chars
+ * are compared as signed, like the matcher always did. With 'nocase' the
+ * bounds and the chars are compared lowercase. */
+static void smSetAddRange(unsigned char *set, char start, char end,
+                          int nocase)
 {
-    while(patternLen) {
-        switch(pattern[0]) {
-        case '*':
-            while (pattern[1] == '*') {
-                pattern++;
-                patternLen--;
-            }
-            if (patternLen == 1)
-                return 1; /* match */
-            while(stringLen) {
-                if (stringmatchlen(pattern+1, patternLen-1,
-                            string, stringLen, nocase))
-                    return 1; /* match */
-                string++;
-                stringLen--;
-            }
-            return 0; /* no match */
-            break;
-        case '?':
-            if (stringLen == 0)
-                return 0; /* no match */
-            string++;
-            stringLen--;
-            break;
-        case '[':
-        {
-            int not, match;
-
-            pattern++;
-            patternLen--;
-            not = pattern[0] == '^';
-            if (not) {
-                pattern++;
-                patternLen--;
-            }
-            match = 0;
-            while(1) {
-                if (pattern[0] == '\\') {
-                    pattern++;
-                    patternLen--;
-                    if (pattern[0] == string[0])
-                        match = 1;
-                } else if (pattern[0] == ']') {
-                    break;
-                } else if (patternLen == 0) {
-                    pattern--;
-                    patternLen++;
-                    break;
-                } else if (pattern[1] == '-' && patternLen >= 3) {
-                    int start = pattern[0];
-                    int end = pattern[2];
-                    int c = string[0];
-                    if (start > end) {
-                        int t = start;
-                        start = end;
-                        end = t;
-                    }
-                    if (nocase) {
-                        start = tolower(start);
-                        end = tolower(end);
-                        c = tolower(c);
-                    }
-                    pattern += 2;
-                    patternLen -= 2;
-                    if (c >= start && c <= end)
-                        match = 1;
-                } else {
-                    if (!nocase) {
-                        if (pattern[0] == string[0])
-                            match = 1;
-                    } else {
-                        if (tolower((int)pattern[0]) == tolower((int)string[0]))
-                            match = 1;
-                    }
-                }
-                pattern++;
-                patternLen--;
-            }
-            if (not)
-                match = !match;
-            if (!match)
-                return 0; /* no match */
-            string++;
-            stringLen--;
-            break;
+    int c, lo = start, hi = end;
+
+    if (lo > hi) {
+        int t = lo;
+        lo = hi;
+        hi = t;
+    }
+    if (nocase) {
+        lo = tolower(lo);
+        hi = tolower(hi);
+    }
+    for (c = lo; c <= hi; c++) {
+        /* Uppercase chars are added with their lowercase, if in range. */
+        if (nocase && tolower(c) != c) continue;
+        smSetAddChar(set,c,nocase);
+    }
+}
+
+/* Return the number of chars in 'set', storing the last one in '*c'. */
+static int smSetCount(unsigned char *set, int *c) {
+    int j, count = 0;
+
+    for (j = 0; j < 256; j++) {
+        if (smSetHas(set,j)) {
+            count++;
+            *c = j;
         }
-        case '\\':
-            if (patternLen >= 2) {
-                pattern++;
-                patternLen--;
-            }
-            /* fall through */
-        default:
-            if (!nocase) {
-                if (pattern[0] != string[0])
-                    return 0; /* no match */
-            } else {
-                if (tolower((int)pattern[0]) != tolower((int)string[0]))
-                    return 0; /* no match */
-            }
-            string++;
-            stringLen--;
+    }
+    return count;
+}
+
+/* Parse the [...] class at 'p' into 'set'. Return the number of pattern
+ * bytes consumed. */
+static size_t smParseClass(const char *p, size_t plen, unsigned char *set,
+                           int nocase)
+{
+    const char *orig = p;
+    int not, j;
+
+    memset(set,0,SM_SET_SIZE);
+    p++;
+    plen--;
+    not = plen && p[0] == '^';
+    if (not) {
+        p++;
+        plen--;
+    }
+    while(plen) {
+        if (p[0] == '\\' && plen >= 2) {
+            /* Escaped chars are always matched exactly. */
+            smSetAdd(set,p[1]);
+            p += 2;
+            plen -= 2;
+        } else if (p[0] == ']') {
+            p++;
             break;
+        } else if (plen >= 3 && p[1] == '-') {
+            smSetAddRange(set,p[0],p[2],nocase);
+            p += 3;
+            plen -= 3;
+        } else {
+            smSetAddChar(set,p[0],nocase);
+            p++;
+            plen--;
         }
-        pattern++;
-        patternLen--;
-        if (stringLen == 0) {
-            while(*pattern == '*') {
-                pattern++;
-                patternLen--;
+    }
+    if (not) for (j = 0; j < SM_SET_SIZE; j++) set[j] = ~set[j];
+    return p-orig;
+}
+
+static uint32_t smSetHash(unsigned char *set) {
+    uint32_t h = 2166136261U;
+    int j;
+
+    for (j = 0; j < SM_SET_SIZE; j++) h = (h ^ set[j]) * 16777619U;
+    return h;
+}
+
+/* Return the index of 'set' in the matcher sets, adding it if there is not
+ * an identical one already. */
+static uint32_t smAddSet(stringmatcher *m, stringmatcherBuilder *b,
+                         unsigned char *set)
+{
+    size_t j, mask;
+
+    /* Keep the table at most half full. */
+    if ((m->numsets+1)*2 > b->tablesize) {
+        size_t size = b->tablesize ? b->tablesize*2 : 16;
+
+        zfree(b->table);
+        b->table = zcalloc(size*sizeof(uint32_t));
+        b->tablesize = size;
+        for (j = 0; j < m->numsets; j++) {
+            size_t i = smSetHash(m->sets+j*SM_SET_SIZE) & (size-1);
+
+            while (b->table[i]) i = (i+1) & (size-1);
+            b->table[i] = j+1;
+        }
+    }
+
+    mask = b->tablesize-1;
+    j = smSetHash(set) & mask;
+    while (b->table[j]) {
+        uint32_t idx = b->table[j]-1;
+
+        if (memcmp(m->sets+(size_t)idx*SM_SET_SIZE,set,SM_SET_SIZE) == 0)
+            return idx;
+        j = (j+1) & mask;
+    }
+    if (m->numsets == b->setscap) {
+        b->setscap = b->setscap ? b->setscap*2 : 4;
+        m->sets = zrealloc(m->sets,b->setscap*SM_SET_SIZE);
+    }
+    memcpy(m->sets+m->numsets*SM_SET_SIZE,set,SM_SET_SIZE);
+    b->table[j] = m->numsets+1;
+    return m->numsets++;
+}
+
+/* Add the position at 'p' to the matcher. Return the number of pattern
+ * bytes consumed. */
+static size_t smParsePosition(stringmatcher *m, stringmatcherBuilder *b,
+                              const char *p, size_t plen)
+{
+    unsigned char set[SM_SET_SIZE];
+    size_t used = 1;
+    int kind = SM_LITERAL, c = p[0], count;
+
+    if (p[0] == '?') {
+        kind = SM_ANY;
+    } else if (p[0] == '[') {
+        used = smParseClass(p,plen,set,m->nocase);
+        count = smSetCount(set,&c);
+        if (count == 256) {
+            kind = SM_ANY;
+        } else if (count != 1 || m->nocase) {
+            /* A class of a single char is just a literal. */
+            kind = SM_SET;
+            m->classes[b->numclasses++] = smAddSet(m,b,set);
+        }
+    } else if (p[0] == '\\' && plen >= 2) {
+        c = p[1];
+        used = 2;
+    }
+    if (kind == SM_LITERAL && m->nocase) c = tolower((int)(char)c);
+    m->chars[m->len] = c;
+    m->kinds[m->len] = kind;
+    m->len++;
+    return used;
+}
+
+/* Compile the glob-style pattern 'pattern'. The returned matcher must be
+ * released with stringmatcherFree(). */
+stringmatcher *stringmatcherCompile(const char *pattern, int patternLen,
+                                    int nocase)
+{
+    stringmatcher *m = zcalloc(sizeof(*m));
+    stringmatcherBuilder b;
+    size_t plen = patternLen > 0 ? (size_t)patternLen : 0;
+
+    /* Every position takes at least a byte of the pattern, and every class
+     * but a final "[" at least two: the arrays are trimmed at the end. */
+    memset(&b,0,sizeof(b));
+    m->chars = zmalloc(plen+1);
+    m->kinds = zmalloc(plen+1);
+    m->classes = zmalloc(sizeof(uint32_t)*(plen/2+1));
+    m->nocase = nocase;
+    m->anchor_start = plen == 0 || pattern[0] != '*';
+    while (plen) {
+        size_t used;
+
+        if (pattern[0] == '*') {
+            /* Consecutive stars are the same as a single one. */
+            if (m->len == 0 || m->kinds[m->len-1] != SM_STAR) {
+                m->chars[m->len] = '*';
+                m->kinds[m->len] = SM_STAR;
+                m->len++;
             }
+            m->lastpos = m->len;
+            m->lastclass = b.numclasses;
+            m->stars = 1;
+            used = 1;
+        } else {
+            used = smParsePosition(m,&b,pattern,plen);
+        }
+        pattern += used;
+        plen -= used;
+    }
+    m->anchor_end = !m->stars || m->kinds[m->len-1] != SM_STAR;
+
+    m->chars = zrealloc(m->chars,m->len+1);
+    m->kinds = zrealloc(m->kinds,m->len+1);
+    m->classes = zrealloc(m->classes,sizeof(uint32_t)*(b.numclasses+1));
+    if (m->numsets) m->sets = zrealloc(m->sets,m->numsets*SM_SET_SIZE);
+    zfree(b.table);
+    return m;
+}
+
+void stringmatcherFree(stringmatcher *m) {
+    zfree(m->chars);
+    zfree(m->kinds);
+    zfree(m->classes);
+    zfree(m->sets);
+    zfree(m);
+}
+
+/* Set 'seg' to the segment starting at the position '*pos', whose first
+ * class is '*class', skipping a star separator. Then advance '*pos' and
+ * '*class' past the segment. */
+static void smGetSegment(stringmatcher *m, size_t *pos, size_t *class,
+                         stringmatcherSegment *seg)
+{
+    size_t j = *pos;
+
+    if (j < m->len && m->kinds[j] == SM_STAR) j++;
+    seg->chars = m->chars+j;
+    seg->kinds = m->kinds+j;
+    seg->classes = m->classes+*class;
+    seg->literal = 1;
+    while (j < m->len && m->kinds[j] != SM_STAR) {
+        if (m->kinds[j] != SM_LITERAL) {
+            seg->literal = 0;
+            if (m->kinds[j] == SM_SET) (*class)++;
+        }
+        j++;
+    }
+    seg->len = j-(seg->chars-m->chars);
+    *pos = j;
+}
+
+/* Return true if 'seg' matches the string at 's'. */
+static int smSegmentMatch(stringmatcher *m, stringmatcherSegment *seg,
+                          const char *s)
+{
+    size_t j, k = 0;
+
+    if (seg->literal && !m->nocase)
+        return memcmp(seg->chars,s,seg->len) == 0;
+    for (j = 0; j < seg->len; j++) {
+        switch(seg->kinds[j]) {
+        case SM_LITERAL:
+            if ((m->nocase ? (char)tolower((int)s[j]) : s[j]) != seg->chars[j])
+                return 0;
+            break;
+        case SM_SET:
+            if (!smSetHas(m->sets+(size_t)seg->classes[k]*SM_SET_SIZE,s[j]))
+                return 0;
+            k++;
             break;
         }
     }
-    if (patternLen == 0 && stringLen == 0)
-        return 1;
-    return 0;
+    return 1;
+}
+
+/* Return the leftmost match of 'seg' in the string between 's' and 'end',
+ * or NULL if there is no match. */
+static const char *smSegmentSearch(stringmatcher *m,
+                                   stringmatcherSegment *seg,
+                                   const char *s, const char *end)
+{
+    const char *last; /* Last position where 'seg' may start. */
+    int usememchr = !m->nocase && seg->kinds[0] == SM_LITERAL;
+
+    if ((size_t)(end-s) < seg->len) return NULL;
+    last = end-seg->len;
+    while (s <= last) {
+        if (usememchr) {
+            s = memchr(s,seg->chars[0],last-s+1);
+            if (s == NULL) return NULL;
+        }
+        if (smSegmentMatch(m,seg,s)) return s;
+        s++;
+    }
+    return NULL;
+}
+
+/* Return true if the string matches the compiled pattern. */
+int stringmatcherMatch(stringmatcher *m, const char *string, int stringLen) {
+    const char *end = string+(stringLen > 0 ? stringLen : 0);
+    size_t pos = 0, class = 0, endpos = m->len;
+    stringmatcherSegment seg;
+
+    if (!m->stars) {
+        smGetSegment(m,&pos,&class,&seg);
+        return (size_t)(end-string) == seg.len &&
+               smSegmentMatch(m,&seg,string);
+    }
+
+    /* Segments are between the positions 'pos' and 'endpos'. */
+    if (m->anchor_start) {
+        smGetSegment(m,&pos,&class,&seg);
+        if ((size_t)(end-string) < seg.len || !smSegmentMatch(m,&seg,string))
+            return 0;
+        string += seg.len;
+    }
+    if (m->anchor_end) {
+        size_t lastpos = m->lastpos, lastclass = m->lastclass;
+
+        smGetSegment(m,&lastpos,&lastclass,&seg);
+        if ((size_t)(end-string) < seg.len ||
+            !smSegmentMatch(m,&seg,end-seg.len)) return 0;
+        end -= seg.len;
+        endpos = m->lastpos-1; /* The star before the last segment. */
+    }
+    while (pos < endpos) {
+        smGetSegment(m,&pos,&class,&seg);
+        if (seg.len == 0) continue; /* Trailing star. */
+        if ((string = smSegmentSearch(m,&seg,string,end)) == NULL) return 0;
+        string += seg.len;
+    }
+    return 1;
+}
+
+/* Match a pattern only once: callers matching the same pattern against
+ * many strings should compile it with stringmatcherCompile() instead. */
+int stringmatchlen(const char *pattern, int patternLen,
+        const char *string, int stringLen, int nocase)
+{
+    stringmatcher *m = stringmatcherCompile(pattern,patternLen,nocase);
+    int match = stringmatcherMatch(m,string,stringLen);
+
+    stringmatcherFree(m);
+    return match;
 }
 
 int stringmatch(const char *pattern, const char *string, int nocase) {
@@ -734,6 +1012,35 @@ static void test_ll2string(void) {
     assert(!strcmp(buf, "9223372036854775807"));
 }
 
+static void test_stringmatch(void) {
+    char buf[1024];
+
+    assert(stringmatch("foo*","foobar",0) == 1);
+    assert(stringmatch("*bar","foobar",0) == 1);
+    assert(stringmatch("f*o*b*r","foobar",0) == 1);
+    assert(stringmatch("f*x*r","foobar",0) == 0);
+    assert(stringmatch("foo?ar","foobar",0) == 1);
+    assert(stringmatch("foo??ar","foobar",0) == 0);
+    assert(stringmatch("*","",0) == 1);
+    assert(stringmatch("?","",0) == 0);
+    assert(stringmatch("a*a","a",0) == 0);
+    assert(stringmatch("FOO*","foobar",1) == 1);
+    assert(stringmatch("FOO*","foobar",0) == 0);
+    assert(stringmatch("[a-c]x","bx",0) == 1);
+    assert(stringmatch("[c-a]x","bx",0) == 1);
+    assert(stringmatch("[^a-c]x","bx",0) == 0);
+    assert(stringmatch("[^a-c]x","dx",0) == 1);
+    assert(stringmatch("[\\]]","]",0) == 1);
+    assert(stringmatch("\\*","*",0) == 1);
+    assert(stringmatch("\\*","a",0) == 0);
+    assert(stringmatch("a\\","a\\",0) == 1);
+
+    /* Many stars can't make the match exponential. */
+    memset(buf,'a',sizeof(buf)-1);
+    buf[sizeof(buf)-1] = '\0';
+    assert(stringmatch("*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b",buf,0) == 0);
+}
+
 #define UNUSED(x) (void)(x)
 int utilTest(int argc, char **argv) {
     UNUSED(argc);
@@ -742,6 +1049,7 @@ int utilTest(int argc, char **argv) {
     test_string2ll();
     test_string2l();
     test_ll2string();
+    test_stringmatch();
     return 0;
 }
 #endif
@@ -33,7 +33,12 @@
 #include <stdint.h>
 #include "sds.h"
 
+typedef struct stringmatcher stringmatcher;
+
 int stringmatchlen(const char *p, int plen, const char *s, int slen, int nocase);
+stringmatcher *stringmatcherCompile(const char *p, int plen, int nocase);
+int stringmatcherMatch(stringmatcher *m, const char *s, int slen);
+void stringmatcherFree(stringmatcher *m);
 int stringmatch(const char *p, const char *s, int nocase);
 long long memtoll(const char *p, int *err);
 uint32_t digits10(uint64_t v);
@@ -70,9 +70,11 @@ void zlibc_free(void *ptr) {
 #if defined(__ATOMIC_RELAXED)
 #define update_zmalloc_stat_add(__n) __atomic_add_fetch(&used_memory, (__n), __ATOMIC_RELAXED)
 #define update_zmalloc_stat_sub(__n) __atomic_sub_fetch(&used_memory, (__n), __ATOMIC_RELAXED)
+#define update_zmalloc_stat_count(__n) __atomic_add_fetch(&allocations, (__n), __ATOMIC_RELAXED)
 #elif defined(HAVE_ATOMIC)
 #define update_zmalloc_stat_add(__n) __sync_add_and_fetch(&used_memory, (__n))
 #define update_zmalloc_stat_sub(__n) __sync_sub_and_fetch(&used_memory, (__n))
+#define update_zmalloc_stat_count(__n) __sync_add_and_fetch(&allocations, (__n))
 #else
 #define update_zmalloc_stat_add(__n) do { \
     pthread_mutex_lock(&used_memory_mutex); \
@@ -86,15 +88,23 @@ void zlibc_free(void *ptr) {
     pthread_mutex_unlock(&used_memory_mutex); \
 } while(0)
 
+#define update_zmalloc_stat_count(__n) do { \
+    pthread_mutex_lock(&used_memory_mutex); \
+    allocations += (__n); \
+    pthread_mutex_unlock(&used_memory_mutex); \
+} while(0)
+
 #endif
  // 线程安全的处理模式 和 非线程安全
 #define update_zmalloc_stat_alloc(__n) do { \
     size_t _n = (__n); \
     if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
     if (zmalloc_thread_safe) { \
-        update_zmalloc_stat_add(_n); \ 
+        update_zmalloc_stat_add(_n); \
+        update_zmalloc_stat_count(1); \
     } else { \
         used_memory += _n; \
+        allocations++; \
     } \
 } while(0)
 
@@ -109,6 +119,7 @@ void zlibc_free(void *ptr) {
 } while(0)
 
 static size_t used_memory = 0;
+static size_t allocations = 0; /* Calls to zmalloc(), zcalloc(), zrealloc(). */
 static int zmalloc_thread_safe = 0;
 pthread_mutex_t used_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -236,6 +247,25 @@ size_t zmalloc_used_memory(void) {
 
     return um;
 }
+/* Return the number of allocations (including reallocations) performed since
+ * the process started. */
+size_t zmalloc_allocations(void) {
+    size_t count;
+
+    if (zmalloc_thread_safe) {
+#if defined(__ATOMIC_RELAXED) || defined(HAVE_ATOMIC)
+        count = update_zmalloc_stat_count(0);
+#else
+        pthread_mutex_lock(&used_memory_mutex);
+        count = allocations;
+        pthread_mutex_unlock(&used_memory_mutex);
+#endif
+    } else {
+        count = allocations;
+    }
+    return count;
+}
+
 // 设置线程安全模式
 void zmalloc_enable_thread_safeness(void) {
     zmalloc_thread_safe = 1;
@@ -257,4 +257,54 @@ tags {"aof"} {
             r expire x -1
         }
     }
+
+    ## Test that an AOF rewritten with an RDB preamble is loaded back, with
+    ## the commands appended after the rewrite.
+    start_server_aof [list dir $server_path aof-use-rdb-preamble yes] {
+        set client [redis [dict get $srv host] [dict get $srv port]]
+
+        test "AOF+RDB preamble: rewritten AOF starts with the RDB payload" {
+            $client flushall
+            $client debug populate 1000
+            $client rpush list a b c
+            $client hmset hash f1 v1 f2 v2
+            $client setex volatile 1000 value
+            $client bgrewriteaof
+            wait_for_condition 50 100 {
+                [string match {*aof_rewrite_in_progress:0*} [$client info persistence]]
+            } else {
+                fail "AOF rewrite is taking too much time."
+            }
+            set fp [open $aof_path r]
+            fconfigure $fp -translation binary
+            set sig [read $fp 5]
+            close $fp
+            set sig
+        } {REDIS}
+
+        test "AOF+RDB preamble: commands are appended after the preamble" {
+            $client incr counter
+            $client incr counter
+            $client lpush list z
+            set ::preamble_digest [$client debug digest]
+            $client debug loadaof
+            assert_equal $::preamble_digest [$client debug digest]
+            assert_equal 2 [$client get counter]
+            assert_equal {z a b c} [$client lrange list 0 -1]
+            assert {[$client ttl volatile] > 0}
+        }
+    }
+
+    start_server_aof [list dir $server_path aof-use-rdb-preamble no] {
+        test "AOF+RDB preamble: loaded at startup even if the option is off" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            wait_for_condition 50 100 {
+                [catch {$client ping} e] == 0
+            } else {
+                fail "Loading DB is taking too much time."
+            }
+            assert_equal $::preamble_digest [$client debug digest]
+            assert_equal 1004 [$client dbsize]
+        }
+    }
 }
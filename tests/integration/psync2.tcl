@@ -0,0 +1,124 @@
+# Check that replication IDs and offsets allow slaves to continue with a
+# partial resynchronization after a failover and after a restart.
+
+proc psync2_fill {r prefix n} {
+    for {set j 0} {$j < $n} {incr j} {
+        $r set $prefix:$j $j
+        $r incr $prefix:counter
+        $r rpush $prefix:list $j
+    }
+}
+
+start_server {tags {"psync2"}} {
+start_server {} {
+start_server {} {
+    set A [srv -2 client]
+    set A_host [srv -2 host]
+    set A_port [srv -2 port]
+    set B [srv -1 client]
+    set B_host [srv -1 host]
+    set B_port [srv -1 port]
+    set C [srv 0 client]
+
+    test {PSYNC2: Set up a master with two slaves} {
+        $B slaveof $A_host $A_port
+        $C slaveof $A_host $A_port
+        psync2_fill $A pre 100
+        wait_for_condition 50 100 {
+            [status $B master_link_status] eq {up} &&
+            [status $C master_link_status] eq {up} &&
+            [status $B master_repl_offset] == [status $A master_repl_offset] &&
+            [status $C master_repl_offset] == [status $A master_repl_offset]
+        } else {
+            fail "Slaves not in sync with the master"
+        }
+        assert_equal [status $A master_replid] [status $B master_replid]
+        assert_equal [status $A master_replid] [status $C master_replid]
+    }
+
+    test {PSYNC2: Promoted slave keeps the old ID as secondary ID} {
+        set old_id [status $A master_replid]
+        set offset [status $A master_repl_offset]
+        $B slaveof no one
+        assert_equal $old_id [status $B master_replid2]
+        assert_equal [expr {$offset+1}] [status $B second_repl_offset]
+        assert {[status $B master_replid] ne $old_id}
+    }
+
+    test {PSYNC2: Old master and other slave partially resync with the new master} {
+        set full [status $B sync_full]
+        set partial [status $B sync_partial_ok]
+        $C slaveof $B_host $B_port
+        $A slaveof $B_host $B_port
+        psync2_fill $B post 100
+        wait_for_condition 50 100 {
+            [status $A master_link_status] eq {up} &&
+            [status $C master_link_status] eq {up} &&
+            [status $A master_repl_offset] == [status $B master_repl_offset] &&
+            [status $C master_repl_offset] == [status $B master_repl_offset]
+        } else {
+            fail "Instances not in sync with the new master"
+        }
+        assert_equal $full [status $B sync_full]
+        assert_equal [expr {$partial+2}] [status $B sync_partial_ok]
+        assert_equal [$B debug digest] [$A debug digest]
+        assert_equal [$B debug digest] [$C debug digest]
+    }
+
+    test {PSYNC2: Sub-slaves receive the proxied master stream} {
+        # Chain A -> C, so that C gets the stream from B via A.
+        set partial [status $A sync_partial_ok]
+        $C slaveof $A_host $A_port
+        psync2_fill $B chain 100
+        wait_for_condition 50 100 {
+            [status $C master_link_status] eq {up} &&
+            [status $C master_repl_offset] == [status $B master_repl_offset]
+        } else {
+            fail "Sub-slave not in sync"
+        }
+        assert_equal [expr {$partial+1}] [status $A sync_partial_ok]
+        assert_equal [status $B master_replid] [status $C master_replid]
+        assert_equal [$B debug digest] [$C debug digest]
+    }
+}}}
+
+start_server {tags {"psync2"}} {
+    set master [srv 0 client]
+    set master_host [srv 0 host]
+    set master_port [srv 0 port]
+
+    start_server [list overrides [list slaveof "$master_host $master_port"]] {
+        set slave [srv 0 client]
+        set dir [lindex [$slave config get dir] 1]
+
+        test {PSYNC2: Slave is in sync before the restart} {
+            psync2_fill $master restart 100
+            wait_for_condition 50 100 {
+                [status $slave master_link_status] eq {up} &&
+                [status $slave master_repl_offset] == [status $master master_repl_offset]
+            } else {
+                fail "Slave not in sync with the master"
+            }
+        }
+
+        test {PSYNC2: Restarted slave partially resyncs using the RDB info} {
+            set full [status $master sync_full]
+            set partial [status $master sync_partial_ok]
+            catch {$slave shutdown save}
+            psync2_fill $master after 100
+            start_server [list overrides [list dir $dir \
+                slaveof "$master_host $master_port"]] {
+                set slave [srv 0 client]
+                wait_for_condition 50 100 {
+                    [status $slave master_link_status] eq {up} &&
+                    [status $slave master_repl_offset] == [status $master master_repl_offset]
+                } else {
+                    fail "Restarted slave not in sync with the master"
+                }
+                assert_equal $full [status $master sync_full]
+                assert_equal [expr {$partial+1}] [status $master sync_partial_ok]
+                assert_equal [$master debug digest] [$slave debug digest]
+            }
+        }
+    }
+}
@@ -21,6 +21,17 @@ start_server [list overrides [list "dir" $server_path "dbfilename" "encodings.rd
 "0","zset","zset","a","1","b","2","c","3","aa","10","bb","20","cc","30","aaa","100","bbb","200","ccc","300","aaaa","1000","cccc","123456789","bbbb","5000000000",
 "0","zset_zipped","zset","a","1","b","2","c","3",
 }
+
+  test "RDB ziplist encoded hashes and zsets are loaded as listpacks" {
+    r select 0
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    set digest [r debug digest]
+    r debug reload
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    assert_equal $digest [r debug digest]
+  }
 }
 
 set server_path [tmpdir "server.rdb-startup-test"]
@@ -96,3 +107,22 @@ start_server_and_kill_it [list "dir" $server_path] {
         }
     }
 }
+
+# Tag the RDB file with version 8, used by upstream Redis for a format this
+# server can't load.
+set fd [open [file join $server_path dump.rdb] r+]
+fconfigure $fd -translation binary
+seek $fd 5 start
+puts -nonewline $fd "0008"
+close $fd
+
+start_server_and_kill_it [list "dir" $server_path] {
+    test {Server should not start if the RDB has an upstream format version} {
+        wait_for_condition 50 100 {
+            [string match {*Can't handle RDB format version 8*} \
+                [exec tail -n10 < [dict get $srv stdout]]]
+        } else {
+            fail "Server loaded an RDB with an upstream format version!"
+        }
+    }
+}
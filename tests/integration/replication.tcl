@@ -5,6 +5,14 @@ proc log_file_matches {log pattern} {
     string match $pattern $content
 }
 
+# Number of times 'str' appears in the log file.
+proc log_file_count {log str} {
+    set fp [open $log r]
+    set content [read $fp]
+    close $fp
+    regexp -all ***=$str $content
+}
+
 start_server {tags {"repl"}} {
     set slave [srv 0 client]
     set slave_host [srv 0 host]
@@ -266,3 +274,176 @@ foreach dl {no yes} {
         }
     }
 }
+
+foreach mdl {no yes} {
+    foreach sdl {disabled on-empty-db swapdb} {
+        start_server {tags {"repl"}} {
+            set master [srv 0 client]
+            $master config set repl-diskless-sync $mdl
+            $master config set repl-diskless-sync-delay 0
+            set master_host [srv 0 host]
+            set master_port [srv 0 port]
+            $master debug populate 5000
+            for {set j 0} {$j < 2000} {incr j} {
+                $master rpush biglist $j
+                $master sadd bigset $j
+                $master zadd bigzset $j $j
+                $master hset bighash $j $j
+            }
+            $master pexpire key:10 1000000
+            start_server {} {
+                set slave [srv 0 client]
+                set slave_log [srv 0 stdout]
+                $slave config set repl-diskless-load $sdl
+                # Leave the slave empty in on-empty-db mode, otherwise it
+                # would just fall back to loading from disk.
+                if {$sdl ne {on-empty-db}} {$slave set oldkey oldvalue}
+
+                test "Full sync, diskless-sync=$mdl diskless-load=$sdl" {
+                    $slave slaveof $master_host $master_port
+                    wait_for_condition 50 100 {
+                        [lindex [$slave role] 3] eq {connected}
+                    } else {
+                        fail "Slave not connected after some time"
+                    }
+                    wait_for_condition 50 100 {
+                        [$master debug digest] eq [$slave debug digest]
+                    } else {
+                        fail "Different dataset between master and slave"
+                    }
+                    assert_equal 0 [$slave exists oldkey]
+                    assert {[$slave pttl key:10] > 0}
+                    assert_equal [expr {$sdl ne {disabled}}] \
+                        [log_file_matches $slave_log "*DB in memory from the socket*"]
+                }
+
+                test "Slave keeps replicating after the diskless-load=$sdl sync" {
+                    $master set newkey newvalue
+                    $master lpush biglist x
+                    wait_for_condition 50 100 {
+                        [$master debug digest] eq [$slave debug digest]
+                    } else {
+                        fail "Slave did not receive the replication stream"
+                    }
+                }
+            }
+        }
+    }
+}
+
+# A fake master sending a truncated payload: the slave must discard the
+# partially loaded dataset and, in swapdb mode, get back the old one.
+# Only the first 'sendlen' bytes of the payload are sent.
+proc fake_master_accept {payload sendlen fd host port} {
+    fconfigure $fd -translation binary -buffering none
+    while {[gets $fd line] >= 0} {
+        set line [string trim $line]
+        if {[string match -nocase psync* $line]} {
+            puts -nonewline $fd "+FULLRESYNC [string repeat a 40] 1\r\n"
+            puts -nonewline $fd "\$[string length $payload]\r\n"
+            puts -nonewline $fd [string range $payload 0 [expr {$sendlen-1}]]
+            break
+        } elseif {[string match -nocase ping* $line]} {
+            puts -nonewline $fd "+PONG\r\n"
+        } else {
+            puts -nonewline $fd "+OK\r\n"
+        }
+    }
+    close $fd
+    set ::fake_master_done 1
+}
+
+foreach sdl {on-empty-db swapdb} {
+    start_server {tags {"repl"}} {
+        set slave [srv 0 client]
+        set slave_log [srv 0 stdout]
+        $slave config set repl-diskless-load $sdl
+        $slave debug populate 20000
+        $slave save
+        set fp [open [file join [lindex [$slave config get dir] 1] \
+            [lindex [$slave config get dbfilename] 1]] r]
+        fconfigure $fp -translation binary
+        set payload [read $fp]
+        close $fp
+        if {$sdl eq {on-empty-db}} {$slave flushall}
+        set digest [$slave debug digest]
+
+        test "Truncated payload with diskless-load=$sdl keeps the old data" {
+            set port [find_available_port [expr {[srv 0 port]+100}]]
+            set listener [socket -server \
+                [list fake_master_accept $payload \
+                    [expr {[string length $payload]/2}]] \
+                -myaddr 127.0.0.1 $port]
+            set ::fake_master_done 0
+            set timer [after 10000 {set ::fake_master_done timeout}]
+            $slave slaveof 127.0.0.1 $port
+            vwait ::fake_master_done
+            after cancel $timer
+            assert_equal 1 $::fake_master_done
+            wait_for_condition 50 100 {
+                [log_file_matches $slave_log "*Failed trying to load the MASTER synchronization DB from socket*"]
+            } else {
+                fail "The slave did not detect the truncated payload"
+            }
+            $slave slaveof no one
+            close $listener
+            assert_equal $digest [$slave debug digest]
+        }
+    }
+}
+
+# With swapdb a corrupted payload must not be fatal either: the slave keeps
+# running with the old data.
+start_server {tags {"repl"}} {
+    set slave [srv 0 client]
+    set slave_log [srv 0 stdout]
+    $slave config set repl-diskless-load swapdb
+    $slave debug populate 20000
+    $slave save
+    set fp [open [file join [lindex [$slave config get dir] 1] \
+        [lindex [$slave config get dbfilename] 1]] r]
+    fconfigure $fp -translation binary
+    set payload [read $fp]
+    close $fp
+    set digest [$slave debug digest]
+
+    # Damage the checksum at the end of the payload, or give one of the
+    # values an unknown string encoding.
+    set last [scan [string index $payload end] %c]
+    set badcrc [string replace $payload end end \
+        [format %c [expr {($last+1)%256}]]]
+    set pos [string first "value:12345" $payload]
+    set badenc [string replace $payload [expr {$pos-1}] [expr {$pos-1}] \
+        "\xc5"]
+
+    foreach {what bad error} [list checksum $badcrc "RDB CRC error" \
+                                   encoding $badenc "Unknown RDB string encoding"] {
+    foreach threads {1 4} {
+        test "Corrupted $what with diskless-load=swapdb, rdb-load-threads=$threads keeps the old data" {
+            set failed "Failed trying to load the MASTER synchronization DB"
+            set failures [log_file_count $slave_log $failed]
+            set errors [log_file_count $slave_log $error]
+            $slave config set rdb-load-threads $threads
+            set port [find_available_port [expr {[srv 0 port]+100}]]
+            set listener [socket -server \
+                [list fake_master_accept $bad [string length $bad]] \
+                -myaddr 127.0.0.1 $port]
+            set ::fake_master_done 0
+            set timer [after 10000 {set ::fake_master_done timeout}]
+            $slave slaveof 127.0.0.1 $port
+            vwait ::fake_master_done
+            after cancel $timer
+            assert_equal 1 $::fake_master_done
+            wait_for_condition 50 100 {
+                [log_file_count $slave_log $failed] > $failures
+            } else {
+                fail "The slave did not detect the corrupted payload"
+            }
+            assert {[log_file_count $slave_log $error] > $errors}
+            $slave slaveof no one
+            close $listener
+            assert_equal $digest [$slave debug digest]
+        }
+    }
+    }
+}
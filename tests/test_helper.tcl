@@ -37,6 +37,7 @@ set ::all_tests {
     integration/replication-3
     integration/replication-4
     integration/replication-psync
+    integration/psync2
     integration/aof
     integration/rdb
     integration/convert-zipmap-hash-on-load
@@ -54,6 +55,8 @@ set ::all_tests {
     unit/geo
     unit/memefficiency
     unit/hyperloglog
+    unit/io-threads
+    unit/lazyfree
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -131,8 +134,9 @@ proc reconnect {args} {
     set client [redis $host $port]
     dict set srv "client" $client
 
-    # select the right db when we don't have to authenticate
-    if {![dict exists $config "requirepass"]} {
+    # select the right db when we don't have to authenticate, and the
+    # server is not in cluster mode (only DB 0 is available there)
+    if {![dict exists $config "requirepass"] && ![cluster_mode $config]} {
         $client select 9
     }
 
@@ -151,11 +155,18 @@ proc redis_deferring_client {args} {
     set client [redis [srv $level "host"] [srv $level "port"] 1]
 
     # select the right db and read the response (OK)
-    $client select 9
-    $client read
+    if {![cluster_mode [srv $level "config"]]} {
+        $client select 9
+        $client read
+    }
     return $client
 }
 
+proc cluster_mode {config} {
+    expr {[dict exists $config "cluster-enabled"] &&
+          [dict get $config "cluster-enabled"] eq {yes}}
+}
+
 # Provide easy access to INFO properties. Same semantic as "proc r".
 proc s {args} {
     set level 0
@@ -6,6 +6,48 @@ start_server {tags {"dump"}} {
         list [r exists foo] [r restore foo 0 $encoded] [r ttl foo] [r get foo]
     } {0 OK -1 bar}
 
+    test {DUMP of listpack encoded values uses this server RDB types and version} {
+        r del h z l
+        r hset h field value
+        r zadd z 1 member
+        r rpush l element
+        foreach key {h z l} type {64 65 66} {
+            set encoded [r dump $key]
+            binary scan $encoded c t
+            binary scan [string range $encoded end-9 end-8] s ver
+            assert_equal $type $t
+            assert_equal 100 $ver
+        }
+    }
+
+    test {RESTORE converts the ziplist nodes of older list payloads} {
+        # DUMP of a list with four elements per node, made by a server
+        # storing the quicklist nodes as ziplists (RDB type 14, version 7).
+        set encoded [binary format H* [join {
+            0e06c31e3d043d0000003a2003040400001561e00a00033117f202e00c180332
+            17f3ffc31e3d043d0000003a2003040400001561e00a00033317f402e00c1803
+            3417f5ffc31e3d043d0000003a2003040400001561e00a00033517f602e00c18
+            033617f7ffc31e3d043d0000003a2003040400001561e00a00033717f802e00c
+            18033817f9ffc3213e043e0000003b2003040400001561e00a00043917fa0216
+            e00a170561313018fbffc31f3f043f0000003c2003040400001661e00a000431
+            3118fc02e00d19033218fdff07004ecbc28d6d865d40
+        } ""]]
+        set expected {}
+        for {set j 1} {$j <= 12} {incr j} {
+            lappend expected aaaaaaaaaaaaaaaaaaaa$j $j
+        }
+        r del l
+        r restore l 0 $encoded
+        assert_encoding quicklist l
+        assert_equal $expected [r lrange l 0 -1]
+        r linsert l before 6 x
+        r lset l 0 y
+        r rpop l
+        set expected [lreplace $expected 0 0 y]
+        set expected [linsert [lrange $expected 0 end-1] 11 x]
+        assert_equal $expected [r lrange l 0 -1]
+    }
+
     test {RESTORE can set an arbitrary expire to the materialized key} {
         r set foo bar
         set encoded [r dump foo]
@@ -49,6 +91,35 @@ start_server {tags {"dump"}} {
         set e
     } {*syntax*}
 
+    test {RESTORE APPEND adds the elements to an existing key} {
+        r del foo bar
+        r rpush foo a b c
+        r rpush bar d e
+        set encoded [r dump bar]
+        r restore foo 0 $encoded append
+        r lrange foo 0 -1
+    } {a b c d e}
+
+    test {RESTORE APPEND returns an error if the key does not exist} {
+        r del foo bar
+        r sadd bar x y
+        catch {r restore foo 0 [r dump bar] append} e
+        set e
+    } {*no such key*}
+
+    test {RESTORE APPEND returns an error with a different type} {
+        r del foo bar
+        r sadd foo x y
+        r rpush bar x y
+        catch {r restore foo 0 [r dump bar] append} e
+        set e
+    } {WRONGTYPE*}
+
+    test {RESTORE REPLACE and APPEND can't be used together} {
+        catch {r restore foo 0 "..." replace append} e
+        set e
+    } {*syntax*}
+
     test {DUMP of non existing key returns nil} {
         r dump nonexisting_key
     } {}
@@ -199,6 +270,109 @@ start_server {tags {"dump"}} {
         }
     }
 
+    foreach {type populate} {
+        list {r rpush key "item $j" $j}
+        set {r sadd key "item $j" $j}
+        zset {r zadd key $j "item $j" [expr {$j/3.0}] $j}
+        hash {r hmset key "field $j" "item $j" $j $j}
+    } {
+        test "MIGRATE can transfer big $type values in parts" {
+            set first [srv 0 client]
+            r flushdb
+            for {set j 0} {$j < 5000} {incr j} $populate
+            set digest [r debug digest]
+            r pexpire key 100000
+            start_server {tags {"repl"}} {
+                set second [srv 0 client]
+                set second_host [srv 0 host]
+                set second_port [srv 0 port]
+
+                set ret [r -1 migrate $second_host $second_port key 9 10000]
+                assert {$ret eq {OK}}
+                assert {[$first exists key] == 0}
+                assert {[$second ttl key] > 0}
+                $second persist key
+                assert {[$second debug digest] eq $digest}
+            }
+        }
+    }
+
+    test {MIGRATE can transfer multiple big values in parts at once} {
+        set first [srv 0 client]
+        r flushdb
+        for {set j 0} {$j < 3000} {incr j} {
+            r rpush list $j
+            r sadd set "item $j"
+            r zadd zset $j "item $j"
+        }
+        r set small foo
+        set digest [r debug digest]
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            $second config resetstat
+            set ret [r -1 migrate $second_host $second_port "" 9 10000 \
+                     keys list small set zset]
+            assert {$ret eq {OK}}
+            assert {[$first dbsize] == 0}
+            assert {[$second debug digest] eq $digest}
+            # 4 RESTORE for the first parts, 2 APPEND for every big value.
+            assert_match {*cmdstat_restore:calls=10,*} [$second info commandstats]
+        }
+    }
+
+    test {MIGRATE of a big value does not touch an existing target key} {
+        set first [srv 0 client]
+        r del key
+        for {set j 0} {$j < 5000} {incr j} {r sadd key $j "item $j"}
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            $second sadd key foo
+            catch {r -1 migrate $second_host $second_port key 9 10000} e
+            assert_match {*BUSYKEY*} $e
+            assert {[$first scard key] == 10000}
+            assert {[$second smembers key] eq {foo}}
+
+            set ret [r -1 migrate $second_host $second_port key 9 10000 replace]
+            assert {$ret eq {OK}}
+            assert {[$first exists key] == 0}
+            assert {[$second scard key] == 10000}
+        }
+    }
+
+    test {MIGRATE removes a partially transferred value from the target} {
+        set first [srv 0 client]
+        r del key
+        set val [string repeat x 1000]
+        for {set j 0} {$j < 5000} {incr j} {r sadd key "$j $val"}
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            # The first part fits, the others are refused with OOM.
+            set used [s used_memory]
+            $second config set maxmemory-policy noeviction
+            $second config set maxmemory [expr {$used+500000}]
+            catch {r -1 migrate $second_host $second_port key 9 10000} e
+            assert_match {*OOM*} $e
+            assert {[$first scard key] == 5000}
+            assert {[$second exists key] == 0}
+
+            # Nothing is left behind on the target, so a retry works.
+            $second config set maxmemory 0
+            set ret [r -1 migrate $second_host $second_port key 9 10000]
+            assert {$ret eq {OK}}
+            assert {[$first exists key] == 0}
+            assert {[$second scard key] == 5000}
+        }
+    }
+
     test {MIGRATE timeout actually works} {
         set first [srv 0 client]
         r set key "Some Value"
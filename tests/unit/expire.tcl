@@ -220,3 +220,135 @@ start_server {tags {"expire"}} {
         assert {$ttl <= 98 && $ttl > 90}
     }
 }
+
+foreach grouped {no yes} {
+    start_server [list tags {"expire"} overrides [list keyspace-embedded-expires yes keyspace-grouped-buckets $grouped]] {
+        test "Embedded expires: TTL, PERSIST and overwrites (grouped: $grouped)" {
+            r set foo bar
+            assert_equal -1 [r ttl foo]
+            r expire foo 100
+            set ttl [r ttl foo]
+            assert {$ttl >= 90 && $ttl <= 100}
+            r expire foo 200
+            set ttl [r ttl foo]
+            assert {$ttl >= 190 && $ttl <= 200}
+            assert_match {*keys=1,expires=1,*} [r info keyspace]
+            assert_equal 1 [r persist foo]
+            assert_equal 0 [r persist foo]
+            assert_equal -1 [r ttl foo]
+            r setex foo 100 bar
+            r set foo baz
+            assert_equal -1 [r ttl foo]
+            assert_equal 0 [llength [regexp -inline {expires=[1-9]} [r info keyspace]]]
+        }
+
+        test "Embedded expires: RENAME, MOVE and DEL keep the volatile keys consistent (grouped: $grouped)" {
+            r flushall
+            for {set j 0} {$j < 100} {incr j} {r setex key:$j 1000 $j}
+            r set persistent 1
+            r rename key:0 renamed
+            set ttl [r ttl renamed]
+            assert {$ttl >= 990 && $ttl <= 1000}
+            r move key:1 1
+            r select 1
+            set ttl [r ttl key:1]
+            assert {$ttl >= 990 && $ttl <= 1000}
+            r select 9
+            for {set j 2} {$j < 100} {incr j 2} {r del key:$j}
+            assert_match {*keys=51,expires=50,*} [r info keyspace]
+            for {set j 3} {$j < 100} {incr j 2} {
+                set ttl [r ttl key:$j]
+                assert {$ttl >= 990 && $ttl <= 1000}
+            }
+        }
+
+        test "Embedded expires: volatile keys are actively expired (grouped: $grouped)" {
+            r flushdb
+            for {set j 0} {$j < 1000} {incr j} {r psetex key:$j 100 $j}
+            r set persistent 1
+            wait_for_condition 50 100 {
+                [r dbsize] == 1
+            } else {
+                fail "Volatile keys not expired"
+            }
+            r randomkey
+        } {persistent}
+
+        test "Embedded expires: DEBUG RELOAD preserves the expires (grouped: $grouped)" {
+            r flushdb
+            r debug populate 1000
+            for {set j 0} {$j < 1000} {incr j 3} {r expire key:$j 1000}
+            set digest [r debug digest]
+            r debug reload
+            assert_equal $digest [r debug digest]
+            assert_match {*keys=1000,expires=334,*} [r info keyspace]
+        }
+
+        test "Embedded expires: volatile policies only evict volatile keys (grouped: $grouped)" {
+            foreach policy {volatile-lru volatile-random volatile-ttl} {
+                r flushdb
+                r debug populate 1000 persistent
+                for {set j 0} {$j < 1000} {incr j} {r setex key:$j 1000 $j}
+                r config set maxmemory-policy $policy
+                r config set maxmemory [expr {[s used_memory]-10000}]
+                r set trigger 1
+                r config set maxmemory 0
+                assert {[scan [regexp -inline {expires=\d+} [r info keyspace]] expires=%d] < 1000}
+                assert_equal 1000 [llength [r keys persistent:*]]
+            }
+            r config set maxmemory-policy noeviction
+        }
+    }
+}
+
+foreach embedded {no yes} {
+    start_server [list tags {"expire"} overrides [list active-expire-index yes keyspace-embedded-expires $embedded]] {
+        proc indexed_keys {} {
+            regexp {indexed keys: (\d+)} [r debug htstats 9] -> n
+            set n
+        }
+
+        test "Expiry index: follows the expires of the keys (embedded: $embedded)" {
+            for {set j 0} {$j < 100} {incr j} {r setex key:$j 1000 $j}
+            for {set j 0} {$j < 100} {incr j 10} {r expire key:$j 2000}
+            r persist key:1
+            r set key:2 overwritten
+            r del key:3
+            r rename key:4 renamed
+            r set persistent 1
+            assert_equal 97 [indexed_keys]
+            assert_match {*keys=100,expires=97,*} [r info keyspace]
+            set digest [r debug digest]
+            r debug reload
+            assert_equal $digest [r debug digest]
+            assert_equal 97 [indexed_keys]
+            r flushdb
+            assert_equal 0 [indexed_keys]
+        }
+
+        test "Expiry index: a batch of keys is reclaimed in deadline order (embedded: $embedded)" {
+            r flushdb
+            r debug set-active-expire 0
+            for {set j 0} {$j < 1000} {incr j} {r psetex short:$j 1 $j}
+            for {set j 0} {$j < 1000} {incr j} {r setex long:$j 1000 $j}
+            after 200
+            assert {[s expired_memory_lag] >= 150}
+            r debug set-active-expire 1
+            wait_for_condition 50 100 {
+                [r dbsize] == 1000
+            } else {
+                fail "Volatile keys not expired"
+            }
+            assert_equal 0 [s expired_memory_lag]
+            assert_equal 1000 [indexed_keys]
+            assert_equal 1000 [llength [r keys long:*]]
+        }
+
+        test "Expiry index: FLUSHALL ASYNC releases the index (embedded: $embedded)" {
+            r flushall async
+            assert_equal 0 [indexed_keys]
+            r setex foo 1000 bar
+            assert_equal 1 [indexed_keys]
+        }
+    }
+}
@@ -20,4 +20,14 @@ start_server {tags {"introspection"}} {
         r set key2 2
         r touch key0 key1 key2 key3
     } 2
+
+    test {Argument objects are recycled between commands} {
+        r set foo bar
+        r config resetstat
+        for {set j 0} {$j < 1000} {incr j} {
+            assert_equal bar [r get foo]
+        }
+        set ratio [s allocations_per_command]
+        assert {$ratio < 0.1}
+    }
 }
@@ -0,0 +1,75 @@
+start_server {tags {"iothreads"} overrides {io-threads 4 io-threads-do-reads yes}} {
+    proc io_threads_burst {clients} {
+        foreach rd $clients {
+            for {set j 0} {$j < 100} {incr j} {
+                $rd set key:$j [string repeat x 100]
+                $rd get key:$j
+            }
+            $rd flush
+        }
+        foreach rd $clients {
+            for {set j 0} {$j < 100} {incr j} {
+                assert_equal OK [$rd read]
+                assert_equal [string repeat x 100] [$rd read]
+            }
+        }
+    }
+
+    test {I/O threads configuration is reported} {
+        assert_equal {io-threads 4} [r config get io-threads]
+        assert_equal {io-threads-do-reads yes} [r config get io-threads-do-reads]
+    }
+
+    test {io-threads can't be changed at runtime} {
+        catch {r config set io-threads 2} e
+        set e
+    } {*Unsupported*}
+
+    test {Many pipelining clients are served by the I/O threads} {
+        set served 0
+        for {set retry 0} {$retry < 10} {incr retry} {
+            exec src/redis-benchmark -q -p [srv port] -c 50 -n 50000 -P 16 \
+                -t set,get
+            set served [status r total_writes_processed_by_io_threads]
+            if {$served > 0} break
+        }
+        assert {$served > 0}
+        assert {[status r total_reads_processed_by_io_threads] > 0}
+        r ping
+    } {PONG}
+
+    test {Protocol errors are reported by clients read by I/O threads} {
+        set clients {}
+        for {set j 0} {$j < 32} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        io_threads_burst $clients
+        set rd [lindex $clients 0]
+        $rd write "*1\r\nfoo\r\n"
+        $rd flush
+        catch {$rd read} e
+        foreach rd $clients {$rd close}
+        set e
+    } {*Protocol error*}
+
+    test {I/O threads keep commands ordering in pipelines} {
+        set clients {}
+        for {set j 0} {$j < 32} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        foreach rd $clients {
+            $rd del counter:$rd
+            for {set j 0} {$j < 200} {incr j} {
+                $rd incr counter:$rd
+            }
+            $rd flush
+        }
+        foreach rd $clients {
+            $rd read ; # DEL reply
+            for {set j 1} {$j <= 200} {incr j} {
+                assert_equal $j [$rd read]
+            }
+            $rd close
+        }
+    }
+}
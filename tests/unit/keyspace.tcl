@@ -272,4 +272,92 @@ start_server {tags {"keyspace"}} {
         r keys *
         r keys *
     } {dlskeriewrioeuwqoirueioqwrueoqwrueqw}
+
+    test {KEYS with glob classes, escapes and multiple stars} {
+        r flushdb
+        foreach key {foo:1:bar foo:22:bar foo:x:baz f*o a?b a-b {a]b}} {
+            r set $key 1
+        }
+        assert_equal {foo:1:bar foo:22:bar} [lsort [r keys foo:*:bar]]
+        assert_equal {foo:1:bar} [r keys foo:\[0-9\]:*]
+        assert_equal {foo:x:baz} [r keys foo:\[^0-9\]*]
+        assert_equal {foo:1:bar foo:22:bar foo:x:baz} [lsort [r keys *:*:ba?]]
+        assert_equal {f*o} [r keys f\\*o]
+        assert_equal {a?b} [r keys a\\?b]
+        assert_equal [list a-b a\]b] [lsort [r keys a\[\\\]-\]b]]
+    }
+
+    test {KEYS and SCAN MATCH with many stars against long keys} {
+        r flushdb
+        set long [string repeat a 5000]
+        r set $long 1
+        r set ${long}b 1
+        set pattern [string repeat *a 30]*b
+        set start [clock milliseconds]
+        set res [list [r keys $pattern] [lindex [r scan 0 match $pattern] 1]]
+        assert {[clock milliseconds]-$start < 1000}
+        assert_equal [list [list ${long}b] [list ${long}b]] $res
+    }
+}
+
+start_server {tags {"keyspace"} overrides {keyspace-grouped-buckets yes}} {
+    test {Grouped buckets layout is used for the keyspace} {
+        r set foo bar
+        assert_equal {keyspace-grouped-buckets yes} \
+            [r config get keyspace-grouped-buckets]
+        assert_match {*grouped buckets*} [r debug htstats 9]
+    }
+
+    test {Grouped buckets: keys survive growing and shrinking the table} {
+        r flushdb
+        r debug populate 20000
+        assert_equal 20000 [r dbsize]
+        for {set j 0} {$j < 20000} {incr j 2} {r del key:$j}
+        assert_equal 10000 [r dbsize]
+        for {set j 0} {$j < 20000} {incr j 1000} {
+            assert_equal 0 [r exists key:$j]
+            assert_equal value:[expr {$j+1}] [r get key:[expr {$j+1}]]
+        }
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal 10000 [llength [r keys *]]
+    }
+
+    test {Grouped buckets: SCAN returns all the keys while the table grows} {
+        r flushdb
+        r debug populate 1000
+        set cur 0
+        set keys {}
+        set added 1000
+        while 1 {
+            set res [r scan $cur count 10]
+            set cur [lindex $res 0]
+            lappend keys {*}[lindex $res 1]
+            # Force rehashings of the table in the middle of the iteration.
+            if {$added < 50000} {
+                r debug populate [incr added 2000]
+            }
+            if {$cur == 0} break
+        }
+        set keys [lsort -unique $keys]
+        for {set j 0} {$j < 1000} {incr j} {
+            assert {[lsearch -sorted $keys key:$j] != -1}
+        }
+    }
+
+    test {Grouped buckets: volatile keys are expired} {
+        r flushdb
+        for {set j 0} {$j < 1000} {incr j} {
+            r psetex key:$j 100 $j
+        }
+        r set persistent 1
+        assert_match {*keys=1001,expires=1000,*} [r info keyspace]
+        wait_for_condition 50 100 {
+            [r dbsize] == 1
+        } else {
+            fail "Volatile keys not expired"
+        }
+        r randomkey
+    } {persistent}
 }
@@ -47,4 +47,46 @@ start_server {tags {"latency-monitor"}} {
         assert {[r latency reset] > 0}
         assert {[r latency latest] eq {}}
     }
+
+    test {LATENCY HISTOGRAM reports the calls of the specified commands} {
+        r config resetstat
+        r set foo bar
+        r get foo
+        r get foo
+        set reply [r latency histogram get set nosuchcommand]
+        assert_equal 4 [llength $reply]
+        set hist [dict create {*}$reply]
+        assert_equal 2 [dict get [dict get $hist get] calls]
+        assert_equal 1 [dict get [dict get $hist set] calls]
+        # The last pair of the histogram accounts for all the calls.
+        set buckets [dict get [dict get $hist get] histogram_usec]
+        assert_equal 2 [lindex $buckets end]
+    }
+
+    test {LATENCY HISTOGRAM without arguments reports all the called commands} {
+        set hist [dict create {*}[r latency histogram]]
+        assert {[dict exists $hist get] && [dict exists $hist set]}
+        assert {![dict exists $hist lpush]}
+    }
+
+    test {INFO latencystats reports the percentiles of the commands} {
+        r config resetstat
+        r debug sleep 0.2
+        set info [r info latencystats]
+        assert_match {*latency_percentiles_usec_config:p50=*} $info
+        assert {[regexp {latency_percentiles_usec_debug:p50=(\d+),p99=(\d+),p99.9=(\d+),max=(\d+)} $info -> p50 p99 p999 max]}
+        # A single call: all the percentiles are the (capped) max value.
+        assert {$max >= 200000 && $p50 == $max && $p99 == $max}
+    }
+
+    test {CONFIG SET latency-tracking no stops recording the latency} {
+        r config resetstat
+        r config set latency-tracking no
+        r get foo
+        set hist [r latency histogram get]
+        r config set latency-tracking yes
+        assert_equal {} $hist
+        r get foo
+        assert_equal 1 [dict get [lindex [r latency histogram get] 1] calls]
+    }
 }
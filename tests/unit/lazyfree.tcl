@@ -0,0 +1,106 @@
+start_server {tags {"lazyfree"}} {
+    test "UNLINK can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        assert {[r unlink myset] == 1}
+        assert {$peak_mem > $orig_mem+1000000}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2
+        } else {
+            fail "Memory is not reclaimed by UNLINK"
+        }
+    }
+
+    test "UNLINK of small values and missing keys" {
+        r set foo bar
+        r rpush mylist a b c
+        assert_equal 2 [r unlink foo mylist nokey]
+        assert_equal 0 [r exists foo mylist]
+    }
+
+    test "FLUSHDB ASYNC can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        r flushdb async
+        assert {[r dbsize] == 0}
+        assert {$peak_mem > $orig_mem+1000000}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2
+        } else {
+            fail "Memory is not reclaimed by FLUSHDB ASYNC"
+        }
+    }
+
+    test "FLUSHALL ASYNC empties every database" {
+        r select 10
+        r set foo bar
+        r select 9
+        r set foo bar
+        r flushall async
+        assert {[r dbsize] == 0}
+        r select 10
+        assert {[r dbsize] == 0}
+        r select 9
+    }
+
+    test "FLUSHDB / FLUSHALL with wrong arguments" {
+        catch {r flushdb foo} e1
+        catch {r flushall async foo} e2
+        list $e1 $e2
+    } {*syntax*syntax*}
+
+    test "UNLINK of a value whose elements are referenced by a reply" {
+        set big [string repeat x 20000]
+        for {set i 0} {$i < 100} {incr i} {
+            r hset myhash field:$i $big$i
+        }
+        set rd [redis_deferring_client]
+        $rd hgetall myhash
+        $rd flush
+        assert {[r unlink myhash] == 1}
+        set reply [$rd read]
+        $rd close
+        assert_equal 200 [llength $reply]
+        foreach {field value} $reply {
+            assert_equal $big[string range $field 6 end] $value
+        }
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Lazy free thread did not complete"
+        }
+        r ping
+    } {PONG}
+
+    test "Overwriting and expiring keys with lazy free enabled" {
+        r config set lazyfree-lazy-server-del yes
+        r config set lazyfree-lazy-expire yes
+        r sadd myset {*}[lrange $args 0 999]
+        r set myset foo
+        assert_equal foo [r get myset]
+        r sadd myset2 {*}[lrange $args 0 999]
+        r pexpire myset2 10
+        wait_for_condition 50 100 {
+            [r exists myset2] == 0
+        } else {
+            fail "Key not expired"
+        }
+        r config set lazyfree-lazy-server-del no
+        r config set lazyfree-lazy-expire no
+        r del myset
+    } {1}
+}
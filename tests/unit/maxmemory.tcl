@@ -23,8 +23,21 @@ start_server {tags {"maxmemory"}} {
         r config set maxmemory 0
     }
 
+    test "With maxmemory and LFU policy integers are not shared" {
+        r config set maxmemory 1073741824
+        r config set maxmemory-policy allkeys-lfu
+        r set a 1
+        r config set maxmemory-policy volatile-lfu
+        r set b 1
+        assert {[r object refcount a] == 1}
+        assert {[r object refcount b] == 1}
+        r config set maxmemory-policy noeviction
+        r config set maxmemory 0
+    }
+
     foreach policy {
-        allkeys-random allkeys-lru volatile-lru volatile-random volatile-ttl
+        allkeys-random allkeys-lru allkeys-lfu volatile-lru volatile-lfu
+        volatile-random volatile-ttl
     } {
         test "maxmemory - is the memory limit honoured? (policy $policy)" {
             # make sure to start with a blank instance
@@ -56,7 +69,8 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        allkeys-random allkeys-lru volatile-lru volatile-random volatile-ttl
+        allkeys-random allkeys-lru allkeys-lfu volatile-lru volatile-lfu
+        volatile-random volatile-ttl
     } {
         test "maxmemory - only allkeys-* should remove non-volatile keys ($policy)" {
             # make sure to start with a blank instance
@@ -98,7 +112,7 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        volatile-lru volatile-random volatile-ttl
+        volatile-lru volatile-lfu volatile-random volatile-ttl
     } {
         test "maxmemory - policy $policy should only remove volatile keys." {
             # make sure to start with a blank instance
@@ -141,4 +155,57 @@ start_server {tags {"maxmemory"}} {
             }
         }
     }
+
+    test "OBJECT FREQ is only available with an LFU policy" {
+        r flushall
+        r set foo bar
+        r config set maxmemory-policy allkeys-lru
+        catch {r object freq foo} e
+        assert_match {*LFU maxmemory policy is not selected*} $e
+        r config set maxmemory-policy allkeys-lfu
+        catch {r object idletime foo} e
+        assert_match {*LFU maxmemory policy is selected*} $e
+        r config set maxmemory-policy noeviction
+    }
+
+    test "LFU counter starts at LFU_INIT_VAL and grows with accesses" {
+        r flushall
+        r config set maxmemory-policy allkeys-lfu
+        r config set lfu-log-factor 0
+        r set foo bar
+        assert_equal 5 [r object freq foo]
+        for {set j 0} {$j < 100} {incr j} {r get foo}
+        set freq [r object freq foo]
+        r config set lfu-log-factor 10
+        r config set maxmemory-policy noeviction
+        set freq
+    } {105}
+
+    test "allkeys-lfu keeps frequently used keys over recently written ones" {
+        r flushall
+        r config set maxmemory 0
+        r config set maxmemory-policy allkeys-lfu
+        # A small set of hot keys, accessed many times.
+        for {set j 0} {$j < 20} {incr j} {
+            r set hot:$j [string repeat x 100]
+            for {set k 0} {$k < 50} {incr k} {r get hot:$j}
+        }
+        set used [s used_memory]
+        set limit [expr {$used+100*1024}]
+        r config set maxmemory $limit
+        # Now write many keys, each touched a single time: with an LRU policy
+        # these would push the hot keys out of memory.
+        for {set j 0} {$j < 5000} {incr j} {
+            r set cold:$j [string repeat x 100]
+        }
+        assert {[s evicted_keys] > 0}
+        assert {[s used_memory] < ($limit+4096)}
+        set survived 0
+        for {set j 0} {$j < 20} {incr j} {
+            if {[r exists hot:$j]} {incr survived}
+        }
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+        set survived
+    } {20}
 }
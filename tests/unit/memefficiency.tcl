@@ -35,3 +35,51 @@ start_server {tags {"memefficiency"}} {
         }
     }
 }
+
+proc memory_per_key {numkeys} {
+    r flushall
+    set base_mem [s used_memory]
+    r debug populate $numkeys
+    set used [expr {[s used_memory]-$base_mem}]
+    r flushall
+    expr {double($used)/$numkeys}
+}
+
+start_server {tags {"memefficiency"}} {
+    set plain [memory_per_key 100000]
+    start_server {overrides {cluster-enabled yes}} {
+        test "Memory overhead per key of the cluster slots to keys map" {
+            set cluster [memory_per_key 100000]
+            set overhead [expr {$cluster-$plain}]
+            assert {$overhead < 80}
+        }
+
+        test "Slots to keys map is consistent after deletions and flushes" {
+            # Serve all the slots, so that we can use regular commands.
+            set slots {}
+            for {set j 0} {$j < 16384} {incr j} {lappend slots $j}
+            r cluster addslots {*}$slots
+            wait_for_condition 50 100 {
+                [string match {*cluster_state:ok*} [r cluster info]]
+            } else {
+                fail "Cluster state is not ok"
+            }
+            r debug populate 1000
+            set total 0
+            for {set j 0} {$j < 16384} {incr j} {
+                incr total [r cluster countkeysinslot $j]
+            }
+            assert_equal 1000 $total
+            set slot [r cluster keyslot key:0]
+            set keys [r cluster getkeysinslot $slot 100]
+            assert {[lsearch $keys key:0] != -1}
+            r del key:0
+            set keys [r cluster getkeysinslot $slot 100]
+            assert {[lsearch $keys key:0] == -1}
+            assert_equal [llength $keys] [r cluster countkeysinslot $slot]
+            r flushall async
+            assert_equal 0 [r cluster countkeysinslot $slot]
+            assert_equal {} [r cluster getkeysinslot $slot 100]
+        }
+    }
+}
@@ -82,6 +82,13 @@ start_server {tags {"other"}} {
                 }
             } {1}
 
+            test {Check consistency after a reload using RDB loading threads} {
+                r config set rdb-load-threads 4
+                r debug reload
+                r config set rdb-load-threads 1
+                r debug digest
+            } $sha1
+
             test {Same dataset digest if saving/reloading as AOF?} {
                 r bgrewriteaof
                 waitForBgrewriteaof r
@@ -123,6 +130,68 @@ start_server {tags {"other"}} {
         list $e1 $e2
     } {1 1}
 
+    test {RDB loading threads load big, compressed and volatile values} {
+        r flushdb
+        r debug populate 1000
+        for {set j 0} {$j < 2000} {incr j} {
+            r rpush biglist "[string repeat x 50] $j"
+            r sadd bigset $j
+            r zadd bigzset $j member:$j
+            r hset bighash field:$j [string repeat v 30]
+        }
+        r set compressed [string repeat abcd 1000]
+        r setex volatile 1000 value
+        r set expired value
+        r pexpire expired 1
+        after 10
+        assert_equal 0 [r exists expired]
+        set digest [r debug digest]
+        r config set rdb-load-threads 3
+        r debug reload
+        r config set rdb-load-threads 1
+        assert_equal $digest [r debug digest]
+        assert {[r ttl volatile] > 900}
+        r dbsize
+    } {1006}
+
+    test {RDB strings compressed with LZ4 can be reloaded} {
+        r flushdb
+        r config set rdb-compression-codec lz4
+        r set compressible [string repeat "lz4 test " 1000]
+        for {set j 0} {$j < 1000} {incr j} {
+            r rpush biglist "[string repeat x 50] $j"
+            r hset bighash field:$j "[string repeat v 30] $j"
+        }
+        # In the RDB file the value has the LZ4 string encoding, 0xC4.
+        r save
+        set fd [open [file join [lindex [r config get dir] 1] \
+                                [lindex [r config get dbfilename] 1]]]
+        fconfigure $fd -translation binary
+        set rdb [read $fd]
+        close $fd
+        assert {[string first "\x00\x0ccompressible\xc4" $rdb] != -1}
+        # DUMP payloads must be understood by servers without LZ4: the
+        # string is compressed with LZF (0xC3), and the RDB version is 7.
+        set encoded [r dump compressible]
+        binary scan $encoded cucu type enc
+        binary scan [string range $encoded end-9 end-8] s ver
+        assert_equal {195 7} [list $enc $ver]
+        r del copy
+        r restore copy 0 $encoded
+        assert_equal [r get compressible] [r get copy]
+        r del copy
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set rdb-load-threads 3
+        r debug reload
+        r config set rdb-load-threads 1
+        assert_equal $digest [r debug digest]
+        r config set rdb-compression-codec lzf
+        r debug reload
+        assert_equal $digest [r debug digest]
+    }
+
     test {EXPIRES after AOF reload (without rewrite)} {
         r flushdb
         r config set appendonly yes
@@ -223,6 +223,102 @@ start_server {tags {"pubsub"}} {
         concat $reply1 $reply2
     } {punsubscribe {} 0 unsubscribe {} 0}
 
+    test "PSUBSCRIBE patterns sharing prefixes match like a plain scan" {
+        set patterns {* news.* news.it.* news.i* news.it.? news.it.[ab]
+                      new? n*s \\news.* news.it.a news.itx* user:*:msg
+                      user:1*:msg user:12:*}
+        set channels {news.it.a news.it.b news.it.c news.itx news.x
+                      news.it. n user:12:msg user:1:msg user:2:msg other}
+        set clients {}
+        foreach pat $patterns {
+            set rd [redis_deferring_client]
+            psubscribe $rd [list $pat]
+            lappend clients $rd
+        }
+        assert_equal [llength $patterns] [r pubsub numpat]
+        foreach ch $channels {
+            set expected 0
+            foreach pat $patterns {
+                if {[string match $pat $ch]} {incr expected}
+            }
+            assert_equal $expected [r publish $ch hello]
+            foreach pat $patterns rd $clients {
+                if {[string match $pat $ch]} {
+                    assert_equal [list pmessage $pat $ch hello] [$rd read]
+                }
+            }
+        }
+
+        # Remove the patterns in a different order and check again that
+        # the remaining ones still match.
+        foreach idx {3 0 9 12 6} {
+            punsubscribe [lindex $clients $idx] [list [lindex $patterns $idx]]
+        }
+        foreach ch $channels {
+            set expected 0
+            foreach pat $patterns idx [lsearch -all $patterns *] {
+                if {$idx in {3 0 9 12 6}} continue
+                if {[string match $pat $ch]} {incr expected}
+            }
+            assert_equal $expected [r publish $ch hello]
+            foreach pat $patterns rd $clients idx [lsearch -all $patterns *] {
+                if {$idx in {3 0 9 12 6}} continue
+                if {[string match $pat $ch]} {
+                    assert_equal [list pmessage $pat $ch hello] [$rd read]
+                }
+            }
+        }
+        foreach rd $clients {$rd close}
+    }
+
+    test "PUNSUBSCRIBE of clients sharing the same pattern" {
+        set rd1 [redis_deferring_client]
+        set rd2 [redis_deferring_client]
+        assert_equal {1 2} [psubscribe $rd1 {foo.* foo.bar.*}]
+        assert_equal {1 2} [psubscribe $rd2 {foo.bar.* foo.*}]
+        assert_equal 4 [r publish foo.bar.x hello]
+        # Messages for different patterns are not delivered in
+        # subscription order.
+        assert_equal {foo.* foo.bar.*} \
+            [lsort [list [lindex [$rd2 read] 1] [lindex [$rd2 read] 1]]]
+        punsubscribe $rd2 {foo.*}
+        $rd1 close
+        wait_for_condition 50 100 {
+            [r pubsub numpat] == 1
+        } else {
+            fail "rd1 patterns not removed"
+        }
+        assert_equal 1 [r publish foo.bar.x hello]
+        assert_equal 0 [r publish foo.x hello]
+        assert_equal {pmessage foo.bar.* foo.bar.x hello} [$rd2 read]
+        $rd2 close
+    }
+
+    test "PUBLISH of a big message does not copy it for every subscriber" {
+        set clients {}
+        for {set j 0} {$j < 50} {incr j} {
+            set rd [redis_deferring_client]
+            subscribe $rd bigchan
+            lappend clients $rd
+        }
+        # Check the memory inside a transaction, so that the messages are
+        # still in the output buffers: 50 copies would use 10MB.
+        set payload [string repeat x 200000]
+        r multi
+        r info memory
+        r publish bigchan $payload
+        r info memory
+        lassign [r exec] before receivers after
+        assert_equal 50 $receivers
+        regexp {used_memory:(\d+)} $before -> before
+        regexp {used_memory:(\d+)} $after -> after
+        assert {$after-$before < 2000000}
+        foreach rd $clients {
+            assert_equal [list message bigchan $payload] [$rd read]
+            $rd close
+        }
+    }
+
     ### Keyspace events notification tests
 
     test "Keyspace notifications: we receive keyspace notifications" {
@@ -119,4 +119,37 @@ start_server {
             }
         }
     }
+
+    test {Compressed listpack nodes survive edits and DEBUG RELOAD} {
+        r config set list-compress-depth 1
+        r del l
+        set l {}
+        for {set j 0} {$j < 2000} {incr j} {
+            set ele [randpath {randomInt 1000} {string repeat x [randomInt 300]}]
+            set pos [randomInt [expr {[llength $l]+1}]]
+            randpath {
+                lappend l $ele
+                r rpush l $ele
+            } {
+                set l [concat [list $ele] $l]
+                r lpush l $ele
+            } {
+                if {$pos < [llength $l]} {
+                    set l [lreplace $l $pos $pos $ele]
+                    r lset l $pos $ele
+                }
+            } {
+                if {$pos < [llength $l]} {
+                    # LINSERT uses the first occurrence of the pivot.
+                    set pivot [lindex $l $pos]
+                    set l [linsert $l [lsearch -exact $l $pivot] $ele]
+                    r linsert l before $pivot $ele
+                }
+            }
+        }
+        assert_equal $l [r lrange l 0 -1]
+        r debug reload
+        assert_equal $l [r lrange l 0 -1]
+        r config set list-compress-depth 0
+    }
 }
@@ -419,4 +419,36 @@ start_server {tags {"string"}} {
         r set foo bar
         r getrange foo 0 4294967297
     } {bar}
+
+    test {Big GET replies reference the value instead of copying it} {
+        r set bigval [string repeat x 2000000]
+        set before [s used_memory]
+        # The clients don't read the reply, so it stays in their output
+        # buffers: twenty copies of the value would use 40MB.
+        set clients {}
+        for {set j 0} {$j < 20} {incr j} {
+            set rd [redis_deferring_client]
+            $rd get bigval
+            $rd flush
+            lappend clients $rd
+        }
+        wait_for_condition 50 100 {
+            [regexp -all {cmd=get} [r client list]] == 20
+        } else {
+            fail "GET not processed by all the clients"
+        }
+        set after [s used_memory]
+        assert {$after-$before < 10000000}
+
+        # Modifying the value must not alter the pending replies.
+        r setrange bigval 0 y
+        r append bigval z
+        foreach rd $clients {
+            set reply [$rd read]
+            assert_equal 2000000 [string length $reply]
+            assert_equal xx [string range $reply 0 1]
+            $rd close
+        }
+        list [string range [r get bigval] 0 1] [r strlen bigval]
+    } {yx 2000001}
 }
@@ -0,0 +1,90 @@
+#!/usr/bin/env tclsh8.5
+# Compare the cache hit ratio of the maxmemory policies under a Zipfian
+# access pattern. The program simulates a cache: every key is read with GET
+# and, on a miss, written with SET, while maxmemory keeps only a fraction of
+# the keyspace in memory.
+#
+# Usage (from the utils/lru directory, with a disposable server running):
+#
+#     tclsh zipf-hitratio.tcl [port] [keys] [requests] [policies...]
+#
+# WARNING: the program calls FLUSHALL on the target instance.
+
+source ../../tests/support/redis.tcl
+
+set port [expr {[llength $argv] > 0 ? [lindex $argv 0] : 6379}]
+set numkeys [expr {[llength $argv] > 1 ? [lindex $argv 1] : 10000}]
+set requests [expr {[llength $argv] > 2 ? [lindex $argv 2] : 200000}]
+set policies [lrange $argv 3 end]
+if {[llength $policies] == 0} {set policies {allkeys-lru allkeys-lfu}}
+set zipf_s 1.0
+set value [string repeat x 100]
+
+# Build the cumulative distribution of a Zipf distribution with exponent
+# $zipf_s over $numkeys items, so that sampling is just a binary search.
+proc zipf_cdf {n s} {
+    set sum 0.0
+    for {set i 1} {$i <= $n} {incr i} {
+        set sum [expr {$sum+1.0/pow($i,$s)}]
+    }
+    set cdf {}
+    set acc 0.0
+    for {set i 1} {$i <= $n} {incr i} {
+        set acc [expr {$acc+(1.0/pow($i,$s))/$sum}]
+        lappend cdf $acc
+    }
+    return $cdf
+}
+
+proc zipf_sample {cdf} {
+    set r [expr {rand()}]
+    set lo 0
+    set hi [expr {[llength $cdf]-1}]
+    while {$lo < $hi} {
+        set mid [expr {($lo+$hi)/2}]
+        if {[lindex $cdf $mid] < $r} {
+            set lo [expr {$mid+1}]
+        } else {
+            set hi $mid
+        }
+    }
+    return $lo
+}
+
+proc info_field {r field} {
+    if {[regexp "\r\n$field:(.*?)\r\n" [$r info] -> v]} {return $v}
+    return 0
+}
+
+set cdf [zipf_cdf $numkeys $zipf_s]
+set r [redis 127.0.0.1 $port]
+
+foreach policy $policies {
+    $r config set maxmemory 0
+    $r flushall
+    # Allow roughly 10% of the keyspace to stay in memory.
+    for {set j 0} {$j < $numkeys/10} {incr j} {
+        $r set fill:$j $value
+    }
+    set limit [info_field $r used_memory]
+    $r flushall
+    $r config set maxmemory $limit
+    $r config set maxmemory-policy $policy
+    $r config resetstat
+
+    # Warm up with the same access pattern, then measure.
+    expr {srand(1234)}
+    foreach phase {warmup measure} {
+        if {$phase eq {measure}} {$r config resetstat}
+        for {set j 0} {$j < $requests} {incr j} {
+            set key key:[zipf_sample $cdf]
+            if {[$r get $key] eq {}} {$r set $key $value}
+        }
+    }
+    set hits [info_field $r keyspace_hits]
+    set misses [info_field $r keyspace_misses]
+    puts [format "%-16s hit ratio: %.2f%% (evicted %s keys)" $policy \
+        [expr {100.0*$hits/($hits+$misses)}] [info_field $r evicted_keys]]
+}
+$r config set maxmemory 0
+$r close
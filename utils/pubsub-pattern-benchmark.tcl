@@ -0,0 +1,45 @@
+#!/usr/bin/env tclsh8.5
+# Measure PUBLISH throughput as the number of PSUBSCRIBE patterns grows.
+# Patterns are in the form "notify:user:<id>:*", like in a notification
+# fan-out where every user listens to its own events, and messages are
+# published to the channel of a single user, so every PUBLISH matches
+# exactly one pattern.
+#
+# Usage (from the utils directory, with a disposable server running):
+#
+#     tclsh pubsub-pattern-benchmark.tcl [port] [publishes] [patterns...]
+
+source ../tests/support/redis.tcl
+
+set port [expr {[llength $argv] > 0 ? [lindex $argv 0] : 6379}]
+set publishes [expr {[llength $argv] > 1 ? [lindex $argv 1] : 20000}]
+set counts [lrange $argv 2 end]
+if {[llength $counts] == 0} {set counts {0 100 1000 10000 20000}}
+
+set r [redis 127.0.0.1 $port]
+set sub [redis 127.0.0.1 $port 1]
+
+set subscribed 0
+foreach count $counts {
+    # Add the missing patterns, reading the PSUBSCRIBE replies.
+    for {set j $subscribed} {$j < $count} {incr j} {
+        $sub psubscribe notify:user:$j:*
+    }
+    $sub flush
+    for {set j $subscribed} {$j < $count} {incr j} {$sub read}
+    set subscribed $count
+
+    set start [clock milliseconds]
+    for {set j 0} {$j < $publishes} {incr j} {
+        $r publish notify:user:[expr {$j % ($count ? $count : 1)}]:msg hello
+    }
+    set elapsed [expr {max([clock milliseconds]-$start,1)}]
+
+    # Consume the messages delivered to the subscriber.
+    if {$count} {for {set j 0} {$j < $publishes} {incr j} {$sub read}}
+
+    puts [format "%6d patterns: %8.0f PUBLISH/sec" $count \
+        [expr {$publishes*1000.0/$elapsed}]]
+}
+$sub close
+$r close
@@ -0,0 +1,77 @@
+#!/usr/bin/env tclsh8.5
+# Compare the RDB compression codecs: for every value of
+# rdb-compression-codec the program reports the time needed to SAVE the
+# dataset, to load it back (time of DEBUG RELOAD minus time of SAVE) and
+# the size of the resulting RDB file.
+#
+# Usage (from the utils directory, with a disposable server running on the
+# same host, since the RDB file size is read from the local disk):
+#
+#     tclsh rdb-codec-benchmark.tcl [port] [keys]
+#
+# If the instance is empty it is populated with 'keys' keys looking like a
+# typical cache: JSON-ish documents, HTML fragments, session hashes and
+# lists of events. Otherwise the existing dataset is used.
+
+source ../tests/support/redis.tcl
+
+set port [expr {[llength $argv] > 0 ? [lindex $argv 0] : 6379}]
+set numkeys [expr {[llength $argv] > 1 ? [lindex $argv 1] : 200000}]
+
+proc elapsed_ms {script} {
+    set start [clock milliseconds]
+    uplevel 1 $script
+    expr {[clock milliseconds]-$start}
+}
+
+proc random_word {} {
+    set words {user order item price status active pending shipped
+               name email address city country created updated id}
+    lindex $words [expr {int(rand()*[llength $words])}]
+}
+
+set r [redis 127.0.0.1 $port]
+
+if {[$r dbsize] == 0} {
+    puts "Populating the dataset with $numkeys keys..."
+    expr {srand(1234)}
+    for {set j 0} {$j < $numkeys} {incr j} {
+        switch [expr {$j%4}] {
+            0 {
+                set doc "{"
+                for {set f 0} {$f < 10} {incr f} {
+                    append doc "\"[random_word]\":\"[random_word] [expr {int(rand()*100000)}]\","
+                }
+                $r set doc:$j "$doc\"id\":$j}"
+            }
+            1 {
+                $r set page:$j "<div class=\"[random_word]\"><span>[random_word] [random_word]</span><a href=\"/[random_word]/$j\">[random_word]</a></div>"
+            }
+            2 {
+                $r hmset session:$j user [random_word]$j created [clock seconds] \
+                    agent "Mozilla/5.0 (X11; Linux x86_64) [random_word]" \
+                    path /[random_word]/[random_word]
+            }
+            3 {
+                for {set e 0} {$e < 20} {incr e} {
+                    $r rpush events:$j "[random_word] event [random_word] at [expr {1460000000+$e}]"
+                }
+            }
+        }
+    }
+}
+puts "Dataset: [$r dbsize] keys"
+
+set rdbfile [file join [lindex [$r config get dir] 1] \
+                       [lindex [$r config get dbfilename] 1]]
+set saved [lindex [$r config get rdb-compression-codec] 1]
+foreach codec {lzf lz4} {
+    $r config set rdb-compression-codec $codec
+    set save_ms [elapsed_ms {$r save}]
+    set size [file size $rdbfile]
+    set reload_ms [elapsed_ms {$r debug reload}]
+    puts [format "%s: save %d ms, load %d ms, size %.2f MB" $codec \
+        $save_ms [expr {$reload_ms-$save_ms}] [expr {$size/1048576.0}]]
+}
+$r config set rdb-compression-codec $saved
+$r close
@@ -0,0 +1,54 @@
+#!/usr/bin/env tclsh8.5
+# Measure how long it takes to load an RDB file with different values of
+# rdb-load-threads. The time of every DEBUG RELOAD (that saves and loads the
+# dataset) minus the time of a SAVE of the same dataset is reported as the
+# loading time.
+#
+# Usage (from the utils directory, with a disposable server running):
+#
+#     tclsh rdb-load-benchmark.tcl [port] [keys] [threads...]
+#
+# The dataset is populated with 'keys' keys, half of them strings and half
+# of them aggregate values of different types, unless the instance already
+# contains data, in which case the existing dataset is used.
+
+source ../tests/support/redis.tcl
+
+set port [expr {[llength $argv] > 0 ? [lindex $argv 0] : 6379}]
+set numkeys [expr {[llength $argv] > 1 ? [lindex $argv 1] : 1000000}]
+set threads [lrange $argv 2 end]
+if {[llength $threads] == 0} {set threads {1 2 4 8}}
+
+proc elapsed_ms {script} {
+    set start [clock milliseconds]
+    uplevel 1 $script
+    expr {[clock milliseconds]-$start}
+}
+
+set r [redis 127.0.0.1 $port]
+
+if {[$r dbsize] == 0} {
+    puts "Populating the dataset with $numkeys keys..."
+    $r debug populate [expr {$numkeys/2}] string
+    set value [string repeat "compressible value " 10]
+    for {set j 0} {$j < $numkeys/2} {incr j 4} {
+        $r rpush list:$j $value $j $value
+        $r sadd set:[expr {$j+1}] $value $j a b c d e
+        $r zadd zset:[expr {$j+2}] 1 $value 2 $j 3 a
+        $r hmset hash:[expr {$j+3}] field $value n $j
+    }
+}
+puts "Dataset: [$r dbsize] keys"
+
+set save_ms [elapsed_ms {$r save}]
+puts [format "SAVE: %d ms" $save_ms]
+
+set saved [lindex [$r config get rdb-load-threads] 1]
+foreach n $threads {
+    $r config set rdb-load-threads $n
+    set reload_ms [elapsed_ms {$r debug reload}]
+    puts [format "rdb-load-threads %-3d load time: %d ms" $n \
+        [expr {$reload_ms-$save_ms}]]
+}
+$r config set rdb-load-threads $saved
+$r close
@@ -65,6 +65,7 @@ proc get-test-names output {
     foreach line [split $output "\n"] {
         lassign [split $line ","] key value
         set key [string tolower [string range $key 1 end-1]]
+        if {$key eq {test}} continue ;# CSV header line.
         lappend names $key
     }
     return $names